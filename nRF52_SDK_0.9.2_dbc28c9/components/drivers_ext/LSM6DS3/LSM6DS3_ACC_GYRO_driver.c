@@ -28,27 +28,27 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "LSM6DS3_ACC_GYRO_driver.h"
-#include "twi_master.h"		
-#include "nrf_delay.h"
+#include "sensor_twi.h"
 //[Example]
 
 /* Private typedef -----------------------------------------------------------*/
 
 /* Private define ------------------------------------------------------------*/
 
+/* The bus layer takes the 7-bit address */
+#define LSM6DS3_ACC_GYRO_TWI_ADDRESS   (LSM6DS3_ACC_GYRO_I2C_ADDRESS >> 1)
+
 /* Private macro -------------------------------------------------------------*/
 
 /* Private variables ---------------------------------------------------------*/
 
 /* Private functions ---------------------------------------------------------*/
 
+/* Blocking accesses through the ring's TWI queue, so they wait their turn
+   behind the asynchronous sample reads */
 static status_t I2C_ByteWrite(u8_t* data, u8_t i2c_addr, u8_t reg)
 {
-    uint8_t buf[2];
-
-    buf[0] = reg;
-    buf[1] = *data;
-    if(twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS, buf, 2, TWI_ISSUE_STOP))
+    if (sensor_twi_write(LSM6DS3_ACC_GYRO_TWI_ADDRESS, reg, data, 1) == 0)
     {
         return MEMS_SUCCESS;                                                      //[Example]
     }
@@ -56,188 +56,214 @@ static status_t I2C_ByteWrite(u8_t* data, u8_t i2c_addr, u8_t reg)
 	{
 	    return MEMS_ERROR;
 	}
-#if 0        
-
-    if(twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS, &reg, 1, TWI_DONT_ISSUE_STOP))
-    {
-        if (twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS, data, 1, TWI_ISSUE_STOP))
-        {
-	        return MEMS_SUCCESS;                                                      //[Example]
-        }
-		else
-		{
-		    return MEMS_ERROR;
-		}
-    }
-	else
-	{
-		return MEMS_ERROR;
-	}
-#endif	
 }
 
 static status_t I2C_BufferWrite(u8_t* data, u8_t i2c_addr, u8_t reg, u16_t len)
 {
-    if (twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS, &reg, 1, TWI_DONT_ISSUE_STOP))
+    /* The register address and the data go out in one transaction,
+       a second START would be taken as a new register address */
+    if (len > LSM6DS3_ACC_GYRO_WRITE_BURST_MAX)
+        return MEMS_ERROR;
+    if (sensor_twi_write(LSM6DS3_ACC_GYRO_TWI_ADDRESS, reg, data, (u8_t)len) == 0)
     {
-        if (twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS, data, len, TWI_ISSUE_STOP))
-        {
-	        return MEMS_SUCCESS;                                                      //[Example]
-        }
-		else
-		{
-		    return MEMS_ERROR;
-		}
+        return MEMS_SUCCESS;                                                      //[Example]
     }
 	else
 	{
-		return MEMS_ERROR;
+	    return MEMS_ERROR;
 	}
 }
 
 static status_t I2C_BufferRead(u8_t* data, u8_t i2c_addr, u8_t reg, u16_t len)
 {
-    if (twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS, &reg, 1, TWI_DONT_ISSUE_STOP))
+    /* Register address write, repeated start, then the data */
+    if (sensor_twi_read(LSM6DS3_ACC_GYRO_TWI_ADDRESS, reg, data, (u8_t)len) == 0)
     {
-        if (twi_master_transfer(LSM6DS3_ACC_GYRO_I2C_ADDRESS | TWI_READ_BIT, data, len, TWI_ISSUE_STOP))
-        {
-	        return MEMS_SUCCESS;                                                      //[Example]
-        }
-		else
-		{
-		    return MEMS_ERROR;
-		}
+        return MEMS_SUCCESS;                                                      //[Example]
     }
 	else
 	{
-		return MEMS_ERROR;
+	    return MEMS_ERROR;
 	}
 }
 
-static void Delay(u16_t ms)
+/* Register shadow ------------------------------------------------------------*/
+
+/* Control registers only change when we write them, so their last known value
+   is kept here and read-modify-write setters only cost the write transaction.
+   Output, status and source registers are always read from the device. */
+static u8_t shadow_value[LSM6DS3_ACC_GYRO_SHADOW_SIZE];
+static u8_t shadow_valid[(LSM6DS3_ACC_GYRO_SHADOW_SIZE + 7) / 8];
+/* RAM_ACCESS.RAM_PAGE swaps 0x02-0x3F for the embedded function registers */
+static u8_t shadow_ram_page;
+
+static u8_t shadow_cacheable(u8_t Reg)
 {
-  nrf_delay_ms(ms);
+  if (Reg == LSM6DS3_ACC_GYRO_RAM_ACCESS)
+    return 1;
+  if (shadow_ram_page)
+    return 0;
+
+  return (Reg >= LSM6DS3_ACC_GYRO_SENSOR_SYNC_TIME && Reg <= LSM6DS3_ACC_GYRO_INT2_CTRL) ||
+         (Reg >= LSM6DS3_ACC_GYRO_CTRL1_XL && Reg <= LSM6DS3_ACC_GYRO_MASTER_CONFIG) ||
+         (Reg >= LSM6DS3_ACC_GYRO_TAP_CFG1 && Reg <= LSM6DS3_ACC_GYRO_MD2_CFG);
+}
+
+static void shadow_store(u8_t Reg, u8_t Data)
+{
+  shadow_value[Reg] = Data;
+  shadow_valid[Reg / 8] |= (u8_t)(1 << (Reg % 8));
+
+  if (Reg == LSM6DS3_ACC_GYRO_RAM_ACCESS)
+    shadow_ram_page = (Data & LSM6DS3_ACC_GYRO_RAM_PAGE_MASK) ? 1 : 0;
+}
+
+static void shadow_drop(u8_t Reg)
+{
+  if (Reg < LSM6DS3_ACC_GYRO_SHADOW_SIZE)
+    shadow_valid[Reg / 8] &= (u8_t)~(1 << (Reg % 8));
+}
+
+/*******************************************************************************
+* Function Name		: LSM6DS3_ACC_GYRO_ShadowInvalidate
+* Description		: Forget every cached control register, e.g. after the
+*					: device lost power behind the driver's back
+* Input				: None
+* Output			: None
+* Return			: None
+*******************************************************************************/
+void LSM6DS3_ACC_GYRO_ShadowInvalidate(void)
+{
+  u8_t i;
+
+  for (i = 0; i < sizeof(shadow_valid); i++)
+    shadow_valid[i] = 0;
+  shadow_ram_page = 0;
 }
 
 /*******************************************************************************
 * Function Name		: LSM6DS3_ACC_GYRO_ReadReg
-* Description		: Generic Reading function. It must be fullfilled with either
-*					: I2C or SPI reading functions					
+* Description		: Generic Reading function. Control registers are served
+*					: from the shadow once they have been read or written
 * Input				: Register Address
 * Output			: Data REad
-* Return			: None
+* Return			: Status [MEMS_ERROR, MEMS_SUCCESS]
 *******************************************************************************/
 u8_t LSM6DS3_ACC_GYRO_ReadReg(u8_t Reg, u8_t* Data) 
 {
-  
-  //To be completed with either I2c or SPI reading function
-  //i.e.: *Data = SPI_Mems_Read_Reg( Reg );
+  u8_t cacheable = shadow_cacheable(Reg);
+
+  if (cacheable && (shadow_valid[Reg / 8] & (1 << (Reg % 8))))
+  {
+    *Data = shadow_value[Reg];
+    return MEMS_SUCCESS;
+  }
+
   if(!I2C_BufferRead(Data, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, 1))  //[Example]
 	return MEMS_ERROR;                                                        //[Example]
-  else                                                                        //[Example]
-	return MEMS_SUCCESS;                                                      //[Example]
+
+  if (cacheable)
+    shadow_store(Reg, *Data);
+  return MEMS_SUCCESS;                                                        //[Example]
 }
 
 /*******************************************************************************
 * Function Name		: LSM6DS3_ACC_GYRO_WriteReg
-* Description		: Generic Writing function. It must be fullfilled with either
-*					: I2C or SPI writing function
+* Description		: Generic Writing function, keeps the shadow up to date
 * Input				: Register Address, Data to be written
 * Output			: None
-* Return			: None
+* Return			: Status [MEMS_ERROR, MEMS_SUCCESS]
 *******************************************************************************/
 u8_t LSM6DS3_ACC_GYRO_WriteReg(u8_t Reg, u8_t Data) 
 {
-    
-  //To be completed with either I2c or SPI writing function
-  //i.e.: SPI_Mems_Write_Reg(Reg, Data);
-  I2C_ByteWrite(&Data,  LSM6DS3_ACC_GYRO_I2C_ADDRESS,  Reg);       //[Example]
+  u8_t cacheable = shadow_cacheable(Reg);
+
+  if (!I2C_ByteWrite(&Data, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg))       //[Example]
+  {
+    /* The device may or may not have taken it */
+    if (cacheable)
+      shadow_drop(Reg);
+    return MEMS_ERROR;
+  }
+
+  /* BOOT and SW_RESET reload every register and clear themselves */
+  if (!shadow_ram_page && Reg == LSM6DS3_ACC_GYRO_CTRL3_C &&
+      (Data & (LSM6DS3_ACC_GYRO_BOOT_MASK | LSM6DS3_ACC_GYRO_SW_RESET_MASK)))
+  {
+    LSM6DS3_ACC_GYRO_ShadowInvalidate();
+    return MEMS_SUCCESS;
+  }
+
+  if (cacheable)
+    shadow_store(Reg, Data);
   return MEMS_SUCCESS;                                                        //[Example]
 }
 
 /*******************************************************************************
 * Function Name		: LSM6DS3_ACC_GYRO_WriteMem
-* Description		: Generic Writing function. It must be fullfilled with either
-*					: I2C or SPI writing function
+* Description		: Writes len consecutive bytes starting at Reg, in bus
+*					: transactions of at most WRITE_BURST_MAX bytes
+*					: (CTRL3_C.IF_INC must be set for the register address
+*					: to advance). DATA_TO_WR_RAM is a fixed-address
+*					: stream: every transaction starts at it again
 * Input				: Register Address, ptr to buffer to be written,
 *                                 length of buffer
 * Output			: None
-* Return			: None
+* Return			: Status [MEMS_ERROR, MEMS_SUCCESS]
 *******************************************************************************/
 u8_t LSM6DS3_ACC_GYRO_WriteMem(u8_t Reg, u8_t *Bufp, u16_t len)
 {
-   //u16_t i;
-   //u8_t data = 0x0;
-  //To be completed with either I2c or SPI writing function
-  //i.e.: SPI_Mems_Write_Reg(Reg, Data);
-//  I2Cx_Write(Bufp, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, len);
-//  return MEMS_SUCCESS;  
-   
-     I2C_BufferWrite(Bufp, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, len);
-     return MEMS_SUCCESS;  
-  
- /* for (i=0;i<len;i++)
+  u16_t i;
+  u16_t chunk;
+
+  /* Forget whatever the burst touches rather than guess at IF_INC */
+  if (!shadow_ram_page)
+  {
+    for (i = 0; i < len; i++)
+      shadow_drop(Reg + i);
+    if (Reg <= LSM6DS3_ACC_GYRO_CTRL3_C && Reg + len > LSM6DS3_ACC_GYRO_CTRL3_C)
+      LSM6DS3_ACC_GYRO_ShadowInvalidate();
+  }
+
+  while (len)
   {
-    //set_ram_addr(i);
-     data = i & 0xFF;
-  I2C_ByteWrite(&data,LSM6DS3_ACC_GYRO_I2C_ADDRESS,LSM6DS3_ACC_GYRO_ADDR0_TO_RW_RAM );
-  Delay(2);
-  data = (i >> 8) & 0xFF;
-  I2C_ByteWrite(&data,LSM6DS3_ACC_GYRO_I2C_ADDRESS,LSM6DS3_ACC_GYRO_ADDR1_TO_RW_RAM);
-    
-    
-    Delay(2);
-    I2C_ByteWrite(&Bufp[i],  LSM6DS3_ACC_GYRO_I2C_ADDRESS,  Reg);     
-     Delay(2);
+    chunk = (len > LSM6DS3_ACC_GYRO_WRITE_BURST_MAX) ? LSM6DS3_ACC_GYRO_WRITE_BURST_MAX : len;
+    if (!I2C_BufferWrite(Bufp, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, chunk))
+      return MEMS_ERROR;
+    Bufp += chunk;
+    if (Reg != LSM6DS3_ACC_GYRO_DATA_TO_WR_RAM)
+      Reg += chunk;
+    len -= chunk;
   }
-   return MEMS_SUCCESS; */     
-  //[Example]
+
+  return MEMS_SUCCESS;
 }
 
 /*******************************************************************************
 * Function Name		: LSM6DS3_ACC_GYRO_ReadMem
-* Description		: Generic Reading function. It must be fullfilled with either
-*					: I2C or SPI writing function
+* Description		: Reads len consecutive bytes starting at Reg with as few
+*					: bus transactions as the transfer length allows
+*					: (CTRL3_C.IF_INC, set by default, advances the address)
 * Input				: Register Address, ptr to buffer to be read,
 *                                 length of buffer
 * Output			: None
-* Return			: None
+* Return			: Status [MEMS_ERROR, MEMS_SUCCESS]
 *******************************************************************************/
 u8_t LSM6DS3_ACC_GYRO_ReadMem(u8_t Reg, u8_t *Bufp, u16_t len)
 {
-   u16_t i; 
-    u8_t data = 0x0;
-  //To be completed with either I2c or SPI writing function
-  //i.e.: SPI_Mems_Write_Reg(Reg, Data);
- // I2Cx_Read(Bufp, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, len);
- // return MEMS_SUCCESS;                                                        //[Example]
- /*  if(!I2C_BufferRead(Bufp, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, len))  //[Example]
-	return MEMS_ERROR;                                                        //[Example]
-  else                                                                        //[Example]
-	return MEMS_SUCCESS;   
-*/
-   
-   
-  for (i=0;i<len;i++)
+  u16_t chunk;
+
+  while (len)
   {
-  data = i & 0xFF;
-  I2C_ByteWrite(&data,LSM6DS3_ACC_GYRO_I2C_ADDRESS,LSM6DS3_ACC_GYRO_ADDR0_TO_RW_RAM );
-  Delay(2);
-  data = (i >> 8) & 0xFF;
-  I2C_ByteWrite(&data,LSM6DS3_ACC_GYRO_I2C_ADDRESS,LSM6DS3_ACC_GYRO_ADDR1_TO_RW_RAM);
-    
-    if(!I2C_BufferRead(&Bufp[i], LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, 1))
-    {
-      return MEMS_ERROR;   
-    }      
-    else
-    { 
-      Delay(2); 
-    }
+    chunk = (len > LSM6DS3_ACC_GYRO_READ_BURST_MAX) ? LSM6DS3_ACC_GYRO_READ_BURST_MAX : len;
+    if (!I2C_BufferRead(Bufp, LSM6DS3_ACC_GYRO_I2C_ADDRESS, Reg, chunk))
+      return MEMS_ERROR;
+    Bufp += chunk;
+    Reg += chunk;
+    len -= chunk;
   }
-  
- return MEMS_SUCCESS;    
 
+  return MEMS_SUCCESS;
 }
 
 /*******************************************************************************
@@ -5816,23 +5842,7 @@ status_t LSM6DS3_ACC_GYRO_R_SleepEvOnInt2(LSM6DS3_ACC_GYRO_INT2_SLEEP_t *value)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetGyroData(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=6/3;
-
-  k=0;
-  for (i=0; i<3;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_OUTX_L_G+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
-
-  return MEMS_SUCCESS; 
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_OUTX_L_G, buff, 6) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /*******************************************************************************
@@ -5844,23 +5854,20 @@ status_t LSM6DS3_ACC_GYRO_Get_GetGyroData(u8_t *buff)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetAccData(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=6/3;
-
-  k=0;
-  for (i=0; i<3;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_OUTX_L_XL+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_OUTX_L_XL, buff, 6) ? MEMS_SUCCESS : MEMS_ERROR;
+}
 
-  return MEMS_SUCCESS; 
+/*******************************************************************************
+* Function Name  : status_t LSM6DS3_ACC_GYRO_Get_GetStatusGyroAccData(u8_t *buff)
+* Description    : Read STATUS_REG through OUTZ_H_XL in one transaction:
+*                  status, reserved, temperature, gyro xyz, accel xyz
+* Input          : pointer to [u8_t], LSM6DS3_ACC_GYRO_STATUS_GYRO_ACC_LEN bytes
+* Output         : GetStatusGyroAccData buffer u8_t
+* Return         : Status [MEMS_ERROR, MEMS_SUCCESS]
+*******************************************************************************/
+status_t LSM6DS3_ACC_GYRO_Get_GetStatusGyroAccData(u8_t *buff) 
+{
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_STATUS_REG, buff, LSM6DS3_ACC_GYRO_STATUS_GYRO_ACC_LEN) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /*******************************************************************************
@@ -5872,23 +5879,7 @@ status_t LSM6DS3_ACC_GYRO_Get_GetAccData(u8_t *buff)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetSnsr3Data(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=6/3;
-
-  k=0;
-  for (i=0; i<3;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_SENSORHUB1_REG+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
-
-  return MEMS_SUCCESS; 
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_SENSORHUB1_REG, buff, 6) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /*******************************************************************************
@@ -5900,23 +5891,7 @@ status_t LSM6DS3_ACC_GYRO_Get_GetSnsr3Data(u8_t *buff)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetSnsr4Data(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=6/3;
-
-  k=0;
-  for (i=0; i<3;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_SENSORHUB7_REG+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
-
-  return MEMS_SUCCESS; 
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_SENSORHUB7_REG, buff, 6) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /*******************************************************************************
@@ -5928,23 +5903,7 @@ status_t LSM6DS3_ACC_GYRO_Get_GetSnsr4Data(u8_t *buff)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetFIFOData(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=2/1;
-
-  k=0;
-  for (i=0; i<1;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
-
-  return MEMS_SUCCESS; 
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L, buff, 2) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /*******************************************************************************
@@ -5956,23 +5915,7 @@ status_t LSM6DS3_ACC_GYRO_Get_GetFIFOData(u8_t *buff)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetTimestamp(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=3/1;
-
-  k=0;
-  for (i=0; i<1;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_TIMESTAMP0_REG+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
-
-  return MEMS_SUCCESS; 
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_TIMESTAMP0_REG, buff, 3) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /*******************************************************************************
@@ -5984,23 +5927,7 @@ status_t LSM6DS3_ACC_GYRO_Get_GetTimestamp(u8_t *buff)
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetStepCounter(u8_t *buff) 
 {
-  u8_t i, j, k;
-  u8_t numberOfByteForDimension;
-  
-  numberOfByteForDimension=2/1;
-
-  k=0;
-  for (i=0; i<1;i++ ) 
-  {
-	for (j=0; j<numberOfByteForDimension;j++ )
-	{	
-		if( !LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_STEP_COUNTER_L+k, &buff[k]))
-		  return MEMS_ERROR;
-		k++;	
-	}
-  }
-
-  return MEMS_SUCCESS; 
+  return LSM6DS3_ACC_GYRO_ReadMem(LSM6DS3_ACC_GYRO_STEP_COUNTER_L, buff, 2) ? MEMS_SUCCESS : MEMS_ERROR;
 }
 
 /************** Access Device RAM  *******************/
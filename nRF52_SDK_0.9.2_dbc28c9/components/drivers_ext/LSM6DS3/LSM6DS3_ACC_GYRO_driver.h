@@ -86,12 +86,22 @@ typedef enum {
 
 #define LSM6DS3_ACC_GYRO_WHO_AM_I         0x69
 
+/************** Bus transfers  *******************/
+
+/* One TWI transfer carries at most 255 bytes; writes are copied into the
+   bus queue, which takes SENSOR_TWI_WRITE_MAX bytes at a time */
+#define LSM6DS3_ACC_GYRO_READ_BURST_MAX    255
+#define LSM6DS3_ACC_GYRO_WRITE_BURST_MAX   16
+/* Registers 0x00-0x5F may be shadowed, see LSM6DS3_ACC_GYRO_ReadReg */
+#define LSM6DS3_ACC_GYRO_SHADOW_SIZE       0x60
+
 /* Private Function Prototype -------------------------------------------------------*/
 
 u8_t LSM6DS3_ACC_GYRO_ReadReg(u8_t Reg, u8_t* Data);
 u8_t LSM6DS3_ACC_GYRO_WriteReg(u8_t Reg, u8_t Data); 
 u8_t LSM6DS3_ACC_GYRO_WriteMem(u8_t Reg, u8_t *Bufp, u16_t len);
 u8_t LSM6DS3_ACC_GYRO_ReadMem(u8_t Reg, u8_t *Bufp, u16_t len);
+void LSM6DS3_ACC_GYRO_ShadowInvalidate(void);
 void LSM6DS3_ACC_GYRO_SwapHighLowByte(u8_t *bufferToSwap, u8_t numberOfByte, u8_t dimension); 
 
 
@@ -2548,6 +2558,13 @@ status_t LSM6DS3_ACC_GYRO_Get_GetGyroData(u8_t *buff);
 *******************************************************************************/
 status_t LSM6DS3_ACC_GYRO_Get_GetAccData(u8_t *buff); 
 /*******************************************************************************
+* Register      : STATUS_REG - OUTZ_H_XL
+* Output Type   : GetStatusGyroAccData, [status, -, temp L/H, gyro xyz, acc xyz]
+* Permission    : RO 
+*******************************************************************************/
+#define LSM6DS3_ACC_GYRO_STATUS_GYRO_ACC_LEN   16
+status_t LSM6DS3_ACC_GYRO_Get_GetStatusGyroAccData(u8_t *buff); 
+/*******************************************************************************
 * Register      : <REGISTER_L> - <REGISTER_H>
 * Output Type   : GetSnsr3Data
 * Permission    : RO 
@@ -177,12 +177,9 @@ ret_code_t nrf_drv_rng_rand(uint8_t * p_buff, uint8_t length)
 #ifndef SOFTDEVICE_PRESENT
     if (FIFO_LENGTH(m_rng_cb.rand_pool) >= length)
     {
-        result = NRF_SUCCESS;
+        uint32_t size = length;
 
-        for (uint32_t i = 0; (i < length) && (result == NRF_SUCCESS); i++)
-        {
-            result = app_fifo_get(&(m_rng_cb.rand_pool), &p_buff[i]);
-        }
+        result = (size > 0) ? app_fifo_read(&(m_rng_cb.rand_pool), p_buff, &size) : NRF_SUCCESS;
         rng_start();
     }
     else
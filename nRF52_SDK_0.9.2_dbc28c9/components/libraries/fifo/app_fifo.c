@@ -11,7 +11,10 @@
  */
 
 #include "app_fifo.h"
+#include <string.h>
+#include "nrf.h"
 #include "nrf_error.h"
+#include "nordic_common.h"
 #include "app_util.h"
 
 static __INLINE uint32_t fifo_length(app_fifo_t * p_fifo)
@@ -22,6 +25,49 @@ static __INLINE uint32_t fifo_length(app_fifo_t * p_fifo)
 
 #define FIFO_LENGTH fifo_length(p_fifo)  /**< Macro for calculating the FIFO length. */
 
+// The index of a side is only moved once its data accesses are done (__DMB), and the other side
+// only touches the data after reading that index, so either side may be an interrupt.
+
+
+/**@brief Function for calculating the room left in the FIFO.
+ */
+static __INLINE uint32_t fifo_available_space(app_fifo_t * p_fifo)
+{
+    return (p_fifo->buf_size_mask + 1) - FIFO_LENGTH;
+}
+
+
+/**@brief Function for copying bytes into the FIFO buffer, in at most two pieces.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  p_src    Bytes to copy.
+ * @param[in]  size     Number of bytes, no more than there is room for.
+ */
+static void fifo_copy_in(app_fifo_t * p_fifo, uint8_t const * p_src, uint32_t size)
+{
+    uint32_t index = p_fifo->write_pos & p_fifo->buf_size_mask;
+    uint32_t first = MIN(size, (p_fifo->buf_size_mask + 1) - index);
+
+    memcpy(&p_fifo->p_buf[index], p_src, first);
+    memcpy(p_fifo->p_buf, &p_src[first], size - first);
+}
+
+
+/**@brief Function for copying bytes out of the FIFO buffer, in at most two pieces.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[out] p_dest   Memory for the bytes.
+ * @param[in]  size     Number of bytes, no more than the FIFO holds.
+ */
+static void fifo_copy_out(app_fifo_t * p_fifo, uint8_t * p_dest, uint32_t size)
+{
+    uint32_t index = p_fifo->read_pos & p_fifo->buf_size_mask;
+    uint32_t first = MIN(size, (p_fifo->buf_size_mask + 1) - index);
+
+    memcpy(p_dest, &p_fifo->p_buf[index], first);
+    memcpy(&p_dest[first], p_fifo->p_buf, size - first);
+}
+
 
 uint32_t app_fifo_init(app_fifo_t * p_fifo, uint8_t * p_buf, uint16_t buf_size)
 {
@@ -51,6 +97,7 @@ uint32_t app_fifo_put(app_fifo_t * p_fifo, uint8_t byte)
     if (FIFO_LENGTH <= p_fifo->buf_size_mask)
     {
         p_fifo->p_buf[p_fifo->write_pos & p_fifo->buf_size_mask] = byte;
+        __DMB();
         p_fifo->write_pos++;
         return NRF_SUCCESS;
     }
@@ -63,7 +110,9 @@ uint32_t app_fifo_get(app_fifo_t * p_fifo, uint8_t * p_byte)
 {
     if (FIFO_LENGTH != 0)
     {
+        __DMB();
         *p_byte = p_fifo->p_buf[p_fifo->read_pos & p_fifo->buf_size_mask];
+        __DMB();
         p_fifo->read_pos++;
         return NRF_SUCCESS;
     }
@@ -72,6 +121,121 @@ uint32_t app_fifo_get(app_fifo_t * p_fifo, uint8_t * p_byte)
 
 }
 
+
+uint32_t app_fifo_write(app_fifo_t * p_fifo, uint8_t const * p_byte_array, uint32_t * p_size)
+{
+    uint32_t available = fifo_available_space(p_fifo);
+
+    if (p_byte_array == NULL)
+    {
+        *p_size = available;
+        return NRF_SUCCESS;
+    }
+
+    if (available == 0)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    *p_size = MIN(*p_size, available);
+    fifo_copy_in(p_fifo, p_byte_array, *p_size);
+    __DMB();
+    p_fifo->write_pos += *p_size;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_fifo_read(app_fifo_t * p_fifo, uint8_t * p_byte_array, uint32_t * p_size)
+{
+    uint32_t length = FIFO_LENGTH;
+
+    if (p_byte_array == NULL)
+    {
+        *p_size = length;
+        return NRF_SUCCESS;
+    }
+
+    if (length == 0)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    *p_size = MIN(*p_size, length);
+    __DMB();
+    fifo_copy_out(p_fifo, p_byte_array, *p_size);
+    __DMB();
+    p_fifo->read_pos += *p_size;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_fifo_write_span_get(app_fifo_t * p_fifo, uint8_t ** pp_data, uint32_t * p_size)
+{
+    uint32_t available = fifo_available_space(p_fifo);
+    uint32_t index     = p_fifo->write_pos & p_fifo->buf_size_mask;
+
+    if (available == 0)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    // The consumer may still be reading up to the point where the room starts.
+    __DMB();
+    *pp_data = &p_fifo->p_buf[index];
+    *p_size  = MIN(available, (p_fifo->buf_size_mask + 1) - index);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_fifo_write_commit(app_fifo_t * p_fifo, uint32_t size)
+{
+    if (size > fifo_available_space(p_fifo))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    __DMB();
+    p_fifo->write_pos += size;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_fifo_read_span_get(app_fifo_t * p_fifo, uint8_t ** pp_data, uint32_t * p_size)
+{
+    uint32_t length = FIFO_LENGTH;
+    uint32_t index  = p_fifo->read_pos & p_fifo->buf_size_mask;
+
+    if (length == 0)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    __DMB();
+    *pp_data = &p_fifo->p_buf[index];
+    *p_size  = MIN(length, (p_fifo->buf_size_mask + 1) - index);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_fifo_read_commit(app_fifo_t * p_fifo, uint32_t size)
+{
+    if (size > FIFO_LENGTH)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    __DMB();
+    p_fifo->read_pos += size;
+
+    return NRF_SUCCESS;
+}
+
+
 uint32_t app_fifo_flush(app_fifo_t * p_fifo)
 {
     p_fifo->read_pos = p_fifo->write_pos;
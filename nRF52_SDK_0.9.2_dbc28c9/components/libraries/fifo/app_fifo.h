@@ -17,6 +17,10 @@
  * @ingroup app_common
  *
  * @brief FIFO implementation.
+ *
+ * @details Safe without critical regions for one producer and one consumer, each of which may
+ *          run in an interrupt or in the main loop. The span functions hand out the buffer memory
+ *          itself, so that a peripheral using EasyDMA can fill or drain it directly.
  */
 
 #ifndef APP_FIFO_H__
@@ -69,6 +73,83 @@ uint32_t app_fifo_put(app_fifo_t * p_fifo, uint8_t byte);
  */
 uint32_t app_fifo_get(app_fifo_t * p_fifo, uint8_t * p_byte);
 
+/**@brief Function for writing bytes to the FIFO.
+ *
+ * @details Writes as many of the bytes as there is room for. With p_byte_array set to NULL,
+ *          only gives the room in the FIFO.
+ *
+ * @param[in]    p_fifo         Pointer to the FIFO.
+ * @param[in]    p_byte_array   Bytes to write, or NULL.
+ * @param[inout] p_size         Number of bytes to write, number of bytes written on return.
+ *
+ * @retval     NRF_SUCCESS              If bytes were written, or the room was given.
+ * @retval     NRF_ERROR_NO_MEM         If the FIFO is full.
+ */
+uint32_t app_fifo_write(app_fifo_t * p_fifo, uint8_t const * p_byte_array, uint32_t * p_size);
+
+/**@brief Function for reading bytes from the FIFO.
+ *
+ * @details Reads as many of the bytes as the FIFO holds. With p_byte_array set to NULL, only
+ *          gives the number of bytes in the FIFO.
+ *
+ * @param[in]    p_fifo         Pointer to the FIFO.
+ * @param[out]   p_byte_array   Memory for the bytes read, or NULL.
+ * @param[inout] p_size         Number of bytes to read, number of bytes read on return.
+ *
+ * @retval     NRF_SUCCESS              If bytes were read, or the number of bytes was given.
+ * @retval     NRF_ERROR_NOT_FOUND      If the FIFO is empty.
+ */
+uint32_t app_fifo_read(app_fifo_t * p_fifo, uint8_t * p_byte_array, uint32_t * p_size);
+
+/**@brief Function for getting the free part of the FIFO buffer that can be written in one piece.
+ *
+ * @details The bytes are added to the FIFO by @ref app_fifo_write_commit once written, for
+ *          example when a DMA transfer into the span completes. A span that ends at the end of
+ *          the buffer may be followed by a second one at its start.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[out] pp_data  Start of the span.
+ * @param[out] p_size   Length of the span.
+ *
+ * @retval     NRF_SUCCESS              If a span was given.
+ * @retval     NRF_ERROR_NO_MEM         If the FIFO is full.
+ */
+uint32_t app_fifo_write_span_get(app_fifo_t * p_fifo, uint8_t ** pp_data, uint32_t * p_size);
+
+/**@brief Function for adding bytes written through @ref app_fifo_write_span_get to the FIFO.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  size     Number of bytes written.
+ *
+ * @retval     NRF_SUCCESS              If the bytes were added.
+ * @retval     NRF_ERROR_INVALID_LENGTH If there is not room for that many bytes.
+ */
+uint32_t app_fifo_write_commit(app_fifo_t * p_fifo, uint32_t size);
+
+/**@brief Function for getting the oldest bytes of the FIFO that lie in one piece of the buffer.
+ *
+ * @details The bytes stay in the FIFO until released by @ref app_fifo_read_commit, for example
+ *          when a DMA transfer out of the span completes.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[out] pp_data  Start of the span.
+ * @param[out] p_size   Length of the span.
+ *
+ * @retval     NRF_SUCCESS              If a span was given.
+ * @retval     NRF_ERROR_NOT_FOUND      If the FIFO is empty.
+ */
+uint32_t app_fifo_read_span_get(app_fifo_t * p_fifo, uint8_t ** pp_data, uint32_t * p_size);
+
+/**@brief Function for releasing bytes read through @ref app_fifo_read_span_get.
+ *
+ * @param[in]  p_fifo   Pointer to the FIFO.
+ * @param[in]  size     Number of bytes read.
+ *
+ * @retval     NRF_SUCCESS              If the bytes were released.
+ * @retval     NRF_ERROR_INVALID_LENGTH If the FIFO holds fewer bytes.
+ */
+uint32_t app_fifo_read_commit(app_fifo_t * p_fifo, uint32_t size);
+
 /**@brief Function for flushing the FIFO.
  *
  * @param[in]  p_fifo   Pointer to the FIFO.
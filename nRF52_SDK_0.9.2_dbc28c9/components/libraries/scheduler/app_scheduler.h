@@ -27,10 +27,17 @@
 #define APP_SCHEDULER_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "app_error.h"
 #include "app_util.h"
 
+#if defined(__LP64__)
+#define APP_SCHED_EVENT_HEADER_SIZE 16      /**< Host builds (tests/host), the 64 bit handler pointer pads either header to 16. */
+#elif defined(APP_SCHEDULER_WITH_STATS)
+#define APP_SCHED_EVENT_HEADER_SIZE 12      /**< Size of app_scheduler_var.event_header_t, which carries a timestamp (only for use inside APP_SCHED_BUF_SIZE()). */
+#else
 #define APP_SCHED_EVENT_HEADER_SIZE 8       /**< Size of app_scheduler.event_header_t (only for use inside APP_SCHED_BUF_SIZE()). */
+#endif
 
 /**@brief Compute number of bytes required to hold the scheduler buffer.
  *
@@ -108,6 +115,181 @@ uint32_t app_sched_event_put(void *                    p_event_data,
                              uint16_t                  event_size,
                              app_sched_event_handler_t handler);
 
+/**@brief Function for reserving room for an event, to be filled in place.
+ *
+ * @details The event runs once @ref app_sched_event_commit has been called on the returned
+ *          pointer. Events queued after it wait until then, so the two calls should follow each
+ *          other closely and from the same context. Safe from any interrupt level.
+ *
+ * @param[in]   event_size   Size of event data to be scheduled.
+ * @param[in]   handler      Event handler to receive the event.
+ *
+ * @return      Word aligned room for the event data, NULL if the queue is full or the event is
+ *              larger than the maximum event size.
+ *
+ * @note Only the variable size backend (app_scheduler_var.c) provides this function.
+ */
+void * app_sched_event_reserve(uint16_t event_size, app_sched_event_handler_t handler);
+
+/**@brief Function for handing a reserved event over to the main loop.
+ *
+ * @param[in]   p_event_data   Pointer returned by @ref app_sched_event_reserve.
+ */
+void app_sched_event_commit(void * p_event_data);
+
+/**@brief Function for giving the scheduler a separate queue for one interrupt.
+ *
+ * @details Events are put into it with @ref app_sched_isr_event_reserve and
+ *          @ref app_sched_isr_event_commit, which never disable interrupts. Only one producer
+ *          may use it: a single interrupt, or several that cannot preempt each other. Its events
+ *          run ahead of those of every lane and are not ordered with respect to them.
+ *
+ * @param[in]   p_buffer      Memory for the queue, aligned to a 4 byte boundary. Each event takes
+ *                            APP_SCHED_EVENT_HEADER_SIZE bytes plus its size rounded up to 4.
+ * @param[in]   buffer_size   Size of the buffer.
+ *
+ * @retval      NRF_SUCCESS               Successful initialization.
+ * @retval      NRF_ERROR_INVALID_PARAM   Buffer not aligned to a 4 byte boundary.
+ *
+ * @note Only the variable size backend (app_scheduler_var.c) provides this function.
+ */
+uint32_t app_sched_isr_queue_init(void * p_buffer, uint16_t buffer_size);
+
+/**@brief Function for reserving room for an event in the interrupt queue.
+ *
+ * @details Only one event may be reserved at a time.
+ *
+ * @param[in]   event_size   Size of event data to be scheduled.
+ * @param[in]   handler      Event handler to receive the event.
+ *
+ * @return      Word aligned room for the event data, NULL if the queue is full.
+ */
+void * app_sched_isr_event_reserve(uint16_t event_size, app_sched_event_handler_t handler);
+
+/**@brief Function for handing the event reserved in the interrupt queue over to the main loop.
+ *
+ * @param[in]   p_event_data   Pointer returned by @ref app_sched_isr_event_reserve.
+ */
+void app_sched_isr_event_commit(void * p_event_data);
+
+#ifndef APP_SCHED_LANE_COUNT
+#define APP_SCHED_LANE_COUNT   3            /**< Number of priority lanes, lane 0 being the most urgent. */
+#endif
+
+#ifndef APP_SCHED_LANE_DEFAULT
+#define APP_SCHED_LANE_DEFAULT 1            /**< Lane of @ref app_sched_event_put and of the buffer given to @ref app_sched_init. */
+#endif
+
+/**@brief Macro for giving a lane other than the default one its queue.
+ *
+ * @details Allocates the buffer like APP_SCHED_INIT() does. Must be used after it.
+ *
+ * @param[in] LANE         Lane, see @ref app_sched_lane_init.
+ * @param[in] EVENT_SIZE   Largest event the lane is sized for.
+ * @param[in] QUEUE_SIZE   Number of such events the lane holds.
+ */
+#define APP_SCHED_LANE_INIT(LANE, EVENT_SIZE, QUEUE_SIZE)                                          \
+    do                                                                                             \
+    {                                                                                              \
+        static uint32_t APP_SCHED_LANE_BUF[CEIL_DIV(APP_SCHED_BUF_SIZE(CEIL_DIV((EVENT_SIZE), 4) * 4, \
+                                                                       (QUEUE_SIZE)),              \
+                                                    sizeof(uint32_t))];                            \
+        uint32_t ERR_CODE = app_sched_lane_init((LANE), APP_SCHED_LANE_BUF, sizeof(APP_SCHED_LANE_BUF)); \
+        APP_ERROR_CHECK(ERR_CODE);                                                                 \
+    } while (0)
+
+/**@brief Function for giving a lane its queue.
+ *
+ * @details Lanes without a queue stay empty; putting an event into one fails with
+ *          NRF_ERROR_NO_MEM. Must be called after @ref app_sched_init, which resets all lanes.
+ *
+ * @param[in]   lane          Lane, below APP_SCHED_LANE_COUNT and not APP_SCHED_LANE_DEFAULT.
+ * @param[in]   p_buffer      Memory for the queue, aligned to a 4 byte boundary.
+ * @param[in]   buffer_size   Size of the buffer.
+ *
+ * @retval      NRF_SUCCESS               Successful initialization.
+ * @retval      NRF_ERROR_INVALID_PARAM   Invalid lane, or buffer not aligned to a 4 byte boundary.
+ *
+ * @note Only the variable size backend (app_scheduler_var.c) provides the lane functions.
+ */
+uint32_t app_sched_lane_init(uint8_t lane, void * p_buffer, uint16_t buffer_size);
+
+/**@brief Function for limiting how long a lane may keep the lanes below it waiting.
+ *
+ * @details A lane with a weight runs at most that many events in a row while a lane below it has
+ *          one waiting. With a weight of 0, the default, it always goes first (strict priority).
+ *          Giving every lane a weight keeps all of them from starving. Main context only.
+ *
+ * @param[in]   lane     Lane.
+ * @param[in]   weight   Events per round, 0 for strict priority.
+ */
+void app_sched_lane_weight_set(uint8_t lane, uint8_t weight);
+
+/**@brief Function for scheduling an event in a given lane.
+ *
+ * @details Same as @ref app_sched_event_put otherwise. Events of different lanes are not ordered
+ *          with respect to each other.
+ *
+ * @param[in]   lane           Lane.
+ * @param[in]   p_event_data   Pointer to event data to be scheduled.
+ * @param[in]   event_size     Size of event data to be scheduled.
+ * @param[in]   handler        Event handler to receive the event.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t app_sched_lane_event_put(uint8_t                   lane,
+                                  void *                    p_event_data,
+                                  uint16_t                  event_size,
+                                  app_sched_event_handler_t handler);
+
+/**@brief Function for reserving room for an event in a given lane.
+ *
+ * @details Same as @ref app_sched_event_reserve otherwise, the event is committed with
+ *          @ref app_sched_event_commit.
+ *
+ * @param[in]   lane         Lane.
+ * @param[in]   event_size   Size of event data to be scheduled.
+ * @param[in]   handler      Event handler to receive the event.
+ *
+ * @return      Word aligned room for the event data, NULL if there is none.
+ */
+void * app_sched_lane_event_reserve(uint8_t                   lane,
+                                    uint16_t                  event_size,
+                                    app_sched_event_handler_t handler);
+
+/**@brief Function for executing at most a given number of scheduled events.
+ *
+ * @details Lets the main loop get back to its other work in the middle of a burst.
+ *
+ * @param[in]   max_events   Number of events to execute at most.
+ *
+ * @return      true if events are left to execute, false while the scheduler is paused.
+ */
+bool app_sched_execute_budget(uint16_t max_events);
+
+#ifdef APP_SCHEDULER_WITH_STATS
+/**@brief Lane statistics, since @ref app_sched_init or @ref app_sched_lane_init. */
+typedef struct
+{
+    uint32_t events;                        /**< Events executed. */
+    uint32_t dropped;                       /**< Events that found the lane full. */
+    uint32_t max_latency;                   /**< Longest wait from being put to being executed, in RTC1 ticks. */
+    uint16_t high_water;                    /**< Most bytes of the queue in use at once. */
+} app_sched_lane_stats_t;
+
+/**@brief Function for reading the statistics of a lane.
+ *
+ * @details Latencies are taken from the app timer counter, so they are 0 while it is stopped.
+ *
+ * @param[in]   lane      Lane.
+ * @param[out]  p_stats   Statistics.
+ *
+ * @retval      NRF_SUCCESS               Statistics copied.
+ * @retval      NRF_ERROR_INVALID_PARAM   Invalid lane.
+ */
+uint32_t app_sched_lane_stats_get(uint8_t lane, app_sched_lane_stats_t * p_stats);
+#endif
+
 #ifdef APP_SCHEDULER_WITH_PAUSE
 /**@brief A function to pause the scheduler.
  *
@@ -123,6 +305,12 @@ void app_sched_pause(void);
  *          @ref app_sched_pause function.
  */
 void app_sched_resume(void);
+
+/**@brief Function for checking whether the scheduler is paused.
+ *
+ * @return      true from @ref app_sched_pause until the matching @ref app_sched_resume.
+ */
+bool app_sched_paused(void);
 #endif
 #endif // APP_SCHEDULER_H__
 
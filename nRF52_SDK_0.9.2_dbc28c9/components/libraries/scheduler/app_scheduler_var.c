@@ -0,0 +1,637 @@
+/** @file
+ *
+ * @brief Scheduler backend queuing variable size events in a contiguous byte ring.
+ *
+ * @details Drop-in replacement for app_scheduler.c, build one or the other. The buffer sized by
+ *          APP_SCHED_INIT() is used as one byte ring, so each event only takes its own size plus
+ *          an 8 byte header instead of a slot as large as the largest event.
+ *
+ *          An event is a header followed by its data, padded to 4 bytes. The producer reserves
+ *          room, writes the data in place and commits it; app_sched_event_put() does the same
+ *          with a memcpy. A record that does not fit before the end of the buffer starts over at
+ *          the beginning, behind a padding header. Events run in the order they were reserved,
+ *          and an event still being written holds back the ones behind it.
+ *
+ *          The data stays in the ring until the handler returns, so handlers may use it in place.
+ *
+ *          Events go into one of APP_SCHED_LANE_COUNT lanes, each its own ring, lane 0 being the
+ *          most urgent. The buffer given to app_sched_init() is the default lane. A lane with a
+ *          weight runs at most that many events before the lanes below it get one in turn, a lane
+ *          without one always goes first.
+ */
+
+#include "app_scheduler.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nordic_common.h"
+#include "nrf_assert.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#ifdef APP_SCHEDULER_WITH_STATS
+#include "app_timer.h"
+#endif
+
+#define EVENT_STATE_RESERVED    0x5253                                      /**< Being written by the producer. */
+#define EVENT_STATE_COMMITTED   0x434D                                      /**< Ready to run. */
+#define EVENT_STATE_PADDING     0x5044                                      /**< Rest of the buffer unused, the next event is at its start. */
+
+/**@brief Structure for holding a scheduled event header. */
+typedef struct
+{
+    app_sched_event_handler_t handler;          /**< Pointer to event handler to receive the event. */
+    uint16_t                  event_data_size;  /**< Size of event data. */
+    volatile uint16_t         state;            /**< One of the EVENT_STATE_ values. */
+#ifdef APP_SCHEDULER_WITH_STATS
+    uint32_t                  timestamp;        /**< RTC1 counter when the event was reserved. */
+#endif
+} event_header_t;
+
+STATIC_ASSERT(sizeof(event_header_t) <= APP_SCHED_EVENT_HEADER_SIZE);
+
+/**@brief Byte ring holding a queue of events. */
+typedef struct
+{
+    uint8_t *         p_buffer;                 /**< Start of the ring, word aligned. */
+    uint16_t          size;                     /**< Ring size, multiple of 4. */
+    volatile uint16_t start;                    /**< Offset of the oldest event, written by the consumer only. */
+    volatile uint16_t end;                      /**< Offset past the newest event the consumer may see. */
+    uint16_t          end_reserved;             /**< Single producer queue: end once the reserved event is committed. */
+} event_queue_t;
+
+/**@brief Priority lane. */
+typedef struct
+{
+    event_queue_t          queue;               /**< Queue shared by all producers of the lane. */
+    uint8_t                weight;              /**< Events in a row before the lanes below get a turn, 0 for no limit. */
+    uint8_t                credit;              /**< Events left to the lane in this round. */
+#ifdef APP_SCHEDULER_WITH_STATS
+    app_sched_lane_stats_t stats;               /**< Statistics, updated from interrupts as well. */
+#endif
+} sched_lane_t;
+
+static sched_lane_t  m_lanes[APP_SCHED_LANE_COUNT];  /**< Lanes, most urgent first. */
+static event_queue_t m_isr_queue;               /**< Queue of the single, lock-free, interrupt producer. */
+static uint16_t      m_queue_event_size;        /**< Maximum event size in queue. */
+#ifdef APP_SCHEDULER_WITH_PAUSE
+static uint32_t      m_scheduler_paused_counter = 0UL; /**< Number of app_sched_pause() calls not yet resumed. */
+#endif
+
+
+/**@brief Function for computing the room an event takes in the ring.
+ */
+static __INLINE uint16_t event_record_size(uint16_t event_data_size)
+{
+    return (uint16_t)(sizeof(event_header_t) + ((event_data_size + 3) & ~3));
+}
+
+
+/**@brief Function for initializing an event queue.
+ *
+ * @param[out]  p_queue       Queue to initialize.
+ * @param[in]   p_buffer      Word aligned buffer.
+ * @param[in]   buffer_size   Size of the buffer, at most 65532 bytes are used.
+ */
+static void queue_init(event_queue_t * p_queue, void * p_buffer, uint32_t buffer_size)
+{
+    if (buffer_size > 0xFFFC)
+    {
+        buffer_size = 0xFFFC;
+    }
+    p_queue->p_buffer     = p_buffer;
+    p_queue->size         = (uint16_t)(buffer_size & ~3);
+    p_queue->start        = 0;
+    p_queue->end          = 0;
+    p_queue->end_reserved = 0;
+}
+
+
+/**@brief Function for finding room for an event behind the given end of the queue.
+ *
+ * @details Writes the padding header if the event has to start over at the beginning of the
+ *          buffer. One word is always left free, so that a full queue can be told from an empty
+ *          one.
+ *
+ * @param[in]   p_queue       Queue.
+ * @param[in]   end           Current end of the queue.
+ * @param[in]   record_size   Room needed, from event_record_size().
+ * @param[out]  p_new_end     End of the queue behind the event.
+ *
+ * @return      Header of the event, NULL if there is no room.
+ */
+static event_header_t * queue_space_find(event_queue_t * p_queue,
+                                         uint16_t        end,
+                                         uint16_t        record_size,
+                                         uint16_t *      p_new_end)
+{
+    uint16_t start = p_queue->start;
+    uint16_t offset;
+
+    if (end >= start)
+    {
+        if ((uint32_t)end + record_size < p_queue->size + (start != 0))
+        {
+            // Fits before the end of the buffer.
+            offset = end;
+        }
+        else if (record_size < start)
+        {
+            // Start over, leaving the tail to the padding.
+            if ((p_queue->size - end) >= sizeof(event_header_t))
+            {
+                event_header_t * p_pad = (event_header_t *)&p_queue->p_buffer[end];
+
+                p_pad->handler         = NULL;
+                p_pad->event_data_size = 0;
+                p_pad->state           = EVENT_STATE_PADDING;
+            }
+            offset = 0;
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    else if ((uint32_t)end + record_size < start)
+    {
+        offset = end;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    *p_new_end = offset + record_size;
+    if (*p_new_end == p_queue->size)
+    {
+        *p_new_end = 0;
+    }
+    return (event_header_t *)&p_queue->p_buffer[offset];
+}
+
+
+/**@brief Function for getting the oldest event of a queue.
+ *
+ * @param[in]   p_queue   Queue.
+ *
+ * @return      Header of the event, NULL if the queue is empty or its oldest event is still being
+ *              written.
+ */
+static event_header_t * queue_event_peek(event_queue_t * p_queue)
+{
+    event_header_t * p_header;
+    uint16_t         start;
+
+    for (;;)
+    {
+        start = p_queue->start;
+        if (start == p_queue->end)
+        {
+            return NULL;
+        }
+        p_header = (event_header_t *)&p_queue->p_buffer[start];
+        if (((p_queue->size - start) < sizeof(event_header_t)) ||
+            (p_header->state == EVENT_STATE_PADDING))
+        {
+            p_queue->start = 0;
+            continue;
+        }
+        break;
+    }
+
+    return (p_header->state == EVENT_STATE_COMMITTED) ? p_header : NULL;
+}
+
+
+/**@brief Function for running the oldest event of a queue.
+ *
+ * @param[in]   p_queue    Queue.
+ * @param[in]   p_header   Its oldest event, from queue_event_peek().
+ */
+static void queue_event_run(event_queue_t * p_queue, event_header_t * p_header)
+{
+    uint16_t next;
+
+    p_header->handler((p_header->event_data_size > 0) ? (p_header + 1) : NULL,
+                      p_header->event_data_size);
+
+    // Only now may the room be reused, the handler had the data in place.
+    next = (uint16_t)((uint8_t *)p_header - p_queue->p_buffer) +
+           event_record_size(p_header->event_data_size);
+    p_header->state = 0;
+    __DMB();
+    p_queue->start = (next == p_queue->size) ? 0 : next;
+}
+
+
+/**@brief Function for picking the lane to run the next event from.
+ *
+ * @details The most urgent lane with an event to run goes first, unless it has used up its weight
+ *          in this round and a lane below it has an event waiting. When every lane with an event
+ *          has used up its weight, the lowest of them goes, with its weight back.
+ *
+ * @param[out]  pp_header   Oldest event of the lane.
+ *
+ * @return      Lane, NULL if there is nothing to run.
+ */
+static sched_lane_t * lane_next(event_header_t ** pp_header)
+{
+    sched_lane_t *   p_lane;
+    sched_lane_t *   p_lowest = NULL;
+    event_header_t * p_header;
+    uint8_t          i;
+
+    for (i = 0; i < APP_SCHED_LANE_COUNT; i++)
+    {
+        p_lane   = &m_lanes[i];
+        p_header = queue_event_peek(&p_lane->queue);
+        if (p_header == NULL)
+        {
+            continue;
+        }
+        if ((p_lane->weight == 0) || (p_lane->credit > 0))
+        {
+            *pp_header = p_header;
+            return p_lane;
+        }
+        p_lowest   = p_lane;
+        *pp_header = p_header;
+    }
+
+    if (p_lowest != NULL)
+    {
+        p_lowest->credit = p_lowest->weight;
+    }
+    return p_lowest;
+}
+
+
+/**@brief Function for running the oldest event of a lane.
+ *
+ * @param[in]   p_lane     Lane.
+ * @param[in]   p_header   Its oldest event, from lane_next().
+ */
+static void lane_event_run(sched_lane_t * p_lane, event_header_t * p_header)
+{
+    sched_lane_t * p_above;
+#ifdef APP_SCHEDULER_WITH_STATS
+    uint32_t now;
+    uint32_t latency;
+
+    (void)app_timer_cnt_get(&now);
+    (void)app_timer_cnt_diff_compute(now, p_header->timestamp, &latency);
+    CRITICAL_REGION_ENTER();
+    p_lane->stats.events++;
+    if (latency > p_lane->stats.max_latency)
+    {
+        p_lane->stats.max_latency = latency;
+    }
+    CRITICAL_REGION_EXIT();
+#endif
+
+    // The lanes above have waited for this one, their next round starts.
+    for (p_above = m_lanes; p_above < p_lane; p_above++)
+    {
+        p_above->credit = p_above->weight;
+    }
+    if (p_lane->credit > 0)
+    {
+        p_lane->credit--;
+    }
+    queue_event_run(&p_lane->queue, p_header);
+}
+
+
+/**@brief Function for reserving room for an event in a lane.
+ *
+ * @param[in]   p_lane            Lane.
+ * @param[in]   event_data_size   Size of event data.
+ * @param[in]   handler           Event handler.
+ *
+ * @return      Room for the event data, NULL if there is none.
+ */
+static void * lane_event_reserve(sched_lane_t *            p_lane,
+                                 uint16_t                  event_data_size,
+                                 app_sched_event_handler_t handler)
+{
+    event_queue_t *  p_queue = &p_lane->queue;
+    event_header_t * p_header;
+    uint16_t         new_end;
+#ifdef APP_SCHEDULER_WITH_STATS
+    uint16_t         used;
+#endif
+
+    if (event_data_size > m_queue_event_size)
+    {
+        return NULL;
+    }
+
+    CRITICAL_REGION_ENTER();
+
+    p_header = queue_space_find(p_queue, p_queue->end, event_record_size(event_data_size), &new_end);
+    if (p_header != NULL)
+    {
+        // The header is in place before the consumer can reach it.
+        p_header->handler         = handler;
+        p_header->event_data_size = event_data_size;
+        p_header->state           = EVENT_STATE_RESERVED;
+        p_queue->end              = new_end;
+#ifdef APP_SCHEDULER_WITH_STATS
+        (void)app_timer_cnt_get(&p_header->timestamp);
+        used = (new_end >= p_queue->start) ? (new_end - p_queue->start)
+                                           : (p_queue->size - p_queue->start + new_end);
+        if (used > p_lane->stats.high_water)
+        {
+            p_lane->stats.high_water = used;
+        }
+    }
+    else
+    {
+        p_lane->stats.dropped++;
+#endif
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    return (p_header != NULL) ? (p_header + 1) : NULL;
+}
+
+
+/**@brief Function for checking if the scheduler is paused.
+ *
+ * @return      true if events may not be run.
+ */
+static __INLINE bool is_app_sched_paused(void)
+{
+#ifdef APP_SCHEDULER_WITH_PAUSE
+    return (m_scheduler_paused_counter > 0);
+#else
+    return false;
+#endif
+}
+
+
+/**@brief Function for running events until none are left or the budget is used up.
+ *
+ * @details A handler may pause the scheduler, nothing more is run from then on.
+ *
+ * @param[in]   max_events   Budget.
+ *
+ * @return      true if events are left to run, false as well while the scheduler is paused.
+ */
+static bool sched_run(uint32_t max_events)
+{
+    event_header_t * p_header;
+    sched_lane_t *   p_lane;
+
+    for (; max_events > 0; max_events--)
+    {
+        if (is_app_sched_paused())
+        {
+            return false;
+        }
+
+        // Interrupt events first, the queue is not ordered with respect to the lanes.
+        p_header = queue_event_peek(&m_isr_queue);
+        if (p_header != NULL)
+        {
+            queue_event_run(&m_isr_queue, p_header);
+            continue;
+        }
+
+        p_lane = lane_next(&p_header);
+        if (p_lane == NULL)
+        {
+            return false;
+        }
+        lane_event_run(p_lane, p_header);
+    }
+
+    return (queue_event_peek(&m_isr_queue) != NULL) || (lane_next(&p_header) != NULL);
+}
+
+
+uint32_t app_sched_init(uint16_t event_size, uint16_t queue_size, void * p_event_buffer)
+{
+    // Check that buffer is correctly aligned
+    if (!is_word_aligned(p_event_buffer))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    memset(m_lanes, 0, sizeof(m_lanes));
+
+    // The whole of what APP_SCHED_INIT() allocated becomes the default lane.
+    queue_init(&m_lanes[APP_SCHED_LANE_DEFAULT].queue,
+               p_event_buffer,
+               APP_SCHED_BUF_SIZE(event_size, queue_size));
+    queue_init(&m_isr_queue, NULL, 0);
+    m_queue_event_size = event_size;
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_sched_isr_queue_init(void * p_buffer, uint16_t buffer_size)
+{
+    if (!is_word_aligned(p_buffer))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    queue_init(&m_isr_queue, p_buffer, buffer_size);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_sched_lane_init(uint8_t lane, void * p_buffer, uint16_t buffer_size)
+{
+    if ((lane >= APP_SCHED_LANE_COUNT) || (lane == APP_SCHED_LANE_DEFAULT) ||
+        !is_word_aligned(p_buffer))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    memset(&m_lanes[lane], 0, sizeof(m_lanes[lane]));
+    queue_init(&m_lanes[lane].queue, p_buffer, buffer_size);
+
+    return NRF_SUCCESS;
+}
+
+
+void app_sched_lane_weight_set(uint8_t lane, uint8_t weight)
+{
+    if (lane < APP_SCHED_LANE_COUNT)
+    {
+        m_lanes[lane].weight = weight;
+        m_lanes[lane].credit = weight;
+    }
+}
+
+
+void * app_sched_lane_event_reserve(uint8_t                   lane,
+                                    uint16_t                  event_data_size,
+                                    app_sched_event_handler_t handler)
+{
+    if (lane >= APP_SCHED_LANE_COUNT)
+    {
+        return NULL;
+    }
+
+    return lane_event_reserve(&m_lanes[lane], event_data_size, handler);
+}
+
+
+void * app_sched_event_reserve(uint16_t event_data_size, app_sched_event_handler_t handler)
+{
+    return lane_event_reserve(&m_lanes[APP_SCHED_LANE_DEFAULT], event_data_size, handler);
+}
+
+
+void app_sched_event_commit(void * p_event_data)
+{
+    event_header_t * p_header = (event_header_t *)p_event_data - 1;
+
+    __DMB();
+    p_header->state = EVENT_STATE_COMMITTED;
+}
+
+
+void * app_sched_isr_event_reserve(uint16_t event_data_size, app_sched_event_handler_t handler)
+{
+    event_header_t * p_header;
+
+    p_header = queue_space_find(&m_isr_queue,
+                                m_isr_queue.end,
+                                event_record_size(event_data_size),
+                                &m_isr_queue.end_reserved);
+    if (p_header == NULL)
+    {
+        return NULL;
+    }
+
+    p_header->handler         = handler;
+    p_header->event_data_size = event_data_size;
+    p_header->state           = EVENT_STATE_COMMITTED;
+
+    return (p_header + 1);
+}
+
+
+void app_sched_isr_event_commit(void * p_event_data)
+{
+    UNUSED_PARAMETER(p_event_data);
+
+    // The consumer sees nothing of the event, padding included, before the end moves.
+    __DMB();
+    m_isr_queue.end = m_isr_queue.end_reserved;
+}
+
+
+uint32_t app_sched_lane_event_put(uint8_t                   lane,
+                                  void                    * p_event_data,
+                                  uint16_t                  event_data_size,
+                                  app_sched_event_handler_t handler)
+{
+    void * p_data;
+
+    if (lane >= APP_SCHED_LANE_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (event_data_size > m_queue_event_size)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (p_event_data == NULL)
+    {
+        event_data_size = 0;
+    }
+
+    p_data = lane_event_reserve(&m_lanes[lane], event_data_size, handler);
+    if (p_data == NULL)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    if (event_data_size > 0)
+    {
+        memcpy(p_data, p_event_data, event_data_size);
+    }
+    app_sched_event_commit(p_data);
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_sched_event_put(void                    * p_event_data,
+                             uint16_t                  event_data_size,
+                             app_sched_event_handler_t handler)
+{
+    return app_sched_lane_event_put(APP_SCHED_LANE_DEFAULT, p_event_data, event_data_size, handler);
+}
+
+
+void app_sched_execute(void)
+{
+    (void)sched_run(UINT32_MAX);
+}
+
+
+bool app_sched_execute_budget(uint16_t max_events)
+{
+    return sched_run(max_events);
+}
+
+
+#ifdef APP_SCHEDULER_WITH_PAUSE
+void app_sched_pause(void)
+{
+    CRITICAL_REGION_ENTER();
+
+    if (m_scheduler_paused_counter < UINT32_MAX)
+    {
+        m_scheduler_paused_counter++;
+    }
+
+    CRITICAL_REGION_EXIT();
+}
+
+
+void app_sched_resume(void)
+{
+    CRITICAL_REGION_ENTER();
+
+    if (m_scheduler_paused_counter > 0)
+    {
+        m_scheduler_paused_counter--;
+    }
+
+    CRITICAL_REGION_EXIT();
+}
+
+
+bool app_sched_paused(void)
+{
+    return is_app_sched_paused();
+}
+#endif
+
+
+#ifdef APP_SCHEDULER_WITH_STATS
+uint32_t app_sched_lane_stats_get(uint8_t lane, app_sched_lane_stats_t * p_stats)
+{
+    if (lane >= APP_SCHED_LANE_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_lanes[lane].stats;
+    CRITICAL_REGION_EXIT();
+
+    return NRF_SUCCESS;
+}
+#endif
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include "nrf.h"
 #include "nrf_soc.h"
+#include "nordic_common.h"
 #include "app_error.h"
 #include "nrf_delay.h"
 #include "app_util.h"
@@ -144,6 +145,7 @@ static uint8_t                       m_ticks_elapsed_q_write_ind;
 static app_timer_evt_schedule_func_t m_evt_schedule_func;                       /**< Pointer to function for propagating timeout events to the scheduler. */
 static bool                          m_rtc1_running;                            /**< Boolean indicating if RTC1 is running. */
 static bool                          m_rtc1_reset;                              /**< Boolean indicating if RTC1 counter has been reset due to last timer removed from timer list during the timer list handling. */
+static app_timer_stats_t             m_stats;                                   /**< Wakeup statistics. Nothing is coalesced, so no wakeups are saved. */
  
 
 /**@brief Function for initializing the RTC1 counter.
@@ -431,6 +433,11 @@ static void timer_timeouts_check(void)
             }
         }
 
+        if (timer_id != m_timer_id_head)
+        {
+            m_stats.wakeups++;
+        }
+
         // Queue the ticks expired.
         m_ticks_elapsed[m_ticks_elapsed_q_write_ind] = ticks_expired;
 
@@ -1001,6 +1008,8 @@ uint32_t app_timer_init(uint32_t                      prescaler,
     }
 
     m_timer_id_head             = TIMER_NULL;
+    m_stats.wakeups             = 0;
+    m_stats.wakeups_saved       = 0;
     m_ticks_elapsed_q_read_ind  = 0;
     m_ticks_elapsed_q_write_ind = 0;
 
@@ -1112,6 +1121,18 @@ uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *
 }
 
 
+uint32_t app_timer_start_with_slack(app_timer_id_t timer_id,
+                                    uint32_t       timeout_ticks,
+                                    uint32_t       slack_ticks,
+                                    void *         p_context)
+{
+    // Timers always expire on time here.
+    UNUSED_PARAMETER(slack_ticks);
+
+    return app_timer_start(timer_id, timeout_ticks, p_context);
+}
+
+
 uint32_t app_timer_stop(app_timer_id_t timer_id)
 {
     // Check state and parameters
@@ -1145,6 +1166,13 @@ uint32_t app_timer_stop_all(void)
 }
 
 
+uint32_t app_timer_stats_get(app_timer_stats_t * p_stats)
+{
+    *p_stats = m_stats;
+    return NRF_SUCCESS;
+}
+
+
 uint32_t app_timer_cnt_get(uint32_t * p_ticks)
 {
     *p_ticks = rtc1_counter_get();
@@ -51,9 +51,16 @@
 #define APP_TIMER_CLOCK_FREQ         32768                      /**< Clock frequency of the RTC timer used to implement the app timer module. */
 #define APP_TIMER_MIN_TIMEOUT_TICKS  5                          /**< Minimum value of the timeout_ticks parameter of app_timer_start(). */
 
+#if defined(__LP64__)
+/* Host builds (tests/host), with 64 bit pointers in the nodes and operations. */
+#define APP_TIMER_NODE_SIZE          56                         /**< Size of app_timer.timer_node_t (only for use inside APP_TIMER_BUF_SIZE()). */
+#define APP_TIMER_USER_OP_SIZE       32                         /**< Size of app_timer.timer_user_op_t (only for use inside APP_TIMER_BUF_SIZE()). */
+#define APP_TIMER_USER_SIZE          16                         /**< Size of app_timer.timer_user_t (only for use inside APP_TIMER_BUF_SIZE()). */
+#else
 #define APP_TIMER_NODE_SIZE          40                         /**< Size of app_timer.timer_node_t (only for use inside APP_TIMER_BUF_SIZE()). */
 #define APP_TIMER_USER_OP_SIZE       24                         /**< Size of app_timer.timer_user_op_t (only for use inside APP_TIMER_BUF_SIZE()). */
 #define APP_TIMER_USER_SIZE          8                          /**< Size of app_timer.timer_user_t (only for use inside APP_TIMER_BUF_SIZE()). */
+#endif
 #define APP_TIMER_INT_LEVELS         3                          /**< Number of interrupt levels from where timer operations may be initiated (only for use inside APP_TIMER_BUF_SIZE()). */
 
 /**@brief Compute number of bytes required to hold the application timer data structures.
@@ -107,6 +114,13 @@ typedef void (*app_timer_timeout_handler_t)(void * p_context);
 typedef uint32_t (*app_timer_evt_schedule_func_t) (app_timer_timeout_handler_t timeout_handler,
                                                    void *                      p_context);
 
+/**@brief Timer coalescing statistics, see @ref app_timer_start_with_slack. */
+typedef struct
+{
+    uint32_t wakeups;                           /**< RTC1 interrupts that expired at least one timer. */
+    uint32_t wakeups_saved;                     /**< Expiries handled early, in another timer's wakeup, instead of in a wakeup of their own. */
+} app_timer_stats_t;
+
 /**@brief Timer modes. */
 typedef enum
 {
@@ -159,6 +173,8 @@ typedef enum
  *
  * @param[in]  prescaler           Value of the RTC1 PRESCALER register. Set to 0 for no prescaling.
  * @param[in]  max_timers          Maximum number of timers that can be created at any given time.
+ *                                 At most 254 with app_timer_wheel.c, whose node links are 8 bit
+ *                                 with 0xFF as the end of a list.
  * @param[in]  op_queues_size      Size of queues holding timer operations that are pending
  *                                 execution. NOTE: Due to the queue implementation, this size must
  *                                 be one more than the size that is actually needed.
@@ -173,7 +189,7 @@ typedef enum
  *
  * @retval     NRF_SUCCESS               Successful initialization.
  * @retval     NRF_ERROR_INVALID_PARAM   Invalid parameter (buffer not aligned to a 4 byte
- *                                       boundary or NULL).
+ *                                       boundary or NULL, or too many timers).
  */
 uint32_t app_timer_init(uint32_t                      prescaler, 
                         uint8_t                       max_timers,
@@ -222,6 +238,33 @@ uint32_t app_timer_create(app_timer_id_t *            p_timer_id,
  */
 uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context);
 
+/**@brief Function for starting a timer that may expire late.
+ *
+ * @details The timeout handler runs somewhere between timeout_ticks and timeout_ticks +
+ *          slack_ticks from now, so that the expiry can share an RTC1 wakeup with other timers.
+ *          Repeated timers keep their period, whenever each expiry actually ran.
+ *
+ * @param[in]  timer_id        Id of timer to start.
+ * @param[in]  timeout_ticks   Number of ticks (of RTC1, including prescaling) to timeout event
+ *                             (minimum 5 ticks).
+ * @param[in]  slack_ticks     Number of ticks the timeout event may come late. 0 makes this
+ *                             the same as @ref app_timer_start.
+ * @param[in]  p_context       General purpose pointer. Will be passed to the timeout handler when
+ *                             the timer expires.
+ *
+ * @retval     NRF_SUCCESS               Timer was successfully started.
+ * @retval     NRF_ERROR_INVALID_PARAM   Invalid parameter.
+ * @retval     NRF_ERROR_INVALID_STATE   Application timer module has not been initialized, or timer
+ *                                       has not been created.
+ * @retval     NRF_ERROR_NO_MEM          Timer operations queue was full.
+ *
+ * @note Only the timing wheel backend (app_timer_wheel.c) coalesces, app_timer.c ignores the slack.
+ */
+uint32_t app_timer_start_with_slack(app_timer_id_t timer_id,
+                                    uint32_t       timeout_ticks,
+                                    uint32_t       slack_ticks,
+                                    void *         p_context);
+
 /**@brief Function for stopping the specified timer.
  *
  * @param[in]  timer_id   Id of timer to stop.
@@ -242,6 +285,14 @@ uint32_t app_timer_stop(app_timer_id_t timer_id);
  */
 uint32_t app_timer_stop_all(void);
 
+/**@brief Function for reading the timer coalescing statistics.
+ *
+ * @param[out] p_stats   Counts since app_timer_init().
+ *
+ * @retval     NRF_SUCCESS   Statistics were successfully read.
+ */
+uint32_t app_timer_stats_get(app_timer_stats_t * p_stats);
+
 /**@brief Function for returning the current value of the RTC1 counter.
  *
  * @param[out] p_ticks   Current value of the RTC1 counter.
@@ -0,0 +1,862 @@
+/** @file
+ *
+ * @brief Application timer backend using a hierarchical timing wheel.
+ *
+ * @details Drop-in replacement for app_timer.c, build one or the other. Running timers hang off
+ *          WHEEL_LEVELS levels of WHEEL_SLOTS slots, each level covering WHEEL_SLOT_BITS more bits
+ *          of the 24-bit RTC1 counter. A timer sits on the highest level where its expiry still
+ *          differs from the wheel time, so everything on a level expires before anything on the
+ *          level above. Reaching a slot on an upper level moves its timers down a level, reaching
+ *          a slot on level 0 expires them.
+ *
+ *          Starting and stopping a timer links or unlinks one node under a critical region,
+ *          directly in the caller's context; there are no operation queues and no SWI0 handler.
+ *          Only the next slot to reach is ever loaded into RTC1 CC[0].
+ *
+ *          A timer started with slack is placed at the end of its window, rounded down to a power
+ *          of two so that similar windows line up. Every RTC1 wakeup also expires the slack
+ *          timers whose window has already opened, which saves them a wakeup of their own.
+ *
+ * @note    Timeouts are limited to half the RTC1 counter range. Once started, RTC1 keeps running
+ *          so app_timer_cnt_get() stays continuous.
+ */
+
+#include "app_timer.h"
+#include <stdlib.h>
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nordic_common.h"
+#include "app_error.h"
+#include "nrf_delay.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#define RTC1_IRQ_PRI            APP_IRQ_PRIORITY_LOW                        /**< Priority of the RTC1 interrupt (used for checking for timeouts and executing timeout handlers). */
+
+#define MAX_RTC_COUNTER_VAL     0x00FFFFFF                                  /**< Maximum value of the RTC counter. */
+#define MAX_TIMEOUT_TICKS       (MAX_RTC_COUNTER_VAL / 2)                   /**< Longest supported timeout. An expiry further away than this counts as already passed. */
+
+#define RTC_COMPARE_OFFSET_MIN  3                                           /**< Minimum offset between the current RTC counter value and the Capture Compare register. */
+
+#define MAX_RTC_TASKS_DELAY     47                                          /**< Maximum delay until an RTC task is executed. */
+
+#define WHEEL_SLOT_BITS         4                                           /**< Counter bits resolved per wheel level. */
+#define WHEEL_SLOTS             (1 << WHEEL_SLOT_BITS)                      /**< Slots per wheel level. */
+#define WHEEL_LEVELS            (24 / WHEEL_SLOT_BITS)                      /**< Levels needed to cover the RTC counter. */
+
+STATIC_ASSERT(WHEEL_LEVELS * WHEEL_SLOT_BITS == 24);
+STATIC_ASSERT(WHEEL_SLOTS <= 16);
+
+#define TIMER_NULL              0xFF                                        /**< Invalid timer index. */
+
+/**@brief Timer node type. */
+typedef struct
+{
+    uint8_t                     allocated;                                  /**< True if the node has been handed out by app_timer_create(). */
+    uint8_t                     mode;                                       /**< Timer mode, app_timer_mode_t. */
+    uint8_t                     next;                                       /**< Next timer in the same slot. */
+    uint8_t                     prev;                                       /**< Previous timer in the same slot, TIMER_NULL for the first one. */
+    uint8_t                     slot;                                       /**< Index into m_slots, TIMER_NULL when not running. */
+    uint8_t                     slack_next;                                 /**< Next running timer with slack. */
+    uint8_t                     slack_prev;                                 /**< Previous running timer with slack, TIMER_NULL for the first one. */
+    uint32_t                    expires;                                    /**< RTC1 counter value at expiry. */
+    uint32_t                    ticks_slack;                                /**< Ticks the timer may expire late. */
+    uint32_t                    ticks_fire;                                 /**< RTC1 counter value the wheel expires the timer at, within the slack. */
+    uint32_t                    ticks_periodic_interval;                    /**< Timer period (for repeating timers). */
+    app_timer_timeout_handler_t p_timeout_handler;                          /**< Pointer to function to be executed when the timer expires. */
+    void *                      p_context;                                  /**< General purpose pointer. Will be passed to the timeout handler when the timer expires. */
+} timer_node_t;
+
+STATIC_ASSERT(sizeof(timer_node_t) <= APP_TIMER_NODE_SIZE);
+STATIC_ASSERT(sizeof(timer_node_t) % 4 == 0);
+
+static uint8_t                       m_node_array_size;                     /**< Size of timer node array. */
+static timer_node_t *                mp_nodes = NULL;                       /**< Array of timer nodes. */
+static uint8_t                       m_slots[WHEEL_LEVELS * WHEEL_SLOTS];   /**< First timer in each slot. */
+static uint16_t                      m_slot_mask[WHEEL_LEVELS];             /**< Non-empty slots per level. */
+static uint32_t                      m_wheel_ticks;                         /**< RTC1 counter value the wheel has been advanced to. */
+static uint8_t                       m_slack_head;                          /**< First running timer with slack. */
+static bool                          m_slack_sweep;                         /**< True if the wheel advanced since slack timers were last checked. */
+static app_timer_stats_t             m_stats;                               /**< Coalescing statistics. */
+static app_timer_evt_schedule_func_t m_evt_schedule_func;                   /**< Pointer to function for propagating timeout events to the scheduler. */
+static bool                          m_rtc1_running;                        /**< Boolean indicating if RTC1 is running. */
+
+
+/**@brief Function for initializing the RTC1 counter.
+ *
+ * @param[in] prescaler   Value of the RTC1 PRESCALER register. Set to 0 for no prescaling.
+ */
+static void rtc1_init(uint32_t prescaler)
+{
+    NRF_RTC1->PRESCALER = prescaler;
+    NVIC_SetPriority(RTC1_IRQn, RTC1_IRQ_PRI);
+}
+
+
+/**@brief Function for starting the RTC1 timer.
+ */
+static void rtc1_start(void)
+{
+    NRF_RTC1->EVTENSET = RTC_EVTEN_COMPARE0_Msk;
+
+    NVIC_ClearPendingIRQ(RTC1_IRQn);
+    NVIC_EnableIRQ(RTC1_IRQn);
+
+    NRF_RTC1->TASKS_START = 1;
+    nrf_delay_us(MAX_RTC_TASKS_DELAY);
+
+    m_rtc1_running = true;
+}
+
+
+/**@brief Function for stopping the RTC1 timer.
+ */
+static void rtc1_stop(void)
+{
+    NVIC_DisableIRQ(RTC1_IRQn);
+
+    NRF_RTC1->EVTENCLR = RTC_EVTEN_COMPARE0_Msk;
+    NRF_RTC1->INTENCLR = RTC_INTENSET_COMPARE0_Msk;
+
+    NRF_RTC1->TASKS_STOP = 1;
+    nrf_delay_us(MAX_RTC_TASKS_DELAY);
+
+    NRF_RTC1->TASKS_CLEAR = 1;
+    nrf_delay_us(MAX_RTC_TASKS_DELAY);
+
+    m_rtc1_running = false;
+}
+
+
+/**@brief Function for returning the current value of the RTC1 counter.
+ *
+ * @return     Current value of the RTC1 counter.
+ */
+static __INLINE uint32_t rtc1_counter_get(void)
+{
+    return NRF_RTC1->COUNTER;
+}
+
+
+/**@brief Function for computing the difference between two RTC1 counter values.
+ *
+ * @return     Number of ticks elapsed from ticks_old to ticks_now.
+ */
+static __INLINE uint32_t ticks_diff_get(uint32_t ticks_now, uint32_t ticks_old)
+{
+    return ((ticks_now - ticks_old) & MAX_RTC_COUNTER_VAL);
+}
+
+
+/**@brief Function for finding the lowest set bit of a non-zero value.
+ */
+static __INLINE uint32_t lowest_bit_get(uint32_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    return __CLZ(__RBIT(value));
+#else
+    uint32_t bit = 0;
+
+    while ((value & 1) == 0)
+    {
+        value >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+
+/**@brief Function for finding the highest set bit of a non-zero value.
+ */
+static __INLINE uint32_t highest_bit_get(uint32_t value)
+{
+#if (__CORTEX_M >= 0x03)
+    return 31 - __CLZ(value);
+#else
+    uint32_t bit = 0;
+
+    while ((value >>= 1) != 0)
+    {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+
+/**@brief Function for finding the first non-empty slot of a level, searching forward from the
+ *        slot the wheel time is in.
+ *
+ * @param[in]  level   Wheel level, must have a non-empty slot.
+ *
+ * @return     Number of slots from the wheel time's slot to the first non-empty one.
+ */
+static uint32_t wheel_slot_offset_get(uint32_t level)
+{
+    uint32_t start = (m_wheel_ticks >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+    uint32_t mask  = m_slot_mask[level];
+
+    // Rotate so that the search starts at the current slot.
+    mask = ((mask >> start) | (mask << (WHEEL_SLOTS - start))) & ((1 << WHEEL_SLOTS) - 1);
+
+    return lowest_bit_get(mask);
+}
+
+
+/**@brief Function for finding the next point where the wheel has work to do.
+ *
+ * @param[out] p_level   Level of the slot that is reached first.
+ * @param[out] p_ticks   Ticks from the wheel time until then.
+ *
+ * @return     TRUE if any timer is running, FALSE otherwise.
+ */
+static bool wheel_next_get(uint32_t * p_level, uint32_t * p_ticks)
+{
+    uint32_t level;
+    uint32_t shift;
+    uint32_t ticks;
+
+    for (level = 0; level < WHEEL_LEVELS; level++)
+    {
+        if (m_slot_mask[level] != 0)
+        {
+            // Start of the slot, relative to the wheel time.
+            shift = level * WHEEL_SLOT_BITS;
+            ticks = ((m_wheel_ticks >> shift) + wheel_slot_offset_get(level)) << shift;
+
+            *p_level = level;
+            *p_ticks = ticks_diff_get(ticks, m_wheel_ticks);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**@brief Function for linking a timer into the slot it is to be expired from.
+ *
+ * @param[in]  timer_id   Id of timer to insert, its expiry and slack must be set.
+ */
+static void wheel_insert(uint8_t timer_id)
+{
+    timer_node_t * p_timer = &mp_nodes[timer_id];
+    uint32_t       differ;
+    uint32_t       level;
+    uint32_t       slot;
+    uint32_t       align;
+
+    p_timer->ticks_fire = p_timer->expires;
+    if (p_timer->ticks_slack != 0)
+    {
+        // The largest power of two that fits the slack still lands inside the window.
+        align               = 1UL << highest_bit_get(p_timer->ticks_slack);
+        p_timer->ticks_fire = ((p_timer->expires + p_timer->ticks_slack) & ~(align - 1))
+                              & MAX_RTC_COUNTER_VAL;
+    }
+    if (ticks_diff_get(p_timer->ticks_fire, m_wheel_ticks) > MAX_TIMEOUT_TICKS)
+    {
+        // Already due.
+        p_timer->ticks_fire = m_wheel_ticks;
+    }
+
+    // The highest level on which the expiry and the wheel time still differ.
+    differ = p_timer->ticks_fire ^ m_wheel_ticks;
+    level  = 0;
+    while ((differ >> ((level + 1) * WHEEL_SLOT_BITS)) != 0)
+    {
+        level++;
+    }
+    slot = (p_timer->ticks_fire >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1);
+
+    p_timer->slot = (uint8_t)(level * WHEEL_SLOTS + slot);
+    p_timer->prev = TIMER_NULL;
+    p_timer->next = m_slots[p_timer->slot];
+    if (p_timer->next != TIMER_NULL)
+    {
+        mp_nodes[p_timer->next].prev = timer_id;
+    }
+    m_slots[p_timer->slot]  = timer_id;
+    m_slot_mask[level]     |= (1 << slot);
+}
+
+
+/**@brief Function for unlinking a running timer from its slot.
+ *
+ * @param[in]  timer_id   Id of timer to remove.
+ */
+static void wheel_remove(uint8_t timer_id)
+{
+    timer_node_t * p_timer = &mp_nodes[timer_id];
+
+    if (p_timer->prev != TIMER_NULL)
+    {
+        mp_nodes[p_timer->prev].next = p_timer->next;
+    }
+    else
+    {
+        m_slots[p_timer->slot] = p_timer->next;
+        if (p_timer->next == TIMER_NULL)
+        {
+            m_slot_mask[p_timer->slot / WHEEL_SLOTS] &= ~(1 << (p_timer->slot % WHEEL_SLOTS));
+        }
+    }
+    if (p_timer->next != TIMER_NULL)
+    {
+        mp_nodes[p_timer->next].prev = p_timer->prev;
+    }
+    p_timer->slot = TIMER_NULL;
+}
+
+
+/**@brief Function for adding a running timer to the list of timers with slack.
+ *
+ * @param[in]  timer_id   Id of timer to add.
+ */
+static void slack_list_insert(uint8_t timer_id)
+{
+    timer_node_t * p_timer = &mp_nodes[timer_id];
+
+    p_timer->slack_prev = TIMER_NULL;
+    p_timer->slack_next = m_slack_head;
+    if (m_slack_head != TIMER_NULL)
+    {
+        mp_nodes[m_slack_head].slack_prev = timer_id;
+    }
+    m_slack_head = timer_id;
+}
+
+
+/**@brief Function for removing a timer from the list of timers with slack.
+ *
+ * @param[in]  timer_id   Id of timer to remove.
+ */
+static void slack_list_remove(uint8_t timer_id)
+{
+    timer_node_t * p_timer = &mp_nodes[timer_id];
+
+    if (p_timer->slack_prev != TIMER_NULL)
+    {
+        mp_nodes[p_timer->slack_prev].slack_next = p_timer->slack_next;
+    }
+    else
+    {
+        m_slack_head = p_timer->slack_next;
+    }
+    if (p_timer->slack_next != TIMER_NULL)
+    {
+        mp_nodes[p_timer->slack_next].slack_prev = p_timer->slack_prev;
+    }
+}
+
+
+/**@brief Function for stopping a running timer.
+ *
+ * @param[in]  timer_id   Id of timer to stop.
+ */
+static void timer_remove(uint8_t timer_id)
+{
+    wheel_remove(timer_id);
+    if (mp_nodes[timer_id].ticks_slack != 0)
+    {
+        slack_list_remove(timer_id);
+    }
+}
+
+
+/**@brief Function for taking an expired timer off the wheel, or putting it back for its next
+ *        period.
+ *
+ * @param[in]  timer_id   Id of the expired timer.
+ */
+static void timer_expire(uint8_t timer_id)
+{
+    timer_node_t * p_timer = &mp_nodes[timer_id];
+
+    if (p_timer->ticks_periodic_interval != 0)
+    {
+        // Keep the phase, however late or early this is.
+        wheel_remove(timer_id);
+        p_timer->expires = (p_timer->expires + p_timer->ticks_periodic_interval) & MAX_RTC_COUNTER_VAL;
+        wheel_insert(timer_id);
+    }
+    else
+    {
+        timer_remove(timer_id);
+    }
+}
+
+
+/**@brief Function for finding a timer with slack whose window has opened at the wheel time, but
+ *        which is to be expired later.
+ *
+ * @return     Id of the timer, TIMER_NULL if there is none.
+ */
+static uint8_t slack_due_get(void)
+{
+    uint8_t timer_id;
+
+    for (timer_id = m_slack_head; timer_id != TIMER_NULL; timer_id = mp_nodes[timer_id].slack_next)
+    {
+        timer_node_t * p_timer = &mp_nodes[timer_id];
+
+        if ((ticks_diff_get(m_wheel_ticks, p_timer->expires) <= MAX_TIMEOUT_TICKS) &&
+            (p_timer->ticks_fire != m_wheel_ticks))
+        {
+            return timer_id;
+        }
+    }
+    return TIMER_NULL;
+}
+
+
+/**@brief Function for moving the wheel time up to the RTC1 counter, as long as no slot is reached
+ *        on the way.
+ */
+static void wheel_ticks_sync(void)
+{
+    uint32_t level;
+    uint32_t ticks_next;
+    uint32_t ticks_elapsed = ticks_diff_get(rtc1_counter_get(), m_wheel_ticks);
+
+    if (!wheel_next_get(&level, &ticks_next) || (ticks_elapsed < ticks_next))
+    {
+        m_wheel_ticks = (m_wheel_ticks + ticks_elapsed) & MAX_RTC_COUNTER_VAL;
+    }
+}
+
+
+/**@brief Function for scheduling a check for timeouts by generating a RTC1 interrupt.
+ */
+static void timer_timeouts_check_sched(void)
+{
+    NVIC_SetPendingIRQ(RTC1_IRQn);
+}
+
+
+/**@brief Function for updating the Capture Compare register to the next timer to expire.
+ */
+static void compare_reg_update(void)
+{
+    uint32_t level;
+    uint32_t ticks_next;
+    uint32_t ticks;
+    uint32_t cc;
+    uint32_t ticks_to_cc;
+    uint8_t  timer_id;
+
+    if (!wheel_next_get(&level, &ticks_next))
+    {
+        NRF_RTC1->INTENCLR = RTC_INTENSET_COMPARE0_Msk;
+        return;
+    }
+    if (!m_rtc1_running)
+    {
+        rtc1_start();
+    }
+
+    if (level != 0)
+    {
+        // Wake up for the first timer in the slot rather than for the slot itself. The slot is
+        // moved down on the way there, without a wakeup of its own.
+        cc       = (m_wheel_ticks + ticks_next) & MAX_RTC_COUNTER_VAL;
+        timer_id = m_slots[level * WHEEL_SLOTS +
+                           ((cc >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1))];
+        ticks_next = MAX_TIMEOUT_TICKS;
+        for (; timer_id != TIMER_NULL; timer_id = mp_nodes[timer_id].next)
+        {
+            ticks = ticks_diff_get(mp_nodes[timer_id].ticks_fire, m_wheel_ticks);
+            if (ticks < ticks_next)
+            {
+                ticks_next = ticks;
+            }
+        }
+    }
+
+    cc = (m_wheel_ticks + ticks_next) & MAX_RTC_COUNTER_VAL;
+
+    NRF_RTC1->CC[0]    = cc;
+    NRF_RTC1->INTENSET = RTC_INTENSET_COMPARE0_Msk;
+
+    // If the COUNTER value is N, writing N or N+1 to a CC register may not trigger a COMPARE
+    // event, and a value already passed only triggers it after the counter wraps.
+    ticks_to_cc = ticks_diff_get(cc, rtc1_counter_get());
+    if ((ticks_to_cc < RTC_COMPARE_OFFSET_MIN) || (ticks_to_cc > MAX_TIMEOUT_TICKS))
+    {
+        timer_timeouts_check_sched();
+    }
+}
+
+
+/**@brief Function for executing an application timeout handler, either by calling it directly, or
+ *        by passing an event to the @ref app_scheduler.
+ *
+ * @param[in]  timeout_handler   Handler of the expired timer.
+ * @param[in]  p_context         Context the timer was started with.
+ */
+static void timeout_handler_exec(app_timer_timeout_handler_t timeout_handler, void * p_context)
+{
+    if (m_evt_schedule_func != NULL)
+    {
+        uint32_t err_code = m_evt_schedule_func(timeout_handler, p_context);
+        APP_ERROR_CHECK(err_code);
+    }
+    else
+    {
+        timeout_handler(p_context);
+    }
+}
+
+
+/**@brief Function for advancing the wheel by one step, if the next slot has been reached.
+ *
+ * @details A reached level 0 slot gives up its first timer, a reached slot on a higher level has
+ *          all its timers moved down. Once the wheel has advanced, the timers with slack whose
+ *          window is open are expired too, one per step.
+ *
+ * @param[out] p_expired   Id of the expired timer, TIMER_NULL if none expired.
+ *
+ * @return     TRUE if the wheel advanced or a timer expired, FALSE if the wheel is up to date with
+ *             the RTC1 counter.
+ */
+static bool wheel_step(uint8_t * p_expired)
+{
+    uint32_t level;
+    uint32_t ticks_next;
+    uint8_t  slot;
+    uint8_t  timer_id;
+
+    *p_expired = TIMER_NULL;
+
+    if (m_slack_sweep)
+    {
+        timer_id = slack_due_get();
+        if (timer_id != TIMER_NULL)
+        {
+            timer_expire(timer_id);
+            m_stats.wakeups_saved++;
+            *p_expired = timer_id;
+            return true;
+        }
+        m_slack_sweep = false;
+    }
+
+    if (!wheel_next_get(&level, &ticks_next) ||
+        (ticks_next > ticks_diff_get(rtc1_counter_get(), m_wheel_ticks)))
+    {
+        return false;
+    }
+    m_wheel_ticks = (m_wheel_ticks + ticks_next) & MAX_RTC_COUNTER_VAL;
+    m_slack_sweep = true;
+    slot          = (uint8_t)(level * WHEEL_SLOTS +
+                              ((m_wheel_ticks >> (level * WHEEL_SLOT_BITS)) & (WHEEL_SLOTS - 1)));
+
+    if (level == 0)
+    {
+        timer_id = m_slots[slot];
+        timer_expire(timer_id);
+        *p_expired = timer_id;
+    }
+    else
+    {
+        while (m_slots[slot] != TIMER_NULL)
+        {
+            timer_id = m_slots[slot];
+            wheel_remove(timer_id);
+            wheel_insert(timer_id);
+        }
+    }
+    return true;
+}
+
+
+/**@brief Function for handling the RTC1 interrupt.
+ *
+ * @details Advances the wheel up to the RTC1 counter, and executes timeout handlers for expired
+ *          timers.
+ */
+void RTC1_IRQHandler(void)
+{
+    app_timer_timeout_handler_t timeout_handler;
+    void *                      p_context;
+    uint8_t                     timer_id;
+    bool                        advanced;
+    bool                        expired = false;
+
+    // Clear all events (also unexpected ones)
+    NRF_RTC1->EVENTS_COMPARE[0] = 0;
+    NRF_RTC1->EVENTS_COMPARE[1] = 0;
+    NRF_RTC1->EVENTS_COMPARE[2] = 0;
+    NRF_RTC1->EVENTS_COMPARE[3] = 0;
+    NRF_RTC1->EVENTS_TICK       = 0;
+    NRF_RTC1->EVENTS_OVRFLW     = 0;
+
+    do
+    {
+        timeout_handler = NULL;
+        p_context       = NULL;
+
+        CRITICAL_REGION_ENTER();
+        advanced = wheel_step(&timer_id);
+        if (timer_id != TIMER_NULL)
+        {
+            timeout_handler = mp_nodes[timer_id].p_timeout_handler;
+            p_context       = mp_nodes[timer_id].p_context;
+            if (!expired)
+            {
+                expired = true;
+                m_stats.wakeups++;
+            }
+        }
+        if (!advanced)
+        {
+            wheel_ticks_sync();
+            compare_reg_update();
+        }
+        CRITICAL_REGION_EXIT();
+
+        // The handler may start or stop timers itself.
+        if (timeout_handler != NULL)
+        {
+            timeout_handler_exec(timeout_handler, p_context);
+        }
+    } while (advanced);
+}
+
+
+uint32_t app_timer_init(uint32_t                      prescaler,
+                        uint8_t                       max_timers,
+                        uint8_t                       op_queues_size,
+                        void *                        p_buffer,
+                        app_timer_evt_schedule_func_t evt_schedule_func)
+{
+    int i;
+
+    // There are no operation queues, their share of the buffer stays unused.
+    UNUSED_PARAMETER(op_queues_size);
+
+    // Check that buffer is correctly aligned
+    if (!is_word_aligned(p_buffer))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    // Check for NULL buffer
+    if (p_buffer == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    // Node links are 8 bit, TIMER_NULL excluded
+    if (max_timers >= TIMER_NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // Stop RTC to prevent any running timers from expiring (in case of reinitialization)
+    rtc1_stop();
+
+    m_evt_schedule_func = evt_schedule_func;
+
+    // Initialize timer node array
+    m_node_array_size = max_timers;
+    mp_nodes          = p_buffer;
+
+    for (i = 0; i < max_timers; i++)
+    {
+        mp_nodes[i].allocated = false;
+        mp_nodes[i].slot      = TIMER_NULL;
+    }
+
+    // Empty wheel
+    for (i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+    {
+        m_slots[i] = TIMER_NULL;
+    }
+    for (i = 0; i < WHEEL_LEVELS; i++)
+    {
+        m_slot_mask[i] = 0;
+    }
+    m_slack_head  = TIMER_NULL;
+    m_slack_sweep = false;
+    m_stats.wakeups       = 0;
+    m_stats.wakeups_saved = 0;
+
+    rtc1_init(prescaler);
+
+    m_wheel_ticks = rtc1_counter_get();
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_timer_create(app_timer_id_t *            p_timer_id,
+                          app_timer_mode_t            mode,
+                          app_timer_timeout_handler_t timeout_handler)
+{
+    int i;
+
+    // Check state and parameters
+    if (mp_nodes == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (timeout_handler == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (p_timer_id == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // Find free timer
+    for (i = 0; i < m_node_array_size; i++)
+    {
+        if (!mp_nodes[i].allocated)
+        {
+            mp_nodes[i].allocated         = true;
+            mp_nodes[i].mode              = (uint8_t)mode;
+            mp_nodes[i].p_timeout_handler = timeout_handler;
+
+            *p_timer_id = i;
+            return NRF_SUCCESS;
+        }
+    }
+
+    return NRF_ERROR_NO_MEM;
+}
+
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context)
+{
+    return app_timer_start_with_slack(timer_id, timeout_ticks, 0, p_context);
+}
+
+
+uint32_t app_timer_start_with_slack(app_timer_id_t timer_id,
+                                    uint32_t       timeout_ticks,
+                                    uint32_t       slack_ticks,
+                                    void *         p_context)
+{
+    timer_node_t * p_timer;
+
+    // Check state and parameters
+    if (mp_nodes == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if ((timer_id >= m_node_array_size)                         ||
+        (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS)           ||
+        (timeout_ticks > MAX_TIMEOUT_TICKS)                     ||
+        (slack_ticks > MAX_TIMEOUT_TICKS - timeout_ticks))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    p_timer = &mp_nodes[timer_id];
+    if (!p_timer->allocated)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    CRITICAL_REGION_ENTER();
+    // Starting a running timer is ignored.
+    if (p_timer->slot == TIMER_NULL)
+    {
+        wheel_ticks_sync();
+
+        p_timer->expires                 = (rtc1_counter_get() + timeout_ticks) & MAX_RTC_COUNTER_VAL;
+        p_timer->ticks_slack             = slack_ticks;
+        p_timer->ticks_periodic_interval = (p_timer->mode == APP_TIMER_MODE_REPEATED) ? timeout_ticks : 0;
+        p_timer->p_context               = p_context;
+
+        wheel_insert((uint8_t)timer_id);
+        if (slack_ticks != 0)
+        {
+            slack_list_insert((uint8_t)timer_id);
+        }
+        compare_reg_update();
+    }
+    CRITICAL_REGION_EXIT();
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_node_t * p_timer;
+
+    // Check state and parameters
+    if (mp_nodes == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (timer_id >= m_node_array_size)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    p_timer = &mp_nodes[timer_id];
+    if (!p_timer->allocated)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    // The compare register is left alone; reaching an emptied slot costs one early interrupt.
+    CRITICAL_REGION_ENTER();
+    if (p_timer->slot != TIMER_NULL)
+    {
+        timer_remove((uint8_t)timer_id);
+    }
+    CRITICAL_REGION_EXIT();
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_timer_stop_all(void)
+{
+    int i;
+
+    // Check state
+    if (mp_nodes == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    CRITICAL_REGION_ENTER();
+    for (i = 0; i < m_node_array_size; i++)
+    {
+        if (mp_nodes[i].slot != TIMER_NULL)
+        {
+            timer_remove((uint8_t)i);
+        }
+    }
+    compare_reg_update();
+    CRITICAL_REGION_EXIT();
+
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_timer_stats_get(app_timer_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats;
+    CRITICAL_REGION_EXIT();
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_timer_cnt_get(uint32_t * p_ticks)
+{
+    *p_ticks = rtc1_counter_get();
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_timer_cnt_diff_compute(uint32_t   ticks_to,
+                                    uint32_t   ticks_from,
+                                    uint32_t * p_ticks_diff)
+{
+    *p_ticks_diff = ticks_diff_get(ticks_to, ticks_from);
+    return NRF_SUCCESS;
+}
@@ -13,6 +13,7 @@
 #include "app_uart.h"
 #include "app_fifo.h"
 #include "nrf_drv_uart.h"
+#include "nordic_common.h"
 
 
 static __INLINE uint32_t fifo_length(app_fifo_t * const fifo)
@@ -25,12 +26,12 @@ static __INLINE uint32_t fifo_length(app_fifo_t * const fifo)
 
 
 static app_uart_event_handler_t   m_event_handler;            /**< Event handler function. */
-static uint8_t tx_buffer[1];
 static uint8_t tx_tmp;
 static uint8_t rx_buffer[1];
 
 static app_fifo_t                  m_rx_fifo;                               /**< RX FIFO buffer for storing data received on the UART until the application fetches them using app_uart_get(). */
 static app_fifo_t                  m_tx_fifo;                               /**< TX FIFO buffer for storing data to be transmitted on the UART when TXD is ready. Data is put to the buffer on using app_uart_put(). */
+static uint8_t                     m_tx_fifo_bytes;                         /**< Bytes the ongoing transfer sends straight out of the TX FIFO, 0 if it does not. */
 
 void uart_event_handler(nrf_drv_uart_event_t * p_event, void* p_context)
 {
@@ -66,10 +67,19 @@ void uart_event_handler(nrf_drv_uart_event_t * p_event, void* p_context)
     }
     else if (p_event->type == NRF_DRV_UART_EVT_TX_DONE)
     {
-        // Get next byte from FIFO.
-        if (app_fifo_get(&m_tx_fifo, tx_buffer) == NRF_SUCCESS)
+        uint8_t * p_data;
+        uint32_t  size;
+
+        // Release what was sent out of the FIFO, then send the next contiguous part in one go.
+        if (m_tx_fifo_bytes > 0)
+        {
+            (void)app_fifo_read_commit(&m_tx_fifo, m_tx_fifo_bytes);
+            m_tx_fifo_bytes = 0;
+        }
+        if (app_fifo_read_span_get(&m_tx_fifo, &p_data, &size) == NRF_SUCCESS)
         {
-            (void)nrf_drv_uart_tx(tx_buffer,1);
+            m_tx_fifo_bytes = (uint8_t)MIN(size, UINT8_MAX);
+            (void)nrf_drv_uart_tx(p_data, m_tx_fifo_bytes);
         }
         if (FIFO_LENGTH(m_tx_fifo) == 0)
         {
@@ -7,10 +7,20 @@
 #include "nrf_error.h"
 #include "nrf_drv_gpiote.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
+#include "app_util.h"
+#include "app_util_platform.h"
 
 #include "button.h"
 
-#define HALL_INTERVAL_VALUE  APP_TIMER_TICKS(100, 0) 
+/* The app timer runs RTC1 without prescaler. */
+#define ROTARY_TICKS_PER_S   APP_TIMER_CLOCK_FREQ
+/* No detent for this long and the ring is standing still. */
+#define ROTARY_IDLE_TICKS    APP_TIMER_TICKS(250, 0)
+
+#define BTN_DEBOUNCE_TICKS   APP_TIMER_TICKS(BTN_DEBOUNCE_MS, 0)
+#define BTN_LONG_PRESS_TICKS APP_TIMER_TICKS(BTN_LONG_PRESS_MS, 0)
+#define BTN_DOUBLE_TICKS     APP_TIMER_TICKS(BTN_DOUBLE_CLICK_MS, 0)
 
 #define GPIO_BUTTON_OK      30
 #define GPIO_BUTTON_CANCEL  27
@@ -21,106 +31,558 @@
 //#define GPIO_VIBERATE_ENABLE 26
 
 
-static volatile bool clockwise_event = false;
-static volatile bool anticlockwise = false;
-static uint32_t m_hall_interval_value = 0;
-static uint32_t m_button_value = 0;
+typedef struct {
+    uint32_t tick;
+    uint8_t state;              /* HALL_1 in bit 1, HALL_2 in bit 0 */
+} rotary_edge_t;
 
-static void btn_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+/* Edges from the GPIOTE interrupt to btn_rotary_get(), single producer and
+ * consumer so the indexes need no lock. */
+static rotary_edge_t m_edges[BTN_ROTARY_EDGE_QUEUE_SIZE];
+static volatile uint8_t m_edge_wr = 0;
+static volatile uint8_t m_edge_rd = 0;
+static volatile uint16_t m_edge_overflows = 0;
+static volatile uint8_t m_edge_last_state;   /* Of the newest queued edge */
+
+/* Decoder, main context only */
+static uint8_t m_rotary_state;
+static int8_t m_rotary_steps;           /* Quarter steps towards the next detent */
+static int32_t m_rotary_position = 0;
+static int32_t m_rotary_velocity = 0;   /* Detents per second, signed */
+static uint32_t m_rotary_last_detent;
+static uint16_t m_rotary_errors = 0;
+
+/* Gray code transitions, indexed by previous state << 2 | new state: HALL_2
+ * leading HALL_1 (11 10 00 01) is clockwise. Both bits changing means an
+ * edge was missed and counts as nothing. */
+static const int8_t m_rotary_table[16] =
+{
+     0, +1, -1,  0,
+    -1,  0,  0, +1,
+    +1,  0,  0, -1,
+     0, -1, +1,  0
+};
+
+/* Raw button edge, from the GPIOTE interrupt to the scheduler */
+typedef struct {
+    uint8_t button;
+    uint32_t tick;
+} btn_edge_evt_t;
+
+STATIC_ASSERT(sizeof(btn_edge_evt_t) <= BTN_SCHED_EVT_SIZE);
+
+typedef struct {
+    uint8_t pin;
+    app_timer_id_t debounce_timer;
+    app_timer_id_t gesture_timer;   /* Long press while held, double click window after */
+    uint8_t gesture_gen;            /* Tells a stale gesture timeout from the current one */
+    uint32_t edge_tick;             /* Latest raw edge */
+    uint32_t press_tick;
+    bool debouncing;
+    bool pressed;                   /* Debounced level */
+    bool long_sent;
+    bool click_pending;             /* Released once, waiting for a second click */
+} btn_state_t;
+
+/* Main context only, apart from the timer ids */
+static btn_state_t m_buttons[BTN_COUNT] =
+{
+    { .pin = GPIO_BUTTON_OK },
+    { .pin = GPIO_BUTTON_CANCEL }
+};
+static btn_evt_handler_t m_subscribers[BTN_SUBSCRIBERS_MAX];
+static volatile uint16_t m_btn_dropped = 0;
+static volatile bool m_rotary_scheduled = false;
+
+static const uint8_t m_input_pins[] =
+{
+    GPIO_BUTTON_OK, GPIO_BUTTON_CANCEL, GPIO_HALL_1, GPIO_HALL_2
+};
+static btn_power_mode_t m_power_mode;
+static btn_power_stats_t m_power_stats;
+
+static uint8_t rotary_state_read(void)
+{
+    uint32_t pins = nrf_gpio_pins_read();
+
+    return (uint8_t)((((pins >> GPIO_HALL_1) & 1) << 1) | ((pins >> GPIO_HALL_2) & 1));
+}
+
+static void rotary_edge_put(void)
+{
+    uint8_t wr = m_edge_wr;
+    rotary_edge_t *p_edge;
+
+    if ((uint8_t)(wr - m_edge_rd) == BTN_ROTARY_EDGE_QUEUE_SIZE)
+    {
+        m_edge_overflows++;
+        return;
+    }
+    p_edge = &m_edges[wr & (BTN_ROTARY_EDGE_QUEUE_SIZE - 1)];
+    p_edge->state = rotary_state_read();
+    m_edge_last_state = p_edge->state;
+    (void)app_timer_cnt_get(&p_edge->tick);
+    /* The entry has to be complete before the consumer sees it. */
+    __DMB();
+    m_edge_wr = wr + 1;
+}
+
+static void btn_dispatch(btn_evt_t const *p_evt)
+{
+    uint8_t i;
+
+    for (i = 0; i < BTN_SUBSCRIBERS_MAX; i++)
+    {
+        if (m_subscribers[i] != NULL)
+        {
+            m_subscribers[i](p_evt);
+        }
+    }
+}
+
+static void btn_notify(uint8_t button, btn_evt_type_t type, uint32_t tick)
+{
+    btn_evt_t evt;
+
+    evt.type = type;
+    evt.button = button;
+    evt.tick = tick;
+    evt.detents = 0;
+    evt.scroll = 0;
+    btn_dispatch(&evt);
+}
+
+static void btn_gesture_start(uint8_t button, uint32_t ticks)
 {
-			static uint32_t hall1_tick = 0;
-			static uint32_t hall2_tick = 0;
+    btn_state_t *p_btn = &m_buttons[button];
+    uint32_t err_code;
+
+    (void)app_timer_stop(p_btn->gesture_timer);
+    p_btn->gesture_gen++;
+    err_code = app_timer_start(p_btn->gesture_timer, ticks,
+                               (void *)(uintptr_t)(button | (p_btn->gesture_gen << 8)));
+    APP_ERROR_CHECK(err_code);
+}
+
+/* Scheduler: the debounce window has ended, look at the settled level. */
+static void btn_settle_handler(void *p_event_data, uint16_t event_size)
+{
+    uint8_t button = *(uint8_t *)p_event_data;
+    btn_state_t *p_btn = &m_buttons[button];
+    uint32_t now;
+    uint32_t quiet;
+    uint32_t err_code;
+    bool pressed;
+
+    (void)app_timer_cnt_get(&now);
+    (void)app_timer_cnt_diff_compute(now, p_btn->edge_tick, &quiet);
+    if (quiet < BTN_DEBOUNCE_TICKS)
+    {
+        /* Still bouncing, wait until the last edge is old enough. */
+        err_code = app_timer_start(p_btn->debounce_timer,
+                                   MAX(BTN_DEBOUNCE_TICKS - quiet, APP_TIMER_MIN_TIMEOUT_TICKS),
+                                   (void *)(uintptr_t)button);
+        APP_ERROR_CHECK(err_code);
+        return;
+    }
+    p_btn->debouncing = false;
+
+    pressed = !nrf_gpio_pin_read(p_btn->pin);
+    if (pressed == p_btn->pressed)
+    {
+        return;
+    }
+    p_btn->pressed = pressed;
+
+    if (pressed)
+    {
+        p_btn->press_tick = p_btn->edge_tick;
+        p_btn->long_sent = false;
+        btn_notify(button, BTN_EVT_PRESS, p_btn->edge_tick);
+        btn_gesture_start(button, BTN_LONG_PRESS_TICKS);
+        return;
+    }
+
+    (void)app_timer_stop(p_btn->gesture_timer);
+    p_btn->gesture_gen++;
+    btn_notify(button, BTN_EVT_RELEASE, p_btn->edge_tick);
+    if (p_btn->long_sent)
+    {
+        return;
+    }
+    if (p_btn->click_pending)
+    {
+        p_btn->click_pending = false;
+        btn_notify(button, BTN_EVT_DOUBLE_CLICK, p_btn->press_tick);
+        return;
+    }
+    p_btn->click_pending = true;
+    btn_gesture_start(button, BTN_DOUBLE_TICKS);
+}
 
+/* Scheduler: the long press time or the double click window ran out. */
+static void btn_gesture_handler(void *p_event_data, uint16_t event_size)
+{
+    uint32_t context = *(uint32_t *)p_event_data;
+    btn_state_t *p_btn = &m_buttons[context & 0xFF];
+
+    if ((uint8_t)(context >> 8) != p_btn->gesture_gen)
+    {
+        return;
+    }
+    if (p_btn->click_pending)
+    {
+        /* Pressed again too late, or held: the first one was a click. */
+        p_btn->click_pending = false;
+        btn_notify(context & 0xFF, BTN_EVT_CLICK, p_btn->press_tick);
+    }
+    if (p_btn->pressed && !p_btn->long_sent)
+    {
+        p_btn->long_sent = true;
+        btn_notify(context & 0xFF, BTN_EVT_LONG_PRESS, p_btn->press_tick);
+    }
+}
+
+/* Scheduler: a raw edge, (re)open the debounce window. */
+static void btn_edge_handler(void *p_event_data, uint16_t event_size)
+{
+    btn_edge_evt_t *p_edge = (btn_edge_evt_t *)p_event_data;
+    btn_state_t *p_btn = &m_buttons[p_edge->button];
+    uint32_t err_code;
+    uint32_t now;
+    uint32_t latency;
+
+    /* Edge interrupt to main loop, sleep included. */
+    (void)app_timer_cnt_get(&now);
+    (void)app_timer_cnt_diff_compute(now, p_edge->tick, &latency);
+    latency = ROUNDED_DIV(latency * 1000000ULL, APP_TIMER_CLOCK_FREQ);
+    m_power_stats.latency_last_us = latency;
+    if (latency > m_power_stats.latency_max_us)
+    {
+        m_power_stats.latency_max_us = latency;
+    }
+    if (m_power_mode == BTN_POWER_SLEEP)
+    {
+        m_power_stats.wakeups++;
+    }
+
+    p_btn->edge_tick = p_edge->tick;
+    if (!p_btn->debouncing)
+    {
+        p_btn->debouncing = true;
+        err_code = app_timer_start(p_btn->debounce_timer, BTN_DEBOUNCE_TICKS,
+                                   (void *)(uintptr_t)p_edge->button);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/* Scheduler: hall edges are queued, hand the detents out. */
+static void btn_rotary_handler(void *p_event_data, uint16_t event_size)
+{
+    btn_rotary_t rotary;
+    btn_evt_t evt;
+
+    m_rotary_scheduled = false;
+    btn_rotary_get(&rotary);
+    if (rotary.detents == 0)
+    {
+        return;
+    }
+    evt.type = BTN_EVT_ROTATE;
+    evt.button = BTN_COUNT;
+    (void)app_timer_cnt_get(&evt.tick);
+    evt.detents = rotary.detents;
+    evt.scroll = rotary.scroll;
+    btn_dispatch(&evt);
+}
+
+/* Timer interrupts only move the work to the scheduler. A full queue
+ * retries on the next tick so that no button stays stuck. */
+static void btn_debounce_timeout(void *p_context)
+{
+    uint8_t button = (uint8_t)(uintptr_t)p_context;
+
+    if (app_sched_lane_event_put(BTN_SCHED_LANE, &button, sizeof(button), btn_settle_handler) != NRF_SUCCESS)
+    {
+        (void)app_timer_start(m_buttons[button].debounce_timer, APP_TIMER_MIN_TIMEOUT_TICKS, p_context);
+    }
+}
+
+static void btn_gesture_timeout(void *p_context)
+{
+    uint32_t context = (uint32_t)(uintptr_t)p_context;
+
+    if (app_sched_lane_event_put(BTN_SCHED_LANE, &context, sizeof(context), btn_gesture_handler) != NRF_SUCCESS)
+    {
+        (void)app_timer_start(m_buttons[context & 0xFF].gesture_timer, APP_TIMER_MIN_TIMEOUT_TICKS, p_context);
+    }
+}
+
+static void btn_edge_put(uint8_t button)
+{
+    btn_edge_evt_t edge;
+
+    edge.button = button;
+    (void)app_timer_cnt_get(&edge.tick);
+    if (app_sched_lane_event_put(BTN_SCHED_LANE, &edge, sizeof(edge), btn_edge_handler) != NRF_SUCCESS)
+    {
+        m_btn_dropped++;
+    }
+}
+
+static void btn_rotary_schedule(void)
+{
+    if (!m_rotary_scheduled)
+    {
+        m_rotary_scheduled = true;
+        if (app_sched_lane_event_put(BTN_SCHED_LANE, NULL, 0, btn_rotary_handler) != NRF_SUCCESS)
+        {
+            m_rotary_scheduled = false;
+        }
+    }
+}
+
+static void btn_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
     switch (pin) {
 		case GPIO_BUTTON_OK:
-			m_button_value = GPIO_BUTTON_OK;
+			btn_edge_put(BTN_OK);
 			break;
 		case GPIO_BUTTON_CANCEL:
-			m_button_value = GPIO_BUTTON_CANCEL;
+			btn_edge_put(BTN_CANCEL);
 			break;
 		case GPIO_HALL_1:
-		        app_timer_cnt_get(&hall1_tick);
-					m_hall_interval_value = hall1_tick - hall2_tick;
-					if (m_hall_interval_value < HALL_INTERVAL_VALUE) {
-						clockwise_event = true;
-						anticlockwise = false;
-				} 
-			break;
 		case GPIO_HALL_2:
-		        app_timer_cnt_get(&hall2_tick);
-					m_hall_interval_value = hall2_tick - hall1_tick;
-					if (m_hall_interval_value < HALL_INTERVAL_VALUE) {
-						clockwise_event = false;
-						anticlockwise = true;
-				} 
+			rotary_edge_put();
+			btn_rotary_schedule();
 			break;
 		default:
 			break;
     }
 }
 
-uint32_t btn_init(void)
+uint32_t btn_subscribe(btn_evt_handler_t handler)
+{
+    uint8_t i;
+
+    if (handler == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+    for (i = 0; i < BTN_SUBSCRIBERS_MAX; i++)
+    {
+        if (m_subscribers[i] == NULL)
+        {
+            m_subscribers[i] = handler;
+            return NRF_SUCCESS;
+        }
+    }
+    return NRF_ERROR_NO_MEM;
+}
+
+static void rotary_detent(int8_t dir, uint32_t tick)
+{
+    uint32_t interval;
+    int32_t velocity;
+
+    (void)app_timer_cnt_diff_compute(tick, m_rotary_last_detent, &interval);
+    m_rotary_last_detent = tick;
+    m_rotary_position += dir;
+
+    if (interval == 0)
+    {
+        interval = 1;
+    }
+    velocity = (interval < ROTARY_IDLE_TICKS) ? dir * (int32_t)(ROTARY_TICKS_PER_S / interval) : dir;
+    if ((velocity < 0) != (m_rotary_velocity < 0))
+    {
+        /* Turned around, the old speed says nothing. */
+        m_rotary_velocity = velocity;
+    }
+    else
+    {
+        m_rotary_velocity = (3 * m_rotary_velocity + velocity) / 4;
+    }
+}
+
+void btn_rotary_get(btn_rotary_t *p_rotary)
+{
+    static int32_t reported = 0;
+    rotary_edge_t edge;
+    uint32_t now;
+    uint32_t idle;
+    int32_t speed;
+    int8_t step;
+
+    while (m_edge_rd != m_edge_wr)
+    {
+        edge = m_edges[m_edge_rd & (BTN_ROTARY_EDGE_QUEUE_SIZE - 1)];
+        __DMB();
+        m_edge_rd++;
+
+        step = m_rotary_table[(m_rotary_state << 2) | edge.state];
+        if (step == 0 && edge.state != m_rotary_state)
+        {
+            m_rotary_errors++;
+        }
+        m_rotary_state = edge.state;
+        m_rotary_steps += step;
+        if (m_rotary_steps >= BTN_ROTARY_STEPS_PER_DETENT)
+        {
+            m_rotary_steps -= BTN_ROTARY_STEPS_PER_DETENT;
+            rotary_detent(+1, edge.tick);
+        }
+        else if (m_rotary_steps <= -BTN_ROTARY_STEPS_PER_DETENT)
+        {
+            m_rotary_steps += BTN_ROTARY_STEPS_PER_DETENT;
+            rotary_detent(-1, edge.tick);
+        }
+    }
+
+    (void)app_timer_cnt_get(&now);
+    (void)app_timer_cnt_diff_compute(now, m_rotary_last_detent, &idle);
+    if (idle >= ROTARY_IDLE_TICKS)
+    {
+        m_rotary_velocity = 0;
+    }
+
+    p_rotary->position = m_rotary_position;
+    p_rotary->detents = (int16_t)(m_rotary_position - reported);
+    reported = m_rotary_position;
+    p_rotary->velocity = (int16_t)m_rotary_velocity;
+
+    speed = (m_rotary_velocity < 0) ? -m_rotary_velocity : m_rotary_velocity;
+    speed = 1 + speed / BTN_ROTARY_ACCEL_STEP;
+    if (speed > BTN_ROTARY_ACCEL_MAX)
+    {
+        speed = BTN_ROTARY_ACCEL_MAX;
+    }
+    p_rotary->scroll = (int16_t)(p_rotary->detents * speed);
+    p_rotary->errors = m_rotary_errors + m_edge_overflows;
+}
+
+/* Every input edge-triggers on both edges. PORT sensing costs nothing
+ * while the pins are still but re-arms from the interrupt, an IN channel
+ * catches every edge. */
+static uint32_t btn_pins_init(bool hi_accuracy)
 {
-    uint32_t err_code = NRF_SUCCESS;
-	
     nrf_drv_gpiote_in_config_t config;
+    uint32_t err_code;
+    uint8_t i;
 
-    if (!nrf_drv_gpiote_is_init())
+    config.is_watcher = false;
+    config.hi_accuracy = hi_accuracy;
+    config.sense = NRF_GPIOTE_POLARITY_TOGGLE;
+    config.pull = NRF_GPIO_PIN_PULLUP;
+    for (i = 0; i < sizeof(m_input_pins); i++)
     {
-        err_code = nrf_drv_gpiote_init();
+        err_code = nrf_drv_gpiote_in_init(m_input_pins[i], &config, btn_handler);
         if (err_code != NRF_SUCCESS)
         {
             return err_code;
         }
+        nrf_drv_gpiote_in_event_enable(m_input_pins[i], true);
     }
+    return NRF_SUCCESS;
+}
 
+static void btn_pins_uninit(void)
+{
+    uint8_t i;
 
-    config.is_watcher = false;
-	config.hi_accuracy = false;
-	config.sense = NRF_GPIOTE_POLARITY_HITOLO;
-    config.pull = NRF_GPIO_PIN_PULLUP;
-    err_code = nrf_drv_gpiote_in_init(GPIO_BUTTON_OK, &config, btn_handler);
-    if (err_code != NRF_SUCCESS)
+    for (i = 0; i < sizeof(m_input_pins); i++)
     {
-        return err_code;
+        nrf_drv_gpiote_in_event_disable(m_input_pins[i]);
+        nrf_drv_gpiote_in_uninit(m_input_pins[i]);
     }
-    nrf_drv_gpiote_in_event_enable(GPIO_BUTTON_OK, true);
-    //nrf_drv_gpiote_in_event_disable(GPIO_BUTTON_OK);
+}
 
+/* Queues whatever changed while the pins were being switched over. */
+static void btn_pins_resync(void)
+{
+    uint8_t i;
 
-    config.is_watcher = false;
-	config.hi_accuracy = false;
-	config.sense = NRF_GPIOTE_POLARITY_HITOLO;
-    config.pull = NRF_GPIO_PIN_PULLUP;
-    err_code = nrf_drv_gpiote_in_init(GPIO_BUTTON_CANCEL, &config, btn_handler);
-    if (err_code != NRF_SUCCESS)
+    CRITICAL_REGION_ENTER();
+    if (rotary_state_read() != m_edge_last_state)
     {
-        return err_code;
+        rotary_edge_put();
+        btn_rotary_schedule();
+        m_power_stats.resyncs++;
     }
-    nrf_drv_gpiote_in_event_enable(GPIO_BUTTON_CANCEL, true);
-    //nrf_drv_gpiote_in_event_disable(GPIO_BUTTON_CANCEL);
-	
-    config.is_watcher = false;
-	config.hi_accuracy = false;
-	config.sense = NRF_GPIOTE_POLARITY_HITOLO;
-    config.pull = NRF_GPIO_PIN_PULLUP;
-    err_code = nrf_drv_gpiote_in_init(GPIO_HALL_1, &config, btn_handler);
-    if (err_code != NRF_SUCCESS)
+    CRITICAL_REGION_EXIT();
+
+    for (i = 0; i < BTN_COUNT; i++)
     {
-        return err_code;
+        if (!nrf_gpio_pin_read(m_buttons[i].pin) != m_buttons[i].pressed)
+        {
+            btn_edge_put(i);
+            m_power_stats.resyncs++;
+        }
     }
-    nrf_drv_gpiote_in_event_enable(GPIO_HALL_1, true);
-	
-    config.is_watcher = false;
-	config.hi_accuracy = false;
-	config.sense = NRF_GPIOTE_POLARITY_HITOLO;
-    config.pull = NRF_GPIO_PIN_PULLUP;
-    err_code = nrf_drv_gpiote_in_init(GPIO_HALL_2, &config, btn_handler);
+}
+
+uint32_t btn_power_mode_set(btn_power_mode_t mode)
+{
+    uint32_t err_code;
+
+    if (mode == m_power_mode)
+    {
+        return NRF_SUCCESS;
+    }
+    btn_pins_uninit();
+    err_code = btn_pins_init(mode == BTN_POWER_ACTIVE);
     if (err_code != NRF_SUCCESS)
     {
         return err_code;
     }
-    nrf_drv_gpiote_in_event_enable(GPIO_HALL_2, true);
+    m_power_mode = mode;
+    btn_pins_resync();
 
     return NRF_SUCCESS;
 }
+
+void btn_power_stats_get(btn_power_stats_t *p_stats)
+{
+    *p_stats = m_power_stats;
+}
+
+uint32_t btn_init(void)
+{
+    uint32_t err_code = NRF_SUCCESS;
+    uint8_t i;
+
+    if (!nrf_drv_gpiote_is_init())
+    {
+        err_code = nrf_drv_gpiote_init();
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+    }
+
+    for (i = 0; i < BTN_COUNT; i++)
+    {
+        err_code = app_timer_create(&m_buttons[i].debounce_timer,
+                                    APP_TIMER_MODE_SINGLE_SHOT,
+                                    btn_debounce_timeout);
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+        err_code = app_timer_create(&m_buttons[i].gesture_timer,
+                                    APP_TIMER_MODE_SINGLE_SHOT,
+                                    btn_gesture_timeout);
+        if (err_code != NRF_SUCCESS)
+        {
+            return err_code;
+        }
+    }
+
+    m_rotary_state = rotary_state_read();
+    m_edge_last_state = m_rotary_state;
+    (void)app_timer_cnt_get(&m_rotary_last_detent);
+
+    /* The display comes up on, so does the input. */
+    m_power_mode = BTN_POWER_ACTIVE;
+    return btn_pins_init(true);
+}
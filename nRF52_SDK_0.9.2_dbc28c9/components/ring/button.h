@@ -5,8 +5,91 @@
 #include <stdbool.h>
 #include "boards.h"
 
+/* Gray code steps the hall sensors go through per detent. */
+#define BTN_ROTARY_STEPS_PER_DETENT  4
+/* Edges held between two btn_rotary_get() calls, power of two. */
+#define BTN_ROTARY_EDGE_QUEUE_SIZE   32
+/* Accelerated scrolling: one extra line per detent for every step of
+ * detents per second, up to the maximum factor. */
+#define BTN_ROTARY_ACCEL_STEP        8
+#define BTN_ROTARY_ACCEL_MAX         6
+
+#define BTN_DEBOUNCE_MS              20
+#define BTN_LONG_PRESS_MS            800
+#define BTN_DOUBLE_CLICK_MS          300   /* Release to second press */
+#define BTN_SUBSCRIBERS_MAX          4
+
+/* Largest event btn_init()'s interrupts put on the app scheduler, and the
+ * scheduler lane they go into, ahead of the default one. */
+#define BTN_SCHED_EVT_SIZE           8
+#define BTN_SCHED_LANE               0
+
+typedef enum {
+    BTN_OK,
+    BTN_CANCEL,
+    BTN_COUNT
+} btn_id_t;
+
+/* App timers btn_init() creates, a debounce and a gesture timer per button,
+ * to be counted in APP_TIMER_MAX_TIMERS. */
+#define BTN_APP_TIMERS               (BTN_COUNT * 2)
+
+typedef enum {
+    BTN_EVT_PRESS,
+    BTN_EVT_RELEASE,
+    BTN_EVT_CLICK,          /* No second press followed in time */
+    BTN_EVT_DOUBLE_CLICK,
+    BTN_EVT_LONG_PRESS,     /* Still held, the release follows later */
+    BTN_EVT_ROTATE          /* detents and scroll filled in */
+} btn_evt_type_t;
+
+typedef struct {
+    btn_evt_type_t type;
+    uint8_t button;         /* btn_id_t, BTN_COUNT for the ring */
+    uint32_t tick;          /* RTC1 tick of the press or edge behind it */
+    int16_t detents;
+    int16_t scroll;
+} btn_evt_t;
+
+typedef void (*btn_evt_handler_t)(btn_evt_t const *p_evt);
+
+typedef enum {
+    BTN_POWER_ACTIVE,       /* GPIOTE IN channels, no edge lost while the UI is up */
+    BTN_POWER_SLEEP         /* PORT sensing only, for when the display sleeps */
+} btn_power_mode_t;
+
+typedef struct {
+    uint32_t wakeups;           /* Button edges that arrived in BTN_POWER_SLEEP */
+    uint32_t latency_last_us;   /* Button edge interrupt to main loop, 30.5 us steps */
+    uint32_t latency_max_us;
+    uint16_t resyncs;           /* Changes caught only by the check after a mode switch */
+} btn_power_stats_t;
+
+typedef struct {
+    int32_t position;       /* Detents since btn_init(), clockwise positive */
+    int16_t detents;        /* Since the previous call */
+    int16_t scroll;         /* detents scaled up by the current speed */
+    int16_t velocity;       /* Detents per second, signed */
+    uint16_t errors;        /* Missed edges and queue overflows so far */
+} btn_rotary_t;
+
+/* Needs the app timer and the app scheduler, with a BTN_SCHED_LANE queue
+ * for BTN_SCHED_EVT_SIZE byte events. */
 uint32_t btn_init(void);
 
+/* The handler runs from app_sched_execute() for every input event. */
+uint32_t btn_subscribe(btn_evt_handler_t handler);
+
+/* Moves all inputs between IN channels and PORT sensing. A level that
+ * changed during the switch is queued as an edge. Main context only;
+ * btn_init() starts out active. */
+uint32_t btn_power_mode_set(btn_power_mode_t mode);
+void btn_power_stats_get(btn_power_stats_t *p_stats);
+
+/* Decodes the hall edges captured since the last call. Main context only;
+ * subscribers get the same detents through BTN_EVT_ROTATE. */
+void btn_rotary_get(btn_rotary_t *p_rotary);
+
 
 #endif 
 
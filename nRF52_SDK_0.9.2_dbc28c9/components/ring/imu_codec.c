@@ -0,0 +1,205 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "imu_codec.h"
+
+#if defined(NRF52)
+#include "nrf.h"
+/* Cortex-M4: paired halfword subtraction and count leading zeros. */
+#define IMU_CODEC_SIMD
+#endif
+
+#define IMU_CODEC_WIDTH_BITS       5
+#define IMU_CODEC_WIDTH_MASK       0x1F
+
+typedef struct {
+	uint8_t *p;
+	uint32_t acc;
+	uint8_t n;
+} imu_codec_writer_t;
+
+typedef struct {
+	uint8_t const *p;
+	uint32_t acc;
+	uint8_t n;
+} imu_codec_reader_t;
+
+static uint8_t imu_codec_width(uint32_t bits)
+{
+#ifdef IMU_CODEC_SIMD
+	return 32-__CLZ(bits);
+#else
+	uint8_t width = 0;
+
+	while(bits) {
+		width++;
+		bits >>= 1;
+	}
+	return width;
+#endif
+}
+
+static uint16_t imu_codec_zigzag(uint16_t delta)
+{
+	return (uint16_t)((delta << 1) ^ (uint16_t)-(delta >> 15));
+}
+
+static uint16_t imu_codec_unzigzag(uint16_t value)
+{
+	return (uint16_t)((value >> 1) ^ (uint16_t)-(value & 0x01));
+}
+
+/* Zigzagged wrapping differences of p_cur to p_prev, x in the low and y in
+ * the high halfword of *p_xy. */
+static void imu_codec_delta(int16_t const *p_cur, int16_t const *p_prev,
+                            uint32_t *p_xy, uint16_t *p_z)
+{
+	uint16_t dx;
+	uint16_t dy;
+#ifdef IMU_CODEC_SIMD
+	uint32_t d;
+
+	d = __SSUB16(__PKHBT((uint16_t)p_cur[0], (uint16_t)p_cur[1], 16),
+	             __PKHBT((uint16_t)p_prev[0], (uint16_t)p_prev[1], 16));
+	dx = (uint16_t)d;
+	dy = (uint16_t)(d >> 16);
+#else
+	dx = (uint16_t)(p_cur[0]-p_prev[0]);
+	dy = (uint16_t)(p_cur[1]-p_prev[1]);
+#endif
+	*p_xy = imu_codec_zigzag(dx) | ((uint32_t)imu_codec_zigzag(dy) << 16);
+	*p_z = imu_codec_zigzag((uint16_t)(p_cur[2]-p_prev[2]));
+}
+
+static void imu_codec_put(imu_codec_writer_t *p_writer, uint32_t value, uint8_t width)
+{
+	p_writer->acc |= value << p_writer->n;
+	p_writer->n += width;
+	while(p_writer->n >= 8) {
+		*p_writer->p++ = (uint8_t)p_writer->acc;
+		p_writer->acc >>= 8;
+		p_writer->n -= 8;
+	}
+}
+
+static uint16_t imu_codec_get(imu_codec_reader_t *p_reader, uint8_t width)
+{
+	uint16_t value;
+
+	while(p_reader->n < width) {
+		p_reader->acc |= (uint32_t)*p_reader->p++ << p_reader->n;
+		p_reader->n += 8;
+	}
+	value = (uint16_t)(p_reader->acc & ((1UL << width)-1));
+	p_reader->acc >>= width;
+	p_reader->n -= width;
+
+	return value;
+}
+
+size_t imu_codec_encode(int16_t const (*p_samples)[3], uint16_t count,
+                        uint8_t *p_out, size_t capacity, uint16_t *p_used)
+{
+	imu_codec_writer_t writer;
+	uint32_t or_xy = 0;
+	uint32_t xy;
+	uint16_t or_z = 0;
+	uint16_t z;
+	uint16_t used = 1;
+	uint16_t k;
+	uint8_t wx = 0, wy = 0, wz = 0;
+	uint8_t nx, ny, nz;
+	uint8_t i;
+
+	if(count == 0 || capacity < IMU_CODEC_HEADER_SIZE) {
+		return 0;
+	}
+	if(count > IMU_CODEC_BLOCK_MAX) {
+		count = IMU_CODEC_BLOCK_MAX;
+	}
+
+	/* The widths only grow, so take samples while the block still fits. */
+	for(k=1; k<count; k++) {
+		imu_codec_delta(p_samples[k], p_samples[k-1], &xy, &z);
+		nx = imu_codec_width((or_xy | xy) & 0xFFFF);
+		ny = imu_codec_width((or_xy | xy) >> 16);
+		nz = imu_codec_width(or_z | z);
+		if(IMU_CODEC_HEADER_SIZE+((uint32_t)k*(nx+ny+nz)+7)/8 > capacity) {
+			break;
+		}
+		or_xy |= xy;
+		or_z |= z;
+		wx = nx;
+		wy = ny;
+		wz = nz;
+		used = k+1;
+	}
+
+	p_out[0] = (uint8_t)(used-1);
+	p_out[1] = (uint8_t)(wx | (wy << IMU_CODEC_WIDTH_BITS));
+	p_out[2] = (uint8_t)((wy >> (8-IMU_CODEC_WIDTH_BITS)) | (wz << (2*IMU_CODEC_WIDTH_BITS-8)));
+	for(i=0; i<3; i++) {
+		p_out[3+2*i] = (uint8_t)p_samples[0][i];
+		p_out[4+2*i] = (uint8_t)((uint16_t)p_samples[0][i] >> 8);
+	}
+
+	writer.p = &p_out[IMU_CODEC_HEADER_SIZE];
+	writer.acc = 0;
+	writer.n = 0;
+	for(k=1; k<used; k++) {
+		imu_codec_delta(p_samples[k], p_samples[k-1], &xy, &z);
+		imu_codec_put(&writer, xy & 0xFFFF, wx);
+		imu_codec_put(&writer, xy >> 16, wy);
+		imu_codec_put(&writer, z, wz);
+	}
+	if(writer.n) {
+		*writer.p++ = (uint8_t)writer.acc;
+	}
+
+	*p_used = used;
+	return writer.p-p_out;
+}
+
+int imu_codec_decode(uint8_t const *p_in, size_t len,
+                     int16_t (*p_samples)[3], uint16_t max, size_t *p_size)
+{
+	imu_codec_reader_t reader;
+	uint16_t widths;
+	uint16_t count;
+	uint16_t k;
+	uint8_t width[3];
+	size_t size;
+	uint8_t i;
+
+	if(len < IMU_CODEC_HEADER_SIZE) {
+		return -1;
+	}
+	count = p_in[0]+1;
+	widths = p_in[1] | (p_in[2] << 8);
+	for(i=0; i<3; i++) {
+		width[i] = (widths >> (i*IMU_CODEC_WIDTH_BITS)) & IMU_CODEC_WIDTH_MASK;
+		if(width[i] > 16) {
+			return -1;
+		}
+	}
+	size = IMU_CODEC_HEADER_SIZE+((uint32_t)(count-1)*(width[0]+width[1]+width[2])+7)/8;
+	if(count > max || size > len) {
+		return -1;
+	}
+
+	for(i=0; i<3; i++) {
+		p_samples[0][i] = (int16_t)(p_in[3+2*i] | (p_in[4+2*i] << 8));
+	}
+	reader.p = &p_in[IMU_CODEC_HEADER_SIZE];
+	reader.acc = 0;
+	reader.n = 0;
+	for(k=1; k<count; k++) {
+		for(i=0; i<3; i++) {
+			p_samples[k][i] = (int16_t)(uint16_t)((uint16_t)p_samples[k-1][i] +
+			                  imu_codec_unzigzag(imu_codec_get(&reader, width[i])));
+		}
+	}
+
+	*p_size = size;
+	return count;
+}
@@ -0,0 +1,35 @@
+#ifndef IMU_CODEC_H__
+#define IMU_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lossless codec for 3-axis int16 sample streams, in self-contained blocks
+ * so that a lost BLE packet or flash record costs only its own samples.
+ *
+ *  count-1(1) widths(2) x(2) y(2) z(2) then count-1 delta triples
+ *
+ * widths holds the bit width of each axis, 5 bits apiece from bit 0. Every
+ * later sample is stored as the zigzagged 16-bit wrapping difference to the
+ * one before, using its axis width, packed LSB first and padded to a byte.
+ * All multi-byte fields are little endian.
+ *
+ * Plain C apart from the encoder's SIMD path, so the decoder builds on the
+ * host as is. */
+#define IMU_CODEC_HEADER_SIZE      9
+#define IMU_CODEC_BLOCK_MAX        256         /* Samples in one block */
+
+/* Encodes the longest run from the start of p_samples that fits in capacity
+ * bytes, stopping at count samples. Returns the block size and sets *p_used
+ * to the samples it holds, or returns 0 when capacity is below
+ * IMU_CODEC_HEADER_SIZE or count is 0. */
+size_t imu_codec_encode(int16_t const (*p_samples)[3], uint16_t count,
+                        uint8_t *p_out, size_t capacity, uint16_t *p_used);
+
+/* Decodes the block at p_in into up to max samples. Returns the number of
+ * samples and sets *p_size to the block size, or returns -1 when the block is
+ * truncated or holds more than max samples. */
+int imu_codec_decode(uint8_t const *p_in, size_t len,
+                     int16_t (*p_samples)[3], uint16_t max, size_t *p_size);
+
+#endif /* IMU_CODEC_H__ */
@@ -1,6 +1,6 @@
 #include <stdbool.h>
 #include <stdint.h>
-#include "nrf_delay.h"
+#include <string.h>
 #include "app_error.h"
 #include "app_util_platform.h"
 #include "nrf_drv_spi.h"
@@ -50,16 +50,166 @@
 #define LCD_SPI_A0_LOW()    do { NRF_GPIO->OUTCLR = (1UL << LCD_SPI_A0_PIN); } while(0)
 
 
-static volatile bool m_lcd_transfer_completed = true;
-static const nrf_drv_spi_t m_lcd_spi_master = NRF_DRV_SPI_INSTANCE(0);
+#define LCD_APP_TIMER_PRESCALER  0   /* Must match the app_timer_init() prescaler. */
+
+/* Command sequence opcodes. Any other leading byte is the number of data
+ * bytes following the command byte: <n> <cmd> <data 0> ... <data n-1>. */
+#define LCD_SEQ_END       0xFF  /* Sequence done. */
+#define LCD_SEQ_DELAY     0xFE  /* <ms>: wait on m_lcd_timer_id, CPU stays free. */
+#define LCD_SEQ_RESET     0xFD  /* <level>: drive the reset line. */
+#define LCD_SEQ_FLUSH     0xFC  /* Stream the whole draw buffer. */
+#define LCD_SEQ_DATA_MAX  16
+
+#define LCD_CMD(cmd, data)  1, (cmd), (data)
+/* The controller steps to the next register after each data byte, so
+ * registers at consecutive addresses go out as one command and one data
+ * transfer: <n> <first register> <data 0> ... <data n-1>. */
+#define LCD_CMD_RUN(cmd, n, ...)  (n), (cmd), __VA_ARGS__
+
+static const nrf_drv_spi_t m_lcd_spi_master = NRF_DRV_SPI_INSTANCE(2);
+/* Word aligned so lcd_draw can fill with 32-bit stores. */
+__ALIGN(sizeof(uint32_t))
 static uint8_t m_lcd_buffer[LCD_BUFFER_SIZE];
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+__ALIGN(sizeof(uint32_t))
+static uint8_t m_lcd_buffer2[LCD_BUFFER_SIZE];
+static uint8_t * m_p_draw_buffer = m_lcd_buffer;
+static uint8_t * m_p_front_buffer = m_lcd_buffer2;
+#else
+static uint8_t * const m_p_draw_buffer = m_lcd_buffer;
+#endif
+#if (LCD_BUFFER_MODE == LCD_BUFFER_STRIPE)
+static uint8_t m_lcd_stripe[LCD_STRIPE_ROWS*LCD_WITH*LCD_COLOR_DEEP];
+#endif
+
+typedef struct {
+	uint8_t x1;
+	uint8_t y1;
+	uint8_t x2;
+	uint8_t y2;
+} lcd_rect_t;
+
+static lcd_rect_t m_dirty_rects[LCD_DIRTY_RECT_MAX];
+static uint32_t m_dirty_count = 0;
+
+/* Background job (command sequence or flush) owning the SPI bus. It is
+ * advanced from the SPI event handler and, across delays, from the timer. */
+static volatile bool m_lcd_busy = false;
+static bool (*m_job_next)(void);
+static lcd_flush_handler_t m_job_handler = NULL;
+static app_timer_id_t m_lcd_timer_id;
+
+static uint8_t const * m_p_seq;
+static uint8_t const * m_p_seq_pending;   /* Waiting for the bus, see lcd_seq_request(). */
+static bool m_seq_data_phase;
+static uint8_t m_seq_buf[LCD_SEQ_DATA_MAX];   /* EasyDMA cannot read flash. */
+
+static lcd_rect_t m_flush_rects[LCD_DIRTY_RECT_MAX];
+static uint32_t m_flush_count;
+static uint32_t m_flush_index;
+static uint8_t m_window_cmd[9];
+static uint32_t m_window_pos;
+static int32_t m_flush_row;
+static uint8_t const * m_p_flush_src;   /* Holds rows from m_flush_src_row on. */
+static uint32_t m_flush_src_row;
+
+static const uint8_t m_lcd_init_seq[] = {
+	LCD_SEQ_RESET, 0,
+	LCD_SEQ_DELAY, 100,
+	LCD_SEQ_RESET, 1,
+	LCD_SEQ_DELAY, 100,
+	LCD_CMD(0x01, 0x00), /* SET SOFT RESET */
+	LCD_CMD(0x14, 0x00), /* STANDBY ON/OFF */
+	LCD_CMD(0x02, 0x00), /* DISPLAY ON/OFF */
+	LCD_CMD(0x0F, 0x40), /* Set ANALOG_CONTROL */
+	LCD_CMD(0x1A, 0x03), /* OSC ADJUST */
+	LCD_CMD_RUN(0x38, 2, 0x00, 0x00), /*DISPLAY START X, Y */
+	LCD_CMD_RUN(0xE0, 2, 0x00, 0x00), /*RGB IF, Set RGB_POL*/
+	LCD_CMD(0xE5, 0x00), /*DISPLAY MODE CONTROL*/ /*Swap RGB*/
+	LCD_CMD(0x0D, 0x00), /* CPU IF */
+	LCD_CMD(0x1D, 0x00), /* Set MEMORY_WRITE/READ */ /* 0x03 */
+	LCD_CMD(0x09, 0x00), /* Set ROW_SCAN_DIRECTION */ /* 0x02 */
+	LCD_CMD(0x13, 0x00), /* Set ROW_SCAN_MODE */
+	LCD_CMD_RUN(0x40, 3, 0x7F, 0x65, 0x7B), /*COLUMN CURRENT R, G, B */
+	LCD_CMD(0x48, 0x03), /*ROW OVERLAP */
+	LCD_CMD(0x18, 0x03), /* DISCHARGE TIME */
+	LCD_CMD(0x16, 0x00), /*PEAK PULSE DELAY */
+	LCD_CMD_RUN(0x3A, 6,
+	            0x03, 0x03, 0x03,  /*PEAK PULSE WIDTH R, G, B */
+	            0x09, 0x09, 0x08), /*PRECHARGE CURRENT R, G, B */
+	LCD_CMD(0x17, 0x00), /*Set ROW_SCAN_ON/OFF */
+	LCD_CMD(0x49, 0x0F), /*SCAN OFF LEVEL */
+	LCD_CMD_RUN(0x30, 4, 0x00, 0x5F, 0x00, 0x5F), /* Set DISPLAY_X1, X2, Y1, Y2 */
+	LCD_CMD(0x02, 0x01), /*DISPLAY ON*/
+	LCD_SEQ_FLUSH,
+	LCD_SEQ_END
+};
+
+static const uint8_t m_lcd_sleep_seq[] = {
+	LCD_CMD(0x02, 0x00), /* DISPLAY ON/OFF */
+	LCD_CMD(0x14, 0x01), /* STANDBY ON/ON */
+	LCD_SEQ_END
+};
+
+static const uint8_t m_lcd_wakeup_seq[] = {
+	LCD_CMD(0x14, 0x00), /* STANDBY ON/OFF */
+	LCD_CMD(0x02, 0x01), /*DISPLAY ON/ON*/
+	LCD_SEQ_END
+};
+
 static void lcd_clear(uint16_t color);
+static bool lcd_flush_next(void);
+static void lcd_flush_load_window(void);
+static void lcd_seq_pending_start(void);
+
+/* Runs the next step of the current job; ends the job and calls its
+ * handler once the job has nothing more to send. */
+static void lcd_job_advance(void)
+{
+	lcd_flush_handler_t handler;
+
+	if(m_job_next()) {
+		return;
+	}
+	handler = m_job_handler;
+	m_lcd_busy = false;
+	if(handler != NULL) {
+		handler();
+	}
+	lcd_seq_pending_start();
+}
+
+static bool lcd_job_claim(void)
+{
+	bool busy;
+
+	CRITICAL_REGION_ENTER();
+	busy = m_lcd_busy;
+	m_lcd_busy = true;
+	CRITICAL_REGION_EXIT();
+
+	return !busy;
+}
+
+static void lcd_job_start(bool (*next)(void), lcd_flush_handler_t handler)
+{
+	m_job_next = next;
+	m_job_handler = handler;
+	lcd_job_advance();
+}
+
+static void lcd_timer_handler(void * p_context)
+{
+	lcd_job_advance();
+}
 
 static void lcd_spi_master_event_handler(nrf_drv_spi_event_t event)
 {
 	switch(event) {
 		case NRF_DRV_SPI_EVENT_DONE:
-			m_lcd_transfer_completed = true;
+			if(m_lcd_busy) {
+				lcd_job_advance();
+			}
 			break;
 		default:
 			// No implementation needed.
@@ -87,192 +237,520 @@ static void lcd_spi_master_init(void)
 	APP_ERROR_CHECK(err_code);
 }
 
-static void write_c(uint8_t cmd)
+static void lcd_seq_transfer(uint8_t length)
 {
 	uint32_t err_code;
 
-	while(!m_lcd_transfer_completed);
-	LCD_SPI_A0_LOW();
-	m_lcd_transfer_completed = false;
 	err_code = nrf_drv_spi_transfer(&m_lcd_spi_master,
-	                                &cmd, 1, NULL, 0);
+	                                m_seq_buf, length, NULL, 0);
 	APP_ERROR_CHECK(err_code);
 }
-static void write_d(uint8_t data)
+
+/* Each command goes out as two transfers: the command byte with A0 low,
+ * then all of its data bytes in one transfer with A0 high. */
+static bool lcd_seq_next(void)
 {
 	uint32_t err_code;
+	uint8_t length;
 
-	while(!m_lcd_transfer_completed);
-	LCD_SPI_A0_HIGH();
-	m_lcd_transfer_completed = false;
-	err_code = nrf_drv_spi_transfer(&m_lcd_spi_master,
-	                                &data, 1, NULL, 0);
-	APP_ERROR_CHECK(err_code);
+	for(;;) {
+		switch(m_p_seq[0]) {
+			case LCD_SEQ_END:
+				return false;
+			case LCD_SEQ_DELAY:
+				err_code = app_timer_start(m_lcd_timer_id,
+				                           APP_TIMER_TICKS(m_p_seq[1], LCD_APP_TIMER_PRESCALER),
+				                           NULL);
+				APP_ERROR_CHECK(err_code);
+				m_p_seq += 2;
+				return true;
+			case LCD_SEQ_RESET:
+				if(m_p_seq[1]) {
+					LCD_RESET_HIGH();
+				} else {
+					LCD_RESET_LOW();
+				}
+				m_p_seq += 2;
+				break;
+			case LCD_SEQ_FLUSH:
+				m_p_seq++;
+				m_flush_rects[0].x1 = 0;
+				m_flush_rects[0].y1 = 0;
+				m_flush_rects[0].x2 = LCD_WITH-1;
+				m_flush_rects[0].y2 = LCD_HIGHT-1;
+				m_flush_count = 1;
+				m_flush_index = 0;
+				m_p_flush_src = m_p_draw_buffer;
+				m_flush_src_row = 0;
+				lcd_flush_load_window();
+				m_job_next = lcd_flush_next;
+				return lcd_flush_next();
+			default:
+				length = m_p_seq[0];
+				if(!m_seq_data_phase) {
+					LCD_SPI_A0_LOW();
+					m_seq_buf[0] = m_p_seq[1];
+					if(length > 0) {
+						m_seq_data_phase = true;
+					} else {
+						m_p_seq += 2;
+					}
+					lcd_seq_transfer(1);
+					return true;
+				}
+				LCD_SPI_A0_HIGH();
+				memcpy(m_seq_buf, &m_p_seq[2], length);
+				m_p_seq += 2+length;
+				m_seq_data_phase = false;
+				lcd_seq_transfer(length);
+				return true;
+		}
+	}
+}
+
+static uint32_t lcd_seq_start(uint8_t const * p_seq, lcd_flush_handler_t handler)
+{
+	if(!lcd_job_claim()) {
+		return NRF_ERROR_BUSY;
+	}
+	m_p_seq = p_seq;
+	m_seq_data_phase = false;
+	lcd_job_start(lcd_seq_next, handler);
+
+	return NRF_SUCCESS;
 }
 
+/* Starts the sequence lcd_seq_request() left waiting, unless a job has
+ * claimed the bus meanwhile; the end of that job tries again. */
+static void lcd_seq_pending_start(void)
+{
+	uint8_t const * p_seq = NULL;
+
+	CRITICAL_REGION_ENTER();
+	if(!m_lcd_busy && m_p_seq_pending != NULL) {
+		p_seq = m_p_seq_pending;
+		m_p_seq_pending = NULL;
+		m_lcd_busy = true;
+	}
+	CRITICAL_REGION_EXIT();
+
+	if(p_seq != NULL) {
+		m_p_seq = p_seq;
+		m_seq_data_phase = false;
+		lcd_job_start(lcd_seq_next, NULL);
+	}
+}
+
+/* Runs the sequence now, or as soon as the job holding the bus ends, so it
+ * may be asked for from any interrupt. Only the latest request waits: a
+ * sleep followed by a wakeup leaves the wakeup. */
+static void lcd_seq_request(uint8_t const * p_seq)
+{
+	CRITICAL_REGION_ENTER();
+	m_p_seq_pending = p_seq;
+	CRITICAL_REGION_EXIT();
+
+	lcd_seq_pending_start();
+}
+
+/* Waits for the bus in thread mode only. From an interrupt at or above the
+ * SPI priority the job could never finish, so the caller gets
+ * NRF_ERROR_BUSY instead. */
+static uint32_t lcd_job_wait(void)
+{
+	if(current_int_priority_get() == NRF_APP_PRIORITY_THREAD) {
+		while(m_lcd_busy);
+	}
+
+	return m_lcd_busy ? NRF_ERROR_BUSY : NRF_SUCCESS;
+}
+
+/* Power-up runs in the background: the reset pulse and the register
+ * sequence are paced by the SPI events and m_lcd_timer_id, so BLE and
+ * sensor init proceed meanwhile. Blocking calls wait for it to finish. */
 void lcd_init(void)
 {
+	uint32_t err_code;
+
 	lcd_spi_master_init();
-    LCD_ENABLE_PIN_CONFIG();
+	err_code = app_timer_create(&m_lcd_timer_id,
+	                            APP_TIMER_MODE_SINGLE_SHOT,
+	                            lcd_timer_handler);
+	APP_ERROR_CHECK(err_code);
+	LCD_ENABLE_PIN_CONFIG();
 	LCD_ENABLE_HIGH();
 	LCD_A0_PIN_CONFIG();
 	LCD_RESET_PIN_CONFIG();
-	LCD_RESET_LOW();
-	nrf_delay_ms(100);
-	LCD_RESET_HIGH();
-	nrf_delay_ms(100);
-	write_c(0x01); /* SET SOFT RESET */
-	write_d(0x00);
-	write_c(0x14); /* STANDBY ON/OFF */
-	write_d(0x00);
-	write_c(0x02); /* DISPLAY ON/OFF */
-	write_d(0x00);
-	write_c(0x0F); /* Set ANALOG_CONTROL */
-	write_d(0x40);
-	write_c(0x1A); /* OSC ADJUST */
-	write_d(0x03);
-	write_c(0x38); /*DISPLAY START */
-	write_d(0x00);
-	write_c(0x39);
-	write_d(0x00);
-	write_c(0xE0); /*RGB IF*/
-	write_d(0x00);
-	write_c(0xE1); /*Set RGB_POL*/
-	write_d(0x00);
-	write_c(0xE5); /*DISPLAY MODE CONTROL*/
-	//write_d(0x00);
-	write_d(0x00); /*Swap RGB*/
-	write_c(0x0D); /* CPU IF */
-	write_d(0x00);
-	write_c(0x1D); /* Set MEMORY_WRITE/READ */
-	write_d(0x00); /* 0x03 */
-	write_c(0x09); /* Set ROW_SCAN_DIRECTION */
-	write_d(0x00); /* 0x02 */
-	write_c(0x13); /* Set ROW_SCAN_MODE */
-	write_d(0x00);
-	write_c(0x40); /*COLUMN CURRENT R */
-	write_d(0x7F);
-	write_c(0x41); /*COLUMN CURRENT G */
-	write_d(0x65);
-	write_c(0x42); /*COLUMN CURRENT B*/
-	write_d(0x7B);
-	write_c(0x48); /*ROW OVERLAP */
-	write_d(0x03);
-	write_c(0x18); /* DISCHARGE TIME */
-	write_d(0x03);
-	write_c(0x16); /*PEAK PULSE DELAY */
-	write_d(0x00);
-	write_c(0x3A); /*PEAK PULSE WIDTH R */
-	write_d(0x03);
-	write_c(0x3B); /*PEAK PULSE WIDTH G */
-	write_d(0x03);
-	write_c(0x3C); /*PEAK PULSE WIDTH B */
-	write_d(0x03);
-	write_c(0x3D); /*PRECHARGE CURRENT R*/
-	write_d(0x09);
-	write_c(0x3E); /*PRECHARGE CURRENT G */
-	write_d(0x09);
-	write_c(0x3F); /*PRECHARGE CURRENT B */
-	write_d(0x08);
-	write_c(0x17); /*Set ROW_SCAN_ON/OFF */
-	write_d(0x00);
-	write_c(0x49); /*SCAN OFF LEVEL */
-	write_d(0x0F);
-	write_c(0x30); /* Set DISPLAY_X1 */
-	write_d(0x00);
-	write_c(0x31); /* Set DISPLAY_X2 */
-	write_d(0x5F);
-	write_c(0x32); /* Set DISPLAY_Y1 */
-	write_d(0x00);
-	write_c(0x33); /* Set DISPLAY_Y2 */
-	write_d(0x5F);
-	write_c(0x02); /*DISPLAY ON*/
-	write_d(0x01);
 	lcd_clear(0x07ff);
+	err_code = lcd_seq_start(m_lcd_init_seq, NULL);
+	APP_ERROR_CHECK(err_code);
 }
 
 void lcd_sleep(void)
 {
-	write_c(0x02); /* DISPLAY ON/OFF */
-	write_d(0x00);
-	write_c(0x14); /* STANDBY ON/ON */
-	write_d(0x01);
+	lcd_seq_request(m_lcd_sleep_seq);
 }
 
 void lcd_wakeup(void)
 {
-	write_c(0x14); /* STANDBY ON/OFF */
-	write_d(0x00);
-	write_c(0x02); /*DISPLAY ON/ON*/
-	write_d(0x01);
+	lcd_seq_request(m_lcd_wakeup_seq);
 }
 
 uint8_t* lcd_get_buffer_address(void)
 {
-	return m_lcd_buffer;
+	return m_p_draw_buffer;
+}
+
+/* Controller rows run opposite to the framebuffer: buffer row 0 is the last
+ * row the controller scans, so a window is streamed from its bottom buffer
+ * row upwards and its MEM_Y limits are mirrored. */
+#define LCD_MEM_ROW(y)  ((LCD_HIGHT-1)-(y))
+
+static void lcd_flush_load_window(void)
+{
+	lcd_rect_t const * p_rect = &m_flush_rects[m_flush_index];
+
+	m_window_cmd[0] = 0x34; /* MEM_X1 */
+	m_window_cmd[1] = p_rect->x1;
+	m_window_cmd[2] = 0x35; /* MEM_X2 */
+	m_window_cmd[3] = p_rect->x2;
+	m_window_cmd[4] = 0x36; /* MEM_Y1 */
+	m_window_cmd[5] = LCD_MEM_ROW(p_rect->y2);
+	m_window_cmd[6] = 0x37; /* MEM_Y2 */
+	m_window_cmd[7] = LCD_MEM_ROW(p_rect->y1);
+	m_window_cmd[8] = 0x08; /*memory access*/
+	m_window_pos = 0;
+	m_flush_row = p_rect->y2;
 }
 
-static void lcd_memory_access(uint8_t const * p_tx_buffer,
-                              uint8_t tx_buffer_length)
+/* Starts the next transfer of the flush in progress. Window commands go out
+ * one byte at a time because A0 changes between them; pixel rows go out as
+ * one transfer each. Returns false once every window has been sent. */
+static bool lcd_flush_next(void)
 {
 	uint32_t err_code;
+	lcd_rect_t const * p_rect;
+	uint8_t const * p_tx;
+	uint8_t length;
 
-	while(!m_lcd_transfer_completed);
-	LCD_SPI_A0_HIGH();
-	m_lcd_transfer_completed = false;
+	if(m_window_pos < sizeof(m_window_cmd)) {
+		if(m_window_pos & 0x01) {
+			LCD_SPI_A0_HIGH();
+		} else {
+			LCD_SPI_A0_LOW();
+		}
+		p_tx = &m_window_cmd[m_window_pos++];
+		length = 1;
+	} else {
+		p_rect = &m_flush_rects[m_flush_index];
+		if(m_flush_row < p_rect->y1) {
+			if(++m_flush_index >= m_flush_count) {
+				return false;
+			}
+			lcd_flush_load_window();
+			return lcd_flush_next();
+		}
+		LCD_SPI_A0_HIGH();
+		p_tx = m_p_flush_src+((m_flush_row-m_flush_src_row)*LCD_WITH+p_rect->x1)*LCD_COLOR_DEEP;
+		length = (p_rect->x2-p_rect->x1+1)*LCD_COLOR_DEEP;
+		m_flush_row--;
+	}
 	err_code = nrf_drv_spi_transfer(&m_lcd_spi_master,
-	                                p_tx_buffer, tx_buffer_length, NULL, 0);
+	                                p_tx, length, NULL, 0);
 	APP_ERROR_CHECK(err_code);
+
+	return true;
 }
 
-void lcd_display(uint8_t startx,
-                 uint8_t starty,
-                 uint8_t endx,
-                 uint8_t endy)
+static uint32_t lcd_flush_start(lcd_rect_t const * p_rects,
+                                uint32_t count,
+                                uint8_t const * p_src,
+                                uint32_t src_row,
+                                lcd_flush_handler_t handler)
 {
-#if 0
-	uint32_t i;
-	uint32_t j;
+	if(!lcd_job_claim()) {
+		return NRF_ERROR_BUSY;
+	}
+	if(count == 0) {
+		m_lcd_busy = false;
+		if(handler != NULL) {
+			handler();
+		}
+		return NRF_SUCCESS;
+	}
+
+	memcpy(m_flush_rects, p_rects, count*sizeof(lcd_rect_t));
+	m_flush_count = count;
+	m_flush_index = 0;
+	m_p_flush_src = p_src;
+	m_flush_src_row = src_row;
+	lcd_flush_load_window();
+	lcd_job_start(lcd_flush_next, handler);
+
+	return NRF_SUCCESS;
+}
 
-	if(startx < LCD_WITH &&
-	   endx < LCD_WITH &&
-	   starty < LCD_HIGHT &&
-	   endy < LCD_HIGHT) {
-#if 0
-		write_c(0x34); /* MEM_X1 */
-		write_d(startx);
-		write_c(0x35); /* MEM_X2 */
-		write_d(endx);
-		write_c(0x36); /* MEM_Y1 */
-		write_d(starty);
-		write_c(0x37); /* MEM_Y2 */
-		write_d(endy);
-		write_c(0x08); /*memory access*/
+bool lcd_is_busy(void)
+{
+	return m_lcd_busy;
+}
+
+uint32_t lcd_display_async(uint8_t startx,
+                           uint8_t starty,
+                           uint8_t endx,
+                           uint8_t endy,
+                           lcd_flush_handler_t handler)
+{
+#if (LCD_BUFFER_MODE != LCD_BUFFER_DOUBLE)
+	lcd_rect_t rect;
 #endif
-		write_c(0x08); /*memory access*/
-		for(i=0; i<(sizeof(m_lcd_buffer)/2); i++) {
-			write_d(0xf8);
-			write_d(0x00);
-		}
-		for(i=0; i<(sizeof(m_lcd_buffer)/2); i++) {
-			write_d(0x07);
-			write_d(0xe0);
+
+	if(startx > endx || endx >= LCD_WITH ||
+	   starty > endy || endy >= LCD_HIGHT) {
+		return NRF_ERROR_INVALID_PARAM;
+	}
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+	/* Streaming the draw buffer directly would leave the region out of
+	 * the back buffer lcd_present() swaps in next. */
+	lcd_invalidate(startx, starty, endx, endy);
+	return lcd_present(handler);
+#else
+	rect.x1 = startx;
+	rect.y1 = starty;
+	rect.x2 = endx;
+	rect.y2 = endy;
+
+	return lcd_flush_start(&rect, 1, m_p_draw_buffer, 0, handler);
+#endif
+}
+
+uint32_t lcd_display(uint8_t startx,
+                     uint8_t starty,
+                     uint8_t endx,
+                     uint8_t endy)
+{
+	uint32_t err_code;
+
+	err_code = lcd_job_wait();
+	if(err_code == NRF_SUCCESS) {
+		err_code = lcd_display_async(startx, starty, endx, endy, NULL);
+	}
+	if(err_code == NRF_SUCCESS) {
+		(void)lcd_job_wait();
+	}
+
+	return err_code;
+}
+
+static uint32_t lcd_rect_area(lcd_rect_t const * p_rect)
+{
+	return (uint32_t)(p_rect->x2-p_rect->x1+1)*(p_rect->y2-p_rect->y1+1);
+}
+
+static void lcd_rect_union(lcd_rect_t * p_dst, lcd_rect_t const * p_src)
+{
+	p_dst->x1 = MIN(p_dst->x1, p_src->x1);
+	p_dst->y1 = MIN(p_dst->y1, p_src->y1);
+	p_dst->x2 = MAX(p_dst->x2, p_src->x2);
+	p_dst->y2 = MAX(p_dst->y2, p_src->y2);
+}
+
+/* Two regions are worth merging when they touch or overlap, or when the
+ * bounding box costs no more pixels than streaming both separately (each
+ * window also costs nine command transfers). */
+static bool lcd_rect_should_merge(lcd_rect_t const * p_a, lcd_rect_t const * p_b)
+{
+	lcd_rect_t u = *p_a;
+
+	if(p_a->x1 <= p_b->x2+1 && p_b->x1 <= p_a->x2+1 &&
+	   p_a->y1 <= p_b->y2+1 && p_b->y1 <= p_a->y2+1) {
+		return true;
+	}
+	lcd_rect_union(&u, p_b);
+	return lcd_rect_area(&u) <= lcd_rect_area(p_a)+lcd_rect_area(p_b);
+}
+
+void lcd_invalidate(uint8_t startx,
+                    uint8_t starty,
+                    uint8_t endx,
+                    uint8_t endy)
+{
+	lcd_rect_t rect;
+	lcd_rect_t u;
+	uint32_t i;
+	uint32_t best;
+	uint32_t best_cost;
+	uint32_t cost;
+
+	if(startx > endx || starty > endy ||
+	   startx >= LCD_WITH || starty >= LCD_HIGHT) {
+		return;
+	}
+	rect.x1 = startx;
+	rect.y1 = starty;
+	rect.x2 = MIN(endx, LCD_WITH-1);
+	rect.y2 = MIN(endy, LCD_HIGHT-1);
+
+	/* Absorb every tracked region the new one should merge with; a grown
+	 * rectangle may now reach regions it did not touch before. */
+	i = 0;
+	while(i < m_dirty_count) {
+		if(lcd_rect_should_merge(&rect, &m_dirty_rects[i])) {
+			lcd_rect_union(&rect, &m_dirty_rects[i]);
+			m_dirty_rects[i] = m_dirty_rects[--m_dirty_count];
+			i = 0;
+		} else {
+			i++;
 		}
-		for(i=0; i<(sizeof(m_lcd_buffer)/2); i++) {
-			write_d(0x00);
-			write_d(0x1f);
+	}
+	if(m_dirty_count < LCD_DIRTY_RECT_MAX) {
+		m_dirty_rects[m_dirty_count++] = rect;
+		return;
+	}
+
+	/* Table full: fold into the region whose bounding box grows least. */
+	best = 0;
+	best_cost = UINT32_MAX;
+	for(i=0; i<m_dirty_count; i++) {
+		u = m_dirty_rects[i];
+		lcd_rect_union(&u, &rect);
+		cost = lcd_rect_area(&u)-lcd_rect_area(&m_dirty_rects[i]);
+		if(cost < best_cost) {
+			best_cost = cost;
+			best = i;
 		}
 	}
+	lcd_rect_union(&m_dirty_rects[best], &rect);
+}
+
+uint32_t lcd_refresh_async(lcd_flush_handler_t handler)
+{
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+	/* The dirty rects also bring the other buffer up to date, only
+	 * lcd_present() may consume them. */
+	return lcd_present(handler);
 #else
-	int32_t i;
+	uint32_t err_code;
 
-	write_c(0x08); /*memory access*/
-	for(i=LCD_HIGHT-1; i>=0; i--) {
-		lcd_memory_access(m_lcd_buffer+i*LCD_WITH*2, LCD_WITH*2);
+	err_code = lcd_flush_start(m_dirty_rects, m_dirty_count,
+	                           m_p_draw_buffer, 0, handler);
+	if(err_code == NRF_SUCCESS) {
+		m_dirty_count = 0;
 	}
+
+	return err_code;
 #endif
 }
 
+bool lcd_buffer_in_use(void)
+{
+	return m_lcd_busy && m_p_flush_src == m_p_draw_buffer;
+}
+
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+static void lcd_copy_rect(uint8_t * p_dst,
+                          uint8_t const * p_src,
+                          lcd_rect_t const * p_rect)
+{
+	uint32_t y;
+	uint32_t offset;
+	uint32_t length;
+
+	length = (p_rect->x2-p_rect->x1+1)*LCD_COLOR_DEEP;
+	for(y=p_rect->y1; y<=p_rect->y2; y++) {
+		offset = (y*LCD_WITH+p_rect->x1)*LCD_COLOR_DEEP;
+		memcpy(p_dst+offset, p_src+offset, length);
+	}
+}
+#endif
+
+uint32_t lcd_present(lcd_flush_handler_t handler)
+{
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+	uint32_t err_code;
+	uint32_t i;
+	uint8_t * p_tmp;
+
+	if(m_lcd_busy) {
+		return NRF_ERROR_BUSY;
+	}
+
+	/* Swap under the lock so an interrupt never sees both pointers naming
+	 * the same buffer, then stream the new front in the background. */
+	CRITICAL_REGION_ENTER();
+	p_tmp = m_p_front_buffer;
+	m_p_front_buffer = m_p_draw_buffer;
+	m_p_draw_buffer = p_tmp;
+	CRITICAL_REGION_EXIT();
+
+	err_code = lcd_flush_start(m_dirty_rects, m_dirty_count,
+	                           m_p_front_buffer, 0, handler);
+	if(err_code != NRF_SUCCESS) {
+		return err_code;
+	}
+
+	/* Bring the new back buffer up to date with what was just presented;
+	 * both buffers are only read here, so this overlaps the flush. */
+	for(i=0; i<m_dirty_count; i++) {
+		lcd_copy_rect(m_p_draw_buffer, m_p_front_buffer, &m_dirty_rects[i]);
+	}
+	m_dirty_count = 0;
+
+	return NRF_SUCCESS;
+#elif (LCD_BUFFER_MODE == LCD_BUFFER_STRIPE)
+	uint32_t err_code;
+	uint32_t i;
+	uint32_t first;
+	uint32_t last;
+
+	if(m_lcd_busy) {
+		return NRF_ERROR_BUSY;
+	}
+	if(m_dirty_count == 0) {
+		return lcd_refresh_async(handler);
+	}
+
+	first = LCD_HIGHT-1;
+	last = 0;
+	for(i=0; i<m_dirty_count; i++) {
+		first = MIN(first, m_dirty_rects[i].y1);
+		last = MAX(last, m_dirty_rects[i].y2);
+	}
+	if(last-first+1 > LCD_STRIPE_ROWS) {
+		/* Damage spans more rows than the snapshot holds: stream straight
+		 * from the draw buffer, lcd_buffer_in_use() reports it busy. */
+		return lcd_refresh_async(handler);
+	}
+
+	memcpy(m_lcd_stripe, m_lcd_buffer+first*LCD_WITH*LCD_COLOR_DEEP,
+	       (last-first+1)*LCD_WITH*LCD_COLOR_DEEP);
+	err_code = lcd_flush_start(m_dirty_rects, m_dirty_count,
+	                           m_lcd_stripe, first, handler);
+	if(err_code == NRF_SUCCESS) {
+		m_dirty_count = 0;
+	}
+
+	return err_code;
+#else
+	return lcd_refresh_async(handler);
+#endif
+}
+
+uint32_t lcd_refresh(void)
+{
+	uint32_t err_code;
+
+	err_code = lcd_job_wait();
+	if(err_code == NRF_SUCCESS) {
+		err_code = lcd_refresh_async(NULL);
+	}
+	if(err_code == NRF_SUCCESS) {
+		(void)lcd_job_wait();
+	}
+
+	return err_code;
+}
+
 static void lcd_clear(uint16_t color)
 {
 	uint32_t i;
@@ -288,5 +766,7 @@ static void lcd_clear(uint16_t color)
 		m_lcd_buffer[i+1] = tmp & 0xff;
 		m_lcd_buffer[i] = (tmp>>8) & 0xff;
 	}
-	lcd_display(0, LCD_WITH-1, 0, LCD_HIGHT-1);
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+	memcpy(m_lcd_buffer2, m_lcd_buffer, sizeof(m_lcd_buffer2));
+#endif
 }
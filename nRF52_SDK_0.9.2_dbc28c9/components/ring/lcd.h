@@ -1,18 +1,68 @@
 #ifndef LCD_H__
 #define LCD_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define LCD_WITH 96
 #define LCD_HIGHT 96
 #define LCD_COLOR_DEEP 2
 #define LCD_BUFFER_SIZE (LCD_WITH*LCD_HIGHT*LCD_COLOR_DEEP)
 
+/* App timers lcd_init() creates, to be counted in APP_TIMER_MAX_TIMERS. */
+#define LCD_APP_TIMERS 1
+
+/* Number of separate damaged regions tracked between two refreshes. When
+ * more regions are reported they are merged into their cheapest neighbour. */
+#define LCD_DIRTY_RECT_MAX 4
+
+/* Framebuffer modes, selected at build time through LCD_BUFFER_MODE:
+ *  SINGLE - one buffer; drawing while a flush runs may tear.
+ *  DOUBLE - a second full buffer (+18 KB); lcd_present() swaps them and the
+ *           UI draws the next frame while the previous one is streamed.
+ *           lcd_refresh_async() and lcd_display_async() present as well.
+ *  STRIPE - a LCD_STRIPE_ROWS high snapshot (+192 bytes per row);
+ *           lcd_present() copies only the dirty rows and streams the copy. */
+#define LCD_BUFFER_SINGLE 0
+#define LCD_BUFFER_DOUBLE 1
+#define LCD_BUFFER_STRIPE 2
+
+#ifndef LCD_BUFFER_MODE
+#define LCD_BUFFER_MODE LCD_BUFFER_SINGLE
+#endif
+
+#ifndef LCD_STRIPE_ROWS
+#define LCD_STRIPE_ROWS 24
+#endif
+
+/* Called from the SPI interrupt when a background flush has been sent. */
+typedef void (*lcd_flush_handler_t)(void);
+
 void lcd_init(void);
+/* Queued behind a running flush or sequence, safe from any interrupt. */
 void lcd_sleep(void);
 void lcd_wakeup(void);
 uint8_t* lcd_get_buffer_address(void);
-void lcd_display(uint8_t startx,
-                 uint8_t starty,
-                 uint8_t endx,
-                 uint8_t endy);
+/* Blocking flushes: in thread mode they wait for the bus and for their own
+ * flush. From an interrupt they only start the flush, or return
+ * NRF_ERROR_BUSY while the bus is taken. */
+uint32_t lcd_display(uint8_t startx,
+                     uint8_t starty,
+                     uint8_t endx,
+                     uint8_t endy);
+void lcd_invalidate(uint8_t startx,
+                    uint8_t starty,
+                    uint8_t endx,
+                    uint8_t endy);
+uint32_t lcd_refresh(void);
+bool lcd_is_busy(void);
+uint32_t lcd_display_async(uint8_t startx,
+                           uint8_t starty,
+                           uint8_t endx,
+                           uint8_t endy,
+                           lcd_flush_handler_t handler);
+uint32_t lcd_refresh_async(lcd_flush_handler_t handler);
+uint32_t lcd_present(lcd_flush_handler_t handler);
+bool lcd_buffer_in_use(void);
 
 #endif /* LCD_H__ */
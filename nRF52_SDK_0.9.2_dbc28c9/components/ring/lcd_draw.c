@@ -0,0 +1,247 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "nrf.h"
+#include "nordic_common.h"
+
+#include "lcd.h"
+#include "lcd_draw.h"
+
+typedef struct {
+	int16_t x1;
+	int16_t y1;
+	int16_t x2;
+	int16_t y2;
+} lcd_draw_clip_t;
+
+/* The controller takes RGB565 bit-reversed and high byte first, so a
+ * framebuffer halfword is the byte-swapped bit reverse of the color. */
+static uint16_t lcd_draw_encode(uint16_t color)
+{
+	return (uint16_t)__REV16(__RBIT(color) >> 16);
+}
+
+static uint16_t * lcd_draw_pixel_address(int16_t x, int16_t y)
+{
+	return (uint16_t *)lcd_get_buffer_address()+(uint32_t)y*LCD_WITH+x;
+}
+
+/* Clips the box at (x, y) of size w x h to the screen. Returns false when
+ * nothing is left to draw. */
+static bool lcd_draw_clip(int16_t x, int16_t y, int16_t w, int16_t h,
+                          lcd_draw_clip_t * p_clip)
+{
+	if(w <= 0 || h <= 0) {
+		return false;
+	}
+	p_clip->x1 = MAX(x, 0);
+	p_clip->y1 = MAX(y, 0);
+	p_clip->x2 = MIN(x+w-1, LCD_WITH-1);
+	p_clip->y2 = MIN(y+h-1, LCD_HIGHT-1);
+
+	return p_clip->x1 <= p_clip->x2 && p_clip->y1 <= p_clip->y2;
+}
+
+static void lcd_draw_invalidate(lcd_draw_clip_t const * p_clip)
+{
+	lcd_invalidate(p_clip->x1, p_clip->y1, p_clip->x2, p_clip->y2);
+}
+
+/* Fills count pixels with halfword stores only at the unaligned edges and
+ * two pixels per word store, unrolled by four, in between. */
+static void lcd_draw_span(uint16_t * p_dst, uint32_t count, uint16_t pixel)
+{
+	uint32_t * p_word;
+	uint32_t pattern;
+
+	if(((uintptr_t)p_dst & 0x02) && count) {
+		*p_dst++ = pixel;
+		count--;
+	}
+	p_word = (uint32_t *)p_dst;
+	pattern = __PKHBT(pixel, pixel, 16);
+	while(count >= 8) {
+		p_word[0] = pattern;
+		p_word[1] = pattern;
+		p_word[2] = pattern;
+		p_word[3] = pattern;
+		p_word += 4;
+		count -= 8;
+	}
+	while(count >= 2) {
+		*p_word++ = pattern;
+		count -= 2;
+	}
+	if(count) {
+		*(uint16_t *)p_word = pixel;
+	}
+}
+
+void lcd_draw_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+	lcd_draw_clip_t clip;
+	uint16_t pixel;
+	uint16_t * p_dst;
+	uint32_t width;
+	int16_t row;
+
+	if(!lcd_draw_clip(x, y, w, h, &clip)) {
+		return;
+	}
+	pixel = lcd_draw_encode(color);
+	p_dst = lcd_draw_pixel_address(clip.x1, clip.y1);
+	width = clip.x2-clip.x1+1;
+	if(width == LCD_WITH) {
+		/* Full rows are contiguous: one span for the whole rectangle. */
+		lcd_draw_span(p_dst, width*(clip.y2-clip.y1+1), pixel);
+	} else {
+		for(row=clip.y1; row<=clip.y2; row++) {
+			lcd_draw_span(p_dst, width, pixel);
+			p_dst += LCD_WITH;
+		}
+	}
+	lcd_draw_invalidate(&clip);
+}
+
+static void lcd_draw_pal4(int16_t x, int16_t y,
+                          lcd_bitmap_t const * p_bitmap,
+                          lcd_draw_clip_t const * p_clip,
+                          uint16_t const * p_pixels)
+{
+	uint32_t stride;
+	uint8_t const * p_row;
+	uint16_t * p_dst;
+	uint32_t col;
+	uint8_t index;
+	int16_t row;
+	int16_t px;
+	int16_t y2;
+
+	/* Only rows the data holds in full are drawn. */
+	stride = (p_bitmap->width+1)/2;
+	y2 = MIN(p_clip->y2, y+(int16_t)(p_bitmap->size/stride)-1);
+	for(row=p_clip->y1; row<=y2; row++) {
+		p_row = p_bitmap->p_data+(uint32_t)(row-y)*stride;
+		p_dst = lcd_draw_pixel_address(p_clip->x1, row);
+		for(px=p_clip->x1; px<=p_clip->x2; px++, p_dst++) {
+			col = px-x;
+			index = p_row[col/2];
+			index = (col & 0x01) ? (index & 0x0F) : (index >> 4);
+			if(index != p_bitmap->transparent) {
+				*p_dst = p_pixels[index];
+			}
+		}
+	}
+}
+
+static void lcd_draw_pal4_rle(int16_t x, int16_t y,
+                              lcd_bitmap_t const * p_bitmap,
+                              lcd_draw_clip_t const * p_clip,
+                              uint16_t const * p_pixels)
+{
+	uint8_t const * p_src = p_bitmap->p_data;
+	uint8_t const * p_end = p_bitmap->p_data+p_bitmap->size;
+	uint32_t run;
+	uint32_t seg;
+	uint8_t index;
+	int16_t col = 0;
+	int16_t row = 0;
+	int16_t sx1;
+	int16_t sx2;
+
+	/* Runs wrap across rows, so they are decoded in order and cut into
+	 * per-row segments; only the visible part of a segment is written. */
+	while(row < p_bitmap->height && y+row <= p_clip->y2 && p_src < p_end) {
+		run = (*p_src >> 4)+1;
+		index = *p_src & 0x0F;
+		p_src++;
+		/* A run spilling past the last row is cut there. */
+		while(run && row < p_bitmap->height) {
+			seg = MIN(run, (uint32_t)(p_bitmap->width-col));
+			if(y+row >= p_clip->y1 && y+row <= p_clip->y2 &&
+			   index != p_bitmap->transparent) {
+				sx1 = MAX(x+col, p_clip->x1);
+				sx2 = MIN(x+col+(int16_t)seg-1, p_clip->x2);
+				if(sx1 <= sx2) {
+					lcd_draw_span(lcd_draw_pixel_address(sx1, y+row),
+					              sx2-sx1+1, p_pixels[index]);
+				}
+			}
+			run -= seg;
+			col += seg;
+			if(col == p_bitmap->width) {
+				col = 0;
+				row++;
+			}
+		}
+	}
+}
+
+void lcd_draw_bitmap(int16_t x, int16_t y, lcd_bitmap_t const * p_bitmap)
+{
+	lcd_draw_clip_t clip;
+	uint16_t pixels[16];
+	uint32_t i;
+
+	if(!lcd_draw_clip(x, y, p_bitmap->width, p_bitmap->height, &clip)) {
+		return;
+	}
+	/* Encode the palette once instead of once per pixel. A nibble can
+	 * name all 16 entries, so the ones past the palette are filled too. */
+	for(i=0; i<16; i++) {
+		pixels[i] = (i < p_bitmap->colors) ? lcd_draw_encode(p_bitmap->p_palette[i]) : 0;
+	}
+	if(p_bitmap->format == LCD_BITMAP_PAL4_RLE) {
+		lcd_draw_pal4_rle(x, y, p_bitmap, &clip, pixels);
+	} else {
+		lcd_draw_pal4(x, y, p_bitmap, &clip, pixels);
+	}
+	lcd_draw_invalidate(&clip);
+}
+
+int16_t lcd_draw_char(int16_t x, int16_t y, char c,
+                      lcd_font_t const * p_font, uint16_t color)
+{
+	lcd_glyph_t const * p_glyph;
+	lcd_draw_clip_t clip;
+	uint8_t const * p_row;
+	uint16_t * p_dst;
+	uint16_t pixel;
+	uint32_t stride;
+	uint32_t col;
+	int16_t row;
+	int16_t px;
+
+	if(c < p_font->first || c > p_font->last) {
+		return x;
+	}
+	p_glyph = &p_font->p_glyphs[c-p_font->first];
+	if(!lcd_draw_clip(x, y, p_glyph->width, p_font->height, &clip)) {
+		return x+p_glyph->width;
+	}
+	pixel = lcd_draw_encode(color);
+	stride = (p_glyph->width+7)/8;
+	for(row=clip.y1; row<=clip.y2; row++) {
+		p_row = p_font->p_bitmap+p_glyph->offset+(uint32_t)(row-y)*stride;
+		p_dst = lcd_draw_pixel_address(clip.x1, row);
+		for(px=clip.x1; px<=clip.x2; px++, p_dst++) {
+			col = px-x;
+			if(p_row[col/8] & (0x80 >> (col%8))) {
+				*p_dst = pixel;
+			}
+		}
+	}
+	lcd_draw_invalidate(&clip);
+
+	return x+p_glyph->width;
+}
+
+int16_t lcd_draw_string(int16_t x, int16_t y, char const * p_str,
+                        lcd_font_t const * p_font, uint16_t color)
+{
+	while(*p_str != '\0' && x < LCD_WITH) {
+		x = lcd_draw_char(x, y, *p_str++, p_font, color);
+	}
+
+	return x;
+}
@@ -0,0 +1,59 @@
+#ifndef LCD_DRAW_H__
+#define LCD_DRAW_H__
+
+#include <stdint.h>
+#include "lcd.h"
+
+#define LCD_RGB565(r, g, b) \
+	((uint16_t)((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | (((b) & 0xF8) >> 3)))
+
+/* Palette index that is never drawn, for sprites without transparency. */
+#define LCD_BITMAP_OPAQUE 0xFF
+
+/* Bitmap encodings, both using a palette of up to 16 RGB565 colors:
+ *  PAL4     - two pixels per byte, high nibble first, each row padded to a
+ *             whole byte.
+ *  PAL4_RLE - one byte per run: high nibble is the run length minus one,
+ *             low nibble the palette index. Runs may wrap to the next row.
+ * Indices past the palette draw black; data shorter than the bitmap leaves
+ * the remaining pixels untouched. */
+typedef enum {
+	LCD_BITMAP_PAL4,
+	LCD_BITMAP_PAL4_RLE
+} lcd_bitmap_format_t;
+
+typedef struct {
+	uint8_t width;
+	uint8_t height;
+	uint8_t format;              /* lcd_bitmap_format_t */
+	uint8_t transparent;         /* Palette index to skip, or LCD_BITMAP_OPAQUE. */
+	uint8_t colors;              /* Palette entries, at most 16. */
+	uint16_t const * p_palette;  /* RGB565 colors. */
+	uint8_t const * p_data;
+	uint16_t size;               /* Bytes in p_data. */
+} lcd_bitmap_t;
+
+typedef struct {
+	uint8_t width;               /* Bitmap width and advance in pixels. */
+	uint16_t offset;             /* Byte offset of the glyph in p_bitmap. */
+} lcd_glyph_t;
+
+/* 1 bpp glyphs, rows MSB first and each row padded to a whole byte. */
+typedef struct {
+	uint8_t height;
+	char first;
+	char last;
+	lcd_glyph_t const * p_glyphs;  /* last-first+1 entries. */
+	uint8_t const * p_bitmap;
+} lcd_font_t;
+
+/* All primitives clip to the screen, write straight into the draw buffer in
+ * controller byte order and report the touched area to lcd_invalidate(). */
+void lcd_draw_fill_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+void lcd_draw_bitmap(int16_t x, int16_t y, lcd_bitmap_t const * p_bitmap);
+int16_t lcd_draw_char(int16_t x, int16_t y, char c,
+                      lcd_font_t const * p_font, uint16_t color);
+int16_t lcd_draw_string(int16_t x, int16_t y, char const * p_str,
+                        lcd_font_t const * p_font, uint16_t color);
+
+#endif /* LCD_DRAW_H__ */
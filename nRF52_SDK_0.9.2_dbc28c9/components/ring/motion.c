@@ -0,0 +1,311 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "motion.h"
+
+#if defined(NRF52)
+#include "nrf.h"
+/* Cortex-M4: dual 16-bit multiply-accumulate and saturation. */
+#define MOTION_SIMD
+#endif
+
+/* Decimated samples filtered in one go. */
+#define MOTION_BLOCK               32
+#define MOTION_MS(n)               ((uint32_t)(n)*1000/MOTION_RATE_HZ)
+#define MOTION_SAMPLES(ms)         ((ms)*MOTION_RATE_HZ/1000)
+
+/* The FIFO runs the accelerometer at +-4 g, 8192 LSB per g. The magnitude
+ * is halved on the way into the filters. */
+#define MOTION_1G                  4096
+
+/* Steps: a peak of the low passed magnitude, counted only once a few come
+ * in a walking rhythm so that single bumps stay out. */
+#define MOTION_STEP_THRESHOLD      (MOTION_1G/10)
+#define MOTION_STEP_MIN            MOTION_SAMPLES(250)
+#define MOTION_STEP_MAX            MOTION_SAMPLES(2000)
+#define MOTION_STEP_CONFIRM        4
+
+/* Gestures: the window closes after the signal stays quiet for a while. */
+#define MOTION_GESTURE_THRESHOLD   (MOTION_1G/2)
+#define MOTION_GESTURE_QUIET       MOTION_SAMPLES(150)
+#define MOTION_TAP_MAX             MOTION_SAMPLES(120)
+#define MOTION_SHAKE_MIN           MOTION_SAMPLES(400)
+#define MOTION_SHAKE_SWINGS        4
+
+/* The high pass rings after start-up while it swallows gravity. */
+#define MOTION_SETTLE              MOTION_SAMPLES(3000)
+
+/* RBJ Butterworth sections at 104 Hz, Q14 (post shift 1). The high pass
+ * numerator is trimmed to sum to zero so gravity cancels exactly. */
+static const int16_t m_highpass_coeffs[6] = { 16037, 0, -32074, 16037, 32068, -15699 };	/* 0.5 Hz */
+static const int16_t m_lowpass_coeffs[6] = { 119, 0, 238, 119, 28587, -12680 };		/* 3 Hz */
+
+static motion_evt_handler_t m_handler;
+static motion_summary_t m_summary;
+static motion_biquad_t m_highpass;
+static motion_biquad_t m_lowpass;
+
+static uint16_t m_settle;
+
+/* Decimator */
+static int32_t m_acc_sum[3];
+static uint8_t m_acc_n;
+
+/* Step detector */
+static bool m_step_in_peak;
+static uint16_t m_step_since;      /* Decimated samples since the last step */
+static uint8_t m_step_pending;     /* Steps waiting for the rhythm to be confirmed */
+
+/* Gesture window */
+static bool m_gesture_open;
+static uint16_t m_gesture_len;
+static uint16_t m_gesture_quiet;
+static uint16_t m_gesture_peak;
+static uint8_t m_gesture_swings;
+
+void motion_biquad_init(motion_biquad_t *p_filter, int16_t const *p_coeffs, uint8_t post_shift)
+{
+	p_filter->b0 = p_coeffs[0];
+	p_filter->b = (uint16_t)p_coeffs[2] | ((uint32_t)(uint16_t)p_coeffs[3] << 16);
+	p_filter->a = (uint16_t)p_coeffs[4] | ((uint32_t)(uint16_t)p_coeffs[5] << 16);
+	p_filter->x = 0;
+	p_filter->y = 0;
+	p_filter->err = 0;
+	p_filter->shift = post_shift;
+}
+
+void motion_biquad_run(motion_biquad_t *p_filter, int16_t *p_data, uint16_t n)
+{
+	uint32_t x = p_filter->x;
+	uint32_t y = p_filter->y;
+	uint32_t err = p_filter->err;
+	uint8_t shift = 15-p_filter->shift;
+	int64_t acc;
+	int32_t out;
+	uint16_t i;
+
+	for(i=0; i<n; i++) {
+		/* The bits the last output dropped go into this one: plain
+		 * truncation would pile up through the feedback into a DC
+		 * offset of hundreds of LSB at these low corner frequencies. */
+		acc = (int32_t)p_filter->b0*p_data[i]+(int32_t)err;
+#ifdef MOTION_SIMD
+		acc = (int64_t)__SMLALD(p_filter->b, x, (uint64_t)acc);
+		acc = (int64_t)__SMLALD(p_filter->a, y, (uint64_t)acc);
+		out = __SSAT((int32_t)(acc >> shift), 16);
+#else
+		acc += (int32_t)(int16_t)p_filter->b*(int16_t)x +
+		       (int32_t)(int16_t)(p_filter->b >> 16)*(int16_t)(x >> 16);
+		acc += (int32_t)(int16_t)p_filter->a*(int16_t)y +
+		       (int32_t)(int16_t)(p_filter->a >> 16)*(int16_t)(y >> 16);
+		out = (int32_t)(acc >> shift);
+		out = out > INT16_MAX ? INT16_MAX : out < INT16_MIN ? INT16_MIN : out;
+#endif
+		err = (uint32_t)acc & ((1UL << shift)-1);
+		x = (x << 16) | (uint16_t)p_data[i];
+		y = (y << 16) | (uint16_t)out;
+		p_data[i] = (int16_t)out;
+	}
+	p_filter->x = x;
+	p_filter->y = y;
+	p_filter->err = err;
+}
+
+static uint16_t motion_sqrt(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit;
+
+#ifdef MOTION_SIMD
+	if(value == 0) {
+		return 0;
+	}
+	bit = 1UL << ((31-__CLZ(value)) & ~1UL);
+#else
+	bit = 1UL << 30;
+	while(bit > value) {
+		bit >>= 2;
+	}
+#endif
+	while(bit) {
+		if(value >= root+bit) {
+			value -= root+bit;
+			root = (root >> 1)+bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint16_t)root;
+}
+
+static void motion_emit(motion_evt_t *p_evt)
+{
+	if(m_handler != NULL) {
+		m_handler(p_evt);
+	}
+}
+
+static void motion_step(uint32_t seq, int16_t level)
+{
+	motion_evt_t evt;
+
+	if(m_step_since < UINT16_MAX) {
+		m_step_since++;
+	}
+	if(m_step_since > MOTION_STEP_MAX) {
+		/* Too slow for walking, forget the partial rhythm. */
+		m_step_pending = 0;
+	}
+	if(!m_step_in_peak) {
+		if(level > MOTION_STEP_THRESHOLD && m_step_since >= MOTION_STEP_MIN) {
+			m_step_in_peak = true;
+		}
+		return;
+	}
+	if(level > 0) {
+		return;
+	}
+
+	/* Back through zero: the peak was a step. */
+	m_step_in_peak = false;
+	m_step_since = 0;
+	if(m_step_pending < MOTION_STEP_CONFIRM) {
+		if(++m_step_pending < MOTION_STEP_CONFIRM) {
+			return;
+		}
+		m_summary.steps += m_step_pending;
+	} else {
+		m_summary.steps++;
+	}
+	evt.type = MOTION_EVT_STEP;
+	evt.seq = seq;
+	evt.params.steps = m_summary.steps;
+	motion_emit(&evt);
+}
+
+static void motion_gesture(uint32_t seq, int16_t level)
+{
+	motion_evt_t evt;
+	uint16_t mag = (uint16_t)(level < 0 ? -level : level);
+
+	if(mag > MOTION_GESTURE_THRESHOLD) {
+		if(!m_gesture_open) {
+			m_gesture_open = true;
+			m_gesture_len = 0;
+			m_gesture_peak = 0;
+			m_gesture_swings = 0;
+		}
+		if(m_gesture_quiet || m_gesture_len == 0) {
+			m_gesture_swings++;
+		}
+		if(mag > m_gesture_peak) {
+			m_gesture_peak = mag;
+		}
+		m_gesture_quiet = 0;
+	} else if(!m_gesture_open) {
+		return;
+	}
+	if(m_gesture_len < UINT16_MAX) {
+		m_gesture_len++;
+	}
+	if(mag > MOTION_GESTURE_THRESHOLD || ++m_gesture_quiet < MOTION_GESTURE_QUIET) {
+		return;
+	}
+
+	/* Quiet long enough, the window ends where the motion did. */
+	m_gesture_open = false;
+	m_gesture_len -= MOTION_GESTURE_QUIET;
+	m_summary.active_ms += MOTION_MS(m_gesture_len);
+	/* Arm swings are not steps. */
+	m_step_pending = 0;
+
+	if(m_gesture_len <= MOTION_TAP_MAX) {
+		evt.type = MOTION_EVT_TAP;
+		m_summary.taps++;
+	} else if(m_gesture_len >= MOTION_SHAKE_MIN && m_gesture_swings >= MOTION_SHAKE_SWINGS) {
+		evt.type = MOTION_EVT_SHAKE;
+		m_summary.shakes++;
+	} else {
+		return;
+	}
+	evt.seq = seq;
+	evt.params.gesture.duration_ms = (uint16_t)MOTION_MS(m_gesture_len);
+	evt.params.gesture.peak = m_gesture_peak;
+	evt.params.gesture.swings = m_gesture_swings;
+	motion_emit(&evt);
+}
+
+void motion_init(motion_evt_handler_t handler)
+{
+	m_handler = handler;
+	memset(&m_summary, 0, sizeof(m_summary));
+	motion_biquad_init(&m_highpass, m_highpass_coeffs, 1);
+	motion_biquad_init(&m_lowpass, m_lowpass_coeffs, 1);
+	m_settle = MOTION_SETTLE;
+	memset(m_acc_sum, 0, sizeof(m_acc_sum));
+	m_acc_n = 0;
+	m_step_in_peak = false;
+	m_step_since = 0;
+	m_step_pending = 0;
+	m_gesture_open = false;
+}
+
+void motion_process(uint32_t seq, sensor_sample_t const *p_samples, uint16_t count)
+{
+	int16_t highpass[MOTION_BLOCK];
+	int16_t lowpass[MOTION_BLOCK];
+	uint32_t seqs[MOTION_BLOCK];
+	uint32_t sum;
+	int32_t axis;
+	uint16_t n;
+	uint16_t i;
+	uint8_t k;
+
+	while(count) {
+		/* Decimate and take the magnitude of a block's worth. */
+		n = 0;
+		while(count && n < MOTION_BLOCK) {
+			for(k=0; k<3; k++) {
+				m_acc_sum[k] += p_samples->acc[k];
+			}
+			p_samples++;
+			count--;
+			if(++m_acc_n < MOTION_DECIMATION) {
+				seq++;
+				continue;
+			}
+			sum = 0;
+			for(k=0; k<3; k++) {
+				axis = m_acc_sum[k]/MOTION_DECIMATION;
+				sum += (uint32_t)(axis*axis);
+				m_acc_sum[k] = 0;
+			}
+			m_acc_n = 0;
+			highpass[n] = (int16_t)(motion_sqrt(sum) >> 1);
+			seqs[n++] = seq++;
+		}
+
+		motion_biquad_run(&m_highpass, highpass, n);
+		memcpy(lowpass, highpass, n*sizeof(lowpass[0]));
+		motion_biquad_run(&m_lowpass, lowpass, n);
+
+		for(i=0; i<n; i++) {
+			if(m_settle) {
+				m_settle--;
+				continue;
+			}
+			motion_gesture(seqs[i], highpass[i]);
+			if(!m_gesture_open) {
+				motion_step(seqs[i], lowpass[i]);
+			}
+		}
+	}
+}
+
+void motion_summary_get(motion_summary_t *p_summary)
+{
+	*p_summary = m_summary;
+}
@@ -0,0 +1,71 @@
+#ifndef MOTION_H__
+#define MOTION_H__
+
+#include <stdint.h>
+#include "sensor_test.h"
+
+/* On-device step and gesture detection on the accelerometer stream, so only
+ * events and counts have to leave the ring.
+ *
+ * The 416 Hz samples are averaged down to 104 Hz, reduced to the magnitude,
+ * high passed at 0.5 Hz to drop gravity and low passed at 3 Hz for the step
+ * detector. Gestures are windows where the high passed magnitude stays
+ * above a threshold. */
+#define MOTION_DECIMATION          4
+#define MOTION_RATE_HZ             104
+
+typedef enum {
+	MOTION_EVT_STEP,           /* steps holds the new total */
+	MOTION_EVT_TAP,            /* A short sharp window, gesture filled in */
+	MOTION_EVT_SHAKE           /* A long window with several swings */
+} motion_evt_type_t;
+
+typedef struct {
+	motion_evt_type_t type;
+	uint32_t seq;              /* sensor_fifo index of the sample that ended it */
+	union {
+		uint32_t steps;
+		struct {
+			uint16_t duration_ms;
+			uint16_t peak;     /* Largest high passed magnitude, 4096 = 1 g */
+			uint8_t swings;    /* Times it went over the threshold */
+		} gesture;
+	} params;
+} motion_evt_t;
+
+typedef struct {
+	uint32_t steps;
+	uint32_t taps;
+	uint32_t shakes;
+	uint32_t active_ms;        /* Time spent inside gesture windows */
+} motion_summary_t;
+
+typedef void (*motion_evt_handler_t)(motion_evt_t const *p_evt);
+
+/* Q15 biquad in the CMSIS-DSP direct form I layout: coefficients
+ * {b0, 0, b1, b2, a1, a2} scaled down by 2^post_shift, with the feedback
+ * terms added rather than subtracted. */
+typedef struct {
+	int16_t b0;
+	uint32_t b;                /* b1 in the low, b2 in the high halfword */
+	uint32_t a;                /* a1 in the low, a2 in the high halfword */
+	uint32_t x;                /* x[n-1] low, x[n-2] high */
+	uint32_t y;                /* y[n-1] low, y[n-2] high */
+	uint32_t err;              /* Accumulator bits below y[n-1] */
+	uint8_t shift;
+} motion_biquad_t;
+
+void motion_biquad_init(motion_biquad_t *p_filter, int16_t const *p_coeffs, uint8_t post_shift);
+/* Filters n samples in place. */
+void motion_biquad_run(motion_biquad_t *p_filter, int16_t *p_data, uint16_t n);
+
+/* p_handler may be NULL when only the summary is wanted. */
+void motion_init(motion_evt_handler_t handler);
+
+/* Feeds consecutive samples starting at sensor_fifo index seq, matches
+ * sensor_fifo_handler_t. Main context only. */
+void motion_process(uint32_t seq, sensor_sample_t const *p_samples, uint16_t count);
+
+void motion_summary_get(motion_summary_t *p_summary);
+
+#endif /* MOTION_H__ */
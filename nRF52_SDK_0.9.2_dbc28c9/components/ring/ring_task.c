@@ -0,0 +1,346 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "nordic_common.h"
+#include "nrf.h"
+#include "nrf_error.h"
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+
+#include "ring_task.h"
+
+/* Half the 24-bit RTC range: a deadline further away is in the past. */
+#define RING_TASK_TICK_MASK        0x00FFFFFF
+#define RING_TASK_TICK_HALF        0x00800000
+
+typedef struct {
+	ring_task_t *p_head;
+	ring_task_t *p_tail;
+} ring_task_list_t;
+
+/* Ready lists, shared with interrupts */
+static ring_task_list_t m_ready[RING_TASK_PRIO_COUNT];
+static volatile bool m_dispatch_queued = false;
+static uint8_t m_passed_over[RING_TASK_PRIO_COUNT];
+
+/* Timed tasks sorted by deadline, main context only */
+static ring_task_t *m_timed = NULL;
+static app_timer_id_t m_timer_id;
+static volatile bool m_timer_queued = false;
+
+static ring_task_idle_hook_t m_idle;
+
+static void ring_task_dispatch(void *p_event_data, uint16_t event_size);
+
+/* Cycle counter on the M4, the RTC elsewhere. */
+static uint32_t ring_task_clock(void)
+{
+#if defined(NRF52)
+	return DWT->CYCCNT;
+#else
+	uint32_t ticks;
+
+	(void)app_timer_cnt_get(&ticks);
+	return ticks;
+#endif
+}
+
+static uint32_t ring_task_elapsed_us(uint32_t start)
+{
+#if defined(NRF52)
+	return (DWT->CYCCNT-start)/(SystemCoreClock/1000000);
+#else
+	uint32_t ticks;
+
+	(void)app_timer_cnt_diff_compute(ring_task_clock(), start, &ticks);
+	return (uint32_t)(((uint64_t)ticks*1000000)/APP_TIMER_CLOCK_FREQ);
+#endif
+}
+
+static bool ring_task_ready_any(void)
+{
+	uint8_t i;
+
+	for(i=0; i<RING_TASK_PRIO_COUNT; i++) {
+		if(m_ready[i].p_head != NULL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Nothing runs until app_sched_resume(), which comes from an event or an
+ * interrupt and so wakes the main loop itself. */
+static bool ring_task_sched_paused(void)
+{
+#ifdef APP_SCHEDULER_WITH_PAUSE
+	return app_sched_paused();
+#else
+	return false;
+#endif
+}
+
+/* Called with interrupts masked. */
+static void ring_task_kick(void)
+{
+	if(!m_dispatch_queued) {
+		m_dispatch_queued = true;
+		if(app_sched_event_put(NULL, 0, ring_task_dispatch) != NRF_SUCCESS) {
+			/* ring_task_run() retries while something is ready. */
+			m_dispatch_queued = false;
+		}
+	}
+}
+
+void ring_task_post(ring_task_t *p_task)
+{
+	ring_task_list_t *p_list = &m_ready[p_task->priority];
+
+	CRITICAL_REGION_ENTER();
+	if(!p_task->ready) {
+		p_task->ready = true;
+		p_task->p_ready_next = NULL;
+		if(p_list->p_tail != NULL) {
+			p_list->p_tail->p_ready_next = p_task;
+		} else {
+			p_list->p_head = p_task;
+		}
+		p_list->p_tail = p_task;
+	}
+	ring_task_kick();
+	CRITICAL_REGION_EXIT();
+}
+
+static ring_task_t *ring_task_take(void)
+{
+	ring_task_t *p_task = NULL;
+	uint8_t prio = RING_TASK_PRIO_COUNT;
+	uint8_t i;
+
+	CRITICAL_REGION_ENTER();
+	for(i=0; i<RING_TASK_PRIO_COUNT; i++) {
+		if(m_ready[i].p_head == NULL) {
+			m_passed_over[i] = 0;
+		} else if(prio == RING_TASK_PRIO_COUNT || m_passed_over[i] >= RING_TASK_AGING) {
+			prio = i;
+		}
+	}
+	if(prio < RING_TASK_PRIO_COUNT) {
+		for(i=0; i<RING_TASK_PRIO_COUNT; i++) {
+			if(i != prio && m_ready[i].p_head != NULL) {
+				m_passed_over[i]++;
+			}
+		}
+		m_passed_over[prio] = 0;
+		p_task = m_ready[prio].p_head;
+		m_ready[prio].p_head = p_task->p_ready_next;
+		if(m_ready[prio].p_head == NULL) {
+			m_ready[prio].p_tail = NULL;
+		}
+		/* It may be posted again while it runs. */
+		p_task->ready = false;
+	}
+	CRITICAL_REGION_EXIT();
+
+	return p_task;
+}
+
+static void ring_task_dispatch(void *p_event_data, uint16_t event_size)
+{
+	ring_task_t *p_task;
+	uint32_t start;
+	uint32_t elapsed;
+
+	m_dispatch_queued = false;
+	p_task = ring_task_take();
+	if(p_task == NULL) {
+		return;
+	}
+
+	start = ring_task_clock();
+	p_task->fn(p_task->p_context);
+	elapsed = ring_task_elapsed_us(start);
+
+	p_task->runs++;
+	if(elapsed > p_task->max_us) {
+		p_task->max_us = elapsed;
+	}
+	if(p_task->budget_us && elapsed > p_task->budget_us) {
+		p_task->overruns++;
+	}
+
+	/* One task per event, the rest queue up behind what came meanwhile. */
+	CRITICAL_REGION_ENTER();
+	if(ring_task_ready_any()) {
+		ring_task_kick();
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+static uint32_t ring_task_ticks_to(uint32_t deadline, uint32_t now)
+{
+	uint32_t ticks = (deadline-now) & RING_TASK_TICK_MASK;
+
+	return (ticks >= RING_TASK_TICK_HALF) ? 0 : ticks;
+}
+
+static void ring_task_timed_remove(ring_task_t *p_task)
+{
+	ring_task_t **pp = &m_timed;
+
+	if(!p_task->timed) {
+		return;
+	}
+	while(*pp != p_task) {
+		pp = &(*pp)->p_timed_next;
+	}
+	*pp = p_task->p_timed_next;
+	p_task->timed = false;
+}
+
+static void ring_task_timed_insert(ring_task_t *p_task, uint32_t now)
+{
+	ring_task_t **pp = &m_timed;
+	uint32_t ticks = ring_task_ticks_to(p_task->deadline, now);
+
+	while(*pp != NULL && ring_task_ticks_to((*pp)->deadline, now) <= ticks) {
+		pp = &(*pp)->p_timed_next;
+	}
+	p_task->p_timed_next = *pp;
+	*pp = p_task;
+	p_task->timed = true;
+}
+
+/* Hands the due tasks over and sets the timer for the next deadline. */
+static void ring_task_timed_update(void)
+{
+	ring_task_t *p_task;
+	uint32_t now;
+	uint32_t ticks;
+	uint32_t err_code;
+
+	(void)app_timer_cnt_get(&now);
+	while(m_timed != NULL && ring_task_ticks_to(m_timed->deadline, now) == 0) {
+		p_task = m_timed;
+		m_timed = p_task->p_timed_next;
+		p_task->timed = false;
+		if(p_task->period) {
+			p_task->deadline = (p_task->deadline+p_task->period) & RING_TASK_TICK_MASK;
+			if(ring_task_ticks_to(p_task->deadline, now) == 0) {
+				/* Fell more than a period behind, skip the missed runs. */
+				p_task->deadline = (now+p_task->period) & RING_TASK_TICK_MASK;
+			}
+			ring_task_timed_insert(p_task, now);
+		}
+		ring_task_post(p_task);
+	}
+
+	err_code = app_timer_stop(m_timer_id);
+	APP_ERROR_CHECK(err_code);
+	if(m_timed != NULL) {
+		ticks = ring_task_ticks_to(m_timed->deadline, now);
+		err_code = app_timer_start(m_timer_id, MAX(ticks, APP_TIMER_MIN_TIMEOUT_TICKS), NULL);
+		APP_ERROR_CHECK(err_code);
+	}
+}
+
+static void ring_task_timer_handler(void *p_event_data, uint16_t event_size)
+{
+	m_timer_queued = false;
+	ring_task_timed_update();
+}
+
+static void ring_task_timeout(void *p_context)
+{
+	if(!m_timer_queued) {
+		m_timer_queued = true;
+		if(app_sched_event_put(NULL, 0, ring_task_timer_handler) != NRF_SUCCESS) {
+			/* Try again on the next tick rather than lose the deadline. */
+			m_timer_queued = false;
+			(void)app_timer_start(m_timer_id, APP_TIMER_MIN_TIMEOUT_TICKS, NULL);
+		}
+	}
+}
+
+static void ring_task_timed_start(ring_task_t *p_task, uint32_t delay_ms, uint32_t period_ms)
+{
+	uint32_t now;
+
+	(void)app_timer_cnt_get(&now);
+	ring_task_timed_remove(p_task);
+	p_task->deadline = (now+APP_TIMER_TICKS(delay_ms, 0)) & RING_TASK_TICK_MASK;
+	p_task->period = APP_TIMER_TICKS(period_ms, 0);
+	ring_task_timed_insert(p_task, now);
+	ring_task_timed_update();
+}
+
+void ring_task_post_delayed(ring_task_t *p_task, uint32_t delay_ms)
+{
+	ring_task_timed_start(p_task, delay_ms, 0);
+}
+
+void ring_task_start_periodic(ring_task_t *p_task, uint32_t period_ms)
+{
+	ring_task_timed_start(p_task, period_ms, period_ms);
+}
+
+void ring_task_stop(ring_task_t *p_task)
+{
+	ring_task_list_t *p_list = &m_ready[p_task->priority];
+	ring_task_t *p_prev = NULL;
+	ring_task_t *p_cur;
+
+	ring_task_timed_remove(p_task);
+
+	CRITICAL_REGION_ENTER();
+	if(p_task->ready) {
+		for(p_cur = p_list->p_head; p_cur != p_task; p_cur = p_cur->p_ready_next) {
+			p_prev = p_cur;
+		}
+		if(p_prev != NULL) {
+			p_prev->p_ready_next = p_task->p_ready_next;
+		} else {
+			p_list->p_head = p_task->p_ready_next;
+		}
+		if(p_list->p_tail == p_task) {
+			p_list->p_tail = p_prev;
+		}
+		p_task->ready = false;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+uint32_t ring_task_init(ring_task_idle_hook_t idle)
+{
+	m_idle = idle;
+#if defined(NRF52)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	return app_timer_create(&m_timer_id, APP_TIMER_MODE_SINGLE_SHOT, ring_task_timeout);
+}
+
+void ring_task_run(void)
+{
+	bool ready;
+
+	ready = app_sched_execute_budget(RING_TASK_RUN_EVENTS);
+
+	CRITICAL_REGION_ENTER();
+	if(ring_task_ready_any()) {
+		/* The dispatch event was lost to a full scheduler queue. While the
+		 * scheduler is paused it could not run anyway, so sleep. */
+		ring_task_kick();
+		if(!ring_task_sched_paused()) {
+			ready = true;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+
+	if(!ready && m_idle != NULL) {
+		m_idle();
+	}
+}
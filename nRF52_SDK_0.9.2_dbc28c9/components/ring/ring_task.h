@@ -0,0 +1,73 @@
+#ifndef RING_TASK_H__
+#define RING_TASK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Run-to-completion tasks on top of the app scheduler. A posted task runs
+ * once from app_sched_execute(), one task per scheduler event so that
+ * button and timer events queued meanwhile get their turn in between.
+ *
+ * The highest priority ready task goes first, except that a priority
+ * passed over RING_TASK_AGING times in a row is served next. Each run is
+ * timed against the task's budget; going over is only counted. */
+#define RING_TASK_PRIO_HIGH        0
+#define RING_TASK_PRIO_NORMAL      1
+#define RING_TASK_PRIO_LOW         2
+#define RING_TASK_PRIO_COUNT       3
+
+#define RING_TASK_AGING            8
+
+/* Scheduler events the module needs room for at once. */
+#define RING_TASK_SCHED_EVENTS     2
+
+/* Scheduler events run per ring_task_run() pass at most. */
+#define RING_TASK_RUN_EVENTS       16
+
+/* App timers ring_task_init() creates, to be counted in APP_TIMER_MAX_TIMERS. */
+#define RING_TASK_APP_TIMERS       1
+
+typedef void (*ring_task_fn_t)(void *p_context);
+typedef void (*ring_task_idle_hook_t)(void);
+
+typedef struct ring_task_s {
+	ring_task_fn_t fn;
+	void *p_context;
+	uint8_t priority;
+	uint32_t budget_us;
+
+	uint32_t runs;
+	uint32_t overruns;
+	uint32_t max_us;           /* Longest run so far */
+
+	/* Private */
+	struct ring_task_s *p_ready_next;
+	struct ring_task_s *p_timed_next;
+	uint32_t deadline;         /* RTC1 tick */
+	uint32_t period;           /* RTC1 ticks, 0 for a one-off */
+	bool timed;
+	volatile bool ready;
+} ring_task_t;
+
+#define RING_TASK_DEF(name, task_fn, context, prio, budget) \
+	static ring_task_t name = { .fn = (task_fn), .p_context = (context), \
+	                            .priority = (prio), .budget_us = (budget) }
+
+/* Needs the app timer and the app scheduler. idle runs whenever nothing is
+ * left to do, typically power_manage(). */
+uint32_t ring_task_init(ring_task_idle_hook_t idle);
+
+/* Makes the task ready unless it already is. Safe from interrupts. */
+void ring_task_post(ring_task_t *p_task);
+
+/* Timed posts, main context only. A periodic task keeps its phase however
+ * late a run was. Starting a timed task again replaces the old timing. */
+void ring_task_post_delayed(ring_task_t *p_task, uint32_t delay_ms);
+void ring_task_start_periodic(ring_task_t *p_task, uint32_t period_ms);
+void ring_task_stop(ring_task_t *p_task);
+
+/* One main loop pass: runs up to RING_TASK_RUN_EVENTS scheduler events,
+ * then the idle hook if nothing is left to run. */
+void ring_task_run(void);
+
+#endif /* RING_TASK_H__ */
@@ -0,0 +1,563 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "nrf.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "crc16.h"
+
+#include "spi_flash.h"
+#include "sensor_log.h"
+
+/* Segment layout: a header, then records packed back to back. A record is
+ * never split across segments but may cross a page. A length byte of 0xFF
+ * means the rest of the page was padded by a flush.
+ *
+ *  header: magic(4) seq(4) crc16(2) pad(2) first_ts(4) last_ts(4)
+ *  record: len(1) tag(1) crc16(2) timestamp(4) data(len)
+ *
+ * magic, seq and the CRC over them are programmed as soon as the segment is
+ * opened, before the next segment is erased, so a reset can never leave the
+ * newest segment and the spare both blank. first_ts goes out with the first
+ * page, last_ts is programmed into the still erased header bytes when the
+ * segment is closed.
+ *
+ * Segments are written round robin; the one after the head is always erased
+ * ahead of time, which wears every sector equally. */
+#define SENSOR_LOG_MAGIC           0x32474C52  /* "RLG2" */
+#define SENSOR_LOG_HEADER_SIZE     20
+#define SENSOR_LOG_HEADER_CRC      8           /* Bytes covered by the header CRC */
+#define SENSOR_LOG_HEADER_EAGER    12          /* Bytes programmed at open */
+#define SENSOR_LOG_FIRST_TS        12
+#define SENSOR_LOG_LAST_TS         16
+#define SENSOR_LOG_NO_TS           0xFFFFFFFF
+#define SENSOR_LOG_RECORD_HEADER   8
+#define SENSOR_LOG_ERASED          0xFF
+
+#define SENSOR_LOG_SEGMENT_ADDR(s) (SENSOR_LOG_START_ADDR+(uint32_t)(s)*SENSOR_LOG_SEGMENT_SIZE)
+#define SENSOR_LOG_NEXT(s)         (((s)+1) % SENSOR_LOG_SEGMENT_COUNT)
+#define SENSOR_LOG_INDEX_SIZE      (SENSOR_LOG_SEGMENT_COUNT/SENSOR_LOG_INDEX_STRIDE)
+#define SENSOR_LOG_NEXT_PAGE(n)    (((n)+1) % SENSOR_LOG_PAGE_BUFFERS)
+
+typedef struct {
+	uint32_t seq;
+	uint32_t first_ts;
+	uint32_t last_ts;
+} sensor_log_header_t;
+
+/* What a queued program was for, passed as its callback context. */
+typedef enum {
+	SENSOR_LOG_WRITE_OPEN,         /* m_open_header */
+	SENSOR_LOG_WRITE_CLOSE,        /* m_close_ts */
+	SENSOR_LOG_WRITE_PAGE          /* m_page[n], passed as PAGE+n */
+} sensor_log_write_t;
+
+static bool m_mounted = false;
+static uint32_t m_head;         /* Segment being written */
+static uint32_t m_head_seq;
+static uint32_t m_tail;         /* Oldest segment holding records */
+static uint32_t m_offset;       /* Write position inside the head segment */
+static uint32_t m_first_ts;     /* Of the head segment, until its header is out */
+static uint32_t m_last_ts;
+
+/* first_ts of segments 0, STRIDE, 2*STRIDE... or SENSOR_LOG_NO_TS. */
+static uint32_t m_index[SENSOR_LOG_INDEX_SIZE];
+
+/* Start of the header of the segment being opened, programmed from here. */
+__ALIGN(sizeof(uint32_t))
+static uint8_t m_open_header[SENSOR_LOG_HEADER_EAGER];
+static volatile bool m_open_busy = false;
+
+/* last_ts of the segment being closed, programmed from here. */
+__ALIGN(sizeof(uint32_t))
+static uint8_t m_close_ts[4];
+static volatile bool m_close_busy = false;
+
+/* Appends fill one page buffer while the ones before it are being
+ * programmed; they are handed over and come back in ring order. */
+__ALIGN(sizeof(uint32_t))
+static uint8_t m_page[SENSOR_LOG_PAGE_BUFFERS][SENSOR_LOG_PAGE_SIZE];
+static volatile bool m_page_busy[SENSOR_LOG_PAGE_BUFFERS];
+static uint8_t m_fill;
+
+static sensor_log_stats_t m_stats;
+
+static void sensor_log_write_done(spi_flash_op_t op, unsigned int offset,
+                                  size_t len, int result, void *p_context)
+{
+	if(result != 0) {
+		m_stats.flash_errors++;
+	}
+	if(op != SPI_FLASH_OP_WRITE) {
+		return;
+	}
+	switch((sensor_log_write_t)(uintptr_t)p_context) {
+		case SENSOR_LOG_WRITE_OPEN:
+			m_open_busy = false;
+			break;
+		case SENSOR_LOG_WRITE_CLOSE:
+			m_close_busy = false;
+			break;
+		default:
+			m_page_busy[(uintptr_t)p_context-SENSOR_LOG_WRITE_PAGE] = false;
+			break;
+	}
+}
+
+/* Queues the erase of a segment; the tail moves on if it was the oldest. */
+static void sensor_log_erase(uint32_t segment)
+{
+	if(segment % SENSOR_LOG_INDEX_STRIDE == 0) {
+		m_index[segment/SENSOR_LOG_INDEX_STRIDE] = SENSOR_LOG_NO_TS;
+	}
+	if(segment == m_tail && segment != m_head) {
+		m_tail = SENSOR_LOG_NEXT(segment);
+	}
+	if(spi_flash_erase_async(SENSOR_LOG_SEGMENT_ADDR(segment), SENSOR_LOG_SEGMENT_SIZE,
+	                         sensor_log_write_done, NULL) != 0) {
+		m_stats.flash_errors++;
+	}
+}
+
+/* Hands the full page buffer ending at m_offset to the flash and switches
+ * to the next one, which the caller has checked to be free. */
+static void sensor_log_submit(void)
+{
+	uint32_t addr;
+
+	addr = SENSOR_LOG_SEGMENT_ADDR(m_head)+m_offset-SENSOR_LOG_PAGE_SIZE;
+	if(m_offset == SENSOR_LOG_PAGE_SIZE) {
+		/* First page: the header can be completed now. */
+		uint32_encode(m_first_ts, &m_page[m_fill][SENSOR_LOG_FIRST_TS]);
+	}
+	m_page_busy[m_fill] = true;
+	if(spi_flash_write_async(addr, SENSOR_LOG_PAGE_SIZE, m_page[m_fill], sensor_log_write_done,
+	                         (void *)(uintptr_t)(SENSOR_LOG_WRITE_PAGE+m_fill)) != 0) {
+		m_page_busy[m_fill] = false;
+		m_stats.flash_errors++;
+	}
+	m_fill = SENSOR_LOG_NEXT_PAGE(m_fill);
+	memset(m_page[m_fill], SENSOR_LOG_ERASED, SENSOR_LOG_PAGE_SIZE);
+}
+
+static void sensor_log_put(const uint8_t *p_src, uint32_t len)
+{
+	uint32_t pos;
+	uint32_t n;
+
+	while(len) {
+		pos = m_offset % SENSOR_LOG_PAGE_SIZE;
+		n = MIN(len, SENSOR_LOG_PAGE_SIZE-pos);
+		memcpy(&m_page[m_fill][pos], p_src, n);
+		m_offset += n;
+		p_src += n;
+		len -= n;
+		if(m_offset % SENSOR_LOG_PAGE_SIZE == 0) {
+			sensor_log_submit();
+		}
+	}
+}
+
+/* Starts writing the given, already erased, segment and erases the next.
+ * The header start is programmed right away, queued ahead of that erase;
+ * the first page carries the same bytes again plus first_ts. */
+static void sensor_log_open(uint32_t segment)
+{
+	uint8_t header[SENSOR_LOG_HEADER_SIZE];
+
+	m_head = segment;
+	m_head_seq++;
+	m_offset = 0;
+	m_first_ts = SENSOR_LOG_NO_TS;
+	memset(header, SENSOR_LOG_ERASED, sizeof(header));
+	uint32_encode(SENSOR_LOG_MAGIC, &header[0]);
+	uint32_encode(m_head_seq, &header[4]);
+	uint16_encode(crc16_compute(header, SENSOR_LOG_HEADER_CRC, NULL), &header[8]);
+	sensor_log_put(header, sizeof(header));
+
+	if(m_open_busy) {
+		/* A whole segment went by since the last open. */
+		m_stats.flash_errors++;
+	} else {
+		m_open_busy = true;
+		memcpy(m_open_header, header, sizeof(m_open_header));
+		if(spi_flash_write_async(SENSOR_LOG_SEGMENT_ADDR(segment), sizeof(m_open_header),
+		                         m_open_header, sensor_log_write_done,
+		                         (void *)SENSOR_LOG_WRITE_OPEN) != 0) {
+			m_open_busy = false;
+			m_stats.flash_errors++;
+		}
+	}
+	sensor_log_erase(SENSOR_LOG_NEXT(segment));
+}
+
+/* Programs last_ts of the head segment before moving on. */
+static void sensor_log_close(void)
+{
+	if(m_close_busy) {
+		return;
+	}
+	m_close_busy = true;
+	uint32_encode(m_last_ts, m_close_ts);
+	if(spi_flash_write_async(SENSOR_LOG_SEGMENT_ADDR(m_head)+SENSOR_LOG_LAST_TS,
+	                         sizeof(m_close_ts), m_close_ts,
+	                         sensor_log_write_done, (void *)SENSOR_LOG_WRITE_CLOSE) != 0) {
+		m_close_busy = false;
+		m_stats.flash_errors++;
+	}
+}
+
+static bool sensor_log_header_read(uint32_t segment, sensor_log_header_t *p_header)
+{
+	uint8_t header[SENSOR_LOG_HEADER_SIZE];
+
+	if(spi_flash_read(SENSOR_LOG_SEGMENT_ADDR(segment), sizeof(header), header) != 0) {
+		return false;
+	}
+	if(uint32_decode(&header[0]) != SENSOR_LOG_MAGIC ||
+	   uint16_decode(&header[8]) != crc16_compute(header, SENSOR_LOG_HEADER_CRC, NULL)) {
+		return false;
+	}
+	p_header->seq = uint32_decode(&header[4]);
+	p_header->first_ts = uint32_decode(&header[SENSOR_LOG_FIRST_TS]);
+	p_header->last_ts = uint32_decode(&header[SENSOR_LOG_LAST_TS]);
+
+	return true;
+}
+
+/* Written segments form one run of increasing sequence numbers starting at
+ * base, so the head is the last one still newer than base: a binary search
+ * over header reads instead of a scan. */
+static uint32_t sensor_log_find_head(uint32_t base, uint32_t base_seq, uint32_t *p_seq)
+{
+	uint32_t lo = base;
+	uint32_t hi = SENSOR_LOG_SEGMENT_COUNT-1;
+	uint32_t mid;
+	sensor_log_header_t header;
+
+	*p_seq = base_seq;
+	while(lo < hi) {
+		mid = lo+(hi-lo+1)/2;
+		if(sensor_log_header_read(mid, &header) && header.seq >= base_seq) {
+			lo = mid;
+			*p_seq = header.seq;
+		} else {
+			hi = mid-1;
+		}
+	}
+
+	return lo;
+}
+
+int sensor_log_mount(void)
+{
+	uint32_t base;
+	uint32_t head;
+	uint32_t next;
+	uint32_t i;
+	sensor_log_header_t header;
+
+	m_mounted = false;
+	memset(&m_stats, 0, sizeof(m_stats));
+	if(SENSOR_LOG_START_ADDR+(uint64_t)SENSOR_LOG_SEGMENT_COUNT*SENSOR_LOG_SEGMENT_SIZE >
+	   spi_flash_size()) {
+		return -1;
+	}
+	memset((void *)m_page_busy, 0, sizeof(m_page_busy));
+	m_fill = 0;
+	memset(m_page[m_fill], SENSOR_LOG_ERASED, SENSOR_LOG_PAGE_SIZE);
+
+	/* Segment 0 is only missing when it is the spare of a wrapped log. */
+	base = 0;
+	if(!sensor_log_header_read(0, &header)) {
+		base = 1;
+	}
+	if(base == 0 || sensor_log_header_read(1, &header)) {
+		head = sensor_log_find_head(base, header.seq, &m_head_seq);
+		next = SENSOR_LOG_NEXT(head);
+		/* Wrapped: the oldest data follows the spare, or is the spare
+		 * itself if its erase never finished. */
+		m_tail = base;
+		if(sensor_log_header_read(next, &header) && header.seq < m_head_seq) {
+			m_tail = next;
+		} else if(sensor_log_header_read(SENSOR_LOG_NEXT(next), &header) &&
+		          header.seq < m_head_seq) {
+			m_tail = SENSOR_LOG_NEXT(next);
+		}
+		if(m_tail == next) {
+			m_tail = SENSOR_LOG_NEXT(next);
+		}
+	} else {
+		next = 0;
+		m_head_seq = 0;
+		m_tail = 0;
+	}
+
+	for(i=0; i<SENSOR_LOG_INDEX_SIZE; i++) {
+		m_index[i] = SENSOR_LOG_NO_TS;
+		if(sensor_log_header_read(i*SENSOR_LOG_INDEX_STRIDE, &header)) {
+			m_index[i] = header.first_ts;
+		}
+	}
+
+	/* Never append behind a record cut by a reset: start a fresh segment,
+	 * erasing it first as its erase may have been interrupted too. */
+	m_head = next;
+	sensor_log_erase(next);
+	sensor_log_open(next);
+	m_mounted = true;
+
+	/* The spare erase or the header could not be queued. */
+	return (m_stats.flash_errors == 0) ? 0 : -1;
+}
+
+int sensor_log_append(uint32_t timestamp, uint8_t tag, const void *p_data, uint8_t len)
+{
+	uint8_t header[SENSOR_LOG_RECORD_HEADER];
+	uint32_t need = SENSOR_LOG_RECORD_HEADER+len;
+	uint16_t crc;
+
+	if(!m_mounted || len > SENSOR_LOG_RECORD_MAX) {
+		return -1;
+	}
+	if(m_offset+need > SENSOR_LOG_SEGMENT_SIZE) {
+		if(m_page_busy[SENSOR_LOG_NEXT_PAGE(m_fill)]) {
+			m_stats.dropped++;
+			return -1;
+		}
+		sensor_log_flush();
+		sensor_log_close();
+		sensor_log_open(SENSOR_LOG_NEXT(m_head));
+	}
+	/* Filling the page needs the next buffer to take over. */
+	if((m_offset % SENSOR_LOG_PAGE_SIZE)+need >= SENSOR_LOG_PAGE_SIZE &&
+	   m_page_busy[SENSOR_LOG_NEXT_PAGE(m_fill)]) {
+		m_stats.dropped++;
+		return -1;
+	}
+
+	header[0] = len;
+	header[1] = tag;
+	uint32_encode(timestamp, &header[4]);
+	crc = crc16_compute(header, 2, NULL);
+	crc = crc16_compute(&header[4], 4, &crc);
+	crc = crc16_compute(p_data, len, &crc);
+	uint16_encode(crc, &header[2]);
+	if(m_first_ts == SENSOR_LOG_NO_TS) {
+		m_first_ts = timestamp;
+		if(m_head % SENSOR_LOG_INDEX_STRIDE == 0) {
+			m_index[m_head/SENSOR_LOG_INDEX_STRIDE] = timestamp;
+		}
+	}
+	m_last_ts = timestamp;
+	sensor_log_put(header, sizeof(header));
+	sensor_log_put(p_data, len);
+	m_stats.records++;
+
+	return 0;
+}
+
+void sensor_log_flush(void)
+{
+	uint32_t pad;
+
+	/* A page holding only the header would leave first_ts unset. */
+	pad = m_offset % SENSOR_LOG_PAGE_SIZE;
+	if(!m_mounted || pad == 0 || m_first_ts == SENSOR_LOG_NO_TS ||
+	   m_page_busy[SENSOR_LOG_NEXT_PAGE(m_fill)]) {
+		return;
+	}
+	/* The buffer is kept 0xFF past the data, which is the padding. */
+	m_offset += SENSOR_LOG_PAGE_SIZE-pad;
+	sensor_log_submit();
+}
+
+void sensor_log_cursor_init(sensor_log_cursor_t *p_cursor)
+{
+	p_cursor->segment = m_tail;
+	p_cursor->seq = 0;
+	p_cursor->offset = 0;
+}
+
+int sensor_log_read(sensor_log_cursor_t *p_cursor, sensor_log_record_t *p_record)
+{
+	uint8_t header[SENSOR_LOG_RECORD_HEADER];
+	uint32_t addr;
+	uint32_t limit;
+	sensor_log_header_t segment;
+	uint16_t crc;
+
+	while(m_mounted) {
+		/* Only pages already handed to the flash are readable. */
+		limit = SENSOR_LOG_SEGMENT_SIZE;
+		if(p_cursor->segment == m_head) {
+			limit = m_offset - m_offset % SENSOR_LOG_PAGE_SIZE;
+		}
+		if(p_cursor->offset == 0) {
+			if(limit < SENSOR_LOG_HEADER_SIZE) {
+				return -1;
+			}
+			if(!sensor_log_header_read(p_cursor->segment, &segment) ||
+			   segment.seq < p_cursor->seq) {
+				p_cursor->offset = SENSOR_LOG_SEGMENT_SIZE;
+			} else {
+				p_cursor->seq = segment.seq;
+				p_cursor->offset = SENSOR_LOG_HEADER_SIZE;
+			}
+		}
+		if(p_cursor->offset+SENSOR_LOG_RECORD_HEADER > limit) {
+			if(p_cursor->segment == m_head) {
+				return -1;
+			}
+			p_cursor->segment = SENSOR_LOG_NEXT(p_cursor->segment);
+			p_cursor->offset = 0;
+			continue;
+		}
+		addr = SENSOR_LOG_SEGMENT_ADDR(p_cursor->segment)+p_cursor->offset;
+		if(spi_flash_read(addr, sizeof(header), header) != 0) {
+			return -1;
+		}
+		if(header[0] == SENSOR_LOG_ERASED) {
+			p_cursor->offset += SENSOR_LOG_PAGE_SIZE - p_cursor->offset % SENSOR_LOG_PAGE_SIZE;
+			continue;
+		}
+		if(header[0] > SENSOR_LOG_RECORD_MAX ||
+		   p_cursor->offset+SENSOR_LOG_RECORD_HEADER+header[0] > SENSOR_LOG_SEGMENT_SIZE) {
+			/* Corrupt length: nothing after it in this segment can be found. */
+			p_cursor->offset = SENSOR_LOG_SEGMENT_SIZE;
+			continue;
+		}
+		if(p_cursor->offset+SENSOR_LOG_RECORD_HEADER+header[0] > limit) {
+			return -1;
+		}
+		if(spi_flash_read(addr+SENSOR_LOG_RECORD_HEADER, header[0], p_record->data) != 0) {
+			return -1;
+		}
+		p_cursor->offset += SENSOR_LOG_RECORD_HEADER+header[0];
+		crc = crc16_compute(header, 2, NULL);
+		crc = crc16_compute(&header[4], 4, &crc);
+		crc = crc16_compute(p_record->data, header[0], &crc);
+		if(crc != uint16_decode(&header[2])) {
+			continue;
+		}
+		p_record->len = header[0];
+		p_record->tag = header[1];
+		p_record->timestamp = uint32_decode(&header[4]);
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/* Segments between tail and head, oldest first. */
+static uint32_t sensor_log_span(void)
+{
+	return (m_head+SENSOR_LOG_SEGMENT_COUNT-m_tail) % SENSOR_LOG_SEGMENT_COUNT + 1;
+}
+
+static uint32_t sensor_log_first_ts(uint32_t segment)
+{
+	sensor_log_header_t header;
+
+	if(segment == m_head) {
+		return m_first_ts;
+	}
+	if(!sensor_log_header_read(segment, &header)) {
+		return SENSOR_LOG_NO_TS;
+	}
+
+	return header.first_ts;
+}
+
+/* Segment at position pos of the log, counting from the tail. */
+static uint32_t sensor_log_at(uint32_t pos)
+{
+	return (m_tail+pos) % SENSOR_LOG_SEGMENT_COUNT;
+}
+
+static bool sensor_log_starts_before(uint32_t ts, uint32_t timestamp)
+{
+	return ts != SENSOR_LOG_NO_TS && ts <= timestamp;
+}
+
+/* Finds the last segment whose first record is not after timestamp. The RAM
+ * index narrows it down to one stride, header reads do the rest. */
+static uint32_t sensor_log_find_segment(uint32_t timestamp)
+{
+	uint32_t span = sensor_log_span();
+	uint32_t pos0;          /* Log position of the first indexed segment */
+	uint32_t count;
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t mid;
+
+	pos0 = (SENSOR_LOG_INDEX_STRIDE - m_tail % SENSOR_LOG_INDEX_STRIDE) % SENSOR_LOG_INDEX_STRIDE;
+	count = (pos0 < span) ? (span-pos0+SENSOR_LOG_INDEX_STRIDE-1)/SENSOR_LOG_INDEX_STRIDE : 0;
+
+	lo = 0;
+	hi = span-1;
+	if(count && sensor_log_starts_before(m_index[sensor_log_at(pos0)/SENSOR_LOG_INDEX_STRIDE], timestamp)) {
+		lo = 0;
+		hi = count-1;
+		while(lo < hi) {
+			mid = lo+(hi-lo+1)/2;
+			if(sensor_log_starts_before(m_index[sensor_log_at(pos0+mid*SENSOR_LOG_INDEX_STRIDE)/
+			                                    SENSOR_LOG_INDEX_STRIDE], timestamp)) {
+				lo = mid;
+			} else {
+				hi = mid-1;
+			}
+		}
+		lo = pos0+lo*SENSOR_LOG_INDEX_STRIDE;
+		hi = MIN(span-1, lo+SENSOR_LOG_INDEX_STRIDE-1);
+	} else if(count) {
+		hi = (pos0 > 0) ? pos0-1 : 0;
+	}
+	while(lo < hi) {
+		mid = lo+(hi-lo+1)/2;
+		if(sensor_log_starts_before(sensor_log_first_ts(sensor_log_at(mid)), timestamp)) {
+			lo = mid;
+		} else {
+			hi = mid-1;
+		}
+	}
+
+	return sensor_log_at(lo);
+}
+
+int sensor_log_seek(uint32_t timestamp, sensor_log_cursor_t *p_cursor)
+{
+	static sensor_log_record_t record;
+	sensor_log_cursor_t prev;
+	sensor_log_header_t header;
+
+	if(!m_mounted) {
+		return -1;
+	}
+	p_cursor->segment = sensor_log_find_segment(timestamp);
+	p_cursor->seq = 0;
+	p_cursor->offset = 0;
+	/* A closed segment ending before timestamp holds nothing to return. */
+	if(p_cursor->segment != m_head &&
+	   sensor_log_header_read(p_cursor->segment, &header) &&
+	   header.last_ts != SENSOR_LOG_NO_TS && header.last_ts < timestamp) {
+		p_cursor->segment = SENSOR_LOG_NEXT(p_cursor->segment);
+		p_cursor->seq = header.seq;
+	}
+	prev = *p_cursor;
+	while(sensor_log_read(p_cursor, &record) == 0) {
+		if(record.timestamp >= timestamp) {
+			*p_cursor = prev;
+			return 0;
+		}
+		prev = *p_cursor;
+	}
+
+	return -1;
+}
+
+void sensor_log_stats_get(sensor_log_stats_t *p_stats)
+{
+	*p_stats = m_stats;
+}
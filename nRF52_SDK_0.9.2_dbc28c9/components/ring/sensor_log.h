@@ -0,0 +1,73 @@
+#ifndef SENSOR_LOG_H__
+#define SENSOR_LOG_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The log owns a ring of erase-sector sized segments on the SPI flash. */
+#define SENSOR_LOG_START_ADDR      0
+#define SENSOR_LOG_SEGMENT_SIZE    4096
+#ifndef SENSOR_LOG_SEGMENT_COUNT
+#define SENSOR_LOG_SEGMENT_COUNT   2048        /* 8 MB, the whole W25Q64 */
+#endif
+#define SENSOR_LOG_PAGE_SIZE       256
+
+/* Pages buffered in RAM while the flash programs the ones before them, or
+ * sits behind a 45 ms segment erase. One FIFO wakeup at 416 Hz, 32 samples
+ * in two records, hands over two pages at once. */
+#ifndef SENSOR_LOG_PAGE_BUFFERS
+#define SENSOR_LOG_PAGE_BUFFERS    4
+#endif
+
+/* Every Nth segment's first timestamp is kept in RAM to seek by time. */
+#define SENSOR_LOG_INDEX_STRIDE    16
+
+/* Largest payload of one record; a record never spans more than two pages. */
+#define SENSOR_LOG_RECORD_MAX      240
+
+typedef struct {
+	uint32_t timestamp;
+	uint8_t tag;
+	uint8_t len;
+	uint8_t data[SENSOR_LOG_RECORD_MAX];
+} sensor_log_record_t;
+
+/* Read position, walking from the oldest segment towards the newest. */
+typedef struct {
+	uint32_t segment;
+	uint32_t seq;
+	uint32_t offset;
+} sensor_log_cursor_t;
+
+typedef struct {
+	uint32_t records;
+	uint32_t dropped;          /* Appends refused because no page buffer was free. */
+	uint32_t flash_errors;
+} sensor_log_stats_t;
+
+/* Finds the newest segment and opens a fresh one after it. Needs
+ * spi_flash_init() first. Returns -1 when the segments do not fit the chip
+ * or the flash did not take the erase of the new segment. */
+int sensor_log_mount(void);
+
+/* Appends one record without waiting for the flash; returns -1 when it had
+ * to be dropped. Timestamps must not decrease. Main context only. */
+int sensor_log_append(uint32_t timestamp, uint8_t tag, const void *p_data, uint8_t len);
+
+/* Pads the page being filled and hands it to the flash, so everything
+ * appended so far becomes readable. */
+void sensor_log_flush(void);
+
+void sensor_log_cursor_init(sensor_log_cursor_t *p_cursor);
+
+/* Positions the cursor on the first record stamped at or after timestamp.
+ * Returns -1 when there is none. Blocks on the flash. */
+int sensor_log_seek(uint32_t timestamp, sensor_log_cursor_t *p_cursor);
+
+/* Reads the next record, blocking on the flash. Returns -1 at the end of the
+ * readable log. */
+int sensor_log_read(sensor_log_cursor_t *p_cursor, sensor_log_record_t *p_record);
+
+void sensor_log_stats_get(sensor_log_stats_t *p_stats);
+
+#endif /* SENSOR_LOG_H__ */
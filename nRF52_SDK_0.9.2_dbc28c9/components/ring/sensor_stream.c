@@ -0,0 +1,214 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "nordic_common.h"
+#include "ble.h"
+#include "ble_gatts.h"
+
+#include "imu_codec.h"
+#include "sensor_test.h"
+#include "sensor_stream.h"
+
+#define SENSOR_STREAM_HEADER       2
+#define SENSOR_STREAM_RAW_SAMPLES  ((SENSOR_STREAM_PACKET_SIZE-SENSOR_STREAM_HEADER)/sizeof(m_window[0]))
+/* Samples taken out of the sensor ring per call. */
+#define SENSOR_STREAM_READ_BATCH   8
+
+typedef struct {
+	uint8_t len;
+	uint8_t samples;
+	uint8_t data[SENSOR_STREAM_PACKET_SIZE];
+} sensor_stream_packet_t;
+
+static uint16_t m_value_handle;
+static volatile uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static volatile bool m_resync = false;
+
+/* Bumped from the BLE event handler whenever a send may succeed again. A
+ * refused send remembers the count it saw, so a TX_COMPLETE racing with the
+ * refusal is not lost. */
+static volatile uint32_t m_tx_kicks = 0;
+static uint32_t m_tx_blocked_at;
+static bool m_tx_blocked = false;
+
+/* Packets waiting for the stack, main loop only. */
+static sensor_stream_packet_t m_queue[SENSOR_STREAM_QUEUE_SIZE];
+static uint32_t m_wr = 0;
+static uint32_t m_rd = 0;
+
+/* Contiguous samples waiting to be encoded, the first one is m_window_seq. */
+static int16_t m_window[SENSOR_STREAM_WINDOW][3];
+static uint16_t m_window_len;
+static uint32_t m_window_seq;
+static sensor_stream_stats_t m_stats;
+
+/* Encodes as much of the window as one notification holds, raw when that
+ * carries more samples than a codec block. */
+static void sensor_stream_pack(void)
+{
+	sensor_stream_packet_t *p_packet;
+	uint16_t seq = (uint16_t)(m_window_seq & SENSOR_STREAM_SEQ_MASK);
+	uint16_t used;
+	uint16_t raw;
+	uint16_t k;
+	uint8_t *p;
+	uint8_t i;
+
+	if(m_wr-m_rd == SENSOR_STREAM_QUEUE_SIZE) {
+		m_stats.dropped += m_queue[m_rd & (SENSOR_STREAM_QUEUE_SIZE-1)].samples;
+		m_rd++;
+	}
+	p_packet = &m_queue[m_wr & (SENSOR_STREAM_QUEUE_SIZE-1)];
+	p_packet->len = SENSOR_STREAM_HEADER +
+	                imu_codec_encode((int16_t const (*)[3])m_window, m_window_len,
+	                                 &p_packet->data[SENSOR_STREAM_HEADER],
+	                                 SENSOR_STREAM_PACKET_SIZE-SENSOR_STREAM_HEADER, &used);
+	raw = MIN(m_window_len, SENSOR_STREAM_RAW_SAMPLES);
+	if(raw > used) {
+		used = raw;
+		seq |= SENSOR_STREAM_SEQ_RAW;
+		p = &p_packet->data[SENSOR_STREAM_HEADER];
+		for(k=0; k<used; k++) {
+			for(i=0; i<3; i++) {
+				*p++ = (uint8_t)((uint16_t)m_window[k][i] >> 8);
+				*p++ = (uint8_t)m_window[k][i];
+			}
+		}
+		p_packet->len = (uint8_t)(p-p_packet->data);
+	}
+	p_packet->data[0] = (uint8_t)(seq >> 8);
+	p_packet->data[1] = (uint8_t)seq;
+	p_packet->samples = (uint8_t)used;
+	m_wr++;
+
+	m_window_len -= used;
+	m_window_seq += used;
+	memmove(m_window, m_window[used], m_window_len*sizeof(m_window[0]));
+}
+
+static void sensor_stream_put(uint32_t seq, int16_t const *p_acc)
+{
+	if(seq != m_window_seq+m_window_len) {
+		/* Samples went missing: a block only holds a contiguous run. */
+		m_stats.dropped += seq-(m_window_seq+m_window_len);
+		while(m_window_len) {
+			sensor_stream_pack();
+		}
+		m_window_seq = seq;
+	}
+	memcpy(m_window[m_window_len++], p_acc, sizeof(m_window[0]));
+	/* Only a full window shows how many samples the next packet takes. */
+	if(m_window_len == SENSOR_STREAM_WINDOW) {
+		sensor_stream_pack();
+	}
+}
+
+/* Hands queued packets to the stack until it runs out of TX buffers. */
+static uint32_t sensor_stream_send(void)
+{
+	ble_gatts_hvx_params_t hvx_params;
+	sensor_stream_packet_t *p_packet;
+	uint32_t err_code;
+	uint32_t kicks;
+	uint16_t len;
+
+	while(m_rd != m_wr) {
+		kicks = m_tx_kicks;
+		if(m_tx_blocked && kicks == m_tx_blocked_at) {
+			break;
+		}
+		m_tx_blocked = false;
+
+		p_packet = &m_queue[m_rd & (SENSOR_STREAM_QUEUE_SIZE-1)];
+		len = p_packet->len;
+		memset(&hvx_params, 0, sizeof(hvx_params));
+		hvx_params.handle = m_value_handle;
+		hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+		hvx_params.offset = 0;
+		hvx_params.p_len  = &len;
+		hvx_params.p_data = p_packet->data;
+
+		err_code = sd_ble_gatts_hvx(m_conn_handle, &hvx_params);
+		if(err_code == NRF_SUCCESS) {
+			m_stats.packets++;
+			m_stats.samples += p_packet->samples;
+			m_rd++;
+		} else if(err_code == BLE_ERROR_NO_TX_BUFFERS ||
+		          err_code == NRF_ERROR_INVALID_STATE ||
+		          err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING) {
+			/* Keep the packet until a buffer frees up or the phone
+			 * enables notifications. */
+			m_tx_blocked = true;
+			m_tx_blocked_at = kicks;
+			break;
+		} else {
+			return err_code;
+		}
+	}
+
+	return NRF_SUCCESS;
+}
+
+void sensor_stream_init(uint16_t value_handle)
+{
+	m_value_handle = value_handle;
+	m_window_len = 0;
+	m_window_seq = sensor_fifo_seq();
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void sensor_stream_on_ble_evt(ble_evt_t * p_ble_evt)
+{
+	switch(p_ble_evt->header.evt_id) {
+		case BLE_GAP_EVT_CONNECTED:
+			m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+			m_resync = true;
+			m_tx_kicks++;
+			break;
+		case BLE_GAP_EVT_DISCONNECTED:
+			m_conn_handle = BLE_CONN_HANDLE_INVALID;
+			break;
+		case BLE_GATTS_EVT_WRITE:	/* Possibly the CCCD */
+		case BLE_EVT_TX_COMPLETE:
+			m_tx_kicks++;
+			break;
+		default:
+			break;
+	}
+}
+
+uint32_t sensor_stream_process(void)
+{
+	sensor_sample_t samples[SENSOR_STREAM_READ_BATCH];
+	uint32_t seq;
+	uint16_t n;
+	uint16_t i;
+
+	/* Samples stay in the sensor ring while nobody listens. */
+	if(m_conn_handle == BLE_CONN_HANDLE_INVALID) {
+		return NRF_SUCCESS;
+	}
+	if(m_resync) {
+		/* Start the connection with what is in the ring now. */
+		m_resync = false;
+		m_rd = m_wr;
+		m_window_len = 0;
+		m_window_seq = sensor_fifo_seq();
+		m_tx_blocked = false;
+	}
+
+	do {
+		seq = sensor_fifo_seq();
+		n = sensor_fifo_read(samples, SENSOR_STREAM_READ_BATCH);
+		for(i=0; i<n; i++) {
+			sensor_stream_put(seq+i, samples[i].acc);
+		}
+	} while(n == SENSOR_STREAM_READ_BATCH);
+
+	return sensor_stream_send();
+}
+
+void sensor_stream_stats_get(sensor_stream_stats_t *p_stats)
+{
+	*p_stats = m_stats;
+}
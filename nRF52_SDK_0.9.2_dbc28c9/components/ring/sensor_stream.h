@@ -0,0 +1,44 @@
+#ifndef SENSOR_STREAM_H__
+#define SENSOR_STREAM_H__
+
+#include <stdint.h>
+#include "ble.h"
+
+/* Notification layout:
+ *  seq(2, big endian) then one imu_codec block of accel samples
+ *  seq(2, big endian) with bit 15 set, then raw x,y,z samples (2 each,
+ *  big endian)
+ * The rest of seq is the index of the first sample modulo 32768, so a jump
+ * tells the phone how many samples were lost. The raw layout is used when
+ * the samples change too fast for a codec block to hold as many. */
+#define SENSOR_STREAM_PACKET_SIZE      20
+#define SENSOR_STREAM_SEQ_RAW          0x8000
+#define SENSOR_STREAM_SEQ_MASK         0x7FFF
+
+/* Samples gathered before a packet is encoded, at least as many as the
+ * quietest signal fits into one. */
+#define SENSOR_STREAM_WINDOW           32
+
+/* Packed notifications held while the link is slower than the sensor, the
+ * oldest go first when it is full. Power of two. */
+#define SENSOR_STREAM_QUEUE_SIZE       32
+
+typedef struct {
+	uint32_t packets;          /* Notifications handed to the stack. */
+	uint32_t samples;
+	uint32_t dropped;          /* Samples lost to a full queue or sensor overrun. */
+} sensor_stream_stats_t;
+
+/* value_handle is the notifying characteristic the samples go out on. */
+void sensor_stream_init(uint16_t value_handle);
+
+/* Tracks the connection and refills the stack's TX buffers as they free up. */
+void sensor_stream_on_ble_evt(ble_evt_t * p_ble_evt);
+
+/* Packs new sensor samples and notifies as many packets as the stack takes.
+ * Main loop only. Returns the first unexpected sd_ble_gatts_hvx() error. */
+uint32_t sensor_stream_process(void);
+
+void sensor_stream_stats_get(sensor_stream_stats_t *p_stats);
+
+#endif /* SENSOR_STREAM_H__ */
@@ -15,9 +15,15 @@
 
 /* Includes ------------------------------------------------------------------*/
 
+#include <string.h>
 #include "LSM6DS3_ACC_GYRO_driver.h"  
-#include "twi_master.h"
+#include "app_util.h"
+#include "app_util_platform.h"
 #include "nrf_delay.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_gpiote.h"
+#include "sensor_test.h"
+#include "sensor_twi.h"
 
 
 
@@ -39,6 +45,26 @@
 
 #define SENSITIVITY_2000DPS    70.0/1000 /* dps/LSB */
 
+/* One FIFO pattern: gyro XYZ then accel XYZ, 16-bit words */
+#define SENSOR_PATTERN_WORDS       6
+#define SENSOR_PATTERN_BYTES       (SENSOR_PATTERN_WORDS*2)
+/* Offsets in the STATUS_REG..OUTZ_H_XL block */
+#define SENSOR_STATUS_OUT_GYRO     (LSM6DS3_ACC_GYRO_OUTX_L_G-LSM6DS3_ACC_GYRO_STATUS_REG)
+#define SENSOR_STATUS_OUT_ACC      (LSM6DS3_ACC_GYRO_OUTX_L_XL-LSM6DS3_ACC_GYRO_STATUS_REG)
+STATIC_ASSERT(SENSOR_STATUS_OUT_ACC+6 <= LSM6DS3_ACC_GYRO_STATUS_GYRO_ACC_LEN);
+
+/* One TWI read of FIFO data, whole words */
+#define SENSOR_BURST_BYTES         254
+
+/* The ring's TWI queue takes the 7-bit address */
+#define SENSOR_TWI_ADDRESS         (LSM6DS3_ACC_GYRO_I2C_ADDRESS >> 1)
+
+/* FIFO drain steps, the TWI callbacks only move it along */
+#define SENSOR_DRAIN_IDLE          0
+#define SENSOR_DRAIN_STATUS        1   /* FIFO_STATUS1..4 read in flight */
+#define SENSOR_DRAIN_DATA          2   /* Burst read in flight */
+#define SENSOR_DRAIN_READY         3   /* Burst landed, to be unpacked in main */
+
 /* Private macro -------------------------------------------------------------*/
 
 /* Private variables ---------------------------------------------------------*/
@@ -54,6 +80,32 @@ Type1Axis16bit_U StepCount;
 
 status_t response;  
 
+static u8_t m_status_out[LSM6DS3_ACC_GYRO_STATUS_GYRO_ACC_LEN];
+
+/* Drained samples, single producer and consumer both in main context */
+static sensor_sample_t m_ring[SENSOR_FIFO_RING_SIZE];
+static uint32_t m_ring_wr = 0;
+static uint32_t m_ring_rd = 0;
+static uint32_t m_ring_overruns = 0;
+static volatile bool m_fifo_pending = false;
+static bool m_fifo_running = false;
+static sensor_fifo_handler_t m_fifo_handler = NULL;
+static sensor_fifo_wakeup_t m_fifo_wakeup = NULL;
+
+/* Asynchronous FIFO drain */
+static volatile u8_t m_drain_state = SENSOR_DRAIN_IDLE;
+static u8_t m_fifo_status[4];
+static u8_t m_burst[SENSOR_BURST_BYTES];
+static u16_t m_burst_skip;       /* Bytes of a partial pattern ahead of the data */
+static u16_t m_burst_patterns;
+static bool m_burst_more;        /* The FIFO held more than one burst */
+
+/* Asynchronous polling when the FIFO is not running */
+static u8_t m_poll_out[LSM6DS3_ACC_GYRO_STATUS_GYRO_ACC_LEN];
+static u8_t m_poll_acc[6];
+STATIC_ASSERT(SENSOR_STATUS_OUT_ACC+sizeof(m_poll_acc) <= sizeof(m_poll_out));
+static volatile bool m_poll_busy = false;
+
 /* Extern variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 
@@ -116,14 +168,17 @@ static void Loop_Test_Sample_Aquisition(void)
   while(1)
   {
     /*
-     * Read ACC output only if new ACC value is available
+     * Status, gyro and ACC output in a single transaction
      */
-    response =  LSM6DS3_ACC_GYRO_R_XLDA(&value_XL);
+    response =  LSM6DS3_ACC_GYRO_Get_GetStatusGyroAccData(m_status_out);
     if(response==MEMS_ERROR) while(1); //manage here comunication error  
     
-    if (LSM6DS3_ACC_GYRO_XLDA_DATA_AVAIL==value_XL)
+    /*
+     * Use ACC output only if new ACC value is available
+     */
+    if (m_status_out[0] & LSM6DS3_ACC_GYRO_XLDA_MASK)
     {
-      LSM6DS3_ACC_GYRO_Get_GetAccData(Acceleration.u8bit);
+      memcpy(Acceleration.u8bit, &m_status_out[SENSOR_STATUS_OUT_ACC], 6);
 
       /* Transorm LSB into G */
       Acceleration_G[0]=Acceleration.i16bit[0]*SENSITIVITY_8G;
@@ -132,14 +187,11 @@ static void Loop_Test_Sample_Aquisition(void)
     }
 
     /* 
-     * Read GYRO output only if new gyro value is available
+     * Use GYRO output only if new gyro value is available
      */
-    response =  LSM6DS3_ACC_GYRO_R_GDA(&value_G);
-    if(response==MEMS_ERROR) while(1); //manage here comunication error  
-    
-    if (LSM6DS3_ACC_GYRO_GDA_DATA_AVAIL==value_G)
+    if (m_status_out[0] & LSM6DS3_ACC_GYRO_GDA_MASK)
     {
-      LSM6DS3_ACC_GYRO_Get_GetGyroData(AngularRate.u8bit);
+      memcpy(AngularRate.u8bit, &m_status_out[SENSOR_STATUS_OUT_GYRO], 6);
 
       /* Transorm LSB into dps */
       AngularRate_dps[0]=AngularRate.i16bit[0]*SENSITIVITY_2000DPS;
@@ -254,7 +306,8 @@ int sensor_init(void)
   uint8_t WHO_AM_I = 0x0;
 
   /* for lsm6ds3 pedometer */
-  twi_master_init();
+  if (sensor_twi_init() != 0)
+    return -1;
   nrf_delay_ms(5);
 
   /* Read WHO_AM_I  and check if device is really the LSM6DS3 */
@@ -306,14 +359,272 @@ int sensor_init(void)
   return 0;
 }
 
+/* TWI interrupt: keep the accel output only if XLDA said it is new */
+static void sensor_poll_done(int result, void *p_context)
+{
+    if (result == 0 && (m_poll_out[0] & LSM6DS3_ACC_GYRO_XLDA_MASK))
+        memcpy(m_poll_acc, &m_poll_out[SENSOR_STATUS_OUT_ACC], sizeof(m_poll_acc));
+    m_poll_busy = false;
+}
+
 void sensor_test(uint8_t* data)
 {
-    do {
-        response =  LSM6DS3_ACC_GYRO_R_XLDA(&value_XL);
-        if(response==MEMS_ERROR) while(1); //manage here comunication error  
-    } while(LSM6DS3_ACC_GYRO_XLDA_DATA_AVAIL != value_XL);
-	
-    LSM6DS3_ACC_GYRO_Get_GetAccData(data);
+    /* In FIFO mode hand out the newest drained sample, no bus traffic */
+    if (m_fifo_running && m_ring_wr != 0)
+    {
+        memcpy(data, m_ring[(m_ring_wr - 1) & (SENSOR_FIFO_RING_SIZE - 1)].acc, 6);
+        return;
+    }
+
+    /* Called from the timer: hand out the last completed read and queue the
+       next one instead of waiting for the bus */
+    CRITICAL_REGION_ENTER();
+    memcpy(data, m_poll_acc, 6);
+    CRITICAL_REGION_EXIT();
+
+    if (!m_poll_busy)
+    {
+        m_poll_busy = true;
+        if (sensor_twi_read_async(SENSOR_TWI_ADDRESS, LSM6DS3_ACC_GYRO_STATUS_REG,
+                                  m_poll_out, sizeof(m_poll_out), sensor_poll_done, NULL) != 0)
+            m_poll_busy = false;
+    }
  }
 
+/* FIFO acquisition ----------------------------------------------------------*/
+
+static void sensor_fifo_wake(void)
+{
+  if (m_fifo_wakeup != NULL)
+    m_fifo_wakeup();
+}
+
+static void sensor_int1_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+  m_fifo_pending = true;
+  sensor_fifo_wake();
+}
+
+/* Init the FIFO: gyro and accel both at 416 Hz, stored undecimated */
+static void init_LSM6DS3_FIFO(void)
+{
+  /* Bypass first, this empties the FIFO and restarts the pattern */
+  response = LSM6DS3_ACC_GYRO_W_FIFO_MODE(LSM6DS3_ACC_GYRO_FIFO_MODE_BYPASS);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  response = LSM6DS3_ACC_GYRO_W_ODR_G(LSM6DS3_ACC_GYRO_ODR_G_416Hz);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  response = LSM6DS3_ACC_GYRO_W_FS_G(LSM6DS3_ACC_GYRO_FS_G_2000dps);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  response = LSM6DS3_ACC_GYRO_W_DEC_FIFO_XL(LSM6DS3_ACC_GYRO_DEC_FIFO_XL_NO_DECIMATION);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  response = LSM6DS3_ACC_GYRO_W_DEC_FIFO_G(LSM6DS3_ACC_GYRO_DEC_FIFO_G_NO_DECIMATION);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  /* Watermark is counted in 16-bit words */
+  response = LSM6DS3_ACC_GYRO_W_FIFO_Watermark(SENSOR_FIFO_WATERMARK_SAMPLES * SENSOR_PATTERN_WORDS);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  response = LSM6DS3_ACC_GYRO_W_FIFO_TSHLD_on_INT1(LSM6DS3_ACC_GYRO_INT1_FTH_ENABLED);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  response = LSM6DS3_ACC_GYRO_W_ODR_FIFO(LSM6DS3_ACC_GYRO_ODR_FIFO_400Hz);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+
+  /* Continuous mode: the oldest samples go if we ever fall behind */
+  response = LSM6DS3_ACC_GYRO_W_FIFO_MODE(LSM6DS3_ACC_GYRO_FIFO_MODE_STREAM);
+  if(response==MEMS_ERROR) while(1); //manage here comunication error
+}
+
+int sensor_fifo_start(void)
+{
+  uint32_t err_code;
+  nrf_drv_gpiote_in_config_t config;
+
+  if (!nrf_drv_gpiote_is_init())
+  {
+    err_code = nrf_drv_gpiote_init();
+    if (err_code != NRF_SUCCESS)
+      return -1;
+  }
+
+  config.is_watcher = false;
+  config.hi_accuracy = false;
+  config.sense = NRF_GPIOTE_POLARITY_LOTOHI;
+  config.pull = NRF_GPIO_PIN_PULLDOWN;
+  err_code = nrf_drv_gpiote_in_init(SENSOR_INT1_PIN, &config, sensor_int1_handler);
+  if (err_code != NRF_SUCCESS)
+    return -1;
+
+  m_ring_wr = 0;
+  m_ring_rd = 0;
+  m_ring_overruns = 0;
+  init_LSM6DS3_FIFO();
+  m_fifo_running = true;
+  nrf_drv_gpiote_in_event_enable(SENSOR_INT1_PIN, true);
+
+  return 0;
+}
+
+static void sensor_fifo_push(u8_t const *p_pattern)
+{
+  sensor_sample_t *p_sample;
+  u8_t i;
+
+  /* Full: drop the oldest so the ring stays contiguous in time */
+  if (m_ring_wr - m_ring_rd == SENSOR_FIFO_RING_SIZE)
+  {
+    m_ring_rd++;
+    m_ring_overruns++;
+  }
+  p_sample = &m_ring[m_ring_wr & (SENSOR_FIFO_RING_SIZE - 1)];
+  for (i=0; i<3; i++)
+  {
+    p_sample->gyro[i] = (int16_t)(p_pattern[2*i] | (p_pattern[2*i+1] << 8));
+    p_sample->acc[i]  = (int16_t)(p_pattern[6+2*i] | (p_pattern[6+2*i+1] << 8));
+  }
+  m_ring_wr++;
+}
+
+/* TWI interrupt: the burst has landed in m_burst */
+static void sensor_fifo_data_done(int result, void *p_context)
+{
+  m_drain_state = (result == 0) ? SENSOR_DRAIN_READY : SENSOR_DRAIN_IDLE;
+  sensor_fifo_wake();
+}
+
+/* TWI interrupt: size the burst from FIFO_STATUS1..4 and queue it */
+static void sensor_fifo_status_done(int result, void *p_context)
+{
+  u16_t words;
+  u16_t pattern;
+  u16_t avail;
+
+  if (result != 0)
+  {
+    m_drain_state = SENSOR_DRAIN_IDLE;
+    sensor_fifo_wake();
+    return;
+  }
+  words = ((m_fifo_status[1] & LSM6DS3_ACC_GYRO_DIFF_FIFO_STATUS2_MASK) << 8) | m_fifo_status[0];
+  pattern = ((m_fifo_status[3] & LSM6DS3_ACC_GYRO_FIFO_STATUS4_PATTERN_MASK) << 8) |
+            (m_fifo_status[2] & LSM6DS3_ACC_GYRO_FIFO_STATUS3_PATTERN_MASK);
+
+  /* Read and drop words until the data starts a pattern (gyro X) again */
+  m_burst_skip = 0;
+  if (pattern != 0 && words >= SENSOR_PATTERN_WORDS - pattern)
+  {
+    m_burst_skip = (SENSOR_PATTERN_WORDS - pattern) * 2;
+    words -= SENSOR_PATTERN_WORDS - pattern;
+  }
+
+  avail = words / SENSOR_PATTERN_WORDS;
+  m_burst_patterns = (SENSOR_BURST_BYTES - m_burst_skip) / SENSOR_PATTERN_BYTES;
+  if (m_burst_patterns > avail)
+    m_burst_patterns = avail;
+  m_burst_more = (avail > m_burst_patterns);
+
+  if (m_burst_skip + m_burst_patterns == 0)
+  {
+    m_drain_state = SENSOR_DRAIN_IDLE;
+    sensor_fifo_wake();
+    return;
+  }
+  m_drain_state = SENSOR_DRAIN_DATA;
+  if (sensor_twi_read_async(SENSOR_TWI_ADDRESS, LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L, m_burst,
+                            m_burst_skip + m_burst_patterns * SENSOR_PATTERN_BYTES,
+                            sensor_fifo_data_done, NULL) != 0)
+  {
+    m_drain_state = SENSOR_DRAIN_IDLE;
+    sensor_fifo_wake();
+  }
+}
+
+/* Hands the samples from seq on to the handler, in at most two runs */
+static void sensor_fifo_notify(uint32_t seq)
+{
+  uint32_t start;
+  uint32_t count;
+
+  while (m_fifo_handler != NULL && seq != m_ring_wr)
+  {
+    start = seq & (SENSOR_FIFO_RING_SIZE - 1);
+    count = m_ring_wr - seq;
+    if (count > SENSOR_FIFO_RING_SIZE - start)
+      count = SENSOR_FIFO_RING_SIZE - start;
+    m_fifo_handler(seq, &m_ring[start], (uint16_t)count);
+    seq += count;
+  }
+}
+
+void sensor_fifo_process(void)
+{
+  uint32_t seq;
+  u16_t i;
+
+  /* The ring is only touched here, the interrupts just fill m_burst */
+  if (m_drain_state == SENSOR_DRAIN_READY)
+  {
+    seq = m_ring_wr;
+    for (i=0; i<m_burst_patterns; i++)
+      sensor_fifo_push(&m_burst[m_burst_skip + i * SENSOR_PATTERN_BYTES]);
+    sensor_fifo_notify(seq);
+
+    /* INT1 is a level; no new edge comes if it is still above the watermark */
+    if (m_burst_more || nrf_gpio_pin_read(SENSOR_INT1_PIN))
+      m_fifo_pending = true;
+    m_drain_state = SENSOR_DRAIN_IDLE;
+  }
+
+  if (!m_fifo_pending || m_drain_state != SENSOR_DRAIN_IDLE)
+    return;
+  m_fifo_pending = false;
+
+  m_drain_state = SENSOR_DRAIN_STATUS;
+  if (sensor_twi_read_async(SENSOR_TWI_ADDRESS, LSM6DS3_ACC_GYRO_FIFO_STATUS1, m_fifo_status,
+                            sizeof(m_fifo_status), sensor_fifo_status_done, NULL) != 0)
+  {
+    /* Queue full, try again on the next pass */
+    m_drain_state = SENSOR_DRAIN_IDLE;
+    m_fifo_pending = true;
+    sensor_fifo_wake();
+  }
+}
+
+uint16_t sensor_fifo_read(sensor_sample_t *p_samples, uint16_t max)
+{
+  uint16_t n = 0;
+
+  while (n < max && m_ring_rd != m_ring_wr)
+  {
+    p_samples[n++] = m_ring[m_ring_rd & (SENSOR_FIFO_RING_SIZE - 1)];
+    m_ring_rd++;
+  }
+
+  return n;
+}
+
+uint32_t sensor_fifo_seq(void)
+{
+  return m_ring_rd;
+}
+
+uint32_t sensor_fifo_overruns(void)
+{
+  return m_ring_overruns;
+}
+
+void sensor_fifo_handler_set(sensor_fifo_handler_t handler)
+{
+  m_fifo_handler = handler;
+}
+
+void sensor_fifo_wakeup_set(sensor_fifo_wakeup_t wakeup)
+{
+  m_fifo_wakeup = wakeup;
+}
+
 /******************* (C) COPYRIGHT 2011 STMicroelectronics *****END OF FILE****/
@@ -1,8 +1,45 @@
 #ifndef SENSOR_TEST_H_
 #define SENSOR_TEST_H_
 
+#include <stdint.h>
+
+/* LSM6DS3 INT1, raised while the FIFO is above the watermark. */
+#define SENSOR_INT1_PIN                  19
+
+/* Samples (gyro + accel pairs) per watermark interrupt: 13 wakeups/s at 416 Hz. */
+#define SENSOR_FIFO_WATERMARK_SAMPLES    32
+/* Drained samples kept for the consumers, power of two. */
+#define SENSOR_FIFO_RING_SIZE            128
+
+typedef struct {
+  int16_t gyro[3];
+  int16_t acc[3];
+} sensor_sample_t;
+
+/* Sees every drained sample once, in order, seq being the index of the
+ * first one. Runs from sensor_fifo_process(). */
+typedef void (*sensor_fifo_handler_t)(uint32_t seq, sensor_sample_t const *p_samples, uint16_t count);
+/* Tells the main loop that sensor_fifo_process() has work, mostly from
+ * interrupts. */
+typedef void (*sensor_fifo_wakeup_t)(void);
+
 int sensor_init(void);
 void sensor_test(uint8_t* data);
 
+/* Puts the LSM6DS3 in continuous FIFO mode with the watermark on INT1. */
+int sensor_fifo_start(void);
+/* Drains the FIFO after a watermark interrupt; call from the main loop. */
+void sensor_fifo_process(void);
+/* Takes up to max samples out of the ring, oldest first. */
+uint16_t sensor_fifo_read(sensor_sample_t *p_samples, uint16_t max);
+/* Index since sensor_fifo_start() of the next sample sensor_fifo_read()
+ * returns, to time stamp it at the ODR. */
+uint32_t sensor_fifo_seq(void);
+uint32_t sensor_fifo_overruns(void);
+/* Taps the sample stream ahead of the ring, NULL to stop. */
+void sensor_fifo_handler_set(sensor_fifo_handler_t handler);
+/* Without one, sensor_fifo_process() has to be polled. */
+void sensor_fifo_wakeup_set(sensor_fifo_wakeup_t wakeup);
+
 #endif /* SENSOR_TEST_H_ */
 
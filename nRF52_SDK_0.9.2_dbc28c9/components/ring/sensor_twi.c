@@ -0,0 +1,208 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "app_util_platform.h"
+#include "nrf_drv_twi.h"
+
+#include "sensor_twi.h"
+
+typedef enum {
+	SENSOR_TWI_STEP_IDLE,
+	SENSOR_TWI_STEP_ADDR,	/* Register address out, bus held for the repeated start */
+	SENSOR_TWI_STEP_READ,	/* Data coming into the caller's buffer */
+	SENSOR_TWI_STEP_WRITE	/* Register address and data out */
+} sensor_twi_step_t;
+
+typedef struct {
+	uint8_t addr;
+	uint8_t len;
+	bool write;
+	uint8_t *p_data;
+	sensor_twi_callback_t callback;
+	void *p_context;
+	uint8_t buf[1 + SENSOR_TWI_WRITE_MAX];	/* Register address, then write data */
+} sensor_twi_req_t;
+
+/* Transaction queue, run from the TWI event handler. */
+static struct {
+	sensor_twi_req_t req[SENSOR_TWI_QUEUE_SIZE];
+	uint8_t rp;
+	uint8_t count;
+} m_queue;
+
+static const nrf_drv_twi_t m_twi = NRF_DRV_TWI_INSTANCE(0);
+static volatile sensor_twi_step_t m_step = SENSOR_TWI_STEP_IDLE;
+
+static void sensor_twi_kick(void);
+
+static void sensor_twi_complete(int result)
+{
+	sensor_twi_req_t *p_req = &m_queue.req[m_queue.rp];
+	sensor_twi_callback_t callback = p_req->callback;
+	void *p_context = p_req->p_context;
+
+	CRITICAL_REGION_ENTER();
+	if(++m_queue.rp == SENSOR_TWI_QUEUE_SIZE) {
+		m_queue.rp = 0;
+	}
+	m_queue.count--;
+	m_step = SENSOR_TWI_STEP_IDLE;
+	CRITICAL_REGION_EXIT();
+	/* Keep the bus busy before running the callback, which may queue more. */
+	sensor_twi_kick();
+	if(callback != NULL) {
+		callback(result, p_context);
+	}
+}
+
+static void sensor_twi_start(void)
+{
+	sensor_twi_req_t *p_req = &m_queue.req[m_queue.rp];
+	ret_code_t err_code;
+
+	if(p_req->write) {
+		m_step = SENSOR_TWI_STEP_WRITE;
+		err_code = nrf_drv_twi_tx(&m_twi, p_req->addr, p_req->buf, 1+p_req->len, false);
+	} else {
+		m_step = SENSOR_TWI_STEP_ADDR;
+		err_code = nrf_drv_twi_tx(&m_twi, p_req->addr, p_req->buf, 1, true);
+	}
+	if(err_code != NRF_SUCCESS) {
+		sensor_twi_complete(-1);
+	}
+}
+
+static void sensor_twi_kick(void)
+{
+	bool start = false;
+
+	CRITICAL_REGION_ENTER();
+	if(m_queue.count && m_step == SENSOR_TWI_STEP_IDLE) {
+		m_step = SENSOR_TWI_STEP_ADDR;
+		start = true;
+	}
+	CRITICAL_REGION_EXIT();
+	if(start) {
+		sensor_twi_start();
+	}
+}
+
+static void sensor_twi_event_handler(nrf_drv_twi_evt_t * p_event)
+{
+	sensor_twi_req_t *p_req = &m_queue.req[m_queue.rp];
+
+	if(m_step == SENSOR_TWI_STEP_IDLE) {
+		return;
+	}
+	switch(p_event->type) {
+		case NRF_DRV_TWI_TX_DONE:
+			if(m_step != SENSOR_TWI_STEP_ADDR) {
+				sensor_twi_complete(0);
+				break;
+			}
+			/* The bus is suspended after the address, rx restarts it. */
+			m_step = SENSOR_TWI_STEP_READ;
+			if(nrf_drv_twi_rx(&m_twi, p_req->addr, p_req->p_data, p_req->len,
+			                  false) != NRF_SUCCESS) {
+				sensor_twi_complete(-1);
+			}
+			break;
+		case NRF_DRV_TWI_RX_DONE:
+			sensor_twi_complete(0);
+			break;
+		default:
+			sensor_twi_complete(-1);
+			break;
+	}
+}
+
+static int sensor_twi_put(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len,
+                          bool write, sensor_twi_callback_t callback, void *p_context)
+{
+	sensor_twi_req_t *p_req;
+	int ret = -1;
+
+	if(len == 0 || (write && len > SENSOR_TWI_WRITE_MAX)) {
+		return -1;
+	}
+	CRITICAL_REGION_ENTER();
+	if(m_queue.count < SENSOR_TWI_QUEUE_SIZE) {
+		p_req = &m_queue.req[(m_queue.rp + m_queue.count) % SENSOR_TWI_QUEUE_SIZE];
+		p_req->addr = addr;
+		p_req->len = len;
+		p_req->write = write;
+		p_req->p_data = p_data;
+		p_req->callback = callback;
+		p_req->p_context = p_context;
+		p_req->buf[0] = reg;
+		if(write) {
+			memcpy(&p_req->buf[1], p_data, len);
+		}
+		m_queue.count++;
+		ret = 0;
+	}
+	CRITICAL_REGION_EXIT();
+	if(ret == 0) {
+		sensor_twi_kick();
+	}
+
+	return ret;
+}
+
+static void sensor_twi_sync_done(int result, void *p_context)
+{
+	*(volatile int *)p_context = result;
+}
+
+static int sensor_twi_sync(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len,
+                           bool write)
+{
+	volatile int result = 1;
+
+	if(len == 0 || (write && len > SENSOR_TWI_WRITE_MAX)) {
+		return -1;
+	}
+	/* A full queue drains by itself, retry until there is room. */
+	while(sensor_twi_put(addr, reg, p_data, len, write,
+	                     sensor_twi_sync_done, (void *)&result) != 0);
+	while(result > 0);
+
+	return result;
+}
+
+int sensor_twi_init(void)
+{
+	if(nrf_drv_twi_init(&m_twi, NULL, sensor_twi_event_handler) != NRF_SUCCESS) {
+		return -1;
+	}
+	nrf_drv_twi_enable(&m_twi);
+
+	return 0;
+}
+
+int sensor_twi_read_async(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len,
+                          sensor_twi_callback_t callback, void *p_context)
+{
+	return sensor_twi_put(addr, reg, p_data, len, false, callback, p_context);
+}
+
+int sensor_twi_write_async(uint8_t addr, uint8_t reg, const uint8_t *p_data, uint8_t len,
+                           sensor_twi_callback_t callback, void *p_context)
+{
+	return sensor_twi_put(addr, reg, (uint8_t *)p_data, len, true, callback, p_context);
+}
+
+int sensor_twi_read(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len)
+{
+	return sensor_twi_sync(addr, reg, p_data, len, false);
+}
+
+int sensor_twi_write(uint8_t addr, uint8_t reg, const uint8_t *p_data, uint8_t len)
+{
+	return sensor_twi_sync(addr, reg, (uint8_t *)p_data, len, true);
+}
+
+bool sensor_twi_is_busy(void)
+{
+	return m_queue.count != 0;
+}
@@ -0,0 +1,37 @@
+#ifndef SENSOR_TWI_H__
+#define SENSOR_TWI_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Transactions the queue holds before sensor_twi_*_async() fails. */
+#define SENSOR_TWI_QUEUE_SIZE      8
+/* Largest register write, the data is copied next to the register address. */
+#define SENSOR_TWI_WRITE_MAX       16
+
+/* Called from the TWI interrupt once a queued transaction has finished, with
+ * result 0 on success or -1 on a NACK or bus error. */
+typedef void (*sensor_twi_callback_t)(int result, void *p_context);
+
+int sensor_twi_init(void);
+
+/* Queued register access, addr is the 7-bit slave address. A read is the
+ * register address write followed by a repeated start and len data bytes,
+ * landing straight in p_data, which must stay valid until the callback. A
+ * write copies the data, so the caller's buffer may be reused at once. The
+ * calls never wait for the bus; they return -1 when the queue is full or the
+ * request is malformed. Any context. */
+int sensor_twi_read_async(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len,
+                          sensor_twi_callback_t callback, void *p_context);
+int sensor_twi_write_async(uint8_t addr, uint8_t reg, const uint8_t *p_data, uint8_t len,
+                           sensor_twi_callback_t callback, void *p_context);
+
+/* Blocking versions for configuration, queued behind whatever is pending.
+ * They spin until the TWI interrupt has run the transaction, so they must not
+ * be called from an interrupt at or above TWI0_CONFIG_IRQ_PRIORITY. */
+int sensor_twi_read(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len);
+int sensor_twi_write(uint8_t addr, uint8_t reg, const uint8_t *p_data, uint8_t len);
+
+bool sensor_twi_is_busy(void);
+
+#endif /* SENSOR_TWI_H__ */
@@ -5,6 +5,7 @@
 #include "app_error.h"
 #include "app_util_platform.h"
 #include "nrf_drv_spi.h"
+#include "nrf_gpio.h"
 #include "bsp.h"
 #include "app_timer.h"
 #include "nordic_common.h"
@@ -27,11 +28,57 @@
 #define FLASH_SPI_MISO_PIN      4
 #define FLASH_SPI_SS_PIN        3
 #define SPI_FLASH_MAX_READ_WRITE_SIZE    251
+#define SPI_FLASH_MAX_DMA_SIZE           255 /* SPIM MAXCNT is 8 bits wide */
+#define SPI_FLASH_APP_TIMER_PRESCALER    0   /* Must match the app_timer_init() prescaler. */
 
 
 static volatile bool m_transfer_completed = true;
+/* CS is driven here rather than by the driver so that a read can keep it
+ * low across the command and several data transfers. */
+static volatile bool m_cs_hold = false;
 static struct spi_flash g_spi_flash;
 
+/* Ready polling of a queued program/erase: the poll timer reads the status
+ * register until WIP clears. */
+static app_timer_id_t m_poll_timer_id;
+static volatile bool m_poll_pending = false;
+static u8 m_poll_cmd = CMD_READ_STATUS;
+static u8 m_poll_status[2];
+
+typedef enum {
+	SPI_FLASH_STEP_IDLE,
+	SPI_FLASH_STEP_WREN,	/* WRITE ENABLE of the chunk in flight */
+	SPI_FLASH_STEP_CMD,	/* Read, program or erase command in flight */
+	SPI_FLASH_STEP_DATA,	/* Read data landing in the caller's buffer */
+	SPI_FLASH_STEP_POLL	/* Waiting for WIP to clear */
+} spi_flash_step_t;
+
+typedef struct {
+	spi_flash_op_t op;
+	u32 offset;
+	size_t len;
+	u8 *data;
+	spi_flash_callback_t callback;
+	void *p_context;
+} spi_flash_req_t;
+
+/* Request queue, run one chunk at a time from the SPI event handler. */
+static struct {
+	spi_flash_req_t req[SPI_FLASH_QUEUE_SIZE];
+	u8 rp;
+	u8 count;
+} m_queue;
+
+static volatile spi_flash_step_t m_step = SPI_FLASH_STEP_IDLE;
+static volatile bool m_sync_active = false;
+static size_t m_done;		/* Bytes of the head request finished */
+static size_t m_chunk;		/* Bytes of the chunk in flight */
+static u32 m_polls_left;
+static u8 m_queue_cmd[5];	/* Read header or WRITE ENABLE, kept apart from the rx buffer */
+static u8 m_queue_buf[256];	/* Page program command and data */
+
+static void spi_flash_queue_kick(void);
+
 static void spi_flash_addr(u32 addr, u8 *cmd)
 {
 	/* cmd[0] is actual command */
@@ -40,31 +87,294 @@ static void spi_flash_addr(u32 addr, u8 *cmd)
 	cmd[3] = addr >> 0;
 }
 
+/* Selects the chip and starts a transfer. With hold set CS stays low after
+ * it, so the next transfer continues the same command. */
+static uint32_t spi_flash_start(struct spi_flash *flash, const u8 *tx, u8 tx_len,
+                                u8 *rx, u8 rx_len, bool hold)
+{
+	uint32_t err_code;
+
+	m_cs_hold = hold;
+	nrf_gpio_pin_clear(FLASH_SPI_SS_PIN);
+	err_code = nrf_drv_spi_transfer(flash->spi->drv_spi, tx, tx_len, rx, rx_len);
+	if(err_code != NRF_SUCCESS) {
+		nrf_gpio_pin_set(FLASH_SPI_SS_PIN);
+	}
+
+	return err_code;
+}
+
+/* Runs one transfer to completion. */
+static int spi_flash_xfer_hold(struct spi_flash *flash, const u8 *tx, u8 tx_len,
+                               u8 *rx, u8 rx_len, bool hold)
+{
+	WAIT_FOR_TRANSFER_COMPLETED;
+	if(spi_flash_start(flash, tx, tx_len, rx, rx_len, hold) != NRF_SUCCESS) {
+		m_transfer_completed = true;
+		return -1;
+	}
+	while(!m_transfer_completed);
+
+	return 0;
+}
+
+static int spi_flash_xfer(struct spi_flash *flash, const u8 *tx, u8 tx_len,
+                          u8 *rx, u8 rx_len)
+{
+	return spi_flash_xfer_hold(flash, tx, tx_len, rx, rx_len, false);
+}
+
 static int spi_flash_cmd_wait_ready(struct spi_flash *flash, unsigned long timeout)
 {
-#if 0
 	u8 cmd;
-	u8 status[3];
+	u8 status[2];
+	unsigned long polls;
 
+	polls = timeout*1000/SPI_FLASH_POLL_DELAY_US;
+	cmd = CMD_READ_STATUS;
 	do {
-		WAIT_FOR_TRANSFER_COMPLETED;
-		cmd = CMD_READ_STATUS;
-		if(nrf_drv_spi_transfer(flash->spi->drv_spi,
-		                        &cmd, 1, status, 3) != NRF_SUCCESS) {
+		if(spi_flash_xfer(flash, &cmd, 1, status, 2) != 0) {
 			return -1;
 		}
-		if((status[1]&0x01) == 0) {
+		if((status[1] & STATUS_WIP) == 0) {
 			return 0;
 		}
-	} while(timeout--);
+		nrf_delay_us(SPI_FLASH_POLL_DELAY_US);
+	} while(polls--);
 
 	return -1;
-#else
-		nrf_delay_ms(100);
-    return 0;
-#endif
 }
 
+/* Takes the bus from the request queue for a synchronous call. Only thread
+ * mode waits for the queue to pause; an interrupt would block the SPI event
+ * that lets it, so there the call fails while a request is in flight. */
+static int spi_flash_claim(void)
+{
+	bool claimed = false;
+	bool wait;
+
+	wait = (current_int_priority_get() == NRF_APP_PRIORITY_THREAD);
+	do {
+		CRITICAL_REGION_ENTER();
+		if(!m_sync_active && m_step == SPI_FLASH_STEP_IDLE) {
+			m_sync_active = true;
+			claimed = true;
+		}
+		CRITICAL_REGION_EXIT();
+	} while(!claimed && wait);
+
+	return claimed ? 0 : -1;
+}
+
+static void spi_flash_release(void)
+{
+	m_sync_active = false;
+	spi_flash_queue_kick();
+}
+
+static int spi_flash_cmd_write_enable(struct spi_flash *flash)
+{
+	u8 cmd = CMD_WRITE_ENABLE;
+
+	return spi_flash_xfer(flash, &cmd, 1, NULL, 0);
+}
+
+static void spi_flash_poll_timeout_handler(void * p_context)
+{
+	m_poll_pending = true;
+	if(spi_flash_start(&g_spi_flash, &m_poll_cmd, 1,
+	                   m_poll_status, 2, false) != NRF_SUCCESS) {
+		m_poll_pending = false;
+		APP_ERROR_CHECK(app_timer_start(m_poll_timer_id,
+		                                APP_TIMER_TICKS(SPI_FLASH_POLL_INTERVAL_MS, SPI_FLASH_APP_TIMER_PRESCALER),
+		                                NULL));
+	}
+}
+
+static void spi_flash_queue_complete(int result)
+{
+	spi_flash_req_t req;
+
+	req = m_queue.req[m_queue.rp];
+	CRITICAL_REGION_ENTER();
+	if(++m_queue.rp == SPI_FLASH_QUEUE_SIZE) {
+		m_queue.rp = 0;
+	}
+	m_queue.count--;
+	m_step = SPI_FLASH_STEP_IDLE;
+	CRITICAL_REGION_EXIT();
+	spi_flash_queue_kick();
+	if(req.callback != NULL) {
+		req.callback(req.op, req.offset, req.len, result, req.p_context);
+	}
+}
+
+/* Starts the next chunk of the head request, or completes it. */
+static void spi_flash_queue_next(void)
+{
+	spi_flash_req_t *p_req = &m_queue.req[m_queue.rp];
+	uint32_t err_code;
+
+	if(m_done == p_req->len) {
+		spi_flash_queue_complete(0);
+		return;
+	}
+	if(p_req->op == SPI_FLASH_OP_READ) {
+		/* One command for the whole request, the data follows with CS held. */
+		m_queue_cmd[0] = CMD_READ_ARRAY_FAST;
+		spi_flash_addr(p_req->offset, m_queue_cmd);
+		m_queue_cmd[4] = 0x00;
+		m_step = SPI_FLASH_STEP_CMD;
+		err_code = spi_flash_start(&g_spi_flash, m_queue_cmd, 5, NULL, 0, true);
+	} else {
+		m_queue_cmd[0] = CMD_WRITE_ENABLE;
+		m_step = SPI_FLASH_STEP_WREN;
+		err_code = spi_flash_start(&g_spi_flash, m_queue_cmd, 1, NULL, 0, false);
+	}
+	if(err_code != NRF_SUCCESS) {
+		spi_flash_queue_complete(-1);
+	}
+}
+
+/* Sends the program or erase command once the chip is write enabled. */
+static void spi_flash_queue_command(void)
+{
+	spi_flash_req_t *p_req = &m_queue.req[m_queue.rp];
+	struct spi_flash *flash = &g_spi_flash;
+	u32 offset = p_req->offset + m_done;
+	u8 len;
+
+	if(p_req->op == SPI_FLASH_OP_WRITE) {
+		m_chunk = min(p_req->len - m_done, flash->page_size - offset % flash->page_size);
+		m_chunk = min(m_chunk, flash->spi->max_write_size);
+		m_queue_buf[0] = CMD_PAGE_PROGRAM;
+		memcpy(&m_queue_buf[4], p_req->data + m_done, m_chunk);
+		len = m_chunk+4;
+	} else {
+		m_chunk = flash->sector_size;
+		m_queue_buf[0] = (flash->sector_size == 4096) ? CMD_ERASE_4K : CMD_ERASE_64K;
+		len = 4;
+	}
+	spi_flash_addr(offset, m_queue_buf);
+	m_step = SPI_FLASH_STEP_CMD;
+	if(spi_flash_start(flash, m_queue_buf, len, NULL, 0, false) != NRF_SUCCESS) {
+		spi_flash_queue_complete(-1);
+	}
+}
+
+/* Receives the next piece of a read straight into the caller's buffer. */
+static void spi_flash_queue_read_data(void)
+{
+	spi_flash_req_t *p_req = &m_queue.req[m_queue.rp];
+	size_t left = p_req->len - m_done;
+
+	m_chunk = min(left, SPI_FLASH_MAX_DMA_SIZE);
+	m_step = SPI_FLASH_STEP_DATA;
+	if(spi_flash_start(&g_spi_flash, NULL, 0, p_req->data + m_done, m_chunk,
+	                   left > m_chunk) != NRF_SUCCESS) {
+		spi_flash_queue_complete(-1);
+	}
+}
+
+static void spi_flash_queue_event(void)
+{
+	spi_flash_req_t *p_req = &m_queue.req[m_queue.rp];
+
+	switch(m_step) {
+		case SPI_FLASH_STEP_WREN:
+			spi_flash_queue_command();
+			break;
+		case SPI_FLASH_STEP_DATA:
+			m_done += m_chunk;
+			if(m_done == p_req->len) {
+				spi_flash_queue_complete(0);
+			} else {
+				spi_flash_queue_read_data();
+			}
+			break;
+		case SPI_FLASH_STEP_CMD:
+			if(p_req->op == SPI_FLASH_OP_READ) {
+				spi_flash_queue_read_data();
+				break;
+			}
+			m_polls_left = ((p_req->op == SPI_FLASH_OP_WRITE) ?
+			                SPI_FLASH_PROG_TIMEOUT : SPI_FLASH_SECTOR_ERASE_TIMEOUT) /
+			               SPI_FLASH_POLL_INTERVAL_MS;
+			m_step = SPI_FLASH_STEP_POLL;
+			if(app_timer_start(m_poll_timer_id,
+			                   APP_TIMER_TICKS(SPI_FLASH_POLL_INTERVAL_MS, SPI_FLASH_APP_TIMER_PRESCALER),
+			                   NULL) != NRF_SUCCESS) {
+				spi_flash_queue_complete(-1);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* Starts the head request when neither a synchronous call nor an
+ * asynchronous program/erase owns the bus. */
+static void spi_flash_queue_kick(void)
+{
+	bool start = false;
+
+	CRITICAL_REGION_ENTER();
+	if(m_queue.count && m_step == SPI_FLASH_STEP_IDLE &&
+	   !m_sync_active) {
+		m_done = 0;
+		m_step = SPI_FLASH_STEP_WREN;
+		start = true;
+	}
+	CRITICAL_REGION_EXIT();
+	if(start) {
+		spi_flash_queue_next();
+	}
+}
+
+static int spi_flash_queue_put(spi_flash_op_t op, u32 offset, size_t len, u8 *data,
+                               spi_flash_callback_t callback, void *p_context)
+{
+	spi_flash_req_t *p_req;
+	int ret = -1;
+
+	if(len == 0 || offset + len > g_spi_flash.size) {
+		return -1;
+	}
+	CRITICAL_REGION_ENTER();
+	if(m_queue.count < SPI_FLASH_QUEUE_SIZE) {
+		p_req = &m_queue.req[(m_queue.rp + m_queue.count) % SPI_FLASH_QUEUE_SIZE];
+		p_req->op = op;
+		p_req->offset = offset;
+		p_req->len = len;
+		p_req->data = data;
+		p_req->callback = callback;
+		p_req->p_context = p_context;
+		m_queue.count++;
+		ret = 0;
+	}
+	CRITICAL_REGION_EXIT();
+	if(ret == 0) {
+		spi_flash_queue_kick();
+	}
+
+	return ret;
+}
+
+static void spi_flash_poll_done(void)
+{
+	if(m_poll_status[1] & STATUS_WIP) {
+		if(m_polls_left-- == 0) {
+			spi_flash_queue_complete(-1);
+			return;
+		}
+		APP_ERROR_CHECK(app_timer_start(m_poll_timer_id,
+		                                APP_TIMER_TICKS(SPI_FLASH_POLL_INTERVAL_MS, SPI_FLASH_APP_TIMER_PRESCALER),
+		                                NULL));
+		return;
+	}
+	m_done += m_chunk;
+	spi_flash_queue_next();
+}
 
 static int spi_flash_cmd_erase(struct spi_flash *flash, u32 offset, size_t len)
 {
@@ -84,8 +394,8 @@ static int spi_flash_cmd_erase(struct spi_flash *flash, u32 offset, size_t len)
 
 	while(len) {
 		spi_flash_addr(offset, cmd);
-		if(nrf_drv_spi_transfer(flash->spi->drv_spi,
-		                        cmd, 4, NULL, 0) != NRF_SUCCESS) {
+		if(spi_flash_cmd_write_enable(flash) != 0 ||
+		   spi_flash_xfer(flash, cmd, 4, NULL, 0) != 0) {
 			return -1;
 		}
 		if(spi_flash_cmd_wait_ready(flash, SPI_FLASH_SECTOR_ERASE_TIMEOUT) != 0) {
@@ -107,7 +417,6 @@ static int spi_flash_cmd_write_multi(struct spi_flash *flash, u32 offset,
 	size_t actual;
 	u8* cmd;
 	u8 buf[256];
-	int ret = -1;
 
 	page_size = flash->page_size;
 
@@ -123,9 +432,8 @@ static int spi_flash_cmd_write_multi(struct spi_flash *flash, u32 offset,
 		spi_flash_addr(offset, cmd);
 
 		memcpy(&buf[4], data+actual, chunk_len);
-		WAIT_FOR_TRANSFER_COMPLETED;
-		if(nrf_drv_spi_transfer(flash->spi->drv_spi,
-		                        buf, chunk_len+4, NULL, 0) != NRF_SUCCESS) {
+		if(spi_flash_cmd_write_enable(flash) != 0 ||
+		   spi_flash_xfer(flash, buf, chunk_len+4, NULL, 0) != 0) {
 			return -1;
 		}
 		offset += chunk_len;
@@ -134,30 +442,30 @@ static int spi_flash_cmd_write_multi(struct spi_flash *flash, u32 offset,
 		}
 	}
 
-	return ret;
+	return 0;
 }
 
 static int spi_flash_cmd_read_fast(struct spi_flash *flash, u32 offset,
                                    size_t len, u8 *data)
 {
 	u8 cmd[5];
-	u8 buf[256];
 	u32 read_len;
 
 	cmd[0] = CMD_READ_ARRAY_FAST;
+	spi_flash_addr(offset, cmd);
 	cmd[4] = 0x00;
 
+	/* The read command streams until CS rises: send it once and receive
+	 * the data straight into the caller's buffer, MAXCNT bytes at a time. */
+	if(spi_flash_xfer_hold(flash, cmd, 5, NULL, 0, len != 0) != 0) {
+		return -1;
+	}
 	while(len) {
-		read_len = min(len, flash->spi->max_write_size);
-		spi_flash_addr(offset, cmd);
-		WAIT_FOR_TRANSFER_COMPLETED;
-		if(nrf_drv_spi_transfer(flash->spi->drv_spi,
-		                        cmd, 5, buf, read_len+5) != NRF_SUCCESS) {
+		read_len = min(len, SPI_FLASH_MAX_DMA_SIZE);
+		len -= read_len;
+		if(spi_flash_xfer_hold(flash, NULL, 0, data, read_len, len != 0) != 0) {
 			return -1;
 		}
-		offset += read_len;
-		len -= read_len;
-		memcpy(data, &buf[5], read_len);
 		data += read_len;
 	}
 
@@ -170,20 +478,21 @@ static int spi_flash_probe(struct spi_flash *flash, const char *name)
 	u8 idcode[4];
 
 
-	WAIT_FOR_TRANSFER_COMPLETED;
 	cmd = CMD_READ_ID;
-	if(nrf_drv_spi_transfer(flash->spi->drv_spi,
-	                        &cmd, 1, idcode, 4) != NRF_SUCCESS) {
+	if(spi_flash_xfer(flash, &cmd, 1, idcode, 4) != 0) {
 		return -1;
 	}
-	WAIT_FOR_TRANSFER_COMPLETED;
 	if(idcode[1] != SPI_FLASH_WINBOND_IDCODE0) {
 		return -1;
 	}
 	flash->name = name;
 	flash->page_size = 256;
 	flash->sector_size = (idcode[2] == 0x20) ? 65536 : 4096;
-	flash->size = 4096 * 16 * 128; /* sector size * 16(sectors per block) * blocks */
+	/* The third ID byte is log2 of the size; commands carry 3 address bytes. */
+	if(idcode[3] < 16 || idcode[3] > 31) {
+		return -1;
+	}
+	flash->size = min(1u << idcode[3], SPI_FLASH_16MB_BOUN);
 	flash->name = name;
 
 	return 0;
@@ -194,6 +503,18 @@ static void spi_flash_event_handler(nrf_drv_spi_event_t event)
 {
 	switch(event) {
 		case NRF_DRV_SPI_EVENT_DONE:
+			if(!m_cs_hold) {
+				nrf_gpio_pin_set(FLASH_SPI_SS_PIN);
+			}
+			if(m_poll_pending) {
+				m_poll_pending = false;
+				spi_flash_poll_done();
+				break;
+			}
+			if(m_step != SPI_FLASH_STEP_IDLE) {
+				spi_flash_queue_event();
+				break;
+			}
 			m_transfer_completed = true;
 			break;
 		default:
@@ -201,8 +522,6 @@ static void spi_flash_event_handler(nrf_drv_spi_event_t event)
 			break;
 	}
 }
-int spi_flash_test(void);
-u8 m_data[256];
 
 int spi_flash_init(void)
 {
@@ -214,7 +533,7 @@ int spi_flash_init(void)
 	spi.max_write_size = SPI_FLASH_MAX_READ_WRITE_SIZE;
 
 	nrf_drv_spi_config_t config = {
-		.ss_pin       = FLASH_SPI_SS_PIN,
+		.ss_pin       = NRF_DRV_SPI_PIN_NOT_USED,
 		.irq_priority = APP_IRQ_PRIORITY_LOW,
 		.orc          = 0xCC,
 		.frequency    = NRF_DRV_SPI_FREQ_1M,
@@ -224,51 +543,99 @@ int spi_flash_init(void)
 	config.sck_pin  = FLASH_SPI_SCK_PIN;
 	config.mosi_pin = FLASH_SPI_MOSI_PIN;
 	config.miso_pin = FLASH_SPI_MISO_PIN;
+	nrf_gpio_pin_set(FLASH_SPI_SS_PIN);
+	nrf_gpio_cfg_output(FLASH_SPI_SS_PIN);
 	if(nrf_drv_spi_init(&drv_spi, &config,
 	                    spi_flash_event_handler) != NRF_SUCCESS) {
 		return -1;
 	}
 	g_spi_flash.spi = &spi;
+	if(app_timer_create(&m_poll_timer_id, APP_TIMER_MODE_SINGLE_SHOT,
+	                    spi_flash_poll_timeout_handler) != NRF_SUCCESS) {
+		return -1;
+	}
 
 	ret = spi_flash_probe(&g_spi_flash, name);
-	spi_flash_test();
 
 	return ret;
 }
 
 int spi_flash_read(unsigned int offset, size_t len, unsigned char *data)
 {
-	return spi_flash_cmd_read_fast(&g_spi_flash, offset, len, data);
+	int ret;
+
+	if(spi_flash_claim() != 0) {
+		return -1;
+	}
+	ret = spi_flash_cmd_read_fast(&g_spi_flash, offset, len, data);
+	spi_flash_release();
+
+	return ret;
 }
 
 int spi_flash_write(unsigned int offset, size_t len, const unsigned char *data)
 {
-	return spi_flash_cmd_write_multi(&g_spi_flash, offset, len, data);
+	int ret;
+
+	if(spi_flash_claim() != 0) {
+		return -1;
+	}
+	ret = spi_flash_cmd_write_multi(&g_spi_flash, offset, len, data);
+	spi_flash_release();
+
+	return ret;
 }
 
 int spi_flash_erase(unsigned int offset, size_t len)
 {
-	return spi_flash_cmd_erase(&g_spi_flash, offset, len);
+	int ret;
+
+	if(spi_flash_claim() != 0) {
+		return -1;
+	}
+	ret = spi_flash_cmd_erase(&g_spi_flash, offset, len);
+	spi_flash_release();
+
+	return ret;
 }
 
+int spi_flash_read_async(unsigned int offset, size_t len, unsigned char *data,
+                         spi_flash_callback_t callback, void *p_context)
+{
+	return spi_flash_queue_put(SPI_FLASH_OP_READ, offset, len, data,
+	                           callback, p_context);
+}
 
-int spi_flash_test(void)
+int spi_flash_write_async(unsigned int offset, size_t len, const unsigned char *data,
+                          spi_flash_callback_t callback, void *p_context)
 {
-	int i;
+	return spi_flash_queue_put(SPI_FLASH_OP_WRITE, offset, len, (u8 *)data,
+	                           callback, p_context);
+}
 
-	if(spi_flash_erase(0, 4096*2) != 0) {
-		return -1;
-	}
-	for(i = 0; i<sizeof(m_data); i++) {
-		m_data[i] = i;
-	}
-	if(spi_flash_write(0, 256, m_data) != 0) {
-		return -1;
-	}
-	memset(m_data, 0, sizeof(m_data));
-	if(spi_flash_read(0, 256, m_data) != 0) {
+int spi_flash_erase_async(unsigned int offset, size_t len,
+                          spi_flash_callback_t callback, void *p_context)
+{
+	if(offset % g_spi_flash.sector_size || len % g_spi_flash.sector_size) {
 		return -1;
 	}
 
-	return 0;
+	return spi_flash_queue_put(SPI_FLASH_OP_ERASE, offset, len, NULL,
+	                           callback, p_context);
 }
+
+unsigned int spi_flash_queue_count(void)
+{
+	return m_queue.count;
+}
+
+unsigned int spi_flash_size(void)
+{
+	return g_spi_flash.size;
+}
+
+bool spi_flash_is_busy(void)
+{
+	return m_queue.count != 0;
+}
+
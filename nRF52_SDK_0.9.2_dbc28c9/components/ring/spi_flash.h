@@ -23,6 +23,7 @@
 #ifndef _SPI_FLASH_H_
 #define _SPI_FLASH_H_
 
+#include <stdbool.h>
 #include "nrf_drv_spi.h"
 #include "ring_types.h"
 
@@ -31,18 +32,30 @@
 #define SPI_FLASH_PAGE_ERASE_TIMEOUT	(5000)
 #define SPI_FLASH_SECTOR_ERASE_TIMEOUT	(10000)
 
+/* Delay between two status reads while blocking on the WIP bit. */
+#define SPI_FLASH_POLL_DELAY_US		(50)
+/* Period of the status poll timer of a queued program/erase. */
+#define SPI_FLASH_POLL_INTERVAL_MS	(1)
+
+/* Requests the I/O queue holds before spi_flash_*_async() fails. */
+#define SPI_FLASH_QUEUE_SIZE		8
+
 /* Common commands */
 #define CMD_READ_ARRAY_FAST		0x0b
 
 #define CMD_READ_ID			    0x9f
 #define CMD_PAGE_PROGRAM		0x02
 #define CMD_READ_STATUS			0x05
+#define CMD_WRITE_ENABLE		0x06
 #define CMD_ERASE_4K			0x20
 #define CMD_ERASE_64K			0xd8
 #define CMD_ERASE_CHIP			0xc7
 
 #define SPI_FLASH_16MB_BOUN		0x1000000
 
+/* Status register bits */
+#define STATUS_WIP			0x01
+
 /* Manufacture ID's */
 #define SPI_FLASH_WINBOND_IDCODE0	0xef
 
@@ -64,9 +77,44 @@ struct spi_flash {
 	u32		sector_size;
 };
 
+typedef enum {
+	SPI_FLASH_OP_READ,
+	SPI_FLASH_OP_WRITE,
+	SPI_FLASH_OP_ERASE
+} spi_flash_op_t;
+
+/* Called from the SPI interrupt once a queued request has finished, with
+ * result 0 on success or -1 on a bus error or chip timeout. */
+typedef void (*spi_flash_callback_t)(spi_flash_op_t op, unsigned int offset,
+                                     size_t len, int result, void *p_context);
+
+/* App timers spi_flash_init() creates, to be counted in APP_TIMER_MAX_TIMERS. */
+#define SPI_FLASH_APP_TIMERS 1
+
+/* Returns 0 once the chip is probed, -1 if the bus, the poll timer or the
+ * probe failed. */
 int spi_flash_init(void);
+
+/* Blocking I/O. In thread mode these wait for the queued request in flight;
+ * from an interrupt they return -1 instead while the queue runs. */
 int spi_flash_read(unsigned int offset, size_t len, unsigned char *data);
 int spi_flash_write(unsigned int offset, size_t len, const unsigned char *data);
 int spi_flash_erase(unsigned int offset, size_t len);
+bool spi_flash_is_busy(void);
+
+/* Bytes addressable on the probed chip, 0 before spi_flash_init(). */
+unsigned int spi_flash_size(void);
+
+/* Queued I/O: the request is split on page and transfer boundaries and run
+ * from the SPI event handler, the call itself never waits for the bus. The
+ * buffer must stay valid until the callback. Returns -1 when the queue is
+ * full or the request is malformed. */
+int spi_flash_read_async(unsigned int offset, size_t len, unsigned char *data,
+                         spi_flash_callback_t callback, void *p_context);
+int spi_flash_write_async(unsigned int offset, size_t len, const unsigned char *data,
+                          spi_flash_callback_t callback, void *p_context);
+int spi_flash_erase_async(unsigned int offset, size_t len,
+                          spi_flash_callback_t callback, void *p_context);
+unsigned int spi_flash_queue_count(void);
 
 #endif /* _SPI_FLASH_H_ */
@@ -25,7 +25,7 @@
 #if (GPIOTE_ENABLED == 1)
 #define GPIOTE_CONFIG_USE_SWI_EGU false
 #define GPIOTE_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_HIGH
-#define GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS 4
+#define GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS 5
 #endif
 
 /* TIMER */
@@ -122,14 +122,15 @@
 #endif
 
 /* SPI */
-#define SPI0_ENABLED 1
+/* SPI0 shares its IRQ with TWI0, which runs the sensor bus; the LCD is on SPI2. */
+#define SPI0_ENABLED 0
 
 #if (SPI0_ENABLED == 1)
-#define SPI0_USE_EASY_DMA 1
+#define SPI0_USE_EASY_DMA 0
 
-#define SPI0_CONFIG_SCK_PIN         9
-#define SPI0_CONFIG_MOSI_PIN        10
-#define SPI0_CONFIG_MISO_PIN        0xff
+#define SPI0_CONFIG_SCK_PIN         2
+#define SPI0_CONFIG_MOSI_PIN        3
+#define SPI0_CONFIG_MISO_PIN        4
 #define SPI0_CONFIG_IRQ_PRIORITY    APP_IRQ_PRIORITY_LOW
 
 #define SPI0_INSTANCE_INDEX 0
@@ -148,14 +149,14 @@
 #define SPI1_INSTANCE_INDEX (SPI0_ENABLED)
 #endif
 
-#define SPI2_ENABLED 0
+#define SPI2_ENABLED 1
 
 #if (SPI2_ENABLED == 1)
-#define SPI2_USE_EASY_DMA 0
+#define SPI2_USE_EASY_DMA 1
 
-#define SPI2_CONFIG_SCK_PIN         2
-#define SPI2_CONFIG_MOSI_PIN        3
-#define SPI2_CONFIG_MISO_PIN        4
+#define SPI2_CONFIG_SCK_PIN         9
+#define SPI2_CONFIG_MOSI_PIN        10
+#define SPI2_CONFIG_MISO_PIN        0xff
 #define SPI2_CONFIG_IRQ_PRIORITY    APP_IRQ_PRIORITY_LOW
 
 #define SPI2_INSTANCE_INDEX (SPI0_ENABLED + SPI1_ENABLED)
@@ -183,12 +184,12 @@
 #endif //NRF52
 #endif
 
-#define TWI0_ENABLED 0
+#define TWI0_ENABLED 1
 
 #if (TWI0_ENABLED == 1)
-#define TWI0_CONFIG_FREQUENCY    NRF_TWI_FREQ_100K
-#define TWI0_CONFIG_SCL          0
-#define TWI0_CONFIG_SDA          1
+#define TWI0_CONFIG_FREQUENCY    NRF_TWI_FREQ_400K
+#define TWI0_CONFIG_SCL          20
+#define TWI0_CONFIG_SDA          21
 #define TWI0_CONFIG_IRQ_PRIORITY APP_IRQ_PRIORITY_HIGH
 
 #define TWI0_INSTANCE_INDEX      0
@@ -40,6 +40,7 @@
 #include "sensorsim.h"
 #include "softdevice_handler.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
 #include "device_manager.h"
 #include "pstorage.h"
 #include "app_trace.h"
@@ -52,6 +53,10 @@
 #include "lcd.h"
 #include "spi_flash.h"
 #include "button.h"
+#include "sensor_log.h"
+#include "sensor_stream.h"
+#include "motion.h"
+#include "ring_task.h"
 #endif
 #include "spi_flash.h"
 
@@ -63,18 +68,20 @@
 #define APP_ADV_TIMEOUT_IN_SECONDS       180                                        /**< The advertising timeout in units of seconds. */
 
 #define APP_TIMER_PRESCALER              0                                          /**< Value of the RTC1 PRESCALER register. */
+#if defined(__RING_SUPPORT__)
+#define APP_TIMER_MAX_TIMERS             (6+LCD_APP_TIMERS+SPI_FLASH_APP_TIMERS+BTN_APP_TIMERS+RING_TASK_APP_TIMERS+BSP_APP_TIMERS_NUMBER) /**< Maximum number of simultaneously created timers: timers_init() and conn_params plus the modules' own. */
+#define APP_TIMER_OP_QUEUE_SIZE          8                                          /**< Size of timer operation queues. */
+#else
 #define APP_TIMER_MAX_TIMERS             (6+BSP_APP_TIMERS_NUMBER)                  /**< Maximum number of simultaneously created timers. */
 #define APP_TIMER_OP_QUEUE_SIZE          4                                          /**< Size of timer operation queues. */
+#endif
 
 #define BATTERY_LEVEL_MEAS_INTERVAL      APP_TIMER_TICKS(2000, APP_TIMER_PRESCALER) /**< Battery level measurement interval (ticks). */
+#define BATTERY_LEVEL_MEAS_SLACK         APP_TIMER_TICKS(250, APP_TIMER_PRESCALER)  /**< How late a battery level measurement may come, so that it can share a wakeup (ticks). */
 #define MIN_BATTERY_LEVEL                81                                         /**< Minimum simulated battery level. */
 #define MAX_BATTERY_LEVEL                100                                        /**< Maximum simulated battery level. */
 #define BATTERY_LEVEL_INCREMENT          1                                          /**< Increment between each simulated battery level measurement. */
-#if defined(__RING_SUPPORT__)
-#define HEART_RATE_MEAS_INTERVAL         APP_TIMER_TICKS(8, APP_TIMER_PRESCALER) /**< Heart rate measurement interval (ticks). */
-#else
 #define HEART_RATE_MEAS_INTERVAL         APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER) /**< Heart rate measurement interval (ticks). */
-#endif
 #define MIN_HEART_RATE                   140                                        /**< Minimum heart rate as returned by the simulated measurement function. */
 #define MAX_HEART_RATE                   300                                        /**< Maximum heart rate as returned by the simulated measurement function. */
 #define HEART_RATE_INCREMENT             10                                         /**< Value by which the heart rate is incremented/decremented for each call to the simulated measurement function. */
@@ -85,7 +92,21 @@
 #define RR_INTERVAL_INCREMENT            1                                          /**< Value by which the RR interval is incremented/decremented for each call to the simulated measurement function. */
 
 #define SENSOR_CONTACT_DETECTED_INTERVAL APP_TIMER_TICKS(5000, APP_TIMER_PRESCALER) /**< Sensor Contact Detected toggle interval (ticks). */
+#define SENSOR_CONTACT_DETECTED_SLACK    APP_TIMER_TICKS(500, APP_TIMER_PRESCALER)  /**< How late a Sensor Contact Detected toggle may come (ticks). */
 #if defined(__RING_SUPPORT__)
+#define SCHED_MAX_EVENT_SIZE             BTN_SCHED_EVT_SIZE                         /**< Maximum size of scheduler events. */
+#define SCHED_QUEUE_SIZE                 (4+RING_TASK_SCHED_EVENTS)                 /**< Maximum number of events in the default scheduler lane. */
+#define SCHED_INPUT_QUEUE_SIZE           16                                         /**< Maximum number of events in the input scheduler lane. */
+#define UI_IDLE_TIMEOUT                  APP_TIMER_TICKS(10000, APP_TIMER_PRESCALER)/**< Input inactivity before the display and the input go to sleep (ticks). */
+#define UI_IDLE_SLACK                    APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER) /**< How late the display and the input may go to sleep (ticks). */
+#define SENSOR_TASK_BUDGET_US            2000                                       /**< Expected worst case of one sensor FIFO drain pass (us). */
+#define STREAM_TASK_BUDGET_US            3000                                       /**< Expected worst case of packing and notifying the queued samples (us). */
+#define LOG_FLUSH_INTERVAL_MS            60000                                      /**< Period after which logged records are made readable even if their page is not full (ms). */
+#define MOTION_LOG_TAG                   0x01                                       /**< Sensor log tag of motion event records, stamped with the sample index. */
+#define MOTION_LOG_RECORD_MAX            6                                          /**< Largest motion event record: type, duration_ms, peak and swings. */
+#define SAMPLE_LOG_ENABLED               0                                          /**< Set to 1 to log the raw 416 Hz samples as well, about 5 KB/s of flash. */
+#define SAMPLE_LOG_TAG                   0x02                                       /**< Sensor log tag of raw sensor_sample_t runs, stamped with the index of the first. */
+#define SAMPLE_LOG_RUN                   (SENSOR_LOG_RECORD_MAX/sizeof(sensor_sample_t)) /**< Samples per raw sample record. */
 #define MIN_CONN_INTERVAL                MSEC_TO_UNITS(10, UNIT_1_25_MS)           /**< Minimum acceptable connection interval (0.4 seconds). */
 #define MAX_CONN_INTERVAL                MSEC_TO_UNITS(100, UNIT_1_25_MS)           /**< Maximum acceptable connection interval (0.65 second). */
 #else
@@ -134,6 +155,10 @@ static app_timer_id_t                    m_battery_timer_id;
 static app_timer_id_t                    m_heart_rate_timer_id;                     /**< Heart rate measurement timer. */
 static app_timer_id_t                    m_rr_interval_timer_id;                    /**< RR interval timer. */
 static app_timer_id_t                    m_sensor_contact_timer_id;                 /**< Sensor contact detected timer. */
+#if defined(__RING_SUPPORT__)
+static app_timer_id_t                    m_ui_idle_timer_id;                        /**< Display and input sleep timer. */
+static bool                              m_ui_asleep = false;                       /**< Display off, input on PORT sensing. */
+#endif
 
 static dm_application_instance_t         m_app_handle;                              /**< Application identifier allocated by device manager */
 
@@ -199,56 +224,6 @@ static void battery_level_meas_timeout_handler(void * p_context)
 
 
 
-#if defined(__RING_SUPPORT__)
-uint32_t ble_sensor_data_send(ble_hrs_t * p_hrs)
-{
-    uint32_t err_code;
-    uint8_t sensor_data[20];
-	uint8_t tmp;
-
-    // Send value if connected and notifying
-    if (p_hrs->conn_handle != BLE_CONN_HANDLE_INVALID)
-    {
-        uint16_t               len;
-        uint16_t               hvx_len;
-        ble_gatts_hvx_params_t hvx_params;
-
-        sensor_test(sensor_data);
-		tmp = sensor_data[1];
-		sensor_data[1] = sensor_data[0];
-		sensor_data[0] = tmp;
-		tmp = sensor_data[3];
-		sensor_data[3] = sensor_data[2];
-		sensor_data[2] = tmp;
-		tmp = sensor_data[5];
-		sensor_data[5] = sensor_data[4];
-		sensor_data[4] = tmp;
-
-        len     = 6;
-        hvx_len = len;
-
-        memset(&hvx_params, 0, sizeof(hvx_params));
-
-        hvx_params.handle = p_hrs->hrm_handles.value_handle;
-        hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
-        hvx_params.offset = 0;
-        hvx_params.p_len  = &hvx_len;
-        hvx_params.p_data = sensor_data;
-
-        err_code = sd_ble_gatts_hvx(p_hrs->conn_handle, &hvx_params);
-        if ((err_code == NRF_SUCCESS) && (hvx_len != len))
-        {
-            err_code = NRF_ERROR_DATA_SIZE;
-        }
-    }
-    else
-    {
-        err_code = NRF_ERROR_INVALID_STATE;
-    }
-
-    return err_code;
-}
-#endif
 /**@brief Function for handling the Heart rate measurement timer timeout.
  *
  * @details This function will be called each time the heart rate measurement timer expires.
@@ -259,24 +234,11 @@ uint32_t ble_sensor_data_send(ble_hrs_t * p_hrs)
  */
 static void heart_rate_meas_timeout_handler(void * p_context)
 {
-#if !defined(__RING_SUPPORT__)
     static uint32_t cnt = 0;
     uint16_t        heart_rate;
-#endif
     uint32_t        err_code;
     UNUSED_PARAMETER(p_context);
 
-#if defined(__RING_SUPPORT__)
-    err_code = ble_sensor_data_send(&m_hrs);
-    if ((err_code != NRF_SUCCESS) &&
-        (err_code != NRF_ERROR_INVALID_STATE) &&
-        (err_code != BLE_ERROR_NO_TX_BUFFERS) &&
-        (err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING)
-        )
-    {
-        APP_ERROR_HANDLER(err_code);
-    }
-#else
     heart_rate = (uint16_t)sensorsim_measure(&m_heart_rate_sim_state, &m_heart_rate_sim_cfg);
 
     cnt++;
@@ -294,7 +256,6 @@ static void heart_rate_meas_timeout_handler(void * p_context)
     // NOTE: An application will normally not do this. It is done here just for testing generation
     //       of messages without RR Interval measurements.
     m_rr_interval_enabled = ((cnt % 3) != 0);
-#endif
 }
 
 
@@ -338,6 +299,103 @@ static void sensor_contact_detected_timeout_handler(void * p_context)
 }
 
 
+#if defined(__RING_SUPPORT__)
+/**@brief Function for packing new samples and notifying them while the link takes them.
+ */
+static void stream_task(void * p_context)
+{
+    uint32_t err_code = sensor_stream_process();
+    APP_ERROR_CHECK(err_code);
+}
+
+RING_TASK_DEF(m_stream_task, stream_task, NULL, RING_TASK_PRIO_NORMAL, STREAM_TASK_BUDGET_US);
+
+
+/**@brief Function for moving completed sensor FIFO bursts into the sample ring.
+ *
+ * @details Ahead of everything else so that the sensor FIFO never overflows.
+ */
+static void sensor_task(void * p_context)
+{
+    sensor_fifo_process();
+    ring_task_post(&m_stream_task);
+}
+
+RING_TASK_DEF(m_sensor_task, sensor_task, NULL, RING_TASK_PRIO_HIGH, SENSOR_TASK_BUDGET_US);
+
+
+/**@brief Function for scheduling the sensor task, called from the sensor interrupts.
+ */
+static void sensor_fifo_wakeup(void)
+{
+    ring_task_post(&m_sensor_task);
+}
+
+
+/**@brief Function for making the records logged so far readable from flash.
+ */
+static void log_flush_task(void * p_context)
+{
+    sensor_log_flush();
+}
+
+RING_TASK_DEF(m_log_flush_task, log_flush_task, NULL, RING_TASK_PRIO_LOW, 0);
+
+
+/**@brief Function for putting the display and the input to sleep, in the main loop.
+ */
+static void ui_idle_handler(void * p_event_data, uint16_t event_size)
+{
+    uint32_t err_code;
+
+    if (m_ui_asleep)
+    {
+        return;
+    }
+    m_ui_asleep = true;
+    lcd_sleep();
+    err_code = btn_power_mode_set(BTN_POWER_SLEEP);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for handling the UI idle timer timeout.
+ *
+ * @param[in] p_context  Pointer used for passing some arbitrary information (context) from the
+ *                       app_start_timer() call to the timeout handler.
+ */
+static void ui_idle_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    // Reconfiguring the GPIOTE and talking to the display belong to the main loop. If the queue
+    // is full the next input restarts the timer anyway.
+    (void)app_sched_event_put(NULL, 0, ui_idle_handler);
+}
+
+
+/**@brief Function for handling ring input events.
+ *
+ * @details Any input wakes the display and the input up and restarts the idle timer.
+ */
+static void ui_input_handler(btn_evt_t const * p_evt)
+{
+    uint32_t err_code;
+
+    if (m_ui_asleep)
+    {
+        m_ui_asleep = false;
+        err_code = btn_power_mode_set(BTN_POWER_ACTIVE);
+        APP_ERROR_CHECK(err_code);
+        lcd_wakeup();
+    }
+    err_code = app_timer_stop(m_ui_idle_timer_id);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start_with_slack(m_ui_idle_timer_id, UI_IDLE_TIMEOUT, UI_IDLE_SLACK, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+#endif
+
+
 /**@brief Function for the Timer initialization.
  *
  * @details Initializes the timer module. This creates and starts application timers.
@@ -369,6 +427,13 @@ static void timers_init(void)
                                 APP_TIMER_MODE_REPEATED,
                                 sensor_contact_detected_timeout_handler);
     APP_ERROR_CHECK(err_code);
+
+#if defined(__RING_SUPPORT__)
+    err_code = app_timer_create(&m_ui_idle_timer_id,
+                                APP_TIMER_MODE_SINGLE_SHOT,
+                                ui_idle_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+#endif
 }
 
 
@@ -620,18 +685,28 @@ static void application_timers_start(void)
 {
     uint32_t err_code;
 
-    // Start application timers.
-#if !defined(__RING_SUPPORT__)
-    err_code = app_timer_start(m_battery_timer_id, BATTERY_LEVEL_MEAS_INTERVAL, NULL);
+    // Start application timers. The ring has no simulated sensors, its samples
+    // are streamed from the main loop.
+#if defined(__RING_SUPPORT__)
+    err_code = app_timer_start_with_slack(m_ui_idle_timer_id, UI_IDLE_TIMEOUT, UI_IDLE_SLACK, NULL);
     APP_ERROR_CHECK(err_code);
-#endif
+#else
+    err_code = app_timer_start_with_slack(m_battery_timer_id,
+                                          BATTERY_LEVEL_MEAS_INTERVAL,
+                                          BATTERY_LEVEL_MEAS_SLACK,
+                                          NULL);
+    APP_ERROR_CHECK(err_code);
+
     err_code = app_timer_start(m_heart_rate_timer_id, HEART_RATE_MEAS_INTERVAL, NULL);
     APP_ERROR_CHECK(err_code);
-#if !defined(__RING_SUPPORT__)
+
     err_code = app_timer_start(m_rr_interval_timer_id, RR_INTERVAL_INTERVAL, NULL);
     APP_ERROR_CHECK(err_code);
 
-    err_code = app_timer_start(m_sensor_contact_timer_id, SENSOR_CONTACT_DETECTED_INTERVAL, NULL);
+    err_code = app_timer_start_with_slack(m_sensor_contact_timer_id,
+                                          SENSOR_CONTACT_DETECTED_INTERVAL,
+                                          SENSOR_CONTACT_DETECTED_SLACK,
+                                          NULL);
     APP_ERROR_CHECK(err_code);
 #endif
 }
@@ -782,6 +857,11 @@ static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
     ble_dfu_on_ble_evt(&m_dfus, p_ble_evt);
     /** @snippet [Propagating BLE Stack events to DFU Service] */
 #endif // BLE_DFU_APP_SUPPORT
+#if defined(__RING_SUPPORT__)
+    sensor_stream_on_ble_evt(p_ble_evt);
+    // A completed transmission frees room for the next notifications.
+    ring_task_post(&m_stream_task);
+#endif
     on_ble_evt(p_ble_evt);
     ble_advertising_on_ble_evt(p_ble_evt);
 }
@@ -970,6 +1050,68 @@ static void buttons_leds_init(bool * p_erase_bonds)
 }
 
 
+#if defined(__RING_SUPPORT__)
+/**@brief Function for the Event Scheduler initialization.
+ *
+ * @details Ring input events are handed from the interrupts to the main loop through it, in a
+ *          lane of their own so that they do not wait behind the task events.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_SIZE, SCHED_QUEUE_SIZE);
+    APP_SCHED_LANE_INIT(BTN_SCHED_LANE, BTN_SCHED_EVT_SIZE, SCHED_INPUT_QUEUE_SIZE);
+}
+
+
+/**@brief Function for handling motion events.
+ *
+ * @details Steps and gestures are kept in the sensor log instead of the raw samples. The record
+ *          is encoded field by field, little endian, so neither struct padding nor the unused part
+ *          of the union reaches the flash: the type byte, then the step total (4 bytes) or the
+ *          gesture duration_ms (2), peak (2) and swings (1).
+ */
+static void motion_evt_handler(motion_evt_t const * p_evt)
+{
+    uint8_t record[MOTION_LOG_RECORD_MAX];
+    uint8_t len = 0;
+
+    record[len++] = (uint8_t)p_evt->type;
+    if (p_evt->type == MOTION_EVT_STEP)
+    {
+        len += uint32_encode(p_evt->params.steps, &record[len]);
+    }
+    else
+    {
+        len += uint16_encode(p_evt->params.gesture.duration_ms, &record[len]);
+        len += uint16_encode(p_evt->params.gesture.peak, &record[len]);
+        record[len++] = p_evt->params.gesture.swings;
+    }
+    (void)sensor_log_append(p_evt->seq, MOTION_LOG_TAG, record, len);
+}
+
+
+/**@brief Function for handling the drained sensor samples.
+ *
+ * @details With SAMPLE_LOG_ENABLED the raw samples are logged in runs of SAMPLE_LOG_RUN before
+ *          the motion pipeline sees them.
+ */
+static void sensor_samples_handler(uint32_t seq, sensor_sample_t const * p_samples, uint16_t count)
+{
+#if SAMPLE_LOG_ENABLED
+    uint32_t run;
+    uint16_t i;
+
+    for (i = 0; i < count; i += run)
+    {
+        run = MIN(count - i, SAMPLE_LOG_RUN);
+        (void)sensor_log_append(seq + i, SAMPLE_LOG_TAG, &p_samples[i], run * sizeof(sensor_sample_t));
+    }
+#endif
+    motion_process(seq, p_samples, count);
+}
+#endif
+
+
 /**@brief Function for the Power manager.
  */
 static void power_manage(void)
@@ -990,6 +1132,11 @@ int main(void)
     app_trace_init();
     timers_init();
     buttons_leds_init(&erase_bonds);
+#if defined(__RING_SUPPORT__)
+    scheduler_init();
+    // Display power-up runs in the background while the rest initializes.
+    lcd_init();
+#endif
     ble_stack_init();
     device_manager_init(erase_bonds);
     gap_params_init();
@@ -998,10 +1145,23 @@ int main(void)
     sensor_simulator_init();
     conn_params_init();
 #if defined(__RING_SUPPORT__)
-     btn_init();
-	  spi_flash_init();
+    err_code = btn_init();
+    APP_ERROR_CHECK(err_code);
+    err_code = btn_subscribe(ui_input_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = (spi_flash_init() == 0) ? NRF_SUCCESS : NRF_ERROR_INTERNAL;
+    APP_ERROR_CHECK(err_code);
+    err_code = (sensor_log_mount() == 0) ? NRF_SUCCESS : NRF_ERROR_INTERNAL;
+    APP_ERROR_CHECK(err_code);
     sensor_init();
-	  lcd_init();
+    err_code = ring_task_init(power_manage);
+    APP_ERROR_CHECK(err_code);
+    motion_init(motion_evt_handler);
+    sensor_fifo_handler_set(sensor_samples_handler);
+    sensor_fifo_wakeup_set(sensor_fifo_wakeup);
+    sensor_fifo_start();
+    sensor_stream_init(m_hrs.hrm_handles.value_handle);
+    ring_task_start_periodic(&m_log_flush_task, LOG_FLUSH_INTERVAL_MS);
 #endif
 
     // Start execution.
@@ -1012,6 +1172,11 @@ int main(void)
     // Enter main loop.
     for (;;)
     {
+#if defined(__RING_SUPPORT__)
+        // Sleeps through power_manage() once nothing is left to run.
+        ring_task_run();
+#else
         power_manage();
+#endif
     }
 }
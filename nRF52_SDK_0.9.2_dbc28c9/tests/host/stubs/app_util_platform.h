@@ -0,0 +1,28 @@
+/* Host stand-in: the tests are single threaded wherever a module takes a
+ * critical region, so the region is only a block. The interrupt level a
+ * module sees is g_host_int_priority, thread mode unless a test changes it. */
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include <stdint.h>
+
+#include "compiler_abstraction.h"
+#include "nrf.h"
+#include "app_error.h"
+
+#define APP_IRQ_PRIORITY_HIGH  1
+#define APP_IRQ_PRIORITY_LOW   3
+
+#define NRF_APP_PRIORITY_THREAD  4
+
+extern uint8_t g_host_int_priority;
+
+static __INLINE uint8_t current_int_priority_get(void)
+{
+	return g_host_int_priority;
+}
+
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT()  }
+
+#endif /* APP_UTIL_PLATFORM_H__ */
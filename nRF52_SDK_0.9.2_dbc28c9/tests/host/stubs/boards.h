@@ -0,0 +1,4 @@
+/* Host stand-in, button.h includes boards.h but uses nothing from it. */
+#ifndef BOARDS_H
+#define BOARDS_H
+#endif /* BOARDS_H */
@@ -0,0 +1,4 @@
+/* Host stand-in, the ring modules include bsp.h but use nothing from it. */
+#ifndef BSP_H__
+#define BSP_H__
+#endif /* BSP_H__ */
@@ -0,0 +1,16 @@
+#include "host.h"
+#include "app_util_platform.h"
+
+NRF_RTC_Type g_host_rtc1;
+bool g_host_rtc1_pending;
+bool g_host_swi0_pending;
+NRF_GPIO_Type g_host_gpio;
+uint8_t g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+uint64_t g_host_time_us;
+
+void host_gpio_sync(void)
+{
+	g_host_gpio.OUT = (g_host_gpio.OUT | g_host_gpio.OUTSET) & ~g_host_gpio.OUTCLR;
+	g_host_gpio.OUTSET = 0;
+	g_host_gpio.OUTCLR = 0;
+}
@@ -0,0 +1,22 @@
+/* Simulated peripherals shared by the host tests, defined in host.c. */
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf.h"
+
+/* Simulated time, moved on by nrf_delay_us() and the bus models. */
+extern uint64_t g_host_time_us;
+
+/* Applies the OUTSET and OUTCLR writes since the last call to OUT. */
+void host_gpio_sync(void);
+
+static inline bool host_gpio_out(uint32_t pin)
+{
+	host_gpio_sync();
+	return (g_host_gpio.OUT >> pin) & 1;
+}
+
+#endif /* HOST_H */
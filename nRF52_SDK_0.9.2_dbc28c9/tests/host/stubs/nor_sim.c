@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "nor_sim.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "nrf_drv_spi.h"
+
+#define NOR_SIM_TIMERS          4
+#define NOR_SIM_STATUS_WIP      0x01
+#define NOR_SIM_STATUS_WEL      0x02
+
+static uint8_t *m_mem;
+static uint32_t m_size;
+static uint8_t m_capacity_code;
+
+/* Command in progress, from CS low to CS high */
+static uint8_t m_cmd;
+static uint32_t m_pos;
+static uint32_t m_addr;
+static uint8_t m_page[256];
+static uint32_t m_page_len;
+static bool m_wel;
+static uint64_t m_busy_until;
+
+static uint32_t m_byte_ns;
+static nrf_drv_spi_handler_t m_spi_handler;
+static bool m_spi_pending;
+static uint64_t m_spi_done_at;
+
+static struct {
+	app_timer_timeout_handler_t handler;
+	bool armed;
+	uint64_t due;
+	void *p_context;
+} m_timers[NOR_SIM_TIMERS];
+static uint32_t m_timer_count;
+
+static nor_sim_stats_t m_stats;
+
+static void command_end(uint64_t now);
+
+void nor_sim_init(uint8_t capacity_code)
+{
+	free(m_mem);
+	m_capacity_code = capacity_code;
+	m_size = 1u << capacity_code;
+	m_mem = malloc(m_size);
+	memset(m_mem, 0xFF, m_size);
+	m_wel = false;
+	m_busy_until = 0;
+	m_spi_pending = false;
+	m_timer_count = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/* A CS rise since the last transfer ends the command before it */
+static void cs_check(void)
+{
+	if(g_host_gpio.OUTSET & (1u << NOR_SIM_CS_PIN)) {
+		command_end(m_spi_done_at);
+		m_cmd = 0;
+		m_pos = 0;
+	}
+	host_gpio_sync();
+}
+
+uint8_t *nor_sim_mem(void)
+{
+	cs_check();
+	return m_mem;
+}
+
+uint32_t nor_sim_size(void)
+{
+	return m_size;
+}
+
+void nor_sim_stats_get(nor_sim_stats_t *p_stats)
+{
+	*p_stats = m_stats;
+}
+
+void nor_sim_stats_reset(void)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+static bool chip_busy(uint64_t now)
+{
+	return now < m_busy_until;
+}
+
+/* Runs a program or erase once CS rises on it */
+static void command_end(uint64_t now)
+{
+	uint32_t i;
+	uint32_t erase = 0;
+	uint32_t busy_us = 0;
+
+	if(m_cmd == 0x02 && m_pos > 4) {
+		for(i = 0; i < m_page_len; i++)
+			m_mem[(m_addr & ~0xFFu) | ((m_addr + i) & 0xFF)] &= m_page[i];
+		m_stats.programs++;
+		busy_us = NOR_SIM_PROGRAM_US;
+	} else if(m_cmd == 0x20 && m_pos >= 4) {
+		erase = 4096;
+		busy_us = NOR_SIM_ERASE_4K_US;
+	} else if(m_cmd == 0xD8 && m_pos >= 4) {
+		erase = 65536;
+		busy_us = NOR_SIM_ERASE_64K_US;
+	} else {
+		return;
+	}
+	if(erase) {
+		memset(&m_mem[m_addr & ~(erase - 1)], 0xFF, erase);
+		m_stats.erases++;
+	}
+	m_wel = false;
+	m_busy_until = now + busy_us;
+}
+
+static uint8_t command_byte(uint8_t in, uint64_t now)
+{
+	uint32_t pos = m_pos++;
+
+	if(pos == 0) {
+		m_cmd = in;
+		m_page_len = 0;
+		if(in != 0x05 && chip_busy(now)) {
+			m_stats.violations++;
+			m_cmd = 0;
+			return 0xFF;
+		}
+		if((in == 0x02 || in == 0x20 || in == 0xD8) && !m_wel) {
+			m_stats.violations++;
+			m_cmd = 0;
+		}
+		if(in == 0x06)
+			m_wel = true;
+		return 0xFF;
+	}
+	switch(m_cmd) {
+		case 0x9F:
+			return (pos == 1) ? 0xEF : (pos == 2) ? 0x40 : (pos == 3) ? m_capacity_code : 0xFF;
+		case 0x05:
+			return (chip_busy(now) ? NOR_SIM_STATUS_WIP : 0) | (m_wel ? NOR_SIM_STATUS_WEL : 0);
+		case 0x0B:
+		case 0x02:
+		case 0x20:
+		case 0xD8:
+			if(pos <= 3) {
+				m_addr = ((m_addr << 8) | in) & (m_size - 1);
+				return 0xFF;
+			}
+			if(m_cmd == 0x0B) {
+				if(pos == 4)
+					return 0xFF;
+				return m_mem[m_addr++ & (m_size - 1)];
+			}
+			if(m_cmd == 0x02 && m_page_len < sizeof(m_page))
+				m_page[m_page_len++] = in;
+			return 0xFF;
+		default:
+			return 0xFF;
+	}
+}
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const * const p_instance,
+                            nrf_drv_spi_config_t const * p_config,
+                            nrf_drv_spi_handler_t handler)
+{
+	(void)p_instance;
+	m_byte_ns = 64000u >> p_config->frequency;    /* 8 bits at 125 kHz << n */
+	m_spi_handler = handler;
+	return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const * const p_instance,
+                                uint8_t const * p_tx_buffer,
+                                uint8_t         tx_buffer_length,
+                                uint8_t       * p_rx_buffer,
+                                uint8_t         rx_buffer_length)
+{
+	uint32_t len = (tx_buffer_length > rx_buffer_length) ? tx_buffer_length : rx_buffer_length;
+	uint64_t us = NOR_SIM_XFER_SETUP_US + (uint64_t)len * m_byte_ns / 1000;
+	uint64_t start;
+	uint32_t i;
+	uint8_t out;
+	bool status;
+
+	(void)p_instance;
+	if(m_spi_pending)
+		return NRF_ERROR_BUSY;
+
+	start = m_spi_done_at > g_host_time_us ? m_spi_done_at : g_host_time_us;
+	cs_check();
+
+	status = (m_pos == 0 && tx_buffer_length && p_tx_buffer[0] == 0x05) || (m_pos && m_cmd == 0x05);
+	for(i = 0; i < len; i++) {
+		out = command_byte(i < tx_buffer_length ? p_tx_buffer[i] : 0xCC, start);
+		if(i < rx_buffer_length)
+			p_rx_buffer[i] = out;
+	}
+	m_stats.transfers++;
+	m_stats.bus_us += us;
+	if(status) {
+		m_stats.status_reads++;
+		m_stats.status_us += us;
+	}
+	m_spi_done_at = start + us;
+
+	if(current_int_priority_get() == NRF_APP_PRIORITY_THREAD) {
+		/* The caller spins on the event, let it happen inside the call */
+		g_host_time_us = m_spi_done_at;
+		g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+		m_spi_handler(NRF_DRV_SPI_EVENT_DONE);
+		g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+	} else {
+		m_spi_pending = true;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode,
+                          app_timer_timeout_handler_t timeout_handler)
+{
+	(void)mode;
+	if(m_timer_count == NOR_SIM_TIMERS)
+		return NRF_ERROR_NO_MEM;
+	m_timers[m_timer_count].handler = timeout_handler;
+	m_timers[m_timer_count].armed = false;
+	*p_timer_id = m_timer_count++;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+	m_timers[timer_id].armed = true;
+	m_timers[timer_id].due = g_host_time_us + (uint64_t)timeout_ticks * 1000000 / APP_TIMER_CLOCK_FREQ;
+	m_timers[timer_id].p_context = p_context;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+	m_timers[timer_id].armed = false;
+	return NRF_SUCCESS;
+}
+
+/* Earliest pending event: a timer index, or -1 for the SPI event. Returns
+ * false when nothing is pending. */
+static bool next_event(uint64_t *p_time, int *p_timer)
+{
+	uint32_t i;
+
+	*p_time = UINT64_MAX;
+	*p_timer = -1;
+	for(i = 0; i < m_timer_count; i++) {
+		if(m_timers[i].armed && m_timers[i].due < *p_time) {
+			*p_time = m_timers[i].due;
+			*p_timer = i;
+		}
+	}
+	if(m_spi_pending && m_spi_done_at <= *p_time) {
+		*p_time = m_spi_done_at;
+		*p_timer = -1;
+		return true;
+	}
+	return *p_timer >= 0;
+}
+
+bool nor_sim_pump(void)
+{
+	uint64_t next;
+	int timer;
+
+	if(!next_event(&next, &timer))
+		return false;
+	if(next > g_host_time_us)
+		g_host_time_us = next;
+
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	if(timer < 0) {
+		m_spi_pending = false;
+		m_spi_handler(NRF_DRV_SPI_EVENT_DONE);
+	} else {
+		m_timers[timer].armed = false;
+		m_timers[timer].handler(m_timers[timer].p_context);
+	}
+	g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+	return true;
+}
+
+void nor_sim_run(void)
+{
+	while(nor_sim_pump())
+		;
+}
+
+void nor_sim_run_until(uint64_t time_us)
+{
+	uint64_t next;
+	int timer;
+
+	while(next_event(&next, &timer) && next <= time_us)
+		nor_sim_pump();
+	if(time_us > g_host_time_us)
+		g_host_time_us = time_us;
+}
@@ -0,0 +1,49 @@
+/* Simulated SPI NOR chip behind a fake nrf_drv_spi and app_timer, for the
+ * host builds of spi_flash.c and what sits on top of it.
+ *
+ * The chip answers READ ID, READ STATUS, WRITE ENABLE, FAST READ, PAGE
+ * PROGRAM and the erases the way a W25Q series part does, and stays busy for
+ * its typical program and erase times on g_host_time_us. A transfer started
+ * from thread mode completes inside the call, like the driver's blocking
+ * wait would; one started from an interrupt completes in nor_sim_pump(),
+ * which also fires the app timers. */
+#ifndef NOR_SIM_H
+#define NOR_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NOR_SIM_CS_PIN          3      /* FLASH_SPI_SS_PIN in spi_flash.c */
+
+#define NOR_SIM_PROGRAM_US      700
+#define NOR_SIM_ERASE_4K_US     45000
+#define NOR_SIM_ERASE_64K_US    150000
+#define NOR_SIM_XFER_SETUP_US   2      /* Per transfer: IRQ, CS and DMA setup */
+
+typedef struct {
+	uint32_t transfers;
+	uint32_t programs;
+	uint32_t erases;
+	uint32_t status_reads;
+	uint32_t violations;       /* Commands the chip would have ignored */
+	uint64_t bus_us;           /* Time the bus was clocking */
+	uint64_t status_us;        /* Part of it spent reading the status */
+} nor_sim_stats_t;
+
+/* Powers up an erased chip of 1 << capacity_code bytes, the third byte of
+ * the JEDEC ID. */
+void nor_sim_init(uint8_t capacity_code);
+uint8_t *nor_sim_mem(void);
+uint32_t nor_sim_size(void);
+
+/* Runs the earliest pending SPI or timer event, moving the clock on to it.
+ * Returns false when nothing is pending. */
+bool nor_sim_pump(void);
+void nor_sim_run(void);
+/* Runs the events due up to time_us, then moves the clock there. */
+void nor_sim_run_until(uint64_t time_us);
+
+void nor_sim_stats_get(nor_sim_stats_t *p_stats);
+void nor_sim_stats_reset(void);
+
+#endif /* NOR_SIM_H */
@@ -0,0 +1,98 @@
+/* Host stand-in for the chip header. RTC1 and GPIO are plain structs the test
+ * drives, see host.h, and the NVIC calls only track whether the RTC1 and SWI0
+ * interrupts are pending. The bit field names come from the real nrf52_bitfields.h. */
+#ifndef NRF_H
+#define NRF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "compiler_abstraction.h"
+#include "nrf52_bitfields.h"
+
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE static inline
+#endif
+
+typedef struct {
+	volatile uint32_t TASKS_START;
+	volatile uint32_t TASKS_STOP;
+	volatile uint32_t TASKS_CLEAR;
+	volatile uint32_t EVENTS_TICK;
+	volatile uint32_t EVENTS_OVRFLW;
+	volatile uint32_t EVENTS_COMPARE[4];
+	volatile uint32_t INTENSET;
+	volatile uint32_t INTENCLR;
+	volatile uint32_t EVTENSET;
+	volatile uint32_t EVTENCLR;
+	volatile uint32_t COUNTER;
+	volatile uint32_t PRESCALER;
+	volatile uint32_t CC[4];
+} NRF_RTC_Type;
+
+/* Writes to OUTSET and OUTCLR only land in OUT through host_gpio_sync(). */
+typedef struct {
+	volatile uint32_t OUT;
+	volatile uint32_t OUTSET;
+	volatile uint32_t OUTCLR;
+	volatile uint32_t IN;
+	volatile uint32_t DIR;
+	volatile uint32_t DIRSET;
+	volatile uint32_t DIRCLR;
+	volatile uint32_t LATCH;
+	volatile uint32_t PIN_CNF[32];
+} NRF_GPIO_Type;
+
+typedef enum {
+	RTC1_IRQn = 17,
+	SWI0_EGU0_IRQn = 20
+} IRQn_Type;
+
+extern NRF_RTC_Type g_host_rtc1;
+extern bool g_host_rtc1_pending;
+extern bool g_host_swi0_pending;
+extern NRF_GPIO_Type g_host_gpio;
+
+#define NRF_RTC1 (&g_host_rtc1)
+#define NRF_GPIO (&g_host_gpio)
+
+static __INLINE void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) { (void)irq; (void)priority; }
+static __INLINE void NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+static __INLINE void NVIC_DisableIRQ(IRQn_Type irq) { (void)irq; }
+static __INLINE void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+	*((irq == RTC1_IRQn) ? &g_host_rtc1_pending : &g_host_swi0_pending) = true;
+}
+static __INLINE void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+	*((irq == RTC1_IRQn) ? &g_host_rtc1_pending : &g_host_swi0_pending) = false;
+}
+
+/* x86 keeps stores and loads in order, so only the compiler has to be held
+ * back there. A full fence would make the byte calls look far slower than on
+ * the chip. */
+#if defined(__x86_64__) || defined(__i386__)
+#define __DMB() __asm__ volatile("" ::: "memory")
+#else
+#define __DMB() __sync_synchronize()
+#endif
+
+/* Plain C versions of the Cortex-M4 intrinsics the drawing code uses. */
+static __INLINE uint32_t __RBIT(uint32_t value)
+{
+	uint32_t result = 0;
+	int i;
+
+	for(i = 0; i < 32; i++, value >>= 1)
+		result = (result << 1) | (value & 1);
+	return result;
+}
+
+static __INLINE uint32_t __REV16(uint32_t value)
+{
+	return ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
+}
+
+#define __PKHBT(a, b, shift) (((uint32_t)(a) & 0xFFFF) | (((uint32_t)(b) << (shift)) & 0xFFFF0000))
+
+#endif /* NRF_H */
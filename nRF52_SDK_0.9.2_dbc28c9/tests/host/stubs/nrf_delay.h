@@ -0,0 +1,11 @@
+/* Host stand-in: a delay only moves the simulated clock on. */
+#ifndef NRF_DELAY_H
+#define NRF_DELAY_H
+
+#include <stdint.h>
+
+extern uint64_t g_host_time_us;
+
+static inline void nrf_delay_us(uint32_t us) { g_host_time_us += us; }
+
+#endif /* NRF_DELAY_H */
@@ -0,0 +1,38 @@
+/* Host stand-in for the GPIOTE driver, input pins only. The types and calls
+ * match the SDK header; each test links its own implementation and raises
+ * the pin events itself by calling the handler it was given. */
+#ifndef NRF_DRV_GPIOTE_H__
+#define NRF_DRV_GPIOTE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf_gpio.h"
+#include "sdk_errors.h"
+
+typedef enum {
+	NRF_GPIOTE_POLARITY_LOTOHI = 1,
+	NRF_GPIOTE_POLARITY_HITOLO = 2,
+	NRF_GPIOTE_POLARITY_TOGGLE = 3
+} nrf_gpiote_polarity_t;
+
+typedef struct {
+	nrf_gpiote_polarity_t sense;
+	nrf_gpio_pin_pull_t   pull;
+	bool                  is_watcher;
+	bool                  hi_accuracy;
+} nrf_drv_gpiote_in_config_t;
+
+typedef uint32_t nrf_drv_gpiote_pin_t;
+
+typedef void (*nrf_drv_gpiote_evt_handler_t)(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action);
+
+ret_code_t nrf_drv_gpiote_init(void);
+bool nrf_drv_gpiote_is_init(void);
+ret_code_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t *p_config,
+                                  nrf_drv_gpiote_evt_handler_t evt_handler);
+void nrf_drv_gpiote_in_uninit(nrf_drv_gpiote_pin_t pin);
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable);
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin);
+
+#endif /* NRF_DRV_GPIOTE_H__ */
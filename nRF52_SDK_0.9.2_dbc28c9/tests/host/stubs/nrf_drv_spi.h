@@ -0,0 +1,71 @@
+/* Host stand-in for the SPI master driver. The types and calls match the SDK
+ * header; each test links its own nrf_drv_spi_init() and
+ * nrf_drv_spi_transfer(), a bus model that raises NRF_DRV_SPI_EVENT_DONE
+ * whenever the test chooses to. */
+#ifndef NRF_DRV_SPI_H__
+#define NRF_DRV_SPI_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+typedef struct {
+	uint8_t drv_inst_idx;
+} nrf_drv_spi_t;
+
+#define NRF_DRV_SPI_INSTANCE(id)  { .drv_inst_idx = (id) }
+
+#define NRF_DRV_SPI_PIN_NOT_USED  0xFF
+
+typedef enum {
+	NRF_DRV_SPI_FREQ_125K,
+	NRF_DRV_SPI_FREQ_250K,
+	NRF_DRV_SPI_FREQ_500K,
+	NRF_DRV_SPI_FREQ_1M,
+	NRF_DRV_SPI_FREQ_2M,
+	NRF_DRV_SPI_FREQ_4M,
+	NRF_DRV_SPI_FREQ_8M
+} nrf_drv_spi_frequency_t;
+
+typedef enum {
+	NRF_DRV_SPI_MODE_0,
+	NRF_DRV_SPI_MODE_1,
+	NRF_DRV_SPI_MODE_2,
+	NRF_DRV_SPI_MODE_3
+} nrf_drv_spi_mode_t;
+
+typedef enum {
+	NRF_DRV_SPI_BIT_ORDER_MSB_FIRST,
+	NRF_DRV_SPI_BIT_ORDER_LSB_FIRST
+} nrf_drv_spi_bit_order_t;
+
+typedef struct {
+	uint8_t sck_pin;
+	uint8_t mosi_pin;
+	uint8_t miso_pin;
+	uint8_t ss_pin;
+	uint8_t irq_priority;
+	uint8_t orc;
+	nrf_drv_spi_frequency_t frequency;
+	nrf_drv_spi_mode_t      mode;
+	nrf_drv_spi_bit_order_t bit_order;
+} nrf_drv_spi_config_t;
+
+typedef enum {
+	NRF_DRV_SPI_EVENT_DONE
+} nrf_drv_spi_event_t;
+
+typedef void (*nrf_drv_spi_handler_t)(nrf_drv_spi_event_t event);
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const * const p_instance,
+                            nrf_drv_spi_config_t const * p_config,
+                            nrf_drv_spi_handler_t handler);
+
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const * const p_instance,
+                                uint8_t const * p_tx_buffer,
+                                uint8_t         tx_buffer_length,
+                                uint8_t       * p_rx_buffer,
+                                uint8_t         rx_buffer_length);
+
+#endif /* NRF_DRV_SPI_H__ */
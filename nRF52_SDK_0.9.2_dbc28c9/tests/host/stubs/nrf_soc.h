@@ -0,0 +1,4 @@
+/* Host stand-in, nothing from the SoC library is needed. */
+#ifndef NRF_SOC_H
+#define NRF_SOC_H
+#endif /* NRF_SOC_H */
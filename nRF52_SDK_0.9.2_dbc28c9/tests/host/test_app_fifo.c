@@ -0,0 +1,234 @@
+/* app_fifo: bulk and span calls across the buffer wrap, the error returns, a
+ * byte against bulk throughput comparison, and a producer and a consumer thread
+ * standing in for the main loop and an interrupt. */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "app_fifo.h"
+#include "nrf_error.h"
+
+#define FIFO_SIZE       1024
+#define BENCH_BYTES     (16u << 20)
+#define BENCH_CHUNK     256
+#define SPSC_BYTES      (4u << 20)
+#define SPSC_CHUNK_MAX  200
+
+static uint8_t m_buf[FIFO_SIZE];
+static app_fifo_t m_fifo;
+static int m_failures = 0;
+static volatile int m_spsc_errors = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void test_init(void)
+{
+	uint8_t buf[12];
+
+	CHECK(app_fifo_init(&m_fifo, NULL, 16) == NRF_ERROR_NULL, "NULL buffer accepted");
+	CHECK(app_fifo_init(&m_fifo, buf, sizeof(buf)) == NRF_ERROR_INVALID_LENGTH, "size 12 accepted");
+}
+
+static void test_bulk(void)
+{
+	uint8_t in[FIFO_SIZE + 10];
+	uint8_t out[FIFO_SIZE + 10];
+	uint32_t size;
+	uint32_t pos;
+	uint8_t byte;
+	int i;
+
+	for(i = 0; i < (int)sizeof(in); i++)
+		in[i] = (uint8_t)(i * 13 + 1);
+	app_fifo_init(&m_fifo, m_buf, FIFO_SIZE);
+
+	/* Park the indices just before the end of the buffer */
+	size = FIFO_SIZE - 7;
+	CHECK(app_fifo_write(&m_fifo, in, &size) == NRF_SUCCESS && size == FIFO_SIZE - 7, "fill");
+	CHECK(app_fifo_read(&m_fifo, out, &size) == NRF_SUCCESS && size == FIFO_SIZE - 7, "drain");
+	CHECK(app_fifo_get(&m_fifo, &byte) == NRF_ERROR_NOT_FOUND, "get from empty FIFO");
+
+	/* A write larger than the FIFO is cut to the room left, across the wrap */
+	size = sizeof(in);
+	CHECK(app_fifo_write(&m_fifo, in, &size) == NRF_SUCCESS && size == FIFO_SIZE, "wrapped write of %u", (unsigned)size);
+	CHECK(app_fifo_put(&m_fifo, 0) == NRF_ERROR_NO_MEM, "put into full FIFO");
+	size = 1;
+	CHECK(app_fifo_write(&m_fifo, in, &size) == NRF_ERROR_NO_MEM, "write into full FIFO");
+	CHECK(app_fifo_write(&m_fifo, NULL, &size) == NRF_SUCCESS && size == 0, "room query %u", (unsigned)size);
+	CHECK(app_fifo_read(&m_fifo, NULL, &size) == NRF_SUCCESS && size == FIFO_SIZE, "length query %u", (unsigned)size);
+
+	/* Byte and bulk reads mix and keep the order */
+	CHECK(app_fifo_get(&m_fifo, &out[0]) == NRF_SUCCESS, "get");
+	size = 20;
+	CHECK(app_fifo_read(&m_fifo, &out[1], &size) == NRF_SUCCESS && size == 20, "short read");
+	pos = 21;
+	size = sizeof(out);
+	CHECK(app_fifo_read(&m_fifo, &out[pos], &size) == NRF_SUCCESS && size == FIFO_SIZE - pos, "wrapped read");
+	CHECK(memcmp(in, out, FIFO_SIZE) == 0, "bytes out of order");
+	size = 1;
+	CHECK(app_fifo_read(&m_fifo, out, &size) == NRF_ERROR_NOT_FOUND, "read from empty FIFO");
+
+	app_fifo_put(&m_fifo, 1);
+	app_fifo_flush(&m_fifo);
+	CHECK(app_fifo_get(&m_fifo, &byte) == NRF_ERROR_NOT_FOUND, "get after flush");
+}
+
+static void test_span(void)
+{
+	uint8_t *p_data;
+	uint32_t size;
+	uint32_t size2;
+	uint8_t out[64];
+	int i;
+
+	app_fifo_init(&m_fifo, m_buf, FIFO_SIZE);
+	for(i = 0; i < FIFO_SIZE - 10; i++) {
+		app_fifo_put(&m_fifo, 0);
+		app_fifo_get(&m_fifo, &out[0]);
+	}
+
+	/* The free part is handed out in two pieces, end of buffer first */
+	CHECK(app_fifo_write_span_get(&m_fifo, &p_data, &size) == NRF_SUCCESS, "write span");
+	CHECK(p_data == &m_buf[FIFO_SIZE - 10] && size == 10, "first write span %u", (unsigned)size);
+	memset(p_data, 0xA5, size);
+	CHECK(app_fifo_write_commit(&m_fifo, size) == NRF_SUCCESS, "commit");
+	CHECK(app_fifo_write_span_get(&m_fifo, &p_data, &size2) == NRF_SUCCESS, "second write span");
+	CHECK(p_data == m_buf && size2 == FIFO_SIZE - 10, "second write span %u", (unsigned)size2);
+	memset(p_data, 0x5A, 30);
+	CHECK(app_fifo_write_commit(&m_fifo, 30) == NRF_SUCCESS, "partial commit");
+	CHECK(app_fifo_write_commit(&m_fifo, FIFO_SIZE) == NRF_ERROR_INVALID_LENGTH, "commit past the room");
+
+	/* And read back the same way */
+	CHECK(app_fifo_read_span_get(&m_fifo, &p_data, &size) == NRF_SUCCESS, "read span");
+	CHECK(p_data == &m_buf[FIFO_SIZE - 10] && size == 10 && p_data[9] == 0xA5, "first read span %u", (unsigned)size);
+	CHECK(app_fifo_read_commit(&m_fifo, 41) == NRF_ERROR_INVALID_LENGTH, "release past the length");
+	CHECK(app_fifo_read_commit(&m_fifo, size) == NRF_SUCCESS, "release");
+	CHECK(app_fifo_read_span_get(&m_fifo, &p_data, &size) == NRF_SUCCESS, "second read span");
+	CHECK(p_data == m_buf && size == 30 && p_data[29] == 0x5A, "second read span %u", (unsigned)size);
+
+	/* A bulk read sees what a span wrote */
+	size = sizeof(out);
+	CHECK(app_fifo_read(&m_fifo, out, &size) == NRF_SUCCESS && size == 30 && out[0] == 0x5A, "read after span");
+	CHECK(app_fifo_read_span_get(&m_fifo, &p_data, &size) == NRF_ERROR_NOT_FOUND, "read span of empty FIFO");
+}
+
+static void bench(void)
+{
+	static uint8_t in[BENCH_CHUNK];
+	static uint8_t out[BENCH_CHUNK];
+	double t_byte;
+	double t_bulk;
+	uint32_t size;
+	uint32_t n;
+	int i;
+
+	app_fifo_init(&m_fifo, m_buf, FIFO_SIZE);
+
+	t_byte = seconds();
+	for(n = 0; n < BENCH_BYTES; n += BENCH_CHUNK) {
+		for(i = 0; i < BENCH_CHUNK; i++)
+			app_fifo_put(&m_fifo, in[i]);
+		for(i = 0; i < BENCH_CHUNK; i++)
+			app_fifo_get(&m_fifo, &out[i]);
+	}
+	t_byte = seconds() - t_byte;
+
+	t_bulk = seconds();
+	for(n = 0; n < BENCH_BYTES; n += BENCH_CHUNK) {
+		size = BENCH_CHUNK;
+		app_fifo_write(&m_fifo, in, &size);
+		size = BENCH_CHUNK;
+		app_fifo_read(&m_fifo, out, &size);
+	}
+	t_bulk = seconds() - t_bulk;
+
+	printf("byte calls %.0f MB/s, bulk calls %.0f MB/s (x%.1f)\n",
+	       BENCH_BYTES / t_byte / 1e6, BENCH_BYTES / t_bulk / 1e6, t_byte / t_bulk);
+}
+
+static void *spsc_producer(void *p_arg)
+{
+	uint8_t chunk[SPSC_CHUNK_MAX];
+	uint32_t n = 0;
+	uint32_t size;
+	uint32_t i;
+
+	(void)p_arg;
+	while(n < SPSC_BYTES) {
+		size = 1 + (n * 7) % SPSC_CHUNK_MAX;
+		if(size > SPSC_BYTES - n)
+			size = SPSC_BYTES - n;
+		for(i = 0; i < size; i++)
+			chunk[i] = (uint8_t)(n + i);
+		if(app_fifo_write(&m_fifo, chunk, &size) == NRF_SUCCESS)
+			n += size;
+		else
+			sched_yield();
+	}
+	return NULL;
+}
+
+static void *spsc_consumer(void *p_arg)
+{
+	uint8_t *p_data;
+	uint32_t n = 0;
+	uint32_t size;
+	uint32_t i;
+
+	(void)p_arg;
+	while(n < SPSC_BYTES) {
+		if(app_fifo_read_span_get(&m_fifo, &p_data, &size) != NRF_SUCCESS) {
+			sched_yield();
+			continue;
+		}
+		for(i = 0; i < size; i++)
+			if(p_data[i] != (uint8_t)(n + i))
+				m_spsc_errors++;
+		n += size;
+		app_fifo_read_commit(&m_fifo, size);
+	}
+	return NULL;
+}
+
+static void test_spsc(void)
+{
+	pthread_t producer;
+	pthread_t consumer;
+
+	app_fifo_init(&m_fifo, m_buf, FIFO_SIZE);
+	pthread_create(&producer, NULL, spsc_producer, NULL);
+	pthread_create(&consumer, NULL, spsc_consumer, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+	CHECK(m_spsc_errors == 0, "%d bytes corrupted between threads", m_spsc_errors);
+	printf("%u bytes between threads\n", SPSC_BYTES);
+}
+
+int main(void)
+{
+	test_init();
+	test_bulk();
+	test_span();
+	bench();
+	test_spsc();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
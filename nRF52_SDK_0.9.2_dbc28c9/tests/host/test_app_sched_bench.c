@@ -0,0 +1,132 @@
+/* Events per second and queue depth per byte, built once against
+ * app_scheduler.c (a slot of the largest size per event) and once against
+ * app_scheduler_var.c (a byte ring), both given the buffer of
+ * APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE).
+ *
+ * The events follow the ring firmware: mostly button and timer events of a
+ * few bytes, sensor samples, some without data and now and then a full size
+ * one. They are put in bursts and run by app_sched_execute(). The host has
+ * 16 byte headers where the nRF52 has 8, which costs the ring more of its
+ * depth than it costs the slots. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app_error.h"
+#include "app_util.h"
+#include "app_scheduler.h"
+
+#define EVENT_SIZE      64
+#define QUEUE_SIZE      16
+#define BURST           8
+#define EVENTS          20000000
+#define FILLS           1000
+
+#ifndef BACKEND
+#define BACKEND "?"
+#endif
+
+static const uint16_t m_sizes[] = { 1, 1, 4, 4, 4, 4, 12, 12, 12, 0, 0, 64 };
+#define SIZES (sizeof(m_sizes) / sizeof(m_sizes[0]))
+
+static uint8_t m_data[EVENT_SIZE];
+static uint32_t m_runs;
+static uint32_t m_sum;
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void event_handler(void *p_event_data, uint16_t event_size)
+{
+	uint8_t *p_data = p_event_data;
+
+	if(event_size > 0)
+		m_sum += p_data[0] + p_data[event_size - 1];
+	m_runs++;
+}
+
+static void throughput(void)
+{
+	uint32_t expected = 0;
+	uint32_t put = 0;
+	uint32_t i;
+	uint16_t size;
+	double t;
+
+	srand(1);
+	m_runs = 0;
+	m_sum = 0;
+	t = seconds();
+	while(put < EVENTS) {
+		for(i = 0; i < BURST; i++) {
+			size = m_sizes[(uint32_t)rand() % SIZES];
+			m_data[0] = (uint8_t)put;
+			m_data[size ? size - 1 : 0] = (uint8_t)put;
+			if(size > 0)
+				expected += 2 * (uint8_t)put;
+			APP_ERROR_CHECK(app_sched_event_put(size ? m_data : NULL, size, event_handler));
+			put++;
+		}
+		app_sched_execute();
+	}
+	t = seconds() - t;
+	CHECK(m_runs == put && m_sum == expected, "%u of %u events ran", (unsigned)m_runs, (unsigned)put);
+	printf("%-5s %.1f M events/s in bursts of %u, %.1f ns per put and run\n",
+	       BACKEND, put / t * 1e-6, BURST, t * 1e9 / put);
+}
+
+/* Events of the mix that fit before the queue is full, on average */
+static void depth(void)
+{
+	uint32_t queued = 0;
+	uint32_t n;
+	uint16_t size;
+
+	srand(2);
+	for(n = 0; n < FILLS; n++) {
+		for(;;) {
+			size = m_sizes[(uint32_t)rand() % SIZES];
+			if(app_sched_event_put(size ? m_data : NULL, size, event_handler) != NRF_SUCCESS)
+				break;
+			queued++;
+		}
+		app_sched_execute();
+	}
+	CHECK(queued >= FILLS * QUEUE_SIZE, "%.1f events deep", (double)queued / FILLS);
+	printf("%-5s %.1f events deep in %u bytes, %.1f bytes per queued event\n", BACKEND, (double)queued / FILLS,
+	       (unsigned)APP_SCHED_BUF_SIZE(EVENT_SIZE, QUEUE_SIZE),
+	       (double)APP_SCHED_BUF_SIZE(EVENT_SIZE, QUEUE_SIZE) * FILLS / queued);
+}
+
+int main(void)
+{
+	APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE);
+	throughput();
+	depth();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
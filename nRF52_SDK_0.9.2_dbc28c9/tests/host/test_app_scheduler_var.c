@@ -0,0 +1,342 @@
+/* app_scheduler_var.c: events reserved, written in place and committed out
+ * of order, records that start over at the beginning of the ring behind a
+ * padding header or behind a tail too short for one, and a full ring. Every
+ * layout is set up on lane 0, whose buffer size the test picks.
+ *
+ * Then the order the lanes run in with weights, a strict lane below a
+ * weighted one included, and the lane statistics, with the app timer
+ * counter moved on by every handler as if it took a millisecond. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_error.h"
+#include "app_util.h"
+#include "app_scheduler.h"
+
+#define EVENT_SIZE      64
+#define QUEUE_SIZE      4
+#define HEADER          APP_SCHED_EVENT_HEADER_SIZE
+#define RECORD          (HEADER + 16)              /* Ring room of a 16 byte event */
+#define LOG_MAX         64
+#define LANE_EVENTS     16                         /* One byte events a lane buffer holds */
+#define LANE_BUF_SIZE   ((LANE_EVENTS + 1) * (HEADER + 4))
+#define WORK_TICKS      33
+#define TICK_MASK       0x00FFFFFF
+
+typedef struct {
+	uint8_t *p_data;
+	uint16_t size;
+	uint8_t tag;
+} run_t;
+
+static uint32_t m_lane_buf[CEIL_DIV(5 * RECORD, sizeof(uint32_t))];
+static uint32_t m_lane0_buf[CEIL_DIV(LANE_BUF_SIZE, sizeof(uint32_t))];
+static uint32_t m_lane2_buf[CEIL_DIV(LANE_BUF_SIZE, sizeof(uint32_t))];
+static run_t m_log[LOG_MAX];
+static uint32_t m_runs;
+static uint32_t m_tick;
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+uint32_t app_timer_cnt_get(uint32_t *p_ticks)
+{
+	*p_ticks = m_tick;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff)
+{
+	*p_ticks_diff = (ticks_to - ticks_from) & TICK_MASK;
+	return NRF_SUCCESS;
+}
+
+/* The first byte tags the event, the rest repeats it, empty events are 0 */
+static void event_handler(void *p_event_data, uint16_t event_size)
+{
+	uint8_t *p_data = p_event_data;
+	uint16_t i;
+
+	for(i = 1; i < event_size; i++)
+		CHECK(p_data[i] == p_data[0], "event %u byte %u is 0x%02x", p_data[0], i, p_data[i]);
+	if(m_runs < LOG_MAX) {
+		m_log[m_runs].p_data = p_data;
+		m_log[m_runs].size = event_size;
+		m_log[m_runs].tag = (event_size > 0) ? p_data[0] : 0;
+	}
+	m_runs++;
+	m_tick = (m_tick + WORK_TICKS) & TICK_MASK;
+}
+
+static void setup(uint16_t lane_size)
+{
+	APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE);
+	APP_ERROR_CHECK(app_sched_lane_init(0, m_lane_buf, lane_size));
+	m_runs = 0;
+}
+
+static uint8_t *reserve(uint16_t size, uint8_t tag)
+{
+	uint8_t *p_data = app_sched_lane_event_reserve(0, size, event_handler);
+
+	if(p_data)
+		memset(p_data, tag, size);
+	return p_data;
+}
+
+static uint8_t *put(uint16_t size, uint8_t tag)
+{
+	uint8_t *p_data = reserve(size, tag);
+
+	CHECK(p_data, "no room for event %u", tag);
+	if(p_data)
+		app_sched_event_commit(p_data);
+	return p_data;
+}
+
+static void check_runs(const uint8_t *p_tags, uint32_t count)
+{
+	uint32_t i;
+
+	CHECK(m_runs == count, "%u events ran, %u expected", (unsigned)m_runs, (unsigned)count);
+	for(i = 0; i < count && i < m_runs; i++)
+		CHECK(m_log[i].tag == p_tags[i], "event %u ran as number %u", p_tags[i], (unsigned)i);
+	m_runs = 0;
+}
+
+/* A reserved event holds back the ones behind it until it is committed */
+static void test_commit_order(void)
+{
+	static const uint8_t order[] = { 1, 2, 0 };
+	uint8_t *p_first;
+	uint8_t *p_second;
+
+	setup(5 * RECORD);
+	p_first = reserve(16, 1);
+	p_second = reserve(8, 2);
+	CHECK(p_first && p_second && p_second == p_first + RECORD, "reserved at %p and %p",
+	      (void *)p_first, (void *)p_second);
+	app_sched_event_commit(p_second);
+	put(0, 0);
+	CHECK(!app_sched_execute_budget(10) && m_runs == 0, "%u events ran ahead of a reserved one", (unsigned)m_runs);
+	app_sched_event_commit(p_first);
+	app_sched_execute();
+	check_runs(order, 3);
+	CHECK(m_log[0].p_data == p_first && m_log[1].size == 8 && m_log[2].p_data == NULL && m_log[2].size == 0,
+	      "events not run in place");
+}
+
+/* Five records of room hold four, one word always stays free */
+static void test_full(void)
+{
+	static const uint8_t order[] = { 1, 2, 3, 4, 5 };
+	uint8_t data[16] = { 0 };
+
+	setup(5 * RECORD);
+	put(16, 1);
+	put(16, 2);
+	put(16, 3);
+	put(16, 4);
+	CHECK(reserve(16, 5) == NULL, "fifth record fits");
+	CHECK(app_sched_lane_event_put(0, data, sizeof(data), event_handler) == NRF_ERROR_NO_MEM, "put into a full lane");
+	CHECK(reserve(EVENT_SIZE + 1, 5) == NULL, "event above the maximum size reserved");
+	CHECK(app_sched_execute_budget(1), "nothing left after one event");
+
+	/* The freed record ends exactly at the end of the ring */
+	put(16, 5);
+	app_sched_execute();
+	check_runs(order, 5);
+	CHECK(put(16, 6) == (uint8_t *)m_lane_buf + HEADER, "event after an exact fit not at the start");
+	app_sched_execute();
+	m_runs = 0;
+}
+
+/* An event that does not fit before the end starts over at the beginning,
+ * behind a padding header on the rest of the ring */
+static void test_wrap_padding(void)
+{
+	static const uint8_t order[] = { 1, 2, 3, 4, 5 };
+	uint8_t *p_wrapped;
+
+	setup(5 * RECORD);
+	put(16, 1);
+	put(16, 2);
+	put(16, 3);
+	put(16, 4);
+	app_sched_execute_budget(2);
+	check_runs(order, 2);
+
+	/* One record left at the end, the event needs more */
+	p_wrapped = put(24, 5);
+	CHECK(p_wrapped == (uint8_t *)m_lane_buf + HEADER, "24 byte event at offset %d",
+	      (int)(p_wrapped - (uint8_t *)m_lane_buf));
+	/* Which leaves less than a record before the oldest event */
+	CHECK(reserve(16, 6) == NULL, "event overlaps the oldest one");
+	app_sched_execute();
+	check_runs(order + 2, 3);
+	CHECK(m_log[2].p_data == p_wrapped && m_log[2].size == 24, "wrapped event not run in place");
+}
+
+/* A tail too short for a header is skipped without one */
+static void test_wrap_short_tail(void)
+{
+	static const uint8_t order[] = { 1, 2, 3, 4, 5 };
+	uint8_t *p_wrapped;
+
+	setup(4 * RECORD + HEADER - 4);
+	put(16, 1);
+	put(16, 2);
+	put(16, 3);
+	put(16, 4);
+	app_sched_execute_budget(3);
+	check_runs(order, 3);
+
+	p_wrapped = put(16, 5);
+	CHECK(p_wrapped == (uint8_t *)m_lane_buf + HEADER, "event after a short tail at offset %d",
+	      (int)(p_wrapped - (uint8_t *)m_lane_buf));
+	app_sched_execute();
+	check_runs(order + 3, 2);
+
+	/* And the ring goes on from behind it */
+	CHECK(put(16, 6) == p_wrapped + RECORD, "next event not behind the wrapped one");
+	app_sched_execute();
+	CHECK(m_runs == 1 && m_log[0].tag == 6, "event after the wrap did not run");
+}
+
+/* Lane 0, the default lane 1 and lane 2 with the given weights, each with
+ * the given number of one byte events tagged lane * 16 + n */
+static void lanes_fill(uint8_t weight0, uint8_t weight1, uint8_t weight2, const uint8_t *p_counts)
+{
+	const uint8_t weights[3] = { weight0, weight1, weight2 };
+	uint8_t lane;
+	uint8_t tag;
+	uint8_t n;
+
+	APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE);
+	APP_ERROR_CHECK(app_sched_lane_init(0, m_lane0_buf, sizeof(m_lane0_buf)));
+	APP_ERROR_CHECK(app_sched_lane_init(2, m_lane2_buf, sizeof(m_lane2_buf)));
+	for(lane = 0; lane < 3; lane++) {
+		app_sched_lane_weight_set(lane, weights[lane]);
+		for(n = 0; n < p_counts[lane]; n++) {
+			tag = (uint8_t)(lane * 16 + n);
+			APP_ERROR_CHECK(app_sched_lane_event_put(lane, &tag, 1, event_handler));
+		}
+	}
+	m_runs = 0;
+}
+
+/* Lane of every event run so far, as digits */
+static const char *lanes_run(void)
+{
+	static char lanes[LOG_MAX + 1];
+	uint32_t i;
+
+	for(i = 0; i < m_runs && i < LOG_MAX; i++)
+		lanes[i] = (char)('0' + m_log[i].tag / 16);
+	lanes[i] = 0;
+	return lanes;
+}
+
+/* Every lane in the order it was put */
+static void check_fifo(void)
+{
+	uint8_t next[3] = { 0, 0, 0 };
+	uint8_t lane;
+	uint32_t i;
+
+	for(i = 0; i < m_runs && i < LOG_MAX; i++) {
+		lane = m_log[i].tag / 16;
+		CHECK(m_log[i].tag % 16 == next[lane], "lane %u ran event %u before %u", lane, m_log[i].tag % 16, next[lane]);
+		next[lane] = (uint8_t)(m_log[i].tag % 16 + 1);
+	}
+}
+
+static void test_lane_weights(void)
+{
+	static const uint8_t counts[3] = { 8, 4, 4 };
+	static const uint8_t strict[3] = { 6, 0, 6 };
+	static const uint8_t alone[3] = { 6, 0, 0 };
+
+	/* Each weighted lane yields one event to the lanes below per round */
+	lanes_fill(3, 2, 1, counts);
+	app_sched_execute();
+	CHECK(strcmp(lanes_run(), "0001000100211222") == 0, "weighted: %s", lanes_run());
+	check_fifo();
+
+	/* A strict lane below a weighted one does not keep it waiting */
+	lanes_fill(2, 0, 0, strict);
+	app_sched_execute();
+	CHECK(strcmp(lanes_run(), "002002002222") == 0, "weighted over strict: %s", lanes_run());
+	check_fifo();
+
+	/* Nor does a weighted lane hold itself back when alone */
+	lanes_fill(2, 0, 0, alone);
+	app_sched_execute();
+	CHECK(strcmp(lanes_run(), "000000") == 0, "alone: %s", lanes_run());
+
+	/* Strict priority without weights */
+	lanes_fill(0, 0, 0, counts);
+	app_sched_execute();
+	CHECK(strcmp(lanes_run(), "0000000011112222") == 0, "strict: %s", lanes_run());
+	check_fifo();
+}
+
+/* Latency from the put to the run, across the wrap of the counter */
+static void test_lane_stats(void)
+{
+	static const uint8_t counts[3] = { 8, 4, LANE_EVENTS };
+	app_sched_lane_stats_t stats;
+	uint32_t latency[3] = { 0, 0, 0 };
+	uint8_t tag = 0xEE;
+	uint8_t lane;
+	uint32_t i;
+
+	m_tick = TICK_MASK - 100;
+	lanes_fill(3, 2, 1, counts);
+	CHECK(app_sched_lane_event_put(2, &tag, 1, event_handler) == NRF_ERROR_NO_MEM, "lane 2 not full");
+	app_sched_execute();
+	for(i = 0; i < m_runs && i < LOG_MAX; i++)
+		latency[m_log[i].tag / 16] = i * WORK_TICKS;
+
+	for(lane = 0; lane < 3; lane++) {
+		APP_ERROR_CHECK(app_sched_lane_stats_get(lane, &stats));
+		CHECK(stats.events == counts[lane] && stats.max_latency == latency[lane] &&
+		      stats.high_water == counts[lane] * (HEADER + 4) && stats.dropped == (lane == 2),
+		      "lane %u: %u events, %u ticks, %u bytes, %u dropped", lane, (unsigned)stats.events,
+		      (unsigned)stats.max_latency, (unsigned)stats.high_water, (unsigned)stats.dropped);
+	}
+	CHECK(app_sched_lane_stats_get(3, &stats) == NRF_ERROR_INVALID_PARAM, "stats of lane 3");
+
+	/* Reset with the lane */
+	APP_ERROR_CHECK(app_sched_lane_init(2, m_lane2_buf, sizeof(m_lane2_buf)));
+	APP_ERROR_CHECK(app_sched_lane_stats_get(2, &stats));
+	CHECK(stats.events == 0 && stats.max_latency == 0 && stats.dropped == 0, "lane 2 stats kept");
+}
+
+int main(void)
+{
+	test_commit_order();
+	test_full();
+	test_wrap_padding();
+	test_wrap_short_tail();
+	test_lane_weights();
+	test_lane_stats();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
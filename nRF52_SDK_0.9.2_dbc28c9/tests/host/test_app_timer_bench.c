@@ -0,0 +1,193 @@
+/* Cost of starting and expiring timers with 8, 64 and 254 of them running,
+ * built once against app_timer.c (sorted list, SWI0 operation queues) and
+ * once against app_timer_wheel.c. 254 is the most the wheel takes, 256
+ * does not fit the uint8_t max_timers of app_timer_init().
+ *
+ * Every timer is single shot and restarts itself from its handler with a
+ * random timeout of up to a second, so the running count stays put. RTC1
+ * jumps straight to the next compare, the SWI0 and RTC1 handlers run as
+ * soon as they are pending, and every expiry is checked against its due
+ * tick on the way. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "host.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+
+#define TIMERS_MAX         254
+#define OP_QUEUE_SIZE      32           /* Restarts from the handlers of one wakeup */
+#define TIMEOUT_MAX        32768        /* Ticks */
+#define LATE_TICKS_MAX     4
+#define START_OPS          200000
+#define EXPIRIES           200000
+#define RTC_COUNTER_MASK   0x00FFFFFF
+
+#ifndef BACKEND
+#define BACKEND "?"
+#endif
+
+void RTC1_IRQHandler(void);
+void SWI0_EGU0_IRQHandler(void);
+
+/* The wheel has no SWI0 handler and never pends it */
+__attribute__((weak)) void SWI0_EGU0_IRQHandler(void)
+{
+}
+
+typedef struct {
+	app_timer_id_t id;
+	uint64_t due;
+	bool running;
+} bench_timer_t;
+
+static bench_timer_t m_timers[TIMERS_MAX];
+static uint32_t m_count;
+static uint64_t m_now;
+static uint32_t m_expiries;
+static uint32_t m_wakeups;
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* SWI0 until it is done, RTC1 once: a handler pending RTC1 for a compare
+ * too close to set waits for the counter to move on */
+static void irqs(void)
+{
+	uint8_t priority = g_host_int_priority;
+
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	do {
+		if(g_host_rtc1_pending) {
+			g_host_rtc1_pending = false;
+			m_wakeups++;
+			RTC1_IRQHandler();
+		}
+		if(g_host_swi0_pending) {
+			g_host_swi0_pending = false;
+			SWI0_EGU0_IRQHandler();
+		}
+	} while(g_host_swi0_pending);
+	g_host_int_priority = priority;
+}
+
+static void timer_start(bench_timer_t *p_timer)
+{
+	uint32_t ticks = APP_TIMER_MIN_TIMEOUT_TICKS + (uint32_t)rand() % TIMEOUT_MAX;
+
+	p_timer->due = m_now + ticks;
+	p_timer->running = true;
+	APP_ERROR_CHECK(app_timer_start(p_timer->id, ticks, p_timer));
+}
+
+static void timeout_handler(void *p_context)
+{
+	bench_timer_t *p_timer = p_context;
+
+	CHECK(p_timer->running && m_now >= p_timer->due && m_now <= p_timer->due + LATE_TICKS_MAX,
+	      "timer %u fired at %llu, due %llu", (unsigned)(p_timer - m_timers),
+	      (unsigned long long)m_now, (unsigned long long)p_timer->due);
+	p_timer->running = false;
+	m_expiries++;
+	timer_start(p_timer);
+}
+
+/* RTC1 on to the next compare, or by a tick when RTC1 is already pending,
+ * or as far as a quarter of the counter */
+static void rtc_jump(void)
+{
+	uint32_t step = (g_host_rtc1.CC[0] - g_host_rtc1.COUNTER) & RTC_COUNTER_MASK;
+
+	if(g_host_rtc1_pending)
+		step = 1;
+	else if(step == 0 || step > RTC_COUNTER_MASK / 4)
+		step = RTC_COUNTER_MASK / 4;
+	m_now += step;
+	g_host_rtc1.COUNTER = (g_host_rtc1.COUNTER + step) & RTC_COUNTER_MASK;
+	if(g_host_rtc1.COUNTER == g_host_rtc1.CC[0])
+		g_host_rtc1_pending = true;
+	irqs();
+}
+
+static void bench(uint32_t count)
+{
+	static uint32_t buf[CEIL_DIV(APP_TIMER_BUF_SIZE(TIMERS_MAX, OP_QUEUE_SIZE + 1), sizeof(uint32_t))];
+	bench_timer_t *p_timer;
+	double start_ns;
+	double expiry_ns;
+	double t;
+	uint32_t i;
+
+	srand(count);
+	m_count = count;
+	APP_ERROR_CHECK(app_timer_init(0, count, OP_QUEUE_SIZE + 1, buf, NULL));
+	for(i = 0; i < count; i++) {
+		APP_ERROR_CHECK(app_timer_create(&m_timers[i].id, APP_TIMER_MODE_SINGLE_SHOT, timeout_handler));
+		timer_start(&m_timers[i]);
+		irqs();
+	}
+
+	/* Restarting a random timer among the others, from thread mode */
+	t = seconds();
+	for(i = 0; i < START_OPS; i++) {
+		p_timer = &m_timers[(uint32_t)rand() % count];
+		APP_ERROR_CHECK(app_timer_stop(p_timer->id));
+		p_timer->running = false;
+		timer_start(p_timer);
+		irqs();
+	}
+	start_ns = (seconds() - t) * 1e9 / START_OPS;
+
+	/* Expiries, each with its restart from the handler */
+	m_expiries = 0;
+	m_wakeups = 0;
+	t = seconds();
+	while(m_expiries < EXPIRIES)
+		rtc_jump();
+	expiry_ns = (seconds() - t) * 1e9 / m_expiries;
+
+	for(i = 0; i < count; i++) {
+		CHECK(!m_timers[i].running || m_now <= m_timers[i].due + LATE_TICKS_MAX, "timer %u missed", (unsigned)i);
+		APP_ERROR_CHECK(app_timer_stop(m_timers[i].id));
+		irqs();
+	}
+	printf("%-5s %3u timers: stop and start %6.0f ns, expiry and restart %6.0f ns, %.2f expiries per RTC1 interrupt\n",
+	       BACKEND, (unsigned)count, start_ns, expiry_ns, (double)m_expiries / m_wakeups);
+}
+
+int main(void)
+{
+	/* Start close to the wrap, both backends have to handle it */
+	g_host_rtc1.COUNTER = RTC_COUNTER_MASK - 100000;
+
+	bench(8);
+	bench(64);
+	bench(TIMERS_MAX);
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/* Random start/stop traffic against app_timer_wheel.c, checked against a
+ * reference model of when every timer is due. RTC1 is simulated one tick at a
+ * time, with occasional interrupt latency, and the 24 bit counter wraps twice. */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "app_error.h"
+#include "app_timer.h"
+
+#define TIMER_COUNT      64
+#define OP_QUEUE_SIZE    4
+#define RUN_TICKS        20000000
+#define CHECK_INTERVAL   100000
+#define LATE_TICKS_MAX   4          /* Interrupt latency plus the compare offset */
+#define RTC_COUNTER_MASK 0x00FFFFFF
+
+void RTC1_IRQHandler(void);
+
+typedef struct {
+	app_timer_id_t id;
+	bool running;
+	uint64_t due;              /* Absolute tick the handler is due */
+	uint32_t period;           /* 0 for single shot */
+	uint32_t slack;
+	uint32_t fired;
+} model_t;
+
+static model_t m_model[TIMER_COUNT];
+static uint64_t m_now;
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+static uint32_t random_timeout(void)
+{
+	/* Mostly short, now and then long enough to sit on the top wheel level */
+	if(rand() % 10 == 0)
+		return APP_TIMER_MIN_TIMEOUT_TICKS + rand() % 2000000;
+	return APP_TIMER_MIN_TIMEOUT_TICKS + rand() % 3000;
+}
+
+static void timeout_handler(void *p_context)
+{
+	int i = (int)(intptr_t)p_context;
+	model_t *p_model = &m_model[i];
+	uint32_t ticks;
+
+	p_model->fired++;
+	CHECK(p_model->running, "timer %d fired while stopped", i);
+	if(!p_model->running)
+		return;
+	CHECK(m_now >= p_model->due && m_now <= p_model->due + p_model->slack + LATE_TICKS_MAX,
+	      "timer %d fired at %llu, due %llu slack %u period %u", i,
+	      (unsigned long long)m_now, (unsigned long long)p_model->due,
+	      (unsigned)p_model->slack, (unsigned)p_model->period);
+
+	if(p_model->period) {
+		p_model->due += p_model->period;
+		return;
+	}
+	p_model->running = false;
+
+	/* Restart from inside the handler, like a one shot chain would */
+	if(rand() % 3 == 0) {
+		ticks = APP_TIMER_MIN_TIMEOUT_TICKS + rand() % 5000;
+		p_model->due = m_now + ticks;
+		p_model->slack = 0;
+		p_model->running = true;
+		APP_ERROR_CHECK(app_timer_start(p_model->id, ticks, p_context));
+	}
+}
+
+static void random_op(void)
+{
+	int i = rand() % TIMER_COUNT;
+	model_t *p_model = &m_model[i];
+	uint32_t ticks;
+
+	if(rand() % 3 == 0) {
+		APP_ERROR_CHECK(app_timer_stop(p_model->id));
+		p_model->running = false;
+		return;
+	}
+	if(p_model->running)
+		return;
+
+	/* Every fourth timer is repeated, every odd one may come late */
+	ticks = random_timeout();
+	p_model->period = (i % 4 == 0) ? ticks : 0;
+	p_model->slack = (i % 2) ? rand() % (ticks / 4 + 1) : 0;
+	p_model->due = m_now + ticks;
+	p_model->running = true;
+	APP_ERROR_CHECK(app_timer_start_with_slack(p_model->id, ticks, p_model->slack, (void *)(intptr_t)i));
+}
+
+/* Advances RTC1 by one tick, or by a few when the interrupt is served late.
+ * A compare always raises the interrupt, so a wakeup with nothing due has to be
+ * harmless. */
+static void rtc_tick(void)
+{
+	int latency = (rand() % 1000 == 0) ? rand() % 4 : 0;
+	bool compare = false;
+	int k;
+
+	for(k = 0; k <= latency; k++) {
+		m_now++;
+		g_host_rtc1.COUNTER = (g_host_rtc1.COUNTER + 1) & RTC_COUNTER_MASK;
+		if(g_host_rtc1.COUNTER == g_host_rtc1.CC[0])
+			compare = true;
+	}
+	if(compare || g_host_rtc1_pending) {
+		g_host_rtc1_pending = false;
+		RTC1_IRQHandler();
+	}
+}
+
+static void missed_check(void)
+{
+	int i;
+
+	for(i = 0; i < TIMER_COUNT; i++) {
+		if(!m_model[i].running || m_now <= m_model[i].due + m_model[i].slack + LATE_TICKS_MAX)
+			continue;
+		CHECK(0, "timer %d missed, now %llu due %llu", i,
+		      (unsigned long long)m_now, (unsigned long long)m_model[i].due);
+		m_model[i].running = false;
+	}
+}
+
+int main(void)
+{
+	static uint32_t buf[CEIL_DIV(APP_TIMER_BUF_SIZE(TIMER_COUNT, OP_QUEUE_SIZE + 1), sizeof(uint32_t))];
+	app_timer_stats_t stats;
+	uint32_t fired = 0;
+	long tick;
+	int i;
+
+	/* The wheel takes the counter as it finds it, start close to the wrap */
+	g_host_rtc1.COUNTER = RTC_COUNTER_MASK - 100000;
+
+	/* 0xFF ends the node lists, so it can not be a timer too */
+	CHECK(app_timer_init(0, 0xFF, OP_QUEUE_SIZE + 1, buf, NULL) == NRF_ERROR_INVALID_PARAM, "255 timers taken");
+
+	APP_ERROR_CHECK(app_timer_init(0, TIMER_COUNT, OP_QUEUE_SIZE + 1, buf, NULL));
+	for(i = 0; i < TIMER_COUNT; i++)
+		APP_ERROR_CHECK(app_timer_create(&m_model[i].id,
+		                                 (i % 4 == 0) ? APP_TIMER_MODE_REPEATED : APP_TIMER_MODE_SINGLE_SHOT,
+		                                 timeout_handler));
+
+	srand(1);
+	for(tick = 0; tick < RUN_TICKS && m_failures <= 10; tick++) {
+		if(rand() % 50 == 0)
+			random_op();
+		rtc_tick();
+		if(tick % CHECK_INTERVAL == 0)
+			missed_check();
+	}
+
+	for(i = 0; i < TIMER_COUNT; i++)
+		fired += m_model[i].fired;
+	APP_ERROR_CHECK(app_timer_stats_get(&stats));
+	printf("%u expiries, %u wakeups, %u saved by slack\n",
+	       (unsigned)fired, (unsigned)stats.wakeups, (unsigned)stats.wakeups_saved);
+	CHECK(fired > 0, "no timer fired");
+	CHECK(stats.wakeups_saved > 0, "slack saved no wakeups");
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
@@ -0,0 +1,420 @@
+/* The rotary decoder of button.c replayed from hall sensor edges: the Gray
+ * table against a model built from the phase order, detents adding up over
+ * partial turns, the speed estimate and its reset after a pause or a turn
+ * around, the accelerated scroll, and the edge queue overflowing. The pins
+ * are g_host_gpio.IN and the RTC1 counter is a 24 bit tick the test steps. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf.h"
+#include "app_timer.h"
+#include "app_scheduler.h"
+#include "nrf_drv_gpiote.h"
+#include "button.h"
+
+#define PIN_HALL_1      18             /* State bit 1, as button.c */
+#define PIN_HALL_2      17             /* State bit 0 */
+#define PINS            32
+#define TICK_MASK       0x00FFFFFF
+#define SCHED_QUEUE     4
+#define REPLAY_EDGES    20000
+
+static int m_failures = 0;
+static uint32_t m_tick;
+static nrf_drv_gpiote_evt_handler_t m_pin_handler[PINS];
+static uint8_t m_state = 3;            /* Both sensors idle high, at a detent */
+
+static struct {
+	app_sched_event_handler_t handler;
+} m_sched[SCHED_QUEUE];
+static uint32_t m_sched_count;
+
+static btn_evt_t m_rotate;             /* Last BTN_EVT_ROTATE */
+static uint32_t m_rotate_count;
+
+/* Clockwise phase order of the hall states */
+static const uint8_t m_cw[4] = { 3, 2, 0, 1 };
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+bool nrf_drv_gpiote_is_init(void)
+{
+	return true;
+}
+
+ret_code_t nrf_drv_gpiote_init(void)
+{
+	return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_gpiote_in_init(nrf_drv_gpiote_pin_t pin, nrf_drv_gpiote_in_config_t *p_config,
+                                  nrf_drv_gpiote_evt_handler_t evt_handler)
+{
+	(void)p_config;
+	m_pin_handler[pin] = evt_handler;
+	return NRF_SUCCESS;
+}
+
+void nrf_drv_gpiote_in_uninit(nrf_drv_gpiote_pin_t pin)
+{
+	m_pin_handler[pin] = NULL;
+}
+
+void nrf_drv_gpiote_in_event_enable(nrf_drv_gpiote_pin_t pin, bool int_enable)
+{
+	(void)pin;
+	(void)int_enable;
+}
+
+void nrf_drv_gpiote_in_event_disable(nrf_drv_gpiote_pin_t pin)
+{
+	(void)pin;
+}
+
+/* The button timers never fire, only the rotary is driven */
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode,
+                          app_timer_timeout_handler_t timeout_handler)
+{
+	(void)mode;
+	(void)timeout_handler;
+	*p_timer_id = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+	(void)timer_id;
+	(void)timeout_ticks;
+	(void)p_context;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+	(void)timer_id;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(uint32_t *p_ticks)
+{
+	*p_ticks = m_tick;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff)
+{
+	*p_ticks_diff = (ticks_to - ticks_from) & TICK_MASK;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_sched_lane_event_put(uint8_t lane, void *p_event_data, uint16_t event_size,
+                                  app_sched_event_handler_t handler)
+{
+	(void)p_event_data;
+	CHECK(lane == BTN_SCHED_LANE && event_size <= BTN_SCHED_EVT_SIZE, "lane %u, %u bytes",
+	      lane, event_size);
+	if(m_sched_count == SCHED_QUEUE)
+		return NRF_ERROR_NO_MEM;
+	m_sched[m_sched_count++].handler = handler;
+	return NRF_SUCCESS;
+}
+
+static void sched_run(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < m_sched_count; i++)
+		m_sched[i].handler(NULL, 0);
+	m_sched_count = 0;
+}
+
+static void subscriber(btn_evt_t const *p_evt)
+{
+	if(p_evt->type == BTN_EVT_ROTATE) {
+		m_rotate = *p_evt;
+		m_rotate_count++;
+	}
+}
+
+static uint8_t phase(uint8_t state)
+{
+	uint8_t p;
+
+	for(p = 0; m_cw[p] != state; p++)
+		;
+	return p;
+}
+
+/* The sensors move to state after ticks; one interrupt even when both
+ * changed, as when an edge was missed */
+static void hall(uint8_t state, uint32_t ticks)
+{
+	uint8_t changed = m_state ^ state;
+	uint8_t pin = (changed & 2) ? PIN_HALL_1 : PIN_HALL_2;
+
+	m_tick = (m_tick + ticks) & TICK_MASK;
+	m_state = state;
+	g_host_gpio.IN = (g_host_gpio.IN & ~((1u << PIN_HALL_1) | (1u << PIN_HALL_2))) |
+	                 ((uint32_t)(state >> 1) << PIN_HALL_1) | ((uint32_t)(state & 1) << PIN_HALL_2);
+	if(changed)
+		m_pin_handler[pin](pin, NRF_GPIOTE_POLARITY_TOGGLE);
+}
+
+/* Quarter steps, clockwise positive, evenly over ticks each */
+static void quarter_steps(int32_t steps, uint32_t ticks)
+{
+	int32_t dir = (steps < 0) ? -1 : 1;
+
+	for(; steps != 0; steps -= dir)
+		hall(m_cw[(phase(m_state) + 4 + dir) % 4], ticks);
+}
+
+static void turn(int32_t detents, uint32_t detent_ticks)
+{
+	quarter_steps(detents * BTN_ROTARY_STEPS_PER_DETENT, detent_ticks / BTN_ROTARY_STEPS_PER_DETENT);
+}
+
+static void idle(uint32_t ticks)
+{
+	m_tick = (m_tick + ticks) & TICK_MASK;
+}
+
+/* Random single steps, bounces on one sensor and missed edges, checked
+ * after every read against a decoder working from the phase order */
+static void test_gray(void)
+{
+	btn_rotary_t rotary;
+	int32_t position;
+	uint32_t errors;
+	int32_t steps = 0;
+	uint32_t edges;
+	uint32_t i;
+	uint8_t next;
+	uint8_t delta;
+
+	btn_rotary_get(&rotary);
+	position = rotary.position;
+	errors = rotary.errors;
+	srand(17);
+	for(i = 0; i < REPLAY_EDGES; i += edges) {
+		for(edges = 0; edges < BTN_ROTARY_EDGE_QUEUE_SIZE; edges++) {
+			do
+				next = (uint8_t)(rand() % 4);
+			while(next == m_state);
+			delta = (uint8_t)((phase(next) + 4 - phase(m_state)) % 4);
+			if(delta == 2 && rand() % 8)
+				continue;               /* Mostly clean edges */
+			if(delta == 1)
+				steps++;
+			else if(delta == 3)
+				steps--;
+			else
+				errors++;
+			if(steps == BTN_ROTARY_STEPS_PER_DETENT) {
+				steps = 0;
+				position++;
+			} else if(steps == -BTN_ROTARY_STEPS_PER_DETENT) {
+				steps = 0;
+				position--;
+			}
+			hall(next, 30);
+		}
+		btn_rotary_get(&rotary);
+		CHECK(rotary.position == position && rotary.errors == errors,
+		      "after %u edges: position %d errors %u, expected %d and %u", (unsigned)(i + edges),
+		      (int)rotary.position, rotary.errors, (int)position, (unsigned)errors);
+	}
+
+	/* Back to a detent for the tests that follow */
+	quarter_steps(-steps, 30);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.position == position, "position %d back at the detent, expected %d",
+	      (int)rotary.position, (int)position);
+	sched_run();
+	printf("%u edges replayed, %d detents, %u missed edges\n", (unsigned)i, (int)position, (unsigned)errors);
+}
+
+static void test_detents(void)
+{
+	btn_rotary_t rotary;
+	int32_t position;
+	uint16_t errors;
+
+	idle(APP_TIMER_TICKS(1000, 0));
+	btn_rotary_get(&rotary);
+	position = rotary.position;
+	errors = rotary.errors;
+
+	/* Three quarters of a detent is nothing yet, the fourth completes it */
+	quarter_steps(3, 100);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == 0 && rotary.position == position, "%d detents after 3 quarter steps",
+	      rotary.detents);
+	quarter_steps(1, 100);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == 1 && rotary.position == position + 1, "%d detents after 4 quarter steps",
+	      rotary.detents);
+
+	/* A bounce on one sensor moves nothing */
+	quarter_steps(1, 10);
+	quarter_steps(-1, 10);
+	quarter_steps(1, 10);
+	quarter_steps(-1, 10);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == 0 && rotary.errors == errors, "bounce: %d detents, %u errors", rotary.detents,
+	      rotary.errors - errors);
+
+	/* A full queue of edges between two reads */
+	turn(BTN_ROTARY_EDGE_QUEUE_SIZE / BTN_ROTARY_STEPS_PER_DETENT, 400);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == BTN_ROTARY_EDGE_QUEUE_SIZE / BTN_ROTARY_STEPS_PER_DETENT,
+	      "%d detents from a full queue", rotary.detents);
+
+	/* Half a detent back and forth across reads, then counter clockwise */
+	quarter_steps(-2, 100);
+	btn_rotary_get(&rotary);
+	quarter_steps(2, 100);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == 0, "%d detents from half a detent and back", rotary.detents);
+	turn(-5, 400);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == -5 && rotary.position == position + 1 + 8 - 5, "%d detents, position %d",
+	      rotary.detents, (int)(rotary.position - position));
+
+	/* Every read scheduled at most one handler, which reports the same */
+	CHECK(m_sched_count <= 1, "%u rotary handlers queued", (unsigned)m_sched_count);
+	turn(2, 400);
+	m_rotate_count = 0;
+	sched_run();
+	CHECK(m_rotate_count == 1 && m_rotate.detents == 2 && m_rotate.button == BTN_COUNT,
+	      "%u rotate events, %d detents", (unsigned)m_rotate_count, m_rotate.detents);
+	sched_run();
+	CHECK(m_rotate_count == 1, "rotate event without detents");
+}
+
+/* Turns at a steady rate from rest and returns the speed read last */
+static btn_rotary_t spin(int32_t dir, uint32_t detents, uint32_t detent_ticks)
+{
+	btn_rotary_t rotary;
+	int32_t scroll = 0;
+	uint32_t i;
+
+	for(i = 0; i < detents; i++) {
+		turn(dir, detent_ticks);
+		btn_rotary_get(&rotary);
+		CHECK(rotary.detents == dir, "%d detents per detent", rotary.detents);
+		scroll += rotary.scroll;
+	}
+	rotary.scroll = (int16_t)scroll;
+	return rotary;
+}
+
+static void test_speed(void)
+{
+	btn_rotary_t rotary;
+	btn_rotary_t fast;
+	uint32_t speed;
+
+	/* 20 detents per second settles just under 20 */
+	idle(APP_TIMER_TICKS(1000, 0));
+	rotary = spin(1, 24, APP_TIMER_CLOCK_FREQ / 20);
+	CHECK(rotary.velocity >= 16 && rotary.velocity <= 20, "velocity %d at 20 detents/s", rotary.velocity);
+	speed = 1 + rotary.velocity / BTN_ROTARY_ACCEL_STEP;
+	btn_rotary_get(&rotary);
+	turn(1, APP_TIMER_CLOCK_FREQ / 20);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.scroll == (int16_t)speed, "scroll %d at velocity %d, expected %u", rotary.scroll,
+	      rotary.velocity, (unsigned)speed);
+	printf("20 detents/s: velocity %d, scroll x%u\n", rotary.velocity, (unsigned)speed);
+
+	/* A pause drops the speed, the next detent scrolls one line and the
+	 * estimate starts again from rest */
+	idle(APP_TIMER_TICKS(250, 0));
+	btn_rotary_get(&rotary);
+	CHECK(rotary.velocity == 0 && rotary.detents == 0 && rotary.scroll == 0, "velocity %d after 250 ms",
+	      rotary.velocity);
+	turn(1, 400);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.velocity <= 1 && rotary.scroll == 1, "velocity %d, scroll %d after a pause",
+	      rotary.velocity, rotary.scroll);
+
+	/* Turning round takes the new speed straight away */
+	rotary = spin(1, 16, APP_TIMER_CLOCK_FREQ / 20);
+	turn(-1, APP_TIMER_CLOCK_FREQ / 20);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.velocity == -20 && rotary.scroll == -(1 + 20 / BTN_ROTARY_ACCEL_STEP),
+	      "velocity %d, scroll %d after turning round", rotary.velocity, rotary.scroll);
+
+	/* Flat out, across the RTC wrapping, the scroll factor stops at the top */
+	idle(APP_TIMER_TICKS(1000, 0));
+	m_tick = TICK_MASK - 1000;
+	fast = spin(-1, 64, 164);
+	CHECK(fast.velocity <= -150 && fast.velocity >= -200, "velocity %d at 200 detents/s", fast.velocity);
+	turn(-1, 164);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.scroll == -BTN_ROTARY_ACCEL_MAX, "scroll %d flat out", rotary.scroll);
+	printf("200 detents/s: velocity %d, %d lines for 64 detents\n", fast.velocity, fast.scroll);
+
+	/* Speeding up from rest scales every read in between */
+	idle(APP_TIMER_TICKS(1000, 0));
+	rotary = spin(1, 32, APP_TIMER_CLOCK_FREQ / 40);
+	CHECK(rotary.scroll > 32 && rotary.scroll < 32 * 6, "%d lines for 32 detents at 40 detents/s",
+	      rotary.scroll);
+	sched_run();
+}
+
+/* More edges than the queue holds between two reads */
+static void test_overflow(void)
+{
+	btn_rotary_t rotary;
+	uint32_t errors;
+	int32_t position;
+
+	idle(APP_TIMER_TICKS(1000, 0));
+	btn_rotary_get(&rotary);
+	errors = rotary.errors;
+	position = rotary.position;
+	turn(10, 400);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.errors == errors + 10 * BTN_ROTARY_STEPS_PER_DETENT - BTN_ROTARY_EDGE_QUEUE_SIZE,
+	      "%u errors from %u lost edges", (unsigned)(rotary.errors - errors),
+	      10 * BTN_ROTARY_STEPS_PER_DETENT - BTN_ROTARY_EDGE_QUEUE_SIZE);
+	CHECK(rotary.position - position == BTN_ROTARY_EDGE_QUEUE_SIZE / BTN_ROTARY_STEPS_PER_DETENT,
+	      "%d detents kept of 10", (int)(rotary.position - position));
+
+	/* The decoder picks up again from the state it finds */
+	turn(1, 400);
+	btn_rotary_get(&rotary);
+	CHECK(rotary.detents == 1, "%d detents after the overflow", rotary.detents);
+	sched_run();
+}
+
+int main(void)
+{
+	g_host_gpio.IN = (1u << PIN_HALL_1) | (1u << PIN_HALL_2);
+	CHECK(btn_init() == NRF_SUCCESS, "btn_init");
+	CHECK(btn_subscribe(subscriber) == NRF_SUCCESS, "btn_subscribe");
+	CHECK(m_pin_handler[PIN_HALL_1] && m_pin_handler[PIN_HALL_2], "hall pins not set up");
+
+	test_gray();
+	test_detents();
+	test_speed();
+	test_overflow();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
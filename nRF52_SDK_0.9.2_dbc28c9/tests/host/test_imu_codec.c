@@ -0,0 +1,130 @@
+/* Round trip of imu_codec blocks over synthetic accelerometer traces, at the
+ * BLE payload size and at a flash record size. */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imu_codec.h"
+
+#define TRACE_LEN        5000
+#define BLE_CAPACITY     18
+#define RECORD_CAPACITY  240
+
+typedef enum {
+	TRACE_WRIST,           /* Slow swings plus sensor noise */
+	TRACE_RANDOM,          /* Full range noise, widest deltas */
+	TRACE_EXTREMES,        /* Alternating -32768/32767, wrapping deltas */
+	TRACE_STILL,           /* Constant, zero width deltas */
+	TRACE_COUNT
+} trace_t;
+
+static const char *m_trace_name[TRACE_COUNT] = { "wrist", "random", "extremes", "still" };
+
+static int16_t m_trace[TRACE_LEN][3];
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+static void trace_fill(trace_t trace)
+{
+	int i;
+	int a;
+
+	for(i=0; i<TRACE_LEN; i++) {
+		for(a=0; a<3; a++) {
+			switch(trace) {
+			case TRACE_WRIST:
+				m_trace[i][a] = (int16_t)(2000*sin(i*0.01*(a+1)) + (rand()%40-20));
+				break;
+			case TRACE_RANDOM:
+				m_trace[i][a] = (int16_t)(rand() & 0xFFFF);
+				break;
+			case TRACE_EXTREMES:
+				m_trace[i][a] = (i & 1) ? 32767 : -32768;
+				break;
+			default:
+				m_trace[i][a] = (int16_t)(a*1000-1000);
+				break;
+			}
+		}
+	}
+}
+
+/* Encodes the whole trace block by block and decodes every block back. */
+static void round_trip(trace_t trace, size_t capacity)
+{
+	static int16_t decoded[IMU_CODEC_BLOCK_MAX][3];
+	uint8_t block[RECORD_CAPACITY];
+	size_t total = 0;
+	size_t size;
+	size_t block_size;
+	uint16_t used;
+	int count;
+	int pos = 0;
+
+	while(pos < TRACE_LEN) {
+		size = imu_codec_encode((int16_t const (*)[3])&m_trace[pos], (uint16_t)(TRACE_LEN-pos),
+		                        block, capacity, &used);
+		CHECK(size >= IMU_CODEC_HEADER_SIZE && size <= capacity,
+		      "%s: block size %u at %d", m_trace_name[trace], (unsigned)size, pos);
+		CHECK(used >= 1 && used <= IMU_CODEC_BLOCK_MAX,
+		      "%s: %u samples at %d", m_trace_name[trace], used, pos);
+		if(m_failures) {
+			return;
+		}
+
+		count = imu_codec_decode(block, size, decoded, IMU_CODEC_BLOCK_MAX, &block_size);
+		CHECK(count == used && block_size == size,
+		      "%s: decoded %d of %u samples, %u of %u bytes at %d", m_trace_name[trace],
+		      count, used, (unsigned)block_size, (unsigned)size, pos);
+		CHECK(count < 0 || memcmp(decoded, m_trace[pos], used*sizeof(m_trace[0])) == 0,
+		      "%s: samples differ at %d", m_trace_name[trace], pos);
+		if(size > IMU_CODEC_HEADER_SIZE) {
+			CHECK(imu_codec_decode(block, size-1, decoded, IMU_CODEC_BLOCK_MAX, &block_size) == -1,
+			      "%s: truncated block accepted at %d", m_trace_name[trace], pos);
+		}
+		if(used > 1) {
+			CHECK(imu_codec_decode(block, size, decoded, used-1, &block_size) == -1,
+			      "%s: block larger than max accepted at %d", m_trace_name[trace], pos);
+		}
+		if(m_failures) {
+			return;
+		}
+
+		pos += used;
+		total += size;
+	}
+
+	printf("%-9s capacity %3u: %.2f samples per 6 bytes\n", m_trace_name[trace],
+	       (unsigned)capacity, (double)TRACE_LEN*6/total);
+}
+
+int main(void)
+{
+	uint8_t block[RECORD_CAPACITY];
+	uint16_t used = 0;
+	trace_t trace;
+
+	srand(1);
+	for(trace=0; trace<TRACE_COUNT; trace++) {
+		trace_fill(trace);
+		round_trip(trace, BLE_CAPACITY);
+		round_trip(trace, RECORD_CAPACITY);
+	}
+
+	CHECK(imu_codec_encode((int16_t const (*)[3])m_trace, 1, block, IMU_CODEC_HEADER_SIZE-1, &used) == 0,
+	      "capacity below the header accepted");
+	CHECK(imu_codec_encode((int16_t const (*)[3])m_trace, 0, block, RECORD_CAPACITY, &used) == 0,
+	      "empty block accepted");
+
+	printf("%s\n", m_failures ? "FAILED" : "OK");
+	return m_failures ? 1 : 0;
+}
@@ -0,0 +1,429 @@
+/* lcd.c against a fake SPI bus feeding a model of the display controller.
+ * Transfers only complete when the test raises the SPI event, so a flush that
+ * busy-waited anywhere would hang instead of passing; alarm() turns that into
+ * a failure. Built once per LCD_BUFFER_MODE. */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_drv_spi.h"
+#include "nrf_error.h"
+#include "lcd.h"
+
+#define LCD_SPI_A0_PIN   7     /* As wired in lcd.c */
+#define ROW_BYTES        (LCD_WITH*LCD_COLOR_DEEP)
+
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+/* Controller model: command bytes with A0 low, their data with A0 high. A
+ * data run writes consecutive registers; after 0x08 the data is pixels,
+ * written into the MEM_X1..Y2 window row by row. */
+static uint8_t m_reg[256];
+static uint8_t m_gram[LCD_HIGHT][ROW_BYTES];
+static uint8_t m_cmd;
+static uint32_t m_cmd_data;
+static uint32_t m_gram_x;
+static uint32_t m_gram_y;
+
+/* Bus statistics, reset per case */
+static uint32_t m_transfers;
+static uint32_t m_cmd_transfers;
+static uint32_t m_windows;
+static uint32_t m_pixel_bytes;
+static uint8_t m_cmd_log[512];
+static uint32_t m_cmd_log_len;
+
+static nrf_drv_spi_handler_t m_spi_handler;
+static bool m_spi_pending;
+static bool m_spi_sync;          /* Complete transfers inside the call */
+static app_timer_timeout_handler_t m_timer_handler;
+static bool m_timer_pending;
+static uint32_t m_flush_done;
+
+/* The frame the application drew, independent of lcd.c's buffers */
+static uint8_t m_ref[LCD_HIGHT][ROW_BYTES];
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode,
+                          app_timer_timeout_handler_t timeout_handler)
+{
+	*p_timer_id = 0;
+	m_timer_handler = timeout_handler;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+	CHECK(!m_timer_pending, "timer started twice");
+	m_timer_pending = true;
+	return NRF_SUCCESS;
+}
+
+ret_code_t nrf_drv_spi_init(nrf_drv_spi_t const * const p_instance,
+                            nrf_drv_spi_config_t const * p_config,
+                            nrf_drv_spi_handler_t handler)
+{
+	m_spi_handler = handler;
+	return NRF_SUCCESS;
+}
+
+static void controller_byte(bool a0, uint8_t byte)
+{
+	bool pixel_high;
+
+	if(!a0) {
+		m_cmd = byte;
+		m_cmd_data = 0;
+		if(m_cmd_log_len < sizeof(m_cmd_log))
+			m_cmd_log[m_cmd_log_len++] = byte;
+		if(byte == 0x08) {
+			m_windows++;
+			m_gram_x = m_reg[0x34];
+			m_gram_y = m_reg[0x36];
+		}
+		return;
+	}
+	if(m_cmd != 0x08) {
+		m_reg[(uint8_t)(m_cmd + m_cmd_data++)] = byte;
+		return;
+	}
+	pixel_high = m_cmd_data++ & 1;
+	CHECK(m_gram_y <= m_reg[0x37] && m_gram_y < LCD_HIGHT, "pixel past the window");
+	if(m_gram_y >= LCD_HIGHT)
+		return;
+	m_gram[m_gram_y][m_gram_x*LCD_COLOR_DEEP + pixel_high] = byte;
+	m_pixel_bytes++;
+	if(pixel_high && ++m_gram_x > m_reg[0x35]) {
+		m_gram_x = m_reg[0x34];
+		m_gram_y++;
+	}
+}
+
+ret_code_t nrf_drv_spi_transfer(nrf_drv_spi_t const * const p_instance,
+                                uint8_t const * p_tx_buffer,
+                                uint8_t         tx_buffer_length,
+                                uint8_t       * p_rx_buffer,
+                                uint8_t         rx_buffer_length)
+{
+	bool a0 = host_gpio_out(LCD_SPI_A0_PIN);
+	uint32_t i;
+
+	if(m_spi_pending)
+		return NRF_ERROR_BUSY;
+	m_transfers++;
+	if(!a0) {
+		m_cmd_transfers++;
+		CHECK(tx_buffer_length == 1, "%u command bytes in one transfer", tx_buffer_length);
+	}
+	for(i = 0; i < tx_buffer_length; i++)
+		controller_byte(a0, p_tx_buffer[i]);
+	if(m_spi_sync) {
+		m_spi_handler(NRF_DRV_SPI_EVENT_DONE);
+		return NRF_SUCCESS;
+	}
+	m_spi_pending = true;
+	return NRF_SUCCESS;
+}
+
+/* Raises SPI and timer events until the bus goes quiet, the interrupts the
+ * flush runs from. */
+static uint32_t pump(void)
+{
+	uint32_t events = 0;
+
+	for(;;) {
+		if(m_spi_pending) {
+			m_spi_pending = false;
+			m_spi_handler(NRF_DRV_SPI_EVENT_DONE);
+		} else if(m_timer_pending) {
+			m_timer_pending = false;
+			m_timer_handler(NULL);
+		} else {
+			return events;
+		}
+		events++;
+	}
+}
+
+static void stats_reset(void)
+{
+	m_transfers = 0;
+	m_cmd_transfers = 0;
+	m_windows = 0;
+	m_pixel_bytes = 0;
+	m_cmd_log_len = 0;
+}
+
+static void flush_done(void)
+{
+	m_flush_done++;
+}
+
+/* Fills a rectangle in both the reference frame and lcd.c's draw buffer. */
+static void draw(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint16_t color)
+{
+	uint8_t *p_buf = lcd_get_buffer_address();
+	uint32_t x;
+	uint32_t y;
+
+	for(y = y1; y <= y2; y++) {
+		for(x = x1; x <= x2; x++) {
+			m_ref[y][x*2] = p_buf[(y*LCD_WITH + x)*2] = color >> 8;
+			m_ref[y][x*2 + 1] = p_buf[(y*LCD_WITH + x)*2 + 1] = color & 0xFF;
+		}
+	}
+	lcd_invalidate(x1, y1, x2, y2);
+}
+
+/* The panel shows buffer row y on controller row 95-y */
+static bool panel_matches_ref(void)
+{
+	uint32_t y;
+
+	for(y = 0; y < LCD_HIGHT; y++)
+		if(memcmp(m_gram[LCD_HIGHT-1-y], m_ref[y], ROW_BYTES) != 0)
+			return false;
+	return true;
+}
+
+static bool draw_buffer_matches_ref(void)
+{
+	return memcmp(lcd_get_buffer_address(), m_ref, sizeof(m_ref)) == 0;
+}
+
+static void test_init(void)
+{
+	uint32_t events;
+
+	stats_reset();
+	lcd_init();
+	CHECK(lcd_is_busy(), "init sequence should run in the background");
+	events = pump();
+	CHECK(!lcd_is_busy(), "init sequence did not finish");
+	memcpy(m_ref, lcd_get_buffer_address(), sizeof(m_ref));
+	CHECK(panel_matches_ref(), "first frame differs from the cleared buffer");
+	CHECK(m_reg[0x30] == 0x00 && m_reg[0x31] == 0x5F && m_reg[0x32] == 0x00 && m_reg[0x33] == 0x5F,
+	      "display window registers");
+	CHECK(m_reg[0x3A] == 0x03 && m_reg[0x3D] == 0x09 && m_reg[0x3F] == 0x08, "pulse and precharge registers");
+	CHECK(m_reg[0x40] == 0x7F && m_reg[0x41] == 0x65 && m_reg[0x42] == 0x7B, "column current registers");
+	CHECK(m_reg[0x02] == 0x01 && m_reg[0x14] == 0x00, "display left off");
+	printf("init: %u transfers (%u command bytes), %u events\n",
+	       (unsigned)m_transfers, (unsigned)m_cmd_transfers, (unsigned)events);
+}
+
+static void test_partial_refresh(void)
+{
+	uint32_t expected;
+
+	/* Two far apart regions go out as two windows, nothing else */
+	stats_reset();
+	draw(2, 3, 9, 5, 0xF800);
+	draw(80, 70, 90, 90, 0x07E0);
+	m_flush_done = 0;
+	CHECK(lcd_refresh_async(flush_done) == NRF_SUCCESS, "refresh_async");
+	CHECK(lcd_is_busy() && m_flush_done == 0, "refresh should return before the flush is done");
+	CHECK(lcd_refresh_async(flush_done) == NRF_ERROR_BUSY, "second flush while busy");
+	pump();
+	CHECK(m_flush_done == 1, "completion handler ran %u times", (unsigned)m_flush_done);
+	CHECK(panel_matches_ref(), "panel differs after partial refresh");
+	expected = (8*3 + 11*21) * LCD_COLOR_DEEP;
+	CHECK(m_windows == 2 && m_pixel_bytes == expected, "%u windows, %u pixel bytes, expected 2 and %u",
+	      (unsigned)m_windows, (unsigned)m_pixel_bytes, (unsigned)expected);
+	printf("partial: %u pixel bytes instead of %u\n", (unsigned)m_pixel_bytes, (unsigned)sizeof(m_ref));
+
+	/* Touching regions merge into one window */
+	stats_reset();
+	draw(10, 10, 19, 19, 0x001F);
+	draw(20, 10, 29, 19, 0x001F);
+	draw(15, 15, 24, 24, 0xFFFF);
+	lcd_refresh_async(NULL);
+	pump();
+	CHECK(m_windows == 1, "touching regions took %u windows", (unsigned)m_windows);
+	CHECK(panel_matches_ref(), "panel differs after merged refresh");
+
+	/* More scattered regions than slots fold together, yet all reach the panel */
+	stats_reset();
+	draw(0, 0, 1, 1, 0x1234);
+	draw(94, 0, 95, 1, 0x2345);
+	draw(0, 94, 1, 95, 0x3456);
+	draw(94, 94, 95, 95, 0x4567);
+	draw(47, 47, 48, 48, 0x5678);
+	draw(30, 60, 31, 61, 0x6789);
+	lcd_refresh_async(NULL);
+	pump();
+	CHECK(m_windows <= LCD_DIRTY_RECT_MAX, "%u windows", (unsigned)m_windows);
+	CHECK(panel_matches_ref(), "panel differs after folding regions");
+
+	/* Nothing dirty: the handler still runs, nothing is sent */
+	stats_reset();
+	m_flush_done = 0;
+	CHECK(lcd_refresh_async(flush_done) == NRF_SUCCESS && m_flush_done == 1 && m_transfers == 0,
+	      "empty refresh");
+}
+
+static void test_queued_sequence(void)
+{
+	uint32_t i;
+	uint32_t flush_end;
+
+	/* A sleep asked for from an interrupt mid-flush runs once the flush ends */
+	stats_reset();
+	draw(40, 40, 60, 60, 0xAAAA);
+	lcd_refresh_async(NULL);
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	lcd_sleep();
+	CHECK(lcd_refresh() == NRF_ERROR_BUSY, "refresh from an interrupt while busy");
+	g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+	pump();
+	CHECK(m_reg[0x02] == 0x00 && m_reg[0x14] == 0x01, "sleep sequence did not run");
+	for(flush_end = 0; flush_end < m_cmd_log_len && m_cmd_log[flush_end] != 0x08; flush_end++)
+		;
+	for(i = 0; i < m_cmd_log_len && m_cmd_log[i] != 0x14; i++)
+		;
+	CHECK(flush_end < i && i < m_cmd_log_len, "sleep overtook the flush");
+
+	/* Sleep then wakeup while busy leaves only the wakeup */
+	stats_reset();
+	draw(40, 40, 41, 41, 0x5555);
+	lcd_refresh_async(NULL);
+	lcd_sleep();
+	lcd_wakeup();
+	pump();
+	CHECK(m_reg[0x02] == 0x01 && m_reg[0x14] == 0x00, "wakeup did not win");
+	CHECK(m_cmd_transfers == 5 + 2, "%u command transfers, expected one window and the wakeup",
+	      (unsigned)m_cmd_transfers);
+
+	/* From an interrupt an idle refresh is only started */
+	stats_reset();
+	draw(0, 50, 95, 50, 0x0F0F);
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	CHECK(lcd_refresh() == NRF_SUCCESS && lcd_is_busy(), "refresh from an interrupt");
+	g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+	pump();
+	CHECK(panel_matches_ref(), "panel differs after refresh from an interrupt");
+
+	/* In thread mode the blocking call returns with the flush done */
+	m_spi_sync = true;
+	draw(5, 5, 6, 90, 0xF0F0);
+	CHECK(lcd_refresh() == NRF_SUCCESS && !lcd_is_busy(), "blocking refresh");
+	CHECK(panel_matches_ref(), "panel differs after blocking refresh");
+	m_spi_sync = false;
+}
+
+/* A completion handler that draws and refreshes again from the SPI interrupt,
+ * the way an animation chains its frames. */
+static int m_chain_left;
+
+static void chain_next(void)
+{
+	int frame = 4 - m_chain_left;
+
+	m_flush_done++;
+	if(m_chain_left-- == 0)
+		return;
+	draw(frame*20, 10, frame*20 + 9, 19, 0x0F0F + frame);
+	CHECK(lcd_refresh_async(chain_next) == NRF_SUCCESS, "chained refresh %d refused", frame);
+}
+
+static void test_async_chain(void)
+{
+	stats_reset();
+	m_flush_done = 0;
+	m_chain_left = 4;
+	draw(0, 0, 5, 5, 0x7777);
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	lcd_refresh_async(chain_next);
+	lcd_sleep();
+	g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+	pump();
+	CHECK(m_flush_done == 5, "chain ran %u flushes", (unsigned)m_flush_done);
+	CHECK(m_windows == 5, "chain sent %u windows", (unsigned)m_windows);
+	CHECK(panel_matches_ref(), "panel differs after the chain");
+	CHECK(m_reg[0x14] == 0x01 && m_cmd_log[m_cmd_log_len - 1] == 0x14, "sleep should wait for the chain");
+	lcd_wakeup();
+	pump();
+
+	/* Damage reported while a flush is on the wire goes out with the next one */
+	stats_reset();
+	draw(50, 50, 59, 59, 0x3C3C);
+	lcd_refresh_async(NULL);
+	draw(5, 80, 9, 85, 0xC3C3);
+	pump();
+	lcd_refresh_async(NULL);
+	pump();
+	CHECK(m_windows == 2, "%u windows for two separate flushes", (unsigned)m_windows);
+	CHECK(panel_matches_ref(), "damage during a flush was lost");
+}
+
+/* Drawing the next frame while the last one is on the wire */
+static void test_present(void)
+{
+	int frame;
+
+	for(frame = 0; frame < 6; frame++) {
+		draw(frame*10, frame*5, frame*10 + 20, frame*5 + 30, 0x1111*(frame + 1));
+		CHECK(lcd_present(flush_done) == NRF_SUCCESS, "present frame %d", frame);
+#if (LCD_BUFFER_MODE == LCD_BUFFER_DOUBLE)
+		CHECK(!lcd_buffer_in_use(), "draw buffer still being streamed");
+		CHECK(draw_buffer_matches_ref(), "back buffer stale after present of frame %d", frame);
+#endif
+		pump();
+		CHECK(panel_matches_ref(), "panel differs after frame %d", frame);
+	}
+
+	/* A plain refresh must not leave the back buffer behind either */
+	draw(70, 0, 95, 10, 0xBEEF);
+	lcd_refresh_async(NULL);
+	pump();
+	CHECK(panel_matches_ref(), "panel differs after refresh");
+	CHECK(draw_buffer_matches_ref(), "draw buffer stale after refresh");
+	draw(0, 80, 10, 95, 0xCAFE);
+	lcd_display_async(0, 80, 10, 95, NULL);
+	pump();
+	draw(20, 20, 21, 21, 0xD00D);
+	lcd_present(NULL);
+	pump();
+	CHECK(panel_matches_ref(), "panel differs after display then present");
+	CHECK(draw_buffer_matches_ref(), "draw buffer stale after display then present");
+}
+
+static void timeout(int sig)
+{
+	printf("FAIL: lcd.c waited on the bus\n");
+	exit(1);
+}
+
+int main(void)
+{
+	signal(SIGALRM, timeout);
+	alarm(10);
+
+	printf("buffer mode %d\n", LCD_BUFFER_MODE);
+	test_init();
+	test_partial_refresh();
+	test_queued_sequence();
+	test_async_chain();
+	test_present();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/* lcd_draw.c against a per pixel reference: fills, PAL4 and PAL4_RLE bitmaps
+ * with clipping, palette indices past the palette, truncated data, and a
+ * pixels/s comparison of the blitter against the per pixel loop. */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "nordic_common.h"
+#include "lcd_draw.h"
+
+#define BENCH_PIXELS    (64u << 20)
+
+static uint8_t m_buffer[LCD_BUFFER_SIZE];
+static uint16_t m_ref[LCD_HIGHT][LCD_WITH];
+static int m_failures = 0;
+static uint32_t m_invalidated;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+uint8_t* lcd_get_buffer_address(void)
+{
+	return m_buffer;
+}
+
+void lcd_invalidate(uint8_t startx, uint8_t starty, uint8_t endx, uint8_t endy)
+{
+	m_invalidated += (endx - startx + 1) * (endy - starty + 1);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* The controller word for a color, spelled out bit by bit */
+static uint16_t ref_encode(uint16_t color)
+{
+	uint16_t rev = 0;
+	int i;
+
+	for(i = 0; i < 16; i++)
+		if(color & (1 << i))
+			rev |= 1 << (15 - i);
+	return (uint16_t)((rev >> 8) | (rev << 8));
+}
+
+static void ref_pixel(int x, int y, uint16_t color)
+{
+	if(x >= 0 && x < LCD_WITH && y >= 0 && y < LCD_HIGHT)
+		m_ref[y][x] = ref_encode(color);
+}
+
+static void ref_fill(int x, int y, int w, int h, uint16_t color)
+{
+	int i;
+	int j;
+
+	for(j = 0; j < h; j++)
+		for(i = 0; i < w; i++)
+			ref_pixel(x + i, y + j, color);
+}
+
+/* Palette lookup the way the header documents it */
+static void ref_index(int x, int y, lcd_bitmap_t const *p_bitmap, uint8_t index)
+{
+	if(index == p_bitmap->transparent)
+		return;
+	ref_pixel(x, y, index < p_bitmap->colors ? p_bitmap->p_palette[index] : 0);
+}
+
+static void ref_bitmap(int x, int y, lcd_bitmap_t const *p_bitmap)
+{
+	uint32_t stride = (p_bitmap->width + 1) / 2;
+	uint32_t n = 0;
+	uint32_t pos;
+	uint32_t run;
+	uint8_t byte;
+	int i;
+	int j;
+
+	if(p_bitmap->format == LCD_BITMAP_PAL4) {
+		for(j = 0; j < p_bitmap->height && (j + 1) * stride <= p_bitmap->size; j++) {
+			for(i = 0; i < p_bitmap->width; i++) {
+				byte = p_bitmap->p_data[j * stride + i / 2];
+				ref_index(x + i, y + j, p_bitmap, (i & 1) ? (byte & 0x0F) : (byte >> 4));
+			}
+		}
+		return;
+	}
+	for(pos = 0; pos < p_bitmap->size; pos++) {
+		byte = p_bitmap->p_data[pos];
+		for(run = (byte >> 4) + 1; run; run--, n++) {
+			if(n >= (uint32_t)p_bitmap->width * p_bitmap->height)
+				return;
+			ref_index(x + n % p_bitmap->width, y + n / p_bitmap->width, p_bitmap, byte & 0x0F);
+		}
+	}
+}
+
+static bool matches_ref(void)
+{
+	return memcmp(m_buffer, m_ref, sizeof(m_ref)) == 0;
+}
+
+static void clear(void)
+{
+	memset(m_buffer, 0x55, sizeof(m_buffer));
+	memset(m_ref, 0x55, sizeof(m_ref));
+}
+
+static uint16_t const m_palette[4] = {
+	LCD_RGB565(255, 0, 0), LCD_RGB565(0, 255, 0), LCD_RGB565(0, 0, 255), LCD_RGB565(255, 255, 255)
+};
+
+static void test_fill(void)
+{
+	static int const rects[][4] = {
+		{ 0, 0, 96, 96 }, { 3, 5, 1, 1 }, { 1, 2, 7, 9 }, { -10, -3, 20, 8 },
+		{ 90, 90, 30, 30 }, { 0, 40, 96, 11 }, { 50, 50, 0, 5 }, { 200, 0, 5, 5 }
+	};
+	uint32_t i;
+
+	clear();
+	for(i = 0; i < sizeof(rects) / sizeof(rects[0]); i++) {
+		lcd_draw_fill_rect(rects[i][0], rects[i][1], rects[i][2], rects[i][3], 0x1234 * (i + 1));
+		ref_fill(rects[i][0], rects[i][1], rects[i][2], rects[i][3], 0x1234 * (i + 1));
+		CHECK(matches_ref(), "fill %u", (unsigned)i);
+	}
+}
+
+static void test_bitmap(void)
+{
+	static uint8_t data[64];
+	lcd_bitmap_t bitmap;
+	uint32_t i;
+	int x;
+
+	for(i = 0; i < sizeof(data); i++)
+		data[i] = (uint8_t)(i * 37 + 11);
+
+	/* Odd width, transparency, nibbles past the 4 entry palette, clipped on
+	 * every side */
+	bitmap.width = 7;
+	bitmap.height = 9;
+	bitmap.format = LCD_BITMAP_PAL4;
+	bitmap.transparent = 2;
+	bitmap.colors = 4;
+	bitmap.p_palette = m_palette;
+	bitmap.p_data = data;
+	bitmap.size = 4 * 9;
+	clear();
+	for(x = -5; x < LCD_WITH; x += 23) {
+		lcd_draw_bitmap(x, x - 3, &bitmap);
+		ref_bitmap(x, x - 3, &bitmap);
+	}
+	CHECK(matches_ref(), "PAL4 bitmap");
+
+	/* A short PAL4 buffer draws the rows it holds in full */
+	bitmap.size = 4 * 5 + 2;
+	lcd_draw_bitmap(40, 10, &bitmap);
+	ref_bitmap(40, 10, &bitmap);
+	CHECK(matches_ref(), "truncated PAL4 bitmap");
+
+	/* RLE runs wrapping over rows and the right edge */
+	bitmap.format = LCD_BITMAP_PAL4_RLE;
+	bitmap.width = 13;
+	bitmap.height = 11;
+	bitmap.size = sizeof(data);
+	bitmap.transparent = LCD_BITMAP_OPAQUE;
+	clear();
+	lcd_draw_bitmap(88, -4, &bitmap);
+	ref_bitmap(88, -4, &bitmap);
+	lcd_draw_bitmap(20, 30, &bitmap);
+	ref_bitmap(20, 30, &bitmap);
+	CHECK(matches_ref(), "RLE bitmap");
+
+	/* Long runs hanging off the bottom of the screen stay inside the buffer */
+	data[60] = 0xF3;
+	data[61] = 0xF1;
+	lcd_draw_bitmap(50, LCD_HIGHT - 2, &bitmap);
+	ref_bitmap(50, LCD_HIGHT - 2, &bitmap);
+	CHECK(matches_ref(), "RLE bitmap clipped at the bottom");
+
+	/* Runs are not read past the data */
+	bitmap.size = 5;
+	data[5] = 0xF1;
+	lcd_draw_bitmap(0, 60, &bitmap);
+	ref_bitmap(0, 60, &bitmap);
+	CHECK(matches_ref(), "truncated RLE bitmap read past its data");
+}
+
+/* What the blitter replaces: clip and encode every pixel on its own */
+static void naive_bitmap(int x, int y, lcd_bitmap_t const *p_bitmap)
+{
+	uint16_t *p_dst = (uint16_t *)m_buffer;
+	uint32_t stride = (p_bitmap->width + 1) / 2;
+	uint8_t index;
+	int i;
+	int j;
+
+	for(j = 0; j < p_bitmap->height; j++) {
+		for(i = 0; i < p_bitmap->width; i++) {
+			if(x + i < 0 || x + i >= LCD_WITH || y + j < 0 || y + j >= LCD_HIGHT)
+				continue;
+			index = p_bitmap->p_data[j * stride + i / 2];
+			index = (i & 1) ? (index & 0x0F) : (index >> 4);
+			if(index != p_bitmap->transparent)
+				p_dst[(y + j) * LCD_WITH + x + i] = ref_encode(p_bitmap->p_palette[index]);
+		}
+	}
+}
+
+static void bench(void)
+{
+	static uint8_t pal4[48 * 96];
+	static uint8_t rle[96 * 96 / 8];
+	static uint16_t palette[16];
+	lcd_bitmap_t bitmap = { 96, 96, LCD_BITMAP_PAL4, LCD_BITMAP_OPAQUE, 16, palette, pal4, sizeof(pal4) };
+	uint32_t frames = BENCH_PIXELS / (96 * 96);
+	uint32_t i;
+	double t_fill;
+	double t_pal4;
+	double t_rle;
+	double t_naive;
+
+	for(i = 0; i < 16; i++)
+		palette[i] = 0x1111 * i;
+	for(i = 0; i < sizeof(pal4); i++)
+		pal4[i] = (uint8_t)(i * 7);
+	for(i = 0; i < sizeof(rle); i++)
+		rle[i] = 0x70 | (i & 0x0F);
+
+	t_fill = seconds();
+	for(i = 0; i < frames; i++)
+		lcd_draw_fill_rect(1, 0, 94, 96, (uint16_t)i);
+	t_fill = seconds() - t_fill;
+
+	t_pal4 = seconds();
+	for(i = 0; i < frames; i++)
+		lcd_draw_bitmap(0, 0, &bitmap);
+	t_pal4 = seconds() - t_pal4;
+
+	t_naive = seconds();
+	for(i = 0; i < frames; i++)
+		naive_bitmap(0, 0, &bitmap);
+	t_naive = seconds() - t_naive;
+
+	bitmap.format = LCD_BITMAP_PAL4_RLE;
+	bitmap.p_data = rle;
+	bitmap.size = sizeof(rle);
+	t_rle = seconds();
+	for(i = 0; i < frames; i++)
+		lcd_draw_bitmap(0, 0, &bitmap);
+	t_rle = seconds() - t_rle;
+
+	printf("Mpixels/s: fill %.0f, PAL4 %.0f, RLE %.0f, per pixel PAL4 %.0f (x%.1f)\n",
+	       frames * 94 * 96 / t_fill / 1e6, frames * 96 * 96 / t_pal4 / 1e6,
+	       frames * 96 * 96 / t_rle / 1e6, frames * 96 * 96 / t_naive / 1e6, t_naive / t_pal4);
+}
+
+int main(void)
+{
+	test_fill();
+	test_bitmap();
+	bench();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/* LSM6DS3 driver over a counting sensor_twi bus: what the control register
+ * shadow and the burst ReadMem/WriteMem save in bus transactions and 400 kHz
+ * bus time, with the register file checked against the same calls made
+ * one register at a time. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensor_twi.h"
+#include "LSM6DS3_ACC_GYRO_driver.h"
+
+#define REGS            0x80
+#define WHO_AM_I        0x69
+#define CTRL3_C_RESET   0x04           /* IF_INC */
+#define WATERMARK       (32 * 6)       /* Words, as sensor_test.c */
+#define SAMPLE_READS    416
+#define STATUS_BLOCK    (LSM6DS3_ACC_GYRO_OUTZ_H_XL - LSM6DS3_ACC_GYRO_STATUS_REG + 1)
+
+static int m_failures = 0;
+static uint8_t m_regs[REGS];
+
+typedef struct {
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t bits;                 /* On the wire at 400 kHz */
+} bus_stats_t;
+
+static bus_stats_t m_bus;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+static void device_reset(void)
+{
+	memset(m_regs, 0, sizeof(m_regs));
+	m_regs[LSM6DS3_ACC_GYRO_WHO_AM_I_REG] = WHO_AM_I;
+	m_regs[LSM6DS3_ACC_GYRO_CTRL3_C] = CTRL3_C_RESET;
+}
+
+/* Register address auto-increment, as CTRL3_C.IF_INC leaves it */
+int sensor_twi_read(uint8_t addr, uint8_t reg, uint8_t *p_data, uint8_t len)
+{
+	uint8_t i;
+
+	(void)addr;
+	for(i = 0; i < len; i++)
+		p_data[i] = m_regs[(reg + i) % REGS];
+	m_bus.reads++;
+	m_bus.bits += (3 + len) * 9 + 3;           /* START, SLA+W, reg, rSTART, SLA+R, data, STOP */
+	return 0;
+}
+
+int sensor_twi_write(uint8_t addr, uint8_t reg, const uint8_t *p_data, uint8_t len)
+{
+	uint8_t i;
+
+	(void)addr;
+	for(i = 0; i < len; i++)
+		m_regs[(reg + i) % REGS] = p_data[i];
+	if(reg == LSM6DS3_ACC_GYRO_CTRL3_C && (p_data[0] & LSM6DS3_ACC_GYRO_SW_RESET_MASK))
+		device_reset();
+	m_bus.writes++;
+	m_bus.bits += (2 + len) * 9 + 2;           /* START, SLA+W, reg, data, STOP */
+	return 0;
+}
+
+/* The FIFO setup of sensor_test.c: nine setters, ten registers as the
+ * watermark spans two */
+static void fifo_setup(bool cold)
+{
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_FIFO_MODE(LSM6DS3_ACC_GYRO_FIFO_MODE_BYPASS), "bypass");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_ODR_G(LSM6DS3_ACC_GYRO_ODR_G_416Hz), "odr g");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_FS_G(LSM6DS3_ACC_GYRO_FS_G_2000dps), "fs g");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_DEC_FIFO_XL(LSM6DS3_ACC_GYRO_DEC_FIFO_XL_NO_DECIMATION), "dec xl");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_DEC_FIFO_G(LSM6DS3_ACC_GYRO_DEC_FIFO_G_NO_DECIMATION), "dec g");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_FIFO_Watermark(WATERMARK), "watermark");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_FIFO_TSHLD_on_INT1(LSM6DS3_ACC_GYRO_INT1_FTH_ENABLED), "int1");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_ODR_FIFO(LSM6DS3_ACC_GYRO_ODR_FIFO_400Hz), "odr fifo");
+	if(cold)
+		LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	CHECK(LSM6DS3_ACC_GYRO_W_FIFO_MODE(LSM6DS3_ACC_GYRO_FIFO_MODE_STREAM), "stream");
+}
+
+static void report(const char *p_what, bus_stats_t const *p_stats)
+{
+	printf("%-34s %5u reads %5u writes %9.1f us\n", p_what, (unsigned)p_stats->reads,
+	       (unsigned)p_stats->writes, p_stats->bits * 2.5);
+}
+
+static void test_shadow(void)
+{
+	uint8_t unshadowed[REGS];
+	bus_stats_t cold;
+	bus_stats_t warm;
+	uint8_t value;
+
+	/* Every setter reading its register first, as before the shadow */
+	device_reset();
+	memset(&m_bus, 0, sizeof(m_bus));
+	fifo_setup(true);
+	cold = m_bus;
+	memcpy(unshadowed, m_regs, sizeof(m_regs));
+
+	/* Same setup from reset with the shadow filling, then again warm */
+	device_reset();
+	LSM6DS3_ACC_GYRO_ShadowInvalidate();
+	fifo_setup(false);
+	CHECK(memcmp(unshadowed, m_regs, sizeof(m_regs)) == 0, "shadowed setup left other register values");
+	memset(&m_bus, 0, sizeof(m_bus));
+	fifo_setup(false);
+	warm = m_bus;
+	CHECK(memcmp(unshadowed, m_regs, sizeof(m_regs)) == 0, "warm setup left other register values");
+	CHECK(warm.reads == 0 && warm.writes == 10, "warm setup: %u reads, %u writes",
+	      (unsigned)warm.reads, (unsigned)warm.writes);
+	report("FIFO setup, read-modify-write", &cold);
+	report("FIFO setup, shadowed", &warm);
+
+	/* A software reset must not leave stale values behind */
+	CHECK(LSM6DS3_ACC_GYRO_W_SW_RESET(LSM6DS3_ACC_GYRO_SW_RESET_RESET_DEVICE), "sw reset");
+	memset(&m_bus, 0, sizeof(m_bus));
+	CHECK(LSM6DS3_ACC_GYRO_W_ODR_G(LSM6DS3_ACC_GYRO_ODR_G_416Hz), "odr g after reset");
+	CHECK(m_bus.reads == 1 && m_regs[LSM6DS3_ACC_GYRO_CTRL2_G] == LSM6DS3_ACC_GYRO_ODR_G_416Hz,
+	      "CTRL2_G 0x%02x after reset, %u reads", m_regs[LSM6DS3_ACC_GYRO_CTRL2_G], (unsigned)m_bus.reads);
+	CHECK(LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_WHO_AM_I_REG, &value) && value == WHO_AM_I,
+	      "who am i 0x%02x", value);
+}
+
+static void test_burst(void)
+{
+	uint8_t burst[STATUS_BLOCK];
+	uint8_t single[STATUS_BLOCK];
+	uint8_t block[40];
+	bus_stats_t bytewise;
+	bus_stats_t bursts;
+	uint32_t n;
+	uint8_t i;
+
+	/* One status, temperature, gyro and accel readout per 416 Hz sample */
+	device_reset();
+	for(i = 0; i < STATUS_BLOCK; i++)
+		m_regs[LSM6DS3_ACC_GYRO_STATUS_REG + i] = (uint8_t)(i * 13 + 1);
+	memset(&m_bus, 0, sizeof(m_bus));
+	for(n = 0; n < SAMPLE_READS; n++) {
+		for(i = 0; i < STATUS_BLOCK; i++)
+			LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_STATUS_REG + i, &single[i]);
+	}
+	bytewise = m_bus;
+	memset(&m_bus, 0, sizeof(m_bus));
+	for(n = 0; n < SAMPLE_READS; n++)
+		CHECK(LSM6DS3_ACC_GYRO_Get_GetStatusGyroAccData(burst), "status block");
+	bursts = m_bus;
+	CHECK(memcmp(burst, single, sizeof(burst)) == 0, "burst read differs");
+	CHECK(bursts.reads == SAMPLE_READS, "%u transactions for %u readouts",
+	      (unsigned)bursts.reads, SAMPLE_READS);
+	report("1 s of readouts, byte by byte", &bytewise);
+	report("1 s of readouts, ReadMem burst", &bursts);
+
+	/* A long write lands register after register, in WRITE_BURST_MAX chunks */
+	for(i = 0; i < sizeof(block); i++)
+		block[i] = (uint8_t)(0xA0 + i);
+	memset(&m_bus, 0, sizeof(m_bus));
+	CHECK(LSM6DS3_ACC_GYRO_WriteMem(LSM6DS3_ACC_GYRO_CTRL1_XL, block, sizeof(block)), "write block");
+	CHECK(memcmp(&m_regs[LSM6DS3_ACC_GYRO_CTRL1_XL], block, sizeof(block)) == 0, "write block differs");
+	CHECK(m_bus.writes == (sizeof(block) + LSM6DS3_ACC_GYRO_WRITE_BURST_MAX - 1) / LSM6DS3_ACC_GYRO_WRITE_BURST_MAX,
+	      "%u transactions for %u bytes", (unsigned)m_bus.writes, (unsigned)sizeof(block));
+	report("40 byte WriteMem", &m_bus);
+
+	/* The burst dropped what the shadow knew of those registers */
+	m_regs[LSM6DS3_ACC_GYRO_CTRL2_G] = 0x5A;
+	CHECK(LSM6DS3_ACC_GYRO_ReadReg(LSM6DS3_ACC_GYRO_CTRL2_G, &i) && i == 0x5A, "CTRL2_G 0x%02x from the shadow", i);
+}
+
+int main(void)
+{
+	test_shadow();
+	test_burst();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
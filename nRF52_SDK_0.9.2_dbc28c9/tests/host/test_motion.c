@@ -0,0 +1,256 @@
+/* motion.c over a corpus of synthetic 416 Hz accelerometer traces: still,
+ * walking at several cadences, taps, a shake and mixes of them, each with
+ * the events it must produce. Then the cost per sample of the whole
+ * pipeline, fed in FIFO watermark sized calls as sensor_test.c does. */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "motion.h"
+
+#define RATE_HZ         416
+#define ONE_G           8192           /* +-4 g range */
+#define WATERMARK       32
+#define TRACE_MAX       (RATE_HZ * 120)
+#define PHASES_MAX      6
+#define BENCH_SECONDS   3600
+
+typedef enum {
+	PHASE_STILL,
+	PHASE_WALK,            /* Vertical bounce at the cadence, arm sway */
+	PHASE_TAP,             /* A 25 ms knock on the z axis */
+	PHASE_SHAKE            /* +-2 g on the x axis at 5 Hz */
+} phase_kind_t;
+
+typedef struct {
+	phase_kind_t kind;
+	float seconds;
+	float hz;              /* Steps per second for PHASE_WALK */
+} phase_t;
+
+typedef struct {
+	const char *name;
+	phase_t phases[PHASES_MAX];
+	uint32_t steps_min;
+	uint32_t steps_max;
+	uint32_t taps;
+	uint32_t shakes;
+} trace_t;
+
+/* Every trace starts still for the filters to settle */
+static const trace_t m_corpus[] = {
+	{ "still", { { PHASE_STILL, 60 } }, 0, 0, 0, 0 },
+	{ "walk 1.6 Hz", { { PHASE_STILL, 4 }, { PHASE_WALK, 60, 1.6f }, { PHASE_STILL, 2 } }, 93, 97, 0, 0 },
+	{ "walk 2.0 Hz", { { PHASE_STILL, 4 }, { PHASE_WALK, 60, 2.0f }, { PHASE_STILL, 2 } }, 117, 121, 0, 0 },
+	{ "run 2.8 Hz", { { PHASE_STILL, 4 }, { PHASE_WALK, 30, 2.8f }, { PHASE_STILL, 2 } }, 81, 85, 0, 0 },
+	{ "three steps", { { PHASE_STILL, 4 }, { PHASE_WALK, 1.5f, 2.0f }, { PHASE_STILL, 4 } }, 0, 0, 0, 0 },
+	{ "taps", { { PHASE_STILL, 4 }, { PHASE_TAP, 1 }, { PHASE_TAP, 1 }, { PHASE_TAP, 1 }, { PHASE_STILL, 1 } },
+	  0, 0, 3, 0 },
+	{ "shake", { { PHASE_STILL, 4 }, { PHASE_SHAKE, 1.5f }, { PHASE_STILL, 2 } }, 0, 0, 0, 1 },
+	{ "walk, shake, walk", { { PHASE_STILL, 4 }, { PHASE_WALK, 20, 1.8f }, { PHASE_SHAKE, 1.5f },
+	  { PHASE_WALK, 20, 1.8f }, { PHASE_STILL, 2 } }, 69, 73, 0, 1 },
+};
+
+static sensor_sample_t m_trace[TRACE_MAX];
+static uint32_t m_trace_len;
+static motion_summary_t m_events;      /* Counted from the handler */
+static uint32_t m_last_steps;
+static uint32_t m_last_seq;
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+static int16_t clamp(float value)
+{
+	return (int16_t)(value > 32767 ? 32767 : value < -32768 ? -32768 : value);
+}
+
+static float noise(void)
+{
+	return (float)(rand() % 81 - 40);
+}
+
+static void trace_fill(trace_t const *p_trace)
+{
+	phase_t const *p_phase;
+	float acc[3];
+	float t;
+	uint32_t n;
+	uint32_t i;
+	int k;
+
+	m_trace_len = 0;
+	for(p_phase = p_trace->phases; p_phase < p_trace->phases + PHASES_MAX && p_phase->seconds > 0; p_phase++) {
+		n = (uint32_t)(p_phase->seconds * RATE_HZ);
+		for(i = 0; i < n && m_trace_len < TRACE_MAX; i++) {
+			t = (float)i / RATE_HZ;
+			acc[0] = 0;
+			acc[1] = 0;
+			acc[2] = ONE_G;
+			switch(p_phase->kind) {
+			case PHASE_WALK:
+				acc[2] += 0.3f * ONE_G * sinf(2 * (float)M_PI * p_phase->hz * t);
+				acc[0] += 0.1f * ONE_G * sinf((float)M_PI * p_phase->hz * t);
+				break;
+			case PHASE_TAP:
+				if(t < 0.025f)
+					acc[2] += 2.0f * ONE_G * sinf((float)M_PI * t / 0.025f);
+				break;
+			case PHASE_SHAKE:
+				acc[0] += 2.0f * ONE_G * sinf(2 * (float)M_PI * 5 * t);
+				break;
+			default:
+				break;
+			}
+			for(k = 0; k < 3; k++) {
+				m_trace[m_trace_len].acc[k] = clamp(acc[k] + noise());
+				m_trace[m_trace_len].gyro[k] = clamp(noise());
+			}
+			m_trace_len++;
+		}
+	}
+}
+
+static void evt_handler(motion_evt_t const *p_evt)
+{
+	CHECK(p_evt->seq >= m_last_seq && p_evt->seq < m_trace_len, "event at sample %u after %u",
+	      (unsigned)p_evt->seq, (unsigned)m_last_seq);
+	m_last_seq = p_evt->seq;
+	switch(p_evt->type) {
+	case MOTION_EVT_STEP:
+		CHECK(p_evt->params.steps > m_last_steps, "step total %u after %u",
+		      (unsigned)p_evt->params.steps, (unsigned)m_last_steps);
+		m_last_steps = p_evt->params.steps;
+		m_events.steps = p_evt->params.steps;
+		break;
+	case MOTION_EVT_TAP:
+		m_events.taps++;
+		break;
+	case MOTION_EVT_SHAKE:
+		CHECK(p_evt->params.gesture.swings >= 4, "shake of %u swings", p_evt->params.gesture.swings);
+		m_events.shakes++;
+		break;
+	}
+}
+
+static void feed(uint32_t seq0)
+{
+	uint32_t i;
+	uint16_t n;
+
+	for(i = 0; i < m_trace_len; i += n) {
+		n = (uint16_t)((m_trace_len - i < WATERMARK) ? m_trace_len - i : WATERMARK);
+		motion_process(seq0 + i, &m_trace[i], n);
+	}
+}
+
+/* Gravity alone must leave the high pass at zero, not at a truncation
+ * offset, and the low pass must pass it through */
+static void test_biquad_dc(void)
+{
+	static const int16_t highpass[6] = { 16037, 0, -32074, 16037, 32068, -15699 };	/* As motion.c */
+	static const int16_t lowpass[6] = { 119, 0, 238, 119, 28587, -12680 };
+	motion_biquad_t filter;
+	int16_t block[WATERMARK];
+	uint32_t i;
+	uint32_t k;
+
+	/* Ten seconds at the decimated rate */
+	motion_biquad_init(&filter, highpass, 1);
+	for(i = 0; i < 10 * MOTION_RATE_HZ / WATERMARK; i++) {
+		for(k = 0; k < WATERMARK; k++)
+			block[k] = 4096;
+		motion_biquad_run(&filter, block, WATERMARK);
+	}
+	CHECK(block[WATERMARK - 1] == 0, "high pass settles at %d on 1 g", block[WATERMARK - 1]);
+
+	motion_biquad_init(&filter, lowpass, 1);
+	for(i = 0; i < 10 * MOTION_RATE_HZ / WATERMARK; i++) {
+		for(k = 0; k < WATERMARK; k++)
+			block[k] = 1000;
+		motion_biquad_run(&filter, block, WATERMARK);
+	}
+	CHECK(block[WATERMARK - 1] >= 995 && block[WATERMARK - 1] <= 1000, "low pass settles at %d on 1000",
+	      block[WATERMARK - 1]);
+}
+
+static void test_corpus(void)
+{
+	motion_summary_t summary;
+	uint32_t t;
+
+	for(t = 0; t < sizeof(m_corpus) / sizeof(m_corpus[0]); t++) {
+		srand(t + 1);
+		trace_fill(&m_corpus[t]);
+		memset(&m_events, 0, sizeof(m_events));
+		m_last_steps = 0;
+		m_last_seq = 0;
+		motion_init(evt_handler);
+		feed(0);
+		motion_summary_get(&summary);
+		CHECK(summary.steps >= m_corpus[t].steps_min && summary.steps <= m_corpus[t].steps_max &&
+		      summary.taps == m_corpus[t].taps && summary.shakes == m_corpus[t].shakes,
+		      "%s: %u steps, %u taps, %u shakes", m_corpus[t].name, (unsigned)summary.steps,
+		      (unsigned)summary.taps, (unsigned)summary.shakes);
+		CHECK(m_events.steps == summary.steps && m_events.taps == summary.taps &&
+		      m_events.shakes == summary.shakes, "%s: events and summary differ", m_corpus[t].name);
+		printf("%-18s %3u steps %u taps %u shakes, %5u ms active\n", m_corpus[t].name,
+		       (unsigned)summary.steps, (unsigned)summary.taps, (unsigned)summary.shakes,
+		       (unsigned)summary.active_ms);
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* An hour of the mixed trace, over and over */
+static void bench(void)
+{
+	uint64_t samples = 0;
+	uint64_t cycles = 0;
+	double t;
+
+	srand(1);
+	trace_fill(&m_corpus[sizeof(m_corpus) / sizeof(m_corpus[0]) - 1]);
+	motion_init(NULL);
+	t = seconds();
+#if defined(__x86_64__) || defined(__i386__)
+	cycles = __builtin_ia32_rdtsc();
+#endif
+	while(samples < (uint64_t)BENCH_SECONDS * RATE_HZ) {
+		feed((uint32_t)samples);
+		samples += m_trace_len;
+	}
+#if defined(__x86_64__) || defined(__i386__)
+	cycles = __builtin_ia32_rdtsc() - cycles;
+#endif
+	t = seconds() - t;
+	printf("%.1f ns per sample", t * 1e9 / samples);
+	if(cycles)
+		printf(", %.1f TSC cycles per sample", (double)cycles / samples);
+	printf(" (host, C filters), %.0f hours of 416 Hz per CPU second\n", samples / t / RATE_HZ / 3600);
+}
+
+int main(void)
+{
+	test_biquad_dc();
+	test_corpus();
+	bench();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
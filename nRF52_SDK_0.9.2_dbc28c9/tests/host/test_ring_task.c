@@ -0,0 +1,408 @@
+/* ring_task.c under synthetic interrupt load on the simulated clock: button
+ * presses, sensor FIFO wakeups and raw scheduler events from interrupts,
+ * a periodic display refresh and a background job that keeps posting
+ * itself. Interrupts land in the middle of whatever runs. Prints the worst
+ * post to run latency per source and checks the bounds the priorities and
+ * the aging promise, then that a paused scheduler lets the loop sleep.
+ *
+ * The scheduler is a FIFO stand-in with app_scheduler.h's calls, sized as
+ * main.c sizes the default lane. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "app_util_platform.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "ring_task.h"
+
+#define SCHED_QUEUE_SIZE    (4 + RING_TASK_SCHED_EVENTS)
+#define TICK_MASK           0x00FFFFFF
+#define RUN_SECONDS         120
+#define DISPLAY_MS          33
+
+typedef struct {
+	const char *name;
+	uint32_t interval_min_us;      /* Between interrupts, uniformly spread */
+	uint32_t interval_max_us;
+	uint32_t cost_us;              /* Of the task or event it leads to */
+	uint8_t priority;              /* RING_TASK_PRIO_COUNT for a raw scheduler event */
+	ring_task_t *p_task;
+
+	uint64_t due;                  /* Next interrupt */
+	uint64_t posted;               /* Oldest post not yet run, 0 for none */
+	uint64_t worst_us;
+	uint64_t total_us;
+	uint32_t runs;
+} source_t;
+
+static void button_fn(void *p_context);
+static void sensor_fn(void *p_context);
+static void display_fn(void *p_context);
+static void background_fn(void *p_context);
+
+RING_TASK_DEF(m_button_task, button_fn, NULL, RING_TASK_PRIO_HIGH, 100);
+RING_TASK_DEF(m_sensor_task, sensor_fn, NULL, RING_TASK_PRIO_NORMAL, 1000);
+RING_TASK_DEF(m_display_task, display_fn, NULL, RING_TASK_PRIO_LOW, 5000);
+RING_TASK_DEF(m_background_task, background_fn, NULL, RING_TASK_PRIO_LOW, 2000);
+
+enum { SRC_BUTTON, SRC_SENSOR, SRC_EDGE, SRC_DISPLAY, SRC_BACKGROUND, SRC_COUNT };
+
+/* The display and background have no interrupt, they are timed and self
+ * posted */
+static source_t m_sources[SRC_COUNT] = {
+	{ "button task (high)", 2000, 30000, 25, RING_TASK_PRIO_HIGH, &m_button_task },
+	{ "sensor task (normal)", 76000, 78000, 450, RING_TASK_PRIO_NORMAL, &m_sensor_task },
+	{ "raw event", 500, 8000, 15, RING_TASK_PRIO_COUNT, NULL },
+	{ "display task (low)", 0, 0, 4000, RING_TASK_PRIO_LOW, &m_display_task },
+	{ "background task (low)", 0, 0, 1500, RING_TASK_PRIO_LOW, &m_background_task },
+};
+
+static int m_failures = 0;
+
+static struct {
+	app_sched_event_handler_t handler;
+	uint64_t put_at;
+} m_sched[SCHED_QUEUE_SIZE];
+static uint32_t m_sched_rd;
+static uint32_t m_sched_wr;
+static uint32_t m_sched_full;
+static uint32_t m_paused;
+
+static app_timer_timeout_handler_t m_timer_handler;
+static bool m_timer_armed;
+static uint64_t m_timer_due;
+
+static uint32_t m_idles;
+static bool m_background_on;
+static uint64_t m_display_start;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+uint32_t app_sched_event_put(void *p_event_data, uint16_t event_size, app_sched_event_handler_t handler)
+{
+	(void)p_event_data;
+	(void)event_size;
+	if(m_sched_wr - m_sched_rd == SCHED_QUEUE_SIZE) {
+		m_sched_full++;
+		return NRF_ERROR_NO_MEM;
+	}
+	m_sched[m_sched_wr % SCHED_QUEUE_SIZE].handler = handler;
+	m_sched[m_sched_wr % SCHED_QUEUE_SIZE].put_at = g_host_time_us;
+	m_sched_wr++;
+	return NRF_SUCCESS;
+}
+
+bool app_sched_execute_budget(uint16_t max_events)
+{
+	uint32_t i;
+
+	for(; max_events > 0; max_events--) {
+		if(m_paused || m_sched_rd == m_sched_wr)
+			return false;
+		i = m_sched_rd % SCHED_QUEUE_SIZE;
+		m_sched[i].handler(NULL, 0);
+		m_sched_rd++;
+	}
+	return !m_paused && m_sched_rd != m_sched_wr;
+}
+
+void app_sched_pause(void)
+{
+	m_paused++;
+}
+
+void app_sched_resume(void)
+{
+	if(m_paused)
+		m_paused--;
+}
+
+bool app_sched_paused(void)
+{
+	return m_paused > 0;
+}
+
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode,
+                          app_timer_timeout_handler_t timeout_handler)
+{
+	(void)mode;
+	m_timer_handler = timeout_handler;
+	*p_timer_id = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context)
+{
+	(void)timer_id;
+	(void)p_context;
+	m_timer_armed = true;
+	m_timer_due = g_host_time_us + (uint64_t)timeout_ticks * 1000000 / APP_TIMER_CLOCK_FREQ;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+	(void)timer_id;
+	m_timer_armed = false;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(uint32_t *p_ticks)
+{
+	*p_ticks = (uint32_t)(g_host_time_us * APP_TIMER_CLOCK_FREQ / 1000000) & TICK_MASK;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff)
+{
+	*p_ticks_diff = (ticks_to - ticks_from) & TICK_MASK;
+	return NRF_SUCCESS;
+}
+
+static uint32_t random_between(uint32_t min, uint32_t max)
+{
+	return min + (uint32_t)rand() % (max - min + 1);
+}
+
+/* Next interrupt: a source index, SRC_COUNT for the app timer */
+static uint64_t next_irq(uint32_t *p_source)
+{
+	uint64_t due = UINT64_MAX;
+	uint32_t i;
+
+	*p_source = SRC_COUNT;
+	for(i = 0; i < SRC_COUNT; i++) {
+		if(m_sources[i].interval_max_us && m_sources[i].due < due) {
+			due = m_sources[i].due;
+			*p_source = i;
+		}
+	}
+	if(m_timer_armed && m_timer_due <= due) {
+		due = m_timer_due;
+		*p_source = SRC_COUNT;
+	}
+	return due;
+}
+
+static void raw_event(void *p_event_data, uint16_t event_size);
+
+static void posted(source_t *p_source)
+{
+	if(p_source->posted == 0)
+		p_source->posted = g_host_time_us;
+}
+
+static void irq(uint32_t i)
+{
+	source_t *p_source;
+
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	if(i == SRC_COUNT) {
+		m_timer_armed = false;
+		m_timer_handler(NULL);
+		/* The display becomes ready once the timer event runs */
+	} else {
+		p_source = &m_sources[i];
+		p_source->due += random_between(p_source->interval_min_us, p_source->interval_max_us);
+		if(p_source->p_task != NULL) {
+			posted(p_source);
+			ring_task_post(p_source->p_task);
+		} else if(app_sched_event_put(NULL, 0, raw_event) == NRF_SUCCESS) {
+			posted(p_source);
+		}
+	}
+	g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+}
+
+/* Main context work, with the interrupts that fall due meanwhile */
+static void busy(uint32_t us)
+{
+	uint64_t end = g_host_time_us + us;
+	uint64_t due;
+	uint32_t i;
+
+	while((due = next_irq(&i)) <= end) {
+		if(due > g_host_time_us)
+			g_host_time_us = due;
+		irq(i);
+	}
+	g_host_time_us = end;
+}
+
+static void ran(source_t *p_source)
+{
+	uint64_t latency = g_host_time_us - p_source->posted;
+
+	if(p_source->posted) {
+		if(latency > p_source->worst_us)
+			p_source->worst_us = latency;
+		p_source->total_us += latency;
+		p_source->runs++;
+		p_source->posted = 0;
+	}
+	busy(random_between(p_source->cost_us / 2, p_source->cost_us));
+}
+
+static void raw_event(void *p_event_data, uint16_t event_size)
+{
+	(void)p_event_data;
+	(void)event_size;
+	ran(&m_sources[SRC_EDGE]);
+}
+
+static void button_fn(void *p_context)
+{
+	(void)p_context;
+	ran(&m_sources[SRC_BUTTON]);
+}
+
+static void sensor_fn(void *p_context)
+{
+	(void)p_context;
+	ran(&m_sources[SRC_SENSOR]);
+}
+
+/* Late by how far the clock is past the last frame boundary */
+static void display_fn(void *p_context)
+{
+	uint64_t ticks = (g_host_time_us - m_display_start) * APP_TIMER_CLOCK_FREQ / 1000000;
+
+	(void)p_context;
+	m_sources[SRC_DISPLAY].posted = g_host_time_us -
+	                                ticks % APP_TIMER_TICKS(DISPLAY_MS, 0) * 1000000 / APP_TIMER_CLOCK_FREQ;
+	ran(&m_sources[SRC_DISPLAY]);
+}
+
+static void background_fn(void *p_context)
+{
+	(void)p_context;
+	ran(&m_sources[SRC_BACKGROUND]);
+	if(m_background_on) {
+		posted(&m_sources[SRC_BACKGROUND]);
+		ring_task_post(&m_background_task);
+	}
+}
+
+/* The idle hook sleeps until the next interrupt */
+static void idle(void)
+{
+	uint32_t i;
+	uint64_t due = next_irq(&i);
+
+	m_idles++;
+	if(due != UINT64_MAX) {
+		if(due > g_host_time_us)
+			g_host_time_us = due;
+		irq(i);
+	}
+}
+
+static void test_load(void)
+{
+	uint64_t end;
+	uint64_t longest = 0;
+	source_t *p_source;
+	uint32_t i;
+
+	srand(3);
+	CHECK(ring_task_init(idle) == NRF_SUCCESS, "ring_task_init");
+	for(i = 0; i < SRC_COUNT; i++) {
+		m_sources[i].due = random_between(0, m_sources[i].interval_max_us);
+		if(m_sources[i].cost_us > longest)
+			longest = m_sources[i].cost_us;
+	}
+
+	/* The display runs from the timer list, due on every frame boundary */
+	m_display_start = g_host_time_us;
+	ring_task_start_periodic(&m_display_task, DISPLAY_MS);
+	m_background_on = true;
+	posted(&m_sources[SRC_BACKGROUND]);
+	ring_task_post(&m_background_task);
+
+	end = g_host_time_us + (uint64_t)RUN_SECONDS * 1000000;
+	while(g_host_time_us < end)
+		ring_task_run();
+	m_background_on = false;
+	ring_task_stop(&m_display_task);
+
+	printf("%u s of load, %u idle passes, %u puts found the scheduler full\n", RUN_SECONDS,
+	       (unsigned)m_idles, (unsigned)m_sched_full);
+	for(i = 0; i < SRC_COUNT; i++) {
+		p_source = &m_sources[i];
+		printf("%-22s %7u runs, latency mean %6.0f us, worst %6u us\n", p_source->name,
+		       (unsigned)p_source->runs, p_source->runs ? (double)p_source->total_us / p_source->runs : 0.0,
+		       (unsigned)p_source->worst_us);
+		CHECK(p_source->runs > 0, "%s never ran", p_source->name);
+	}
+
+	/* A high priority task waits for the run in progress and whatever was
+	 * queued ahead of its dispatch event, never for another task */
+	CHECK(m_sources[SRC_BUTTON].worst_us <= longest + SCHED_QUEUE_SIZE * m_sources[SRC_EDGE].cost_us + 100,
+	      "button task waited %u us", (unsigned)m_sources[SRC_BUTTON].worst_us);
+	/* Aging: the low priorities get a turn within RING_TASK_AGING of the
+	 * others, the display stays within a few frames */
+	CHECK(m_sources[SRC_DISPLAY].worst_us < 3 * DISPLAY_MS * 1000, "display waited %u us",
+	      (unsigned)m_sources[SRC_DISPLAY].worst_us);
+	CHECK(m_sources[SRC_EDGE].worst_us <= 2 * longest + 100, "raw event waited %u us",
+	      (unsigned)m_sources[SRC_EDGE].worst_us);
+	CHECK(m_button_task.overruns == 0, "%u button task overruns", (unsigned)m_button_task.overruns);
+}
+
+/* A paused scheduler runs nothing, the main loop must sleep rather than
+ * spin on the ready task */
+static void test_paused(void)
+{
+	uint32_t runs;
+	uint32_t idles;
+	uint32_t i;
+
+	for(i = 0; i < SRC_COUNT; i++)
+		m_sources[i].interval_max_us = 0;
+	m_timer_armed = false;
+	while(m_sched_rd != m_sched_wr || m_background_task.ready)
+		ring_task_run();
+	runs = m_button_task.runs;
+
+	/* Posted while the queue is full, so the dispatch event is lost */
+	app_sched_pause();
+	while(app_sched_event_put(NULL, 0, raw_event) == NRF_SUCCESS)
+		;
+	ring_task_post(&m_button_task);
+	idles = m_idles;
+	for(i = 0; i < 10; i++)
+		ring_task_run();
+	CHECK(m_idles == idles + 10 && m_button_task.runs == runs, "%u of 10 passes slept while paused, %u runs",
+	      (unsigned)(m_idles - idles), (unsigned)(m_button_task.runs - runs));
+
+	/* After the resume the queue drains, the dispatch is put again and runs */
+	app_sched_resume();
+	idles = m_idles;
+	ring_task_run();
+	CHECK(m_idles == idles, "slept with the task ready after the resume");
+	ring_task_run();
+	CHECK(m_button_task.runs == runs + 1, "%u runs after the resume", (unsigned)(m_button_task.runs - runs));
+}
+
+int main(void)
+{
+	test_load();
+	test_paused();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
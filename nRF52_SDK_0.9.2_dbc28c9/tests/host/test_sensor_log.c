@@ -0,0 +1,305 @@
+/* sensor_log.c over spi_flash.c and the simulated NOR chip: read back after
+ * a remount, a torn segment header, the head wrapping around the segment
+ * ring, seek by timestamp, and 416 Hz six axis logging at the rate the
+ * sensor FIFO delivers it, timed on the simulated clock. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "nor_sim.h"
+#include "nordic_common.h"
+#include "app_util.h"
+#include "spi_flash.h"
+#include "sensor_log.h"
+#include "sensor_test.h"
+
+#define TAG                 0x07
+#define RATE_HZ             416
+#define WATERMARK           32        /* Samples per FIFO wakeup, as sensor_test.h */
+#define RUN                 (SENSOR_LOG_RECORD_MAX / sizeof(sensor_sample_t))
+#define SUSTAINED_SECONDS   120
+
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+/* Records carry their own timestamp in a length that changes with it */
+static uint8_t payload(uint32_t ts, uint8_t *p_data)
+{
+	uint8_t len = 4 + ts % 29;
+	uint8_t i;
+
+	for(i = 0; i < len; i++)
+		p_data[i] = (uint8_t)(ts * 31 + i);
+	return len;
+}
+
+static void append(uint32_t ts)
+{
+	uint8_t data[64];
+	uint8_t len = payload(ts, data);
+
+	CHECK(sensor_log_append(ts, TAG, data, len) == 0, "append %u", (unsigned)ts);
+	nor_sim_run();
+}
+
+static bool record_ok(sensor_log_record_t const *p_record)
+{
+	uint8_t data[64];
+	uint8_t len = payload(p_record->timestamp, data);
+
+	return p_record->tag == TAG && p_record->len == len && memcmp(p_record->data, data, len) == 0;
+}
+
+/* Reads the whole log, checking the records follow each other in steps of
+ * one. Returns how many were read and the first and last stamps. */
+static uint32_t read_all(uint32_t *p_first, uint32_t *p_last)
+{
+	static sensor_log_record_t record;
+	sensor_log_cursor_t cursor;
+	uint32_t n = 0;
+
+	sensor_log_cursor_init(&cursor);
+	while(sensor_log_read(&cursor, &record) == 0) {
+		CHECK(record_ok(&record), "record %u damaged", (unsigned)record.timestamp);
+		if(n == 0)
+			*p_first = record.timestamp;
+		else
+			CHECK(record.timestamp == *p_last + 1, "record %u after %u",
+			      (unsigned)record.timestamp, (unsigned)*p_last);
+		*p_last = record.timestamp;
+		n++;
+	}
+	return n;
+}
+
+/* The blocking reads wait for the queue, which only the pumped IRQs drain */
+static void flush(void)
+{
+	sensor_log_flush();
+	nor_sim_run();
+}
+
+static void remount(void)
+{
+	nor_sim_run();
+	CHECK(sensor_log_mount() == 0, "mount");
+	nor_sim_run();
+}
+
+/* Newest segment by its header sequence number */
+static uint32_t newest_segment(void)
+{
+	uint8_t *p_mem = nor_sim_mem();
+	uint32_t best = 0;
+	uint32_t best_seq = 0;
+	uint32_t seq;
+	uint32_t s;
+
+	for(s = 0; s < SENSOR_LOG_SEGMENT_COUNT; s++) {
+		if(uint32_decode(&p_mem[s * SENSOR_LOG_SEGMENT_SIZE]) != 0x32474C52)
+			continue;
+		seq = uint32_decode(&p_mem[s * SENSOR_LOG_SEGMENT_SIZE + 4]);
+		if(seq >= best_seq) {
+			best_seq = seq;
+			best = s;
+		}
+	}
+	return best;
+}
+
+static uint32_t test_fresh(void)
+{
+	uint32_t first = 0;
+	uint32_t last = 0;
+	uint32_t ts;
+
+	remount();
+	CHECK(read_all(&first, &last) == 0, "records on an erased chip");
+	for(ts = 1; ts <= 300; ts++)
+		append(ts);
+	flush();
+	CHECK(read_all(&first, &last) == 300 && first == 1 && last == 300, "%u..%u read back",
+	      (unsigned)first, (unsigned)last);
+
+	/* A reset keeps everything that reached the flash */
+	remount();
+	CHECK(read_all(&first, &last) == 300 && first == 1 && last == 300, "%u..%u after remount",
+	      (unsigned)first, (unsigned)last);
+	return 301;
+}
+
+static uint32_t test_torn_header(uint32_t ts)
+{
+	uint32_t first = 0;
+	uint32_t last = 0;
+	uint32_t torn_first;
+	uint32_t segment;
+	uint32_t n;
+
+	/* Fill a few segments, then lose the newest header to a reset in the
+	 * middle of programming it: the top bits of seq are still erased */
+	for(; ts < 1200; ts++)
+		append(ts);
+	flush();
+	segment = newest_segment();
+	torn_first = uint32_decode(&nor_sim_mem()[segment * SENSOR_LOG_SEGMENT_SIZE + 12]);
+	nor_sim_mem()[segment * SENSOR_LOG_SEGMENT_SIZE + 7] = 0xFF;
+
+	remount();
+	n = read_all(&first, &last);
+	CHECK(n > 0 && first == 1 && last == torn_first - 1,
+	      "%u..%u readable after a torn header, expected 1..%u", (unsigned)first,
+	      (unsigned)last, (unsigned)(torn_first - 1));
+
+	/* Logging goes on in a fresh segment, the lost stamps are skipped */
+	ts = last + 1;
+	for(; ts < last + 400; ts++)
+		append(ts);
+	flush();
+	n = read_all(&first, &last);
+	CHECK(first == 1 && last == ts - 1 && n == ts - 1, "%u records %u..%u after the torn segment",
+	      (unsigned)n, (unsigned)first, (unsigned)last);
+	return ts;
+}
+
+static void test_wrap_and_seek(uint32_t ts)
+{
+	static sensor_log_record_t record;
+	sensor_log_cursor_t cursor;
+	sensor_log_stats_t stats;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	uint32_t target;
+	uint32_t i;
+
+	/* Three times round the ring, flushing and remounting now and then */
+	for(i = 0; i < 3 * SENSOR_LOG_SEGMENT_COUNT * 150; i++, ts++) {
+		append(ts);
+		if(i % 7919 == 0) {
+			flush();
+			remount();
+		}
+	}
+	flush();
+	read_all(&first, &last);
+	CHECK(last == ts - 1, "newest record %u, expected %u", (unsigned)last, (unsigned)(ts - 1));
+	CHECK(first > ts - SENSOR_LOG_SEGMENT_COUNT * 340 && first < ts - (SENSOR_LOG_SEGMENT_COUNT - 2) * 100,
+	      "oldest record %u of %u, not a full ring", (unsigned)first, (unsigned)ts);
+	remount();
+	CHECK(read_all(&first, &last) > 0 && last == ts - 1, "newest record %u after remount", (unsigned)last);
+
+	for(i = 0; i < 200; i++) {
+		target = first + (uint32_t)rand() % (last - first + 1);
+		CHECK(sensor_log_seek(target, &cursor) == 0, "seek %u", (unsigned)target);
+		CHECK(sensor_log_read(&cursor, &record) == 0 && record.timestamp == target,
+		      "seek %u found %u", (unsigned)target, (unsigned)record.timestamp);
+	}
+	CHECK(sensor_log_seek(0, &cursor) == 0 && sensor_log_read(&cursor, &record) == 0 &&
+	      record.timestamp == first, "seek before the oldest found %u", (unsigned)record.timestamp);
+	CHECK(sensor_log_seek(last + 1, &cursor) != 0, "seek past the newest");
+
+	sensor_log_stats_get(&stats);
+	CHECK(stats.dropped == 0 && stats.flash_errors == 0, "%u dropped, %u flash errors",
+	      (unsigned)stats.dropped, (unsigned)stats.flash_errors);
+}
+
+/* The FIFO hands over WATERMARK samples every WATERMARK/RATE_HZ seconds and
+ * main.c logs them in runs of RUN; the flash works in between. */
+static void test_sustained(void)
+{
+	static sensor_sample_t samples[WATERMARK];
+	static sensor_log_record_t record;
+	sensor_sample_t const *p_sample;
+	sensor_log_cursor_t cursor;
+	sensor_log_stats_t stats;
+	nor_sim_stats_t flash;
+	uint64_t start;
+	uint64_t t;
+	uint64_t longest = 0;
+	uint32_t seq = 0;
+	uint32_t last = 0;
+	uint32_t n = 0;
+	uint32_t run;
+	uint32_t i;
+	uint32_t k;
+
+	nor_sim_init(0x17);
+	CHECK(spi_flash_init() == 0, "spi_flash_init");
+	remount();
+	nor_sim_stats_reset();
+	start = g_host_time_us;
+	while(seq < SUSTAINED_SECONDS * RATE_HZ) {
+		nor_sim_run_until(start + (uint64_t)(seq + WATERMARK) * 1000000 / RATE_HZ);
+		for(i = 0; i < WATERMARK; i++) {
+			for(k = 0; k < 3; k++) {
+				samples[i].gyro[k] = (int16_t)(seq + i + k);
+				samples[i].acc[k] = (int16_t)(seq + i - k);
+			}
+		}
+		for(i = 0; i < WATERMARK; i += run) {
+			run = MIN(WATERMARK - i, RUN);
+			t = g_host_time_us;
+			sensor_log_append(seq + i, TAG, &samples[i], run * sizeof(sensor_sample_t));
+			if(g_host_time_us - t > longest)
+				longest = g_host_time_us - t;
+		}
+		seq += WATERMARK;
+	}
+	t = g_host_time_us - start;
+	flush();
+
+	sensor_log_stats_get(&stats);
+	nor_sim_stats_get(&flash);
+	CHECK(stats.dropped == 0 && stats.flash_errors == 0, "%u runs dropped, %u flash errors at %u Hz",
+	      (unsigned)stats.dropped, (unsigned)stats.flash_errors, RATE_HZ);
+	CHECK(flash.violations == 0, "%u commands sent to a busy chip", (unsigned)flash.violations);
+	printf("%u Hz for %u s: %u records, %.1f KB/s, flash bus busy %.1f%%, "
+	       "%u erases, longest append %u us\n",
+	       RATE_HZ, SUSTAINED_SECONDS, (unsigned)stats.records,
+	       seq * sizeof(sensor_sample_t) / 1.024 / t * 1000, 100.0 * flash.bus_us / t,
+	       (unsigned)flash.erases, (unsigned)longest);
+
+	/* The runs come back whole and in order, up to the last sample */
+	sensor_log_cursor_init(&cursor);
+	while(sensor_log_read(&cursor, &record) == 0) {
+		p_sample = (sensor_sample_t const *)record.data;
+		CHECK(record.len % sizeof(sensor_sample_t) == 0 && p_sample->acc[0] == (int16_t)record.timestamp &&
+		      (last == 0 || record.timestamp == last), "run at %u", (unsigned)record.timestamp);
+		last = record.timestamp + record.len / sizeof(sensor_sample_t);
+		n++;
+	}
+	CHECK(last == seq, "log ends at sample %u of %u", (unsigned)last, (unsigned)seq);
+	printf("%u runs back from the flash\n", (unsigned)n);
+}
+
+int main(void)
+{
+	uint32_t ts;
+
+	srand(1);
+	nor_sim_init(0x17);
+	CHECK(spi_flash_init() == 0, "spi_flash_init");
+
+	ts = test_fresh();
+	ts = test_torn_header(ts);
+	test_wrap_and_seek(ts);
+	test_sustained();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
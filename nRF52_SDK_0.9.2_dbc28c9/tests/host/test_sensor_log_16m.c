@@ -0,0 +1,122 @@
+/* sensor_log.c sized for a 16 MB W25Q128, 4096 segments: mount and seek
+ * times on the simulated clock, on an empty chip and on a log that has
+ * wrapped, and a mount refused on a chip too small for the segments. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "nor_sim.h"
+#include "app_util.h"
+#include "spi_flash.h"
+#include "sensor_log.h"
+
+#define TAG             0x07
+#define PAYLOAD         56          /* 64 byte records, 63 to a segment */
+#define SEEKS           1000
+
+static int m_failures = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+static uint32_t transfers(void)
+{
+	nor_sim_stats_t stats;
+
+	nor_sim_stats_get(&stats);
+	return stats.transfers;
+}
+
+/* Simulated time and SPI transfers of one mount */
+static void mount(const char *p_what)
+{
+	uint64_t t;
+	uint32_t n;
+
+	nor_sim_run();
+	n = transfers();
+	t = g_host_time_us;
+	CHECK(sensor_log_mount() == 0, "mount %s", p_what);
+	t = g_host_time_us - t;
+	n = transfers() - n;
+	nor_sim_run();
+	printf("mount %s: %.1f ms, %u transfers\n", p_what, t / 1000.0, (unsigned)n);
+}
+
+static void seeks(uint32_t first, uint32_t last)
+{
+	static sensor_log_record_t record;
+	sensor_log_cursor_t cursor;
+	uint64_t total = 0;
+	uint64_t longest = 0;
+	uint64_t t;
+	uint32_t target;
+	uint32_t i;
+
+	for(i = 0; i < SEEKS; i++) {
+		target = first + (uint32_t)rand() % (last - first + 1);
+		t = g_host_time_us;
+		CHECK(sensor_log_seek(target, &cursor) == 0, "seek %u", (unsigned)target);
+		t = g_host_time_us - t;
+		CHECK(sensor_log_read(&cursor, &record) == 0 && record.timestamp == target,
+		      "seek %u found %u", (unsigned)target, (unsigned)record.timestamp);
+		total += t;
+		if(t > longest)
+			longest = t;
+	}
+	printf("seek over %u records: mean %.2f ms, longest %.2f ms\n",
+	       (unsigned)(last - first + 1), total / 1000.0 / SEEKS, longest / 1000.0);
+}
+
+int main(void)
+{
+	static sensor_log_record_t record;
+	sensor_log_cursor_t cursor;
+	uint8_t data[PAYLOAD];
+	uint32_t first;
+	uint32_t ts;
+
+	srand(1);
+
+	/* 4096 segments do not fit a W25Q64 */
+	nor_sim_init(0x17);
+	CHECK(spi_flash_init() == 0 && spi_flash_size() == 8u << 20, "8 MB probe");
+	CHECK(sensor_log_mount() != 0, "16 MB of segments mounted on 8 MB");
+
+	nor_sim_init(0x18);
+	CHECK(spi_flash_init() == 0 && spi_flash_size() == 16u << 20, "16 MB probe");
+	mount("empty");
+
+	/* A trip and a quarter round the chip */
+	memset(data, 0x5A, sizeof(data));
+	for(ts = 1; ts <= SENSOR_LOG_SEGMENT_COUNT * 63 * 5 / 4; ts++) {
+		CHECK(sensor_log_append(ts, TAG, data, sizeof(data)) == 0, "append %u", (unsigned)ts);
+		nor_sim_run();
+	}
+	sensor_log_flush();
+	nor_sim_run();
+	mount("wrapped");
+
+	sensor_log_cursor_init(&cursor);
+	CHECK(sensor_log_read(&cursor, &record) == 0, "oldest record");
+	first = record.timestamp;
+	CHECK(first > SENSOR_LOG_SEGMENT_COUNT * 63 / 4, "oldest record %u, the log did not wrap",
+	      (unsigned)first);
+	seeks(first, ts - 1);
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}
@@ -0,0 +1,175 @@
+/* spi_flash.c against a simulated W25Q64: blocking and queued reads, writes
+ * and erases checked byte for byte, the chip never addressed while busy, and
+ * the throughput of status polling next to the fixed 100 ms sleep it
+ * replaced, on the simulated clock. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "nor_sim.h"
+#include "app_util_platform.h"
+#include "spi_flash.h"
+
+#define DEMO_BYTES      (64u * 1024)
+#define OLD_SLEEP_US    100000     /* What every program and erase used to cost */
+
+static int m_failures = 0;
+static uint8_t m_in[DEMO_BYTES];
+static uint8_t m_out[DEMO_BYTES];
+static uint32_t m_callbacks;
+static int m_last_result;
+static uint64_t m_longest_call_us;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)) { \
+		printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+		printf(__VA_ARGS__); \
+		printf("\n"); \
+		m_failures++; \
+	} \
+} while(0)
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name)
+{
+	printf("app_error 0x%x at %s:%u\n", (unsigned)error_code, (const char *)p_file_name, (unsigned)line_num);
+	exit(1);
+}
+
+static void done(spi_flash_op_t op, unsigned int offset, size_t len, int result, void *p_context)
+{
+	m_callbacks++;
+	m_last_result = result;
+}
+
+static uint32_t violations(void)
+{
+	nor_sim_stats_t stats;
+
+	nor_sim_stats_get(&stats);
+	return stats.violations;
+}
+
+static void test_blocking(void)
+{
+	uint32_t i;
+
+	for(i = 0; i < sizeof(m_in); i++)
+		m_in[i] = (uint8_t)(i * 7 + (i >> 8));
+
+	CHECK(spi_flash_erase(0, 8192) == 0, "erase");
+	CHECK(spi_flash_write(100, 600, m_in) == 0, "write across pages");
+	CHECK(spi_flash_read(90, 700, m_out) == 0, "read");
+	CHECK(m_out[0] == 0xFF && memcmp(&m_out[10], m_in, 600) == 0 && m_out[699] == 0xFF,
+	      "read back differs");
+	CHECK(spi_flash_erase(100, 4096) != 0, "unaligned erase accepted");
+	CHECK(violations() == 0, "%u commands sent to a busy chip", (unsigned)violations());
+}
+
+static void test_queued(void)
+{
+	static uint8_t buf[1000];
+
+	m_callbacks = 0;
+	CHECK(spi_flash_erase_async(4096, 4096, done, NULL) == 0, "queue erase");
+	CHECK(spi_flash_write_async(4096 + 250, 700, m_in, done, NULL) == 0, "queue write");
+	CHECK(spi_flash_read_async(4096, sizeof(buf), buf, done, NULL) == 0, "queue read");
+	CHECK(spi_flash_erase_async(4097, 4096, done, NULL) != 0, "unaligned erase queued");
+	CHECK(spi_flash_is_busy(), "queue idle with requests in it");
+
+	/* An interrupt may not wait for the queue, the blocking calls refuse */
+	g_host_int_priority = APP_IRQ_PRIORITY_LOW;
+	CHECK(spi_flash_read(0, 4, buf) != 0, "blocking read from an interrupt while the queue runs");
+	g_host_int_priority = NRF_APP_PRIORITY_THREAD;
+
+	nor_sim_run();
+	CHECK(m_callbacks == 3 && m_last_result == 0, "%u callbacks, last result %d",
+	      (unsigned)m_callbacks, m_last_result);
+	CHECK(!spi_flash_is_busy(), "queue busy after the run");
+	CHECK(buf[249] == 0xFF && memcmp(&buf[250], m_in, 700) == 0 && buf[950] == 0xFF,
+	      "queued read differs");
+	CHECK(violations() == 0, "%u commands sent to a busy chip", (unsigned)violations());
+}
+
+/* Queues as much as fits and keeps the queue full from the main loop */
+static void queued_run(bool erase)
+{
+	uint32_t queued = 0;
+	uint64_t t;
+	int ret;
+
+	m_callbacks = 0;
+	while(m_callbacks < ((erase ? DEMO_BYTES / 4096 : DEMO_BYTES / 256))) {
+		while(queued < (erase ? DEMO_BYTES / 4096 : DEMO_BYTES / 256)) {
+			t = g_host_time_us;
+			if(erase)
+				ret = spi_flash_erase_async(queued * 4096, 4096, done, NULL);
+			else
+				ret = spi_flash_write_async(queued * 256, 256, &m_in[queued * 256], done, NULL);
+			t = g_host_time_us - t;
+			if(t > m_longest_call_us)
+				m_longest_call_us = t;
+			if(ret != 0)
+				break;
+			queued++;
+		}
+		nor_sim_pump();
+	}
+}
+
+static void bench(void)
+{
+	nor_sim_stats_t stats;
+	uint64_t t_erase;
+	uint64_t t_write;
+	uint64_t t_read;
+	uint64_t t_old;
+	uint64_t t_qerase;
+	uint64_t t_qwrite;
+
+	nor_sim_stats_reset();
+	t_erase = g_host_time_us;
+	CHECK(spi_flash_erase(0, DEMO_BYTES) == 0, "erase");
+	t_erase = g_host_time_us - t_erase;
+	t_write = g_host_time_us;
+	CHECK(spi_flash_write(0, DEMO_BYTES, m_in) == 0, "write");
+	t_write = g_host_time_us - t_write;
+	t_read = g_host_time_us;
+	CHECK(spi_flash_read(0, DEMO_BYTES, m_out) == 0, "read");
+	t_read = g_host_time_us - t_read;
+	CHECK(memcmp(m_in, m_out, DEMO_BYTES) == 0, "64 KB read back differs");
+
+	/* The same traffic with the status reads swapped for the old sleep */
+	nor_sim_stats_get(&stats);
+	t_old = stats.bus_us - stats.status_us + (uint64_t)(stats.programs + stats.erases) * OLD_SLEEP_US;
+
+	t_qerase = g_host_time_us;
+	queued_run(true);
+	t_qerase = g_host_time_us - t_qerase;
+	t_qwrite = g_host_time_us;
+	queued_run(false);
+	t_qwrite = g_host_time_us - t_qwrite;
+	CHECK(spi_flash_read(0, DEMO_BYTES, m_out) == 0 && memcmp(m_in, m_out, DEMO_BYTES) == 0,
+	      "queued 64 KB differs");
+	CHECK(violations() == 0, "%u commands sent to a busy chip", (unsigned)violations());
+
+	printf("blocking KB/s: erase %.0f, write %.1f, read %.1f; with the old 100 ms sleep erase+write %.2f\n",
+	       DEMO_BYTES / 1.024 / t_erase * 1000, DEMO_BYTES / 1.024 / t_write * 1000,
+	       DEMO_BYTES / 1.024 / t_read * 1000, 2 * DEMO_BYTES / 1.024 / t_old * 1000);
+	printf("queued KB/s: erase %.0f, write %.1f, longest call %u us\n",
+	       DEMO_BYTES / 1.024 / t_qerase * 1000, DEMO_BYTES / 1.024 / t_qwrite * 1000,
+	       (unsigned)m_longest_call_us);
+}
+
+int main(void)
+{
+	nor_sim_init(0x17);
+	CHECK(spi_flash_init() == 0, "init");
+
+	test_blocking();
+	test_queued();
+	bench();
+
+	printf(m_failures ? "FAILED\n" : "OK\n");
+	return m_failures ? 1 : 0;
+}